@@ -0,0 +1,216 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "bench.h"
+#include "benchsel.h"
+#include "cfgdlg.h"
+#include "find.h"
+#include "crc32.h"
+#include "worker.h"
+#include "codetbl.h"
+
+#ifdef _DEBUG
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+// diff.h of the File Comparator plugin uses std::min and std::max
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef min
+#undef max
+#include "lukas\diff.h"
+#pragma pop_macro("max")
+#pragma pop_macro("min")
+
+//
+// ****************************************************************************
+// DiffBenchmark
+//
+// Myers' diff vs. histogram diff from diff.h (used by the File Comparator) on
+// sequences of line classes that imitate source files: many unique lines, blank
+// lines and lines with braces are frequent
+
+#define DIFF_BENCH_LINES 300000 // lines of the first sequence
+
+struct CDiffBenchEdit
+{
+    const std::vector<size_t>* A;
+    const std::vector<size_t>* B;
+    size_t APos; // expected offsets of the next operation
+    size_t BPos;
+    size_t Changes; // blocks of deleted or inserted lines
+    size_t Length;  // deleted + inserted lines
+    char LastOp;
+    BOOL Valid; // the script is continuous and matched lines are equal
+
+    CDiffBenchEdit(const std::vector<size_t>& a, const std::vector<size_t>& b)
+        : A(&a), B(&b), APos(0), BPos(0), Changes(0), Length(0), LastOp(diff_base::ed_match), Valid(TRUE) {}
+
+    void operator()(char op, size_t off, size_t len)
+    {
+        if (len == 0)
+            return;
+        if (op == diff_base::ed_match)
+        {
+            if (off != APos || !std::equal(A->begin() + off, A->begin() + off + len, B->begin() + BPos))
+                Valid = FALSE;
+            APos += len;
+            BPos += len;
+        }
+        else
+        {
+            if (LastOp == diff_base::ed_match)
+                Changes++;
+            if (op == diff_base::ed_delete)
+            {
+                Valid &= off == APos;
+                APos += len;
+            }
+            else
+            {
+                Valid &= off == BPos;
+                BPos += len;
+            }
+            Length += len;
+        }
+        LastOp = op;
+    }
+};
+
+static void DiffBenchmark(const char* dir)
+{
+    static const char* variants[] = {"few changes", "many changes", "moved blocks"};
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    int variant;
+    for (variant = 0; variant < _countof(variants); variant++)
+    {
+        DWORD seed = 12345;
+        size_t unique = 100; // classes 0-99 are shared lines (0 is a blank line, 1 is "}")
+        std::vector<size_t> a, b;
+        a.reserve(DIFF_BENCH_LINES);
+        int i;
+        for (i = 0; i < DIFF_BENCH_LINES; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            DWORD r = (seed >> 16) & 0x7FFF;
+            a.push_back(r % 4 == 0 ? 0 : r % 9 == 0 ? 1 : r % 13 == 0 ? r % 100 : unique++);
+        }
+
+        // changed copy: blocks of lines are replaced by new lines or moved
+        DWORD changeEvery = variant == 1 ? 20 : 500;
+        b.reserve(a.size() + a.size() / 10);
+        std::vector<size_t> moved;
+        size_t pos = 0;
+        while (pos < a.size())
+        {
+            seed = seed * 1103515245 + 12345;
+            DWORD r = (seed >> 16) & 0x7FFF;
+            if (r % changeEvery != 0)
+            {
+                b.push_back(a[pos++]);
+                continue;
+            }
+            size_t len = min(a.size() - pos, (size_t)(1 + r % 8));
+            if (variant == 2 && r % 2 == 0)
+            {
+                if (moved.empty())
+                {
+                    // cut a block...
+                    moved.assign(a.begin() + pos, a.begin() + min(a.size(), pos + 50 + r % 150));
+                    pos += moved.size();
+                }
+                else
+                {
+                    // ...and paste it further
+                    b.insert(b.end(), moved.begin(), moved.end());
+                    moved.clear();
+                }
+                continue;
+            }
+            pos += len;
+            for (len = r % 5; len > 0; len--)
+                b.push_back(unique++);
+        }
+        b.insert(b.end(), moved.begin(), moved.end());
+
+        CDiffBenchEdit myers(a, b);
+        QueryPerformanceCounter(&start);
+        ptrdiff_t myersD = diff(0, a.size(), 0, b.size(), sequence_comparator(a.begin(), b.begin()),
+                                edit_forwarder<CDiffBenchEdit>(myers));
+        QueryPerformanceCounter(&end);
+        DWORD myersMS = (DWORD)((end.QuadPart - start.QuadPart) * 1000 / freq.QuadPart);
+
+        CDiffBenchEdit histogram(a, b);
+        QueryPerformanceCounter(&start);
+        ptrdiff_t histogramD = histogram_diff(a.begin(), a.size(), b.begin(), b.size(),
+                                              edit_forwarder<CDiffBenchEdit>(histogram));
+        QueryPerformanceCounter(&end);
+        DWORD histogramMS = (DWORD)((end.QuadPart - start.QuadPart) * 1000 / freq.QuadPart);
+
+        if (!myers.Valid || myers.APos != a.size() || myers.BPos != b.size() || (size_t)myersD != myers.Length)
+            TRACE_E("DiffBenchmark(): diff() returned an invalid edit script (" << variants[variant] << ")");
+        if (!histogram.Valid || histogram.APos != a.size() || histogram.BPos != b.size() ||
+            (size_t)histogramD != histogram.Length || histogramD < myersD)
+        {
+            TRACE_E("DiffBenchmark(): histogram_diff() returned an invalid edit script (" << variants[variant] << ")");
+        }
+
+        // the limit of the edit script length must be respected by both algorithms
+        ptrdiff_t dmax = myersD / 2 + 1;
+        if (diff(0, a.size(), 0, b.size(), sequence_comparator(a.begin(), b.begin()), null_edit(), 0, dmax) != dmax ||
+            histogram_diff(a.begin(), a.size(), b.begin(), b.size(), null_edit(), 0, dmax) != dmax)
+        {
+            TRACE_E("DiffBenchmark(): dmax was not respected (" << variants[variant] << ")");
+        }
+
+        TRACE_I("DiffBenchmark(): " << variants[variant] << " (" << a.size() << " and " << b.size() << " lines): diff " << myersMS << " ms, " << myers.Changes << " changes, " << myersD << " lines; histogram_diff " << histogramMS << " ms, " << histogram.Changes << " changes, " << histogramD << " lines");
+    }
+}
+
+typedef void (*FBenchmark)(const char* dir);
+
+struct CBenchmarkItem
+{
+    const char* Name;
+    FBenchmark Function;
+};
+
+static CBenchmarkItem Benchmarks[] = {
+    {"find", FindBenchmark},          // parallel search engine of the Find dialog (files/s, MB/s)
+    {"moore", SearchDataBenchmark},   // Boyer-Moore vs. vectorized substring search (MB/s)
+    {"regexp", RegExpDFABenchmark},   // regexec vs. automaton engine on lines of text (MB/s)
+    {"crc32", CrcBenchmark},          // self-test and speed of the CRC-32 kernels (MB/s)
+    {"copy", CopyBenchmark},          // copying of small files one by one vs. with reading ahead (files/s)
+    {"codetbl", CodeTablesBenchmark}, // conversion through each encoding table, text type detection (MB/s, us)
+    {"diff", DiffBenchmark},          // Myers' vs. histogram diff of line sequences (ms, changes found)
+};
+
+void RunBenchmarks()
+{
+    char dir[MAX_PATH];
+    BOOL haveDir = FALSE;
+    int i;
+    for (i = 0; i < _countof(Benchmarks); i++)
+    {
+        if (!IsBenchmarkSelected(Benchmarks[i].Name))
+            continue;
+        if (!haveDir)
+        {
+            if (!GetBenchmarkDir(dir))
+            {
+                TRACE_E("RunBenchmarks(): unable to get directory for benchmark data.");
+                return;
+            }
+            haveDir = TRUE;
+        }
+        TRACE_I("Benchmark \"" << Benchmarks[i].Name << "\": begin");
+        Benchmarks[i].Function(dir);
+        TRACE_I("Benchmark \"" << Benchmarks[i].Name << "\": end");
+    }
+}
+
+#endif // _DEBUG
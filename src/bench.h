@@ -0,0 +1,24 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+//
+// ****************************************************************************
+// Benchmarks of the search, hashing, conversion, diff and copy engines
+//
+// Benchmarks exist only in DEBUG builds; results are reported as TRACE_I messages
+// (see Trace Server). They are started at the end of the initialization of Salamander
+// when the environment variable OPENSAL_BENCHMARK contains their names separated by ';'
+// (e.g. "find;crc32", "all" starts all of them). Synthetic data are created in the
+// directory from the OPENSAL_BENCHMARK_DIR variable (%TEMP% by default) and are kept
+// there for the next runs. The selection is shared with the benchmarks of the plugins
+// (see benchsel.h).
+//
+
+#ifdef _DEBUG
+
+// starts benchmarks selected by OPENSAL_BENCHMARK
+void RunBenchmarks();
+
+#endif // _DEBUG
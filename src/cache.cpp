@@ -4,6 +4,7 @@
 
 #include "precomp.h"
 
+#include "cfgdlg.h"
 #include "mainwnd.h"
 #include "cache.h"
 #include "plugins.h"
@@ -52,6 +53,12 @@ CCacheData::CCacheData(const char* name, const char* tmpName, BOOL ownDelete,
     OutOfDate = FALSE;
     OwnDelete = ownDelete;
     OwnDeletePlugin = ownDeletePlugin;
+    Hits = 0;
+    Dir = NULL;
+    NameHash = 0;
+    TmpNameHash = 0;
+    NextByName = NULL;
+    NextByTmpName = NULL;
 }
 
 CCacheData::~CCacheData()
@@ -206,6 +213,7 @@ CCacheData::GetName(CDiskCache* monitor, BOOL* exists, BOOL canBlock, BOOL onlyA
                 }
                 else
                 {
+                    Hits++; // requested again while in the cache -> protected segment
                     *exists = TRUE;
                     return TmpName;
                 }
@@ -324,8 +332,9 @@ void CCacheData::PrematureDeleteByPlugin(CPluginInterfaceAbstract* ownDeletePlug
 // CCacheDirData
 //
 
-CCacheDirData::CCacheDirData(const char* path) : Names(100, 50)
+CCacheDirData::CCacheDirData(CDiskCache* owner, const char* path) : Names(100, 50)
 {
+    Owner = owner;
     int l = (int)strlen(path);
     if (l > 0 && path[l - 1] == '\\')
         l--;
@@ -373,12 +382,8 @@ BOOL CCacheDirData::ContainTmpName(const char* tmpName, const char* rootTmpPath,
             if (PathLength + strlen(tmpName) + 1 <= MAX_PATH)
             {
                 strcpy(tmpFullName + PathLength, tmpName);
-                int i;
-                for (i = 0; i < Names.Count; i++)
-                {
-                    if (Names[i]->TmpNameEqual(tmpFullName))
-                        return TRUE;
-                }
+                if (Owner->FindTmpName(tmpFullName) != NULL)
+                    return TRUE;
 
                 WIN32_FIND_DATAW dataW;
                 WIN32_FIND_DATA data;
@@ -482,23 +487,17 @@ void CCacheDirData::RemoveEmptyTmpDirsOnlyFromDisk()
         Path[PathLength - 1] = '\\'; // restoring backslash
 }
 
-BOOL CCacheDirData::GetName(CDiskCache* monitor, const char* name, BOOL* exists, const char** tmpPath,
-                            BOOL canBlock, BOOL onlyAdd, int* errorCode)
+const char*
+CCacheDirData::GetName(CDiskCache* monitor, CCacheData* data, BOOL* exists,
+                       BOOL canBlock, BOOL onlyAdd, int* errorCode)
 {
-    CALL_STACK_MESSAGE4("CCacheDirData::GetName(, %s, , , %d, %d,)", name, canBlock, onlyAdd);
-    int i;
-    if (errorCode != NULL)
-        *errorCode = DCGNE_SUCCESS;
-    if (GetNameIndex(name, i)) // 'name' found at index 'i'
-    {
-        *tmpPath = Names[i]->GetName(monitor, exists, canBlock, onlyAdd, errorCode);
-        if (*tmpPath != NULL) // not a fatal error nor an unprepared tmp-file
-        {                     // nor a "file already exists" error (only if 'onlyAdd' is TRUE)
-            CheckAndCreateDirectory(Path, NULL, TRUE);
-        }
-        return TRUE;
+    CALL_STACK_MESSAGE4("CCacheDirData::GetName(, %s, , %d, %d,)", data->GetName(), canBlock, onlyAdd);
+    const char* tmpPath = data->GetName(monitor, exists, canBlock, onlyAdd, errorCode);
+    if (tmpPath != NULL) // not a fatal error nor an unprepared tmp-file
+    {                    // nor a "file already exists" error (only if 'onlyAdd' is TRUE)
+        CheckAndCreateDirectory(Path, NULL, TRUE);
     }
-    return FALSE;
+    return tmpPath;
 }
 
 const char*
@@ -531,8 +530,10 @@ CCacheDirData::GetName(const char* name, const char* tmpName, BOOL* exists, BOOL
             TRACE_E("This should never happen!");
         }
         Names.Insert(i, newName);
-        if (!Names.IsGood())
+        if (!Names.IsGood() || !Owner->AddToIndex(this, newName))
         {
+            if (Names.IsGood())
+                Names.Delete(i);
             Names.ResetState();
             delete newName;
             *exists = TRUE; // fatal error
@@ -554,55 +555,6 @@ CCacheDirData::GetName(const char* name, const char* tmpName, BOOL* exists, BOOL
     }
 }
 
-BOOL CCacheDirData::NamePrepared(const char* name, const CQuadWord& size, BOOL* ret)
-{
-    CALL_STACK_MESSAGE3("CCacheDirData::NamePrepared(%s, %g, )", name, size.GetDouble());
-    int i;
-    if (GetNameIndex(name, i)) // 'name' found at index 'i'
-    {
-        *ret = Names[i]->NamePrepared(size);
-        return TRUE;
-    }
-    return FALSE;
-}
-
-BOOL CCacheDirData::AssignName(CCacheHandles* handles, const char* name, HANDLE lock, BOOL lockOwner,
-                               CCacheRemoveType remove, BOOL* ret)
-{
-    CALL_STACK_MESSAGE4("CCacheDirData::AssignName(, %s, , %d, %d, )", name, lockOwner, remove);
-    int i;
-    if (GetNameIndex(name, i)) // 'name' found at index 'i'
-    {
-        *ret = Names[i]->AssignName(handles, lock, lockOwner, remove);
-        return TRUE;
-    }
-    return FALSE;
-}
-
-BOOL CCacheDirData::ReleaseName(const char* name, BOOL* ret, BOOL* lastCached, BOOL storeInCache)
-{
-    CALL_STACK_MESSAGE3("CCacheDirData::ReleaseName(%s, , , %d)", name, storeInCache);
-    int i;
-    if (GetNameIndex(name, i)) // 'name' found at index 'i'
-    {
-        BOOL last;
-        *ret = Names[i]->ReleaseName(&last, storeInCache);
-        *lastCached = FALSE;
-        if (last) // contemporarily, this was also the last link to this tmp-file
-        {
-            if (Names[i]->IsCached())
-                *lastCached = TRUE;
-            else // it's not cached, we can cancel it right away
-            {
-                delete (Names[i]);
-                Names.Delete(i);
-            }
-        }
-        return TRUE;
-    }
-    return FALSE;
-}
-
 BOOL CCacheDirData::Release(CCacheData* data)
 {
     CALL_STACK_MESSAGE1("CCacheDirData::Release()");
@@ -617,6 +569,7 @@ BOOL CCacheDirData::Release(CCacheData* data)
         }
 #endif // _DEBUG
         Names.Delete(i);
+        Owner->RemoveFromIndex(data);
         TRACE_I("Tmp-file " << data->GetTmpName() << " was deleted.");
         delete data;
         return TRUE;
@@ -624,17 +577,6 @@ BOOL CCacheDirData::Release(CCacheData* data)
     return FALSE;
 }
 
-CQuadWord
-CCacheDirData::GetSizeOfFiles()
-{
-    CALL_STACK_MESSAGE1("CCacheDirData::GetSizeOfFiles()");
-    CQuadWord size(0, 0);
-    int i;
-    for (i = 0; i < Names.Count; i++)
-        size += Names[i]->GetSize();
-    return size;
-}
-
 void CCacheDirData::AddVictimsToArray(TDirectArray<CCacheData*>& victArr)
 {
     CALL_STACK_MESSAGE1("CCacheDirData::AddVictimsToArray()");
@@ -651,23 +593,6 @@ void CCacheDirData::AddVictimsToArray(TDirectArray<CCacheData*>& victArr)
     }
 }
 
-BOOL CCacheDirData::DetachTmpFile(const char* tmpName)
-{
-    if (StrNICmp(tmpName, Path, PathLength) == 0) // if there's a chance that this is our tmp-file
-    {
-        int i;
-        for (i = 0; i < Names.Count; i++)
-        {
-            if (StrICmp(Names[i]->GetTmpName() + PathLength, tmpName + PathLength) == 0) // we've got it
-            {
-                Names[i]->DetachTmpFile();
-                return TRUE;
-            }
-        }
-    }
-    return FALSE;
-}
-
 void CCacheDirData::FlushCache(const char* name)
 {
     int nameLen = (int)strlen(name);
@@ -682,6 +607,7 @@ void CCacheDirData::FlushCache(const char* name)
             {
                 // we will delete the found tmp-file
                 Names.Delete(i);
+                Owner->RemoveFromIndex(data);
                 TRACE_I("Tmp-file " << data->GetTmpName() << " was deleted.");
                 delete data;
                 i--;
@@ -697,28 +623,12 @@ void CCacheDirData::FlushCache(const char* name)
     }
 }
 
-BOOL CCacheDirData::FlushOneFile(const char* name)
+void CCacheDirData::FlushOneFile(CCacheData* data)
 {
-    int i;
-    if (GetNameIndex(name, i)) // 'name' found at index 'i'
-    {
-        CCacheData* data = Names[i];
-        if (data->IsLocked())
-        {
-            // we will delete the found tmp-file
-            Names.Delete(i);
-            TRACE_I("Tmp-file " << data->GetTmpName() << " was deleted.");
-            delete data;
-            i--;
-        }
-        else
-        {
-            // it can't be deleted now, it will be deleted as soon as possible
-            data->SetOutOfDate();
-        }
-        return TRUE; // deleted
-    }
-    return FALSE; // not found
+    if (data->IsLocked())
+        Release(data); // we will delete the found tmp-file
+    else
+        data->SetOutOfDate(); // it can't be deleted now, it will be deleted as soon as possible
 }
 
 //
@@ -1064,6 +974,12 @@ void CCacheHandles::WaitForIdle()
 CDiskCache::CDiskCache() : Dirs(10, 5)
 {
     CALL_STACK_MESSAGE_NONE;
+    NameIndex = NULL;
+    TmpNameIndex = NULL;
+    IndexSize = 0;
+    IndexCount = 0;
+    TotalSize.Set(0, 0);
+    memset(&Stats, 0, sizeof(Stats));
     Handles.SetDiskCache(this);
     HANDLES(InitializeCriticalSection(&Monitor));
     HANDLES(InitializeCriticalSection(&WaitForIdleCS));
@@ -1082,6 +998,10 @@ CDiskCache::~CDiskCache()
             delete data;
         }
     }
+    if (NameIndex != NULL)
+        free(NameIndex);
+    if (TmpNameIndex != NULL)
+        free(TmpNameIndex);
     HANDLES(DeleteCriticalSection(&WaitForIdleCS));
     HANDLES(DeleteCriticalSection(&Monitor));
 }
@@ -1091,6 +1011,7 @@ void CDiskCache::PrepareForShutdown()
     CALL_STACK_MESSAGE1("CDiskCache::PrepareForShutdown()");
     WaitForIdle();
     Enter();
+    TraceStatistics();
     int i;
     for (i = Dirs.Count - 1; i >= 0; i--)
     {
@@ -1128,23 +1049,28 @@ CDiskCache::GetName(const char* name, const char* tmpName, BOOL* exists, BOOL on
     if (errorCode != NULL)
         *errorCode = DCGNE_SUCCESS;
     // we will verify if we know 'name'
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
-    {
-        const char* tmpPath;
-        if (Dirs[i]->GetName(this, name, exists, &tmpPath,
-                             tmpName != NULL && !onlyAdd, onlyAdd, errorCode))
-        { // 'name' found; if 'tmpName' is NULL, it can be an unprepared tmp-file (it returns 'not found' error)
-            // if 'onlyAdd' is TRUE, it can be a "file already exists" error
-            Leave();
-            return tmpPath;
+    CCacheData* data = FindName(name);
+    if (data != NULL)
+    { // 'name' found; if 'tmpName' is NULL, it can be an unprepared tmp-file (it returns 'not found' error)
+        // if 'onlyAdd' is TRUE, it can be a "file already exists" error
+        const char* tmpPath = data->GetDir()->GetName(this, data, exists, tmpName != NULL && !onlyAdd,
+                                                      onlyAdd, errorCode);
+        if (tmpPath != NULL)
+        {
+            if (*exists)
+                Stats.Hits++;
+            else
+                Stats.Misses++; // the tmp-file must be prepared again
         }
+        Leave();
+        return tmpPath;
     }
 
     // if we are just searching for an existing tmp-file, we will return "not found" error
     if (tmpName == NULL)
     {
         *exists = FALSE; // "not found" error (but not a fatal error)
+        Stats.Misses++;
         Leave();
         if (errorCode != NULL)
             *errorCode = DCGNE_NOTFOUND;
@@ -1165,12 +1091,15 @@ CDiskCache::GetName(const char* name, const char* tmpName, BOOL* exists, BOOL on
     BOOL canContainThisName;
 
     // we will find a suitable tmp-directory for the added tmp-file
+    int i;
     for (i = 0; i < Dirs.Count; i++)
     {
         if (!Dirs[i]->ContainTmpName(tmpName, rootTmpPathExp, rootTmpPathExpLen, &canContainThisName) &&
             canContainThisName) // adding a new 'name'
         {
             const char* ret = Dirs[i]->GetName(name, tmpName, exists, ownDelete, ownDeletePlugin, errorCode);
+            if (ret != NULL)
+                Stats.Misses++;
             Leave();
             return ret;
         }
@@ -1191,7 +1120,7 @@ CDiskCache::GetName(const char* name, const char* tmpName, BOOL* exists, BOOL on
         return NULL;
     }
 
-    CCacheDirData* newDir = new CCacheDirData(newDirPath);
+    CCacheDirData* newDir = new CCacheDirData(this, newDirPath);
     if (newDir == NULL)
     {
         TRACE_E(LOW_MEMORY);
@@ -1217,6 +1146,8 @@ CDiskCache::GetName(const char* name, const char* tmpName, BOOL* exists, BOOL on
 
     // we will add 'name' to our new tmp-directory (index==Dirs.Count - 1)
     const char* ret = newDir->GetName(name, tmpName, exists, ownDelete, ownDeletePlugin, errorCode);
+    if (ret != NULL)
+        Stats.Misses++;
     Leave();
     return ret;
 }
@@ -1225,15 +1156,14 @@ BOOL CDiskCache::NamePrepared(const char* name, const CQuadWord& size)
 {
     CALL_STACK_MESSAGE3("CDiskCache::NamePrepared(%s, %g)", name, size.GetDouble());
     Enter();
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
+    CCacheData* data = FindName(name);
+    if (data != NULL) // 'name' found
     {
-        BOOL ret;
-        if (Dirs[i]->NamePrepared(name, size, &ret)) // 'name' found
-        {
-            Leave();
-            return ret;
-        }
+        TotalSize -= data->GetSize(); // the tmp-file can be prepared again (see CCacheData::GetName())
+        BOOL ret = data->NamePrepared(size);
+        TotalSize += data->GetSize();
+        Leave();
+        return ret;
     }
     Leave();
     TRACE_E("Incorrect call to CDiskCache::NamePrepared().");
@@ -1246,17 +1176,14 @@ BOOL CDiskCache::AssignName(const char* name, HANDLE lock, BOOL lockOwner, CCach
     Handles.WaitForBox(); // we will wait until we have a place for writing
 
     Enter();
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
+    CCacheData* data = FindName(name);
+    if (data != NULL) // 'name' found
     {
-        BOOL ret;
-        if (Dirs[i]->AssignName(&Handles, name, lock, lockOwner, remove, &ret))
-        { // 'name' found
-            if (!ret)
-                Handles.ReleaseBox(); // an error occurred, we will release the box
-            Leave();
-            return ret;
-        }
+        BOOL ret = data->AssignName(&Handles, lock, lockOwner, remove);
+        if (!ret)
+            Handles.ReleaseBox(); // an error occurred, we will release the box
+        Leave();
+        return ret;
     }
     Handles.ReleaseBox(); // an error occurred, we will release the box
     Leave();
@@ -1268,20 +1195,22 @@ BOOL CDiskCache::ReleaseName(const char* name, BOOL storeInCache)
 {
     CALL_STACK_MESSAGE3("CDiskCache::ReleaseName(%s, %d)", name, storeInCache);
     Enter();
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
+    CCacheData* data = FindName(name);
+    if (data != NULL) // 'name' found
     {
-        BOOL ret;
-        BOOL lastCached;
-        if (Dirs[i]->ReleaseName(name, &ret, &lastCached, storeInCache)) // 'name' found
+        BOOL last;
+        BOOL ret = data->ReleaseName(&last, storeInCache);
+        if (last) // contemporarily, this was also the last link to this tmp-file
         {
-            if (lastCached) // tmp-file is without links and cached, we will see if we need
-            {               // to release it, or if we need to release space on disk
+            if (data->IsCached()) // tmp-file is without links and cached, we will see if we need
+            {                     // to release it, or if we need to release space on disk
                 CheckCachedFiles();
             }
-            Leave();
-            return ret;
+            else // it's not cached, we can cancel it right away
+                data->GetDir()->Release(data);
         }
+        Leave();
+        return ret;
     }
     Leave();
     TRACE_E("Incorrect call to CDiskCache::ReleaseName().");
@@ -1316,16 +1245,23 @@ void SortVictims(TDirectArray<CCacheData*>& victArr, int left, int right)
         SortVictims(victArr, i, right);
 }
 
+CQuadWord
+CDiskCache::GetMaxCacheSize()
+{
+    DWORD maxSize = Configuration.DiskCacheMaxSize;
+    if (maxSize == 0)
+        maxSize = 1; // at least 1 MB
+    return CQuadWord().SetUI64((unsigned __int64)maxSize * 1024 * 1024);
+}
+
 void CDiskCache::CheckCachedFiles()
 {
     CALL_STACK_MESSAGE1("CDiskCache::CheckCachedFiles()");
-    CQuadWord size(0, 0);
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
-        size += Dirs[i]->GetSizeOfFiles();
-    if (size > MAX_CACHE_SIZE) // it is needed to delete some files
+    CQuadWord maxSize = GetMaxCacheSize();
+    if (TotalSize > maxSize) // it is needed to delete some files
     {
         TDirectArray<CCacheData*> victArr(100, 50);
+        int i;
         for (i = 0; i < Dirs.Count; i++)
         {
             Dirs[i]->AddVictimsToArray(victArr);
@@ -1334,24 +1270,53 @@ void CDiskCache::CheckCachedFiles()
             return; // low memory, we won't perform optimization
         if (victArr.Count > 1)
             SortVictims(victArr, 0, victArr.Count - 1);
-        int actVict = 0;
-        while (size > MAX_CACHE_SIZE)
+
+        // segmented LRU: the probationary segment (tmp-files used only once) is released first,
+        // the protected segment (tmp-files requested again) only after it; the oldest protected
+        // tmp-files above DISKCACHE_PROTECTED_PERCENT of the cache size fall back to the probationary
+        // segment, so tmp-files used repeatedly long ago can't occupy the cache forever
+        // (the last victim is never released, see below)
+        CQuadWord protectedSize(0, 0);
+        for (i = 0; i + 1 < victArr.Count; i++)
         {
-            // we will select the oldest cached tmp-file without links
-            if (actVict + 1 < victArr.Count)
+            if (victArr[i]->IsProtected())
+                protectedSize += victArr[i]->GetSize();
+        }
+        CQuadWord maxProtectedSize = maxSize / CQuadWord(100, 0) * CQuadWord(DISKCACHE_PROTECTED_PERCENT, 0);
+        for (i = 0; i + 1 < victArr.Count && protectedSize > maxProtectedSize; i++)
+        {
+            if (victArr[i]->IsProtected())
+            {
+                victArr[i]->Demote();
+                protectedSize -= victArr[i]->GetSize();
+            }
+        }
+
+        int evicted = 0;
+        int segment;
+        for (segment = 0; segment < 2 && TotalSize > maxSize; segment++)
+        {
+            // we will select the oldest cached tmp-files without links from the segment;
+            // at least one cached file must remain in cache, it will be the one which was
+            // released last, it prevents discarding of the file which the user is currently
+            // looking at
+            for (i = 0; i + 1 < victArr.Count && TotalSize > maxSize; i++)
             {
-                CCacheData* data = victArr[actVict++];
-                size -= data->GetSize();         // subtract its size from the total size of cache
-                for (i = 0; i < Dirs.Count; i++) // release it from cache and from disk
+                CCacheData* data = victArr[i];
+                if (data != NULL && (segment == 0) != (data->IsProtected() != FALSE))
                 {
-                    if (Dirs[i]->Release(data))
-                        break; // found and cancelled
+                    Stats.Evictions++;
+                    Stats.EvictedSize += data->GetSize();
+                    evicted++;
+                    victArr[i] = NULL;
+                    data->GetDir()->Release(data); // release it from cache and from disk (also updates TotalSize)
                 }
             }
-            else
-                break; // at least one cached file must remain in cache, it will be
-                       // the one which was released last, it prevents discarding
-                       // of the file which the user is currently looking at
+        }
+        if (evicted > 0)
+        {
+            TRACE_I("CDiskCache::CheckCachedFiles(): released " << evicted << " cached tmp-file(s).");
+            TraceStatistics();
         }
     }
 }
@@ -1371,17 +1336,9 @@ void CDiskCache::WaitSatisfied(HANDLE lock, CCacheData* owner)
             }
             else // we should delete the file directly
             {
-                int i;
-                for (i = 0; i < Dirs.Count; i++)
-                {
-                    if (Dirs[i]->Release(owner)) // found
-                    {
-                        Leave();
-                        return;
-                    }
-                }
+                if (!owner->GetDir()->Release(owner))
+                    TRACE_E("Incorrect call to CDiskCache::WaitSatisfied().");
                 Leave();
-                TRACE_E("Incorrect call to CDiskCache::WaitSatisfied().");
                 return;
             }
         }
@@ -1397,14 +1354,11 @@ BOOL CDiskCache::DetachTmpFile(const char* tmpName)
     CALL_STACK_MESSAGE2("CDiskCache::DetachTmpFile(%s)", tmpName);
     BOOL ret = FALSE;
     Enter();
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
+    CCacheData* data = FindTmpName(tmpName);
+    if (data != NULL)
     {
-        if (Dirs[i]->DetachTmpFile(tmpName))
-        {
-            ret = TRUE;
-            break;
-        }
+        data->DetachTmpFile();
+        ret = TRUE;
     }
     Leave();
     return ret;
@@ -1426,14 +1380,12 @@ BOOL CDiskCache::FlushOneFile(const char* name)
 {
     CALL_STACK_MESSAGE2("CDiskCache::FlushOneFile(%s)", name);
     Enter();
-    int i;
-    for (i = 0; i < Dirs.Count; i++)
+    CCacheData* data = FindName(name);
+    if (data != NULL)
     {
-        if (Dirs[i]->FlushOneFile(name))
-        {
-            Leave();
-            return TRUE; // deleted
-        }
+        data->GetDir()->FlushOneFile(data);
+        Leave();
+        return TRUE; // deleted
     }
     Leave();
     return FALSE;
@@ -1461,6 +1413,168 @@ void CDiskCache::PrematureDeleteByPlugin(CPluginInterfaceAbstract* ownDeletePlug
     Leave();
 }
 
+void CDiskCache::GetStatistics(CDiskCacheStatistics* stats)
+{
+    CALL_STACK_MESSAGE1("CDiskCache::GetStatistics()");
+    Enter();
+    *stats = Stats;
+    stats->Files = IndexCount;
+    stats->ProtectedFiles = 0;
+    int i;
+    for (i = 0; i < IndexSize; i++)
+    {
+        CCacheData* data;
+        for (data = NameIndex[i]; data != NULL; data = data->NextByName)
+        {
+            if (data->IsProtected())
+                stats->ProtectedFiles++;
+        }
+    }
+    stats->Size = TotalSize;
+    stats->MaxSize = GetMaxCacheSize();
+    Leave();
+}
+
+void CDiskCache::TraceStatistics()
+{
+    TRACE_I("Disk-cache: hits=" << Stats.Hits << ", misses=" << Stats.Misses << ", evictions=" << Stats.Evictions << " (" << Stats.EvictedSize.Value << " bytes), files=" << IndexCount << ", size=" << TotalSize.Value << " bytes (max. " << GetMaxCacheSize().Value << " bytes)");
+}
+
+// FNV-1a hash of the string 's'; if 'ignoreCase' is TRUE, letters are converted to lowercase first
+static DWORD GetDiskCacheHash(const char* s, BOOL ignoreCase)
+{
+    DWORD hash = 2166136261;
+    if (ignoreCase)
+    {
+        for (; *s != 0; s++)
+            hash = (hash ^ LowerCase[(BYTE)*s]) * 16777619;
+    }
+    else
+    {
+        for (; *s != 0; s++)
+            hash = (hash ^ (BYTE)*s) * 16777619;
+    }
+    return hash;
+}
+
+BOOL CDiskCache::ResizeIndex(int size)
+{
+    CCacheData** nameIndex = (CCacheData**)malloc(size * sizeof(CCacheData*));
+    CCacheData** tmpNameIndex = (CCacheData**)malloc(size * sizeof(CCacheData*));
+    if (nameIndex == NULL || tmpNameIndex == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        if (nameIndex != NULL)
+            free(nameIndex);
+        if (tmpNameIndex != NULL)
+            free(tmpNameIndex);
+        return FALSE;
+    }
+    memset(nameIndex, 0, size * sizeof(CCacheData*));
+    memset(tmpNameIndex, 0, size * sizeof(CCacheData*));
+    int i;
+    for (i = 0; i < IndexSize; i++) // move all tmp-files to the new tables
+    {
+        CCacheData* data = NameIndex[i];
+        while (data != NULL)
+        {
+            CCacheData* next = data->NextByName;
+            int bucket = data->NameHash & (size - 1);
+            data->NextByName = nameIndex[bucket];
+            nameIndex[bucket] = data;
+            data = next;
+        }
+        data = TmpNameIndex[i];
+        while (data != NULL)
+        {
+            CCacheData* next = data->NextByTmpName;
+            int bucket = data->TmpNameHash & (size - 1);
+            data->NextByTmpName = tmpNameIndex[bucket];
+            tmpNameIndex[bucket] = data;
+            data = next;
+        }
+    }
+    if (NameIndex != NULL)
+        free(NameIndex);
+    if (TmpNameIndex != NULL)
+        free(TmpNameIndex);
+    NameIndex = nameIndex;
+    TmpNameIndex = tmpNameIndex;
+    IndexSize = size;
+    return TRUE;
+}
+
+BOOL CDiskCache::AddToIndex(CCacheDirData* dir, CCacheData* data)
+{
+    if (IndexSize == 0 && !ResizeIndex(DISKCACHE_INDEX_MIN_SIZE))
+        return FALSE;
+    if (IndexCount >= IndexSize)
+        ResizeIndex(2 * IndexSize); // on low memory we continue with longer chains
+    data->Dir = dir;
+    data->NameHash = GetDiskCacheHash(data->GetName(), FALSE);
+    data->TmpNameHash = GetDiskCacheHash(data->GetTmpName(), TRUE);
+    int bucket = data->NameHash & (IndexSize - 1);
+    data->NextByName = NameIndex[bucket];
+    NameIndex[bucket] = data;
+    bucket = data->TmpNameHash & (IndexSize - 1);
+    data->NextByTmpName = TmpNameIndex[bucket];
+    TmpNameIndex[bucket] = data;
+    IndexCount++;
+    TotalSize += data->GetSize();
+    return TRUE;
+}
+
+void CDiskCache::RemoveFromIndex(CCacheData* data)
+{
+    CCacheData** item = &NameIndex[data->NameHash & (IndexSize - 1)];
+    while (*item != NULL && *item != data)
+        item = &(*item)->NextByName;
+    if (*item == NULL)
+    {
+        TRACE_E("CDiskCache::RemoveFromIndex(): tmp-file is not in the index!");
+        return;
+    }
+    *item = data->NextByName;
+    item = &TmpNameIndex[data->TmpNameHash & (IndexSize - 1)];
+    while (*item != NULL && *item != data)
+        item = &(*item)->NextByTmpName;
+    if (*item != NULL)
+        *item = data->NextByTmpName;
+    data->NextByName = data->NextByTmpName = NULL;
+    IndexCount--;
+    TotalSize -= data->GetSize();
+}
+
+CCacheData*
+CDiskCache::FindName(const char* name)
+{
+    if (IndexSize == 0)
+        return NULL;
+    DWORD hash = GetDiskCacheHash(name, FALSE);
+    CCacheData* data;
+    for (data = NameIndex[hash & (IndexSize - 1)]; data != NULL; data = data->NextByName)
+    {
+        if (data->NameHash == hash && strcmp(data->GetName(), name) == 0)
+            return data;
+    }
+    return NULL;
+}
+
+CCacheData*
+CDiskCache::FindTmpName(const char* tmpName)
+{
+    if (IndexSize == 0)
+        return NULL;
+    DWORD hash = GetDiskCacheHash(tmpName, TRUE);
+    CCacheData* data;
+    for (data = TmpNameIndex[hash & (IndexSize - 1)]; data != NULL; data = data->NextByTmpName)
+    {
+        if (data->TmpNameHash == hash && StrICmp(data->GetTmpName(), tmpName) == 0)
+            return data;
+    }
+    return NULL;
+}
+
 void CDiskCache::ClearTEMPIfNeeded(HWND parent, HWND hActivePanel)
 {
     char tmpDir[2 * MAX_PATH];
@@ -9,8 +9,11 @@ BOOL InitializeDiskCache();
 
 // how long time to wait between checking the state of watched objects
 #define CACHE_HANDLES_WAIT 500
-// (100 MB) max . size of disk-cache in bytes, should be moved to configuration
-#define MAX_CACHE_SIZE CQuadWord(104857600, 0)
+// initial number of buckets of the disk-cache hash tables (power of two, they grow when needed)
+#define DISKCACHE_INDEX_MIN_SIZE 256
+// max. part of the disk-cache size (in percents) held by the protected segment (tmp-files
+// requested repeatedly), older tmp-files above this limit are moved back to the probationary segment
+#define DISKCACHE_PROTECTED_PERCENT 80
 
 // error state codes for method CDiskCache::GetName()
 #define DCGNE_SUCCESS 0
@@ -32,6 +35,7 @@ enum CCacheRemoveType // if it's possible to remove the item from cache, when it
 };
 
 class CDiskCache;
+class CCacheDirData;
 class CCacheHandles;
 
 class CCacheData // tmp-name, info about file or directory on disk, internal use
@@ -55,6 +59,14 @@ protected:
     BOOL OutOfDate;                            // TRUE => once possible, we acquire a new copy (as if it's not on disk)
     BOOL OwnDelete;                            // FALSE = delete the tmp-file using DeleteFile(), TRUE = delete using DeleteManager (the plugin OwnDeletePlugin deletes)
     CPluginInterfaceAbstract* OwnDeletePlugin; // plugin interface, which should delete the tmp-file (NULL = the plugin is unloaded, the tmp-file should not be deleted)
+    int Hits;                                  // number of requests satisfied from the cache; 0 = probationary segment, otherwise protected segment
+
+    // data of the disk-cache indexes (see CDiskCache::AddToIndex())
+    CCacheDirData* Dir;        // tmp-directory containing the tmp-file
+    DWORD NameHash;            // hash of Name (case sensitive)
+    DWORD TmpNameHash;         // hash of TmpName (case insensitive)
+    CCacheData* NextByName;    // next item in the same bucket of CDiskCache::NameIndex
+    CCacheData* NextByTmpName; // next item in the same bucket of CDiskCache::TmpNameIndex
 
 public:
     CCacheData(const char* name, const char* tmpName, BOOL ownDelete,
@@ -73,6 +85,16 @@ public:
     // returns "time" of last access to the tmp-file
     int GetLastAccess() { return LastAccess; }
 
+    // returns TRUE if the tmp-file is in the protected segment of the cache (it was requested again
+    // while it was in the cache)
+    BOOL IsProtected() { return Hits > 0; }
+
+    // moves the tmp-file to the probationary segment of the cache
+    void Demote() { Hits = 0; }
+
+    // returns the tmp-directory containing the tmp-file
+    CCacheDirData* GetDir() { return Dir; }
+
     // cancels tmp-file on disk, returns success (Name is not on disk anymore)
     BOOL CleanFromDisk();
 
@@ -85,9 +107,6 @@ public:
     // is the tmp-file without any link? (it still has no link/it has no link anymore?)
     BOOL IsLocked() { return LockObject.Count == 0 && NewCount == 0; }
 
-    BOOL NameEqual(const char* name) { return StrICmp(Name, name) == 0; }
-    BOOL TmpNameEqual(const char* tmpName) { return StrICmp(TmpName, tmpName) == 0; }
-
     // waits until the tmp-file is prepared or until the method ReleaseName() is called
     // then 'exists' is set to return value matching CDiskCache::GetName()
     // NULL -> fatal error or "file not prepared" (see below)
@@ -144,6 +163,8 @@ public:
     // deletion won't occur); if 'onlyDetach' is TRUE, the tmp-file is not deleted, it's only marked
     // as deleted (the plugin is detached from the tmp-file)
     void PrematureDeleteByPlugin(CPluginInterfaceAbstract* ownDeletePlugin, BOOL onlyDetach);
+
+    friend class CDiskCache; // maintains the index data
 };
 
 //****************************************************************************
@@ -154,12 +175,13 @@ public:
 class CCacheDirData // tmp-directory, contains unique tmp-names, internal use
 {
 protected:
+    CDiskCache* Owner;               // disk-cache, to which this tmp-directory belongs (maintains indexes of tmp-files)
     char Path[MAX_PATH];             // tmp-directory representation on disk
     int PathLength;                  // length of the string in Path
     TDirectArray<CCacheData*> Names; // the list of records, type of item (CCacheData *)
 
 public:
-    CCacheDirData(const char* path);
+    CCacheDirData(CDiskCache* owner, const char* path);
     ~CCacheDirData();
 
     int GetNamesCount() { return Names.Count; }
@@ -177,74 +199,41 @@ public:
     BOOL ContainTmpName(const char* tmpName, const char* rootTmpPath, int rootTmpPathLen,
                         BOOL* canContainThisName);
 
-    // searches for 'name' in the tmp-directory; if it's found, returns TRUE and values 'name' and 'tmpPath',
-    // so that they match expected values from CDiskCache::GetName(); if it's not found,
-    // returns FALSE
+    // returns tmp-file 'data' (found in this tmp-directory) as expected from CDiskCache::GetName()
+    // (NULL && 'exists'==TRUE -> fatal error)
     //
-    // name - unique item identification
-    // exists - pointer to BOOL, which is set per the description above
-    // tmpPath - return value of CDiskCache::GetName() (NULL && 'exists'==TRUE -> fatal error)
+    // exists - pointer to BOOL, which is set per the description of CDiskCache::GetName()
     //
-    // if 'onlyAdd' is TRUE, it is possible to create only a new name or restore a deleted tmp-file
-    // (the name exists, but the tmp-file is not prepared) - if the name exists, returns TRUE,
-    // 'exists' FALSE and 'tmpPath' NULL ("file already exists");
-    // 'canBlock' is TRUE if waiting for readiness of the tmp-file is expected, in case 'name'
-    // is in cache, but it's not prepared, if 'canBlock' is FALSE and the tmp-file is not prepared,
-    // returns TRUE, 'exists' FALSE and 'tmpPath' NULL ("not found");
+    // if 'onlyAdd' is TRUE, it is possible only to restore a deleted tmp-file (the name exists,
+    // but the tmp-file is not prepared) - otherwise returns NULL and 'exists' FALSE ("file already exists");
+    // 'canBlock' is TRUE if waiting for readiness of the tmp-file is expected, if 'canBlock' is FALSE
+    // and the tmp-file is not prepared, returns NULL and 'exists' FALSE ("not found");
     // if 'errorCode' is not NULL, the error code is returned in it (see DCGNE_XXX)
-    BOOL GetName(CDiskCache* monitor, const char* name, BOOL* exists, const char** tmpPath,
-                 BOOL canBlock, BOOL onlyAdd, int* errorCode);
+    const char* GetName(CDiskCache* monitor, CCacheData* data, BOOL* exists,
+                        BOOL canBlock, BOOL onlyAdd, int* errorCode);
 
     // for description see CDiskCache::GetName() - adding a new 'name'
     const char* GetName(const char* name, const char* tmpName, BOOL* exists, BOOL ownDelete,
                         CPluginInterfaceAbstract* ownDeletePlugin, int* errorCode);
 
-    // searches for 'name' in the tmp-directory; if it's found, returns TRUE and 'ret' is set to return value
-    // CDiskCache::NamePrepared(name, size); if it's not found, returns FALSE
-    // for description see CDiskCache::NamePrepared()
-    BOOL NamePrepared(const char* name, const CQuadWord& size, BOOL* ret);
-
-    // searches for 'name' in the tmp-directory; if it's found, returns TRUE and 'ret' is set to return value
-    // CDiskCache::AssignName(name, lock, lockOwner, remove); if it's not found, returns FALSE
-    // for description see CDiskCache::AssignName()
-    //
-    // handles - object for watching the 'lock' object
-    BOOL AssignName(CCacheHandles* handles, const char* name, HANDLE lock, BOOL lockOwner,
-                    CCacheRemoveType remove, BOOL* ret);
-
-    // searches for 'name' in the tmp-directory; if it's found, returns TRUE and 'ret' is set to return value
-    // CDiskCache::ReleaseName(name); if it's not found, returns FALSE
-    // for description see CDiskCache::ReleaseName()
-    //
-    // lastCached - pointer to BOOL, which is set to TRUE if this is the last link to the cached tmp-file,
-    //              or if it's necessary to decide about its further existence
-    BOOL ReleaseName(const char* name, BOOL* ret, BOOL* lastCached, BOOL storeInCache);
-
     // searches for 'data' in the tmp-directory; if it's found, returns TRUE and cancels tmp-file 'data';
     // if it's not found, returns FALSE
     //
     // data - tmp-file
     BOOL Release(CCacheData* data);
 
-    // sum of sizes of tmp-files in the tmp-directory
-    CQuadWord GetSizeOfFiles();
-
     // fills the array 'victArr' with cached tmp-files without any link (WARNING: it doesn't sort from the oldest to the newest)
     void AddVictimsToArray(TDirectArray<CCacheData*>& victArr);
 
-    // if we change our mind about deleting the tmp-file on disk (e.g. it was not possible to pack it
-    // so we leave it in temp, so that the users don't kill us)
-    BOOL DetachTmpFile(const char* tmpName);
-
     // removes all cached tmp-files beginning with 'name' (e.g. all files from one archive)
     // opened files will be marked as out-of-date, so that they will be restored when used again
     // (the current copy remains, so that the viewers don't yell at us)
     void FlushCache(const char* name);
 
-    // removes cached file 'name'; the opened file will be marked as out-of-date, so that it will be
-    // restored when used again (the current copy remains, so that the viewers don't yell at us);
-    // returns TRUE if the file was found and removed
-    BOOL FlushOneFile(const char* name);
+    // removes cached tmp-file 'data' (found in this tmp-directory); the opened file will be marked
+    // as out-of-date, so that it will be restored when used again (the current copy remains, so that
+    // the viewers don't yell at us)
+    void FlushOneFile(CCacheData* data);
 
     // search for the name in the array Names; returns TRUE if 'name' was found (returns also where - 'index');
     // returns FALSE if 'name' is not in Names (returns also where it could be inserted - 'index')
@@ -330,6 +319,18 @@ protected:
 // CDiskCache
 //
 
+struct CDiskCacheStatistics // counters of the disk-cache, see CDiskCache::GetStatistics()
+{
+    DWORD Hits;            // requests satisfied by a prepared tmp-file from the cache
+    DWORD Misses;          // requests for which the tmp-file had to be prepared (or was not found)
+    DWORD Evictions;       // number of cached tmp-files released because of the cache size limit
+    CQuadWord EvictedSize; // sum of sizes of the released tmp-files
+    int Files;             // current number of tmp-files
+    int ProtectedFiles;    // current number of tmp-files in the protected segment
+    CQuadWord Size;        // current sum of sizes of tmp-files
+    CQuadWord MaxSize;     // current size limit of the cache
+};
+
 class CDiskCache // assigns names for tmp-files
 {                // object is synchronized - monitor
 protected:
@@ -338,6 +339,15 @@ protected:
     TDirectArray<CCacheDirData*> Dirs; // list of tmp-directories, type of item (CCacheDirData *)
     CCacheHandles Handles;             // object, which watches the 'lock' objects
 
+    // indexes of all tmp-files from all tmp-directories (hash tables with chaining through CCacheData)
+    CCacheData** NameIndex;    // by Name (unique item identification)
+    CCacheData** TmpNameIndex; // by TmpName (full name of the tmp-file on disk)
+    int IndexSize;             // number of buckets in both tables (power of two; 0 = not allocated yet)
+    int IndexCount;            // number of tmp-files in the tables
+    CQuadWord TotalSize;       // sum of sizes of all tmp-files (see CCacheData::GetSize())
+
+    CDiskCacheStatistics Stats; // hit/miss/eviction counters (the rest is filled in GetStatistics())
+
 public:
     CDiskCache();
     ~CDiskCache();
@@ -455,6 +465,9 @@ public:
     // as deleted (the plugin is detached from the tmp-file)
     void PrematureDeleteByPlugin(CPluginInterfaceAbstract* ownDeletePlugin, BOOL onlyDetach);
 
+    // returns the current counters and state of the disk-cache in 'stats'
+    void GetStatistics(CDiskCacheStatistics* stats);
+
     // the TEMP directory clean-up from the rest of previous instances; called only by the first instance
     // if it finds subdirectories "SAL*.tmp", it asks the user if he wants to delete them and if so,
     // it deletes them
@@ -467,6 +480,27 @@ protected:
     // checks conditions on disk, if necessary, releases some free cached tmp-files
     void CheckCachedFiles();
 
+    // returns the size limit of the cache (see CConfiguration::DiskCacheMaxSize)
+    CQuadWord GetMaxCacheSize();
+
+    // adds tmp-file 'data' from tmp-directory 'dir' to the indexes; returns FALSE on low memory
+    BOOL AddToIndex(CCacheDirData* dir, CCacheData* data);
+
+    // removes tmp-file 'data' from the indexes (called before its destruction)
+    void RemoveFromIndex(CCacheData* data);
+
+    // returns tmp-file with unique item identification 'name' or NULL if it is not in the cache
+    CCacheData* FindName(const char* name);
+
+    // returns tmp-file with full name 'tmpName' (case insensitive) or NULL if it is not in the cache
+    CCacheData* FindTmpName(const char* tmpName);
+
+    // rehashes the indexes to 'size' buckets; returns FALSE on low memory (the indexes remain unchanged)
+    BOOL ResizeIndex(int size);
+
+    // writes the counters of the disk-cache to the trace server
+    void TraceStatistics();
+
     // reacts to the transition of one of the 'lock' to the "signaled" state (the tmp-file loses a link)
     //
     // lock - watched object handle, which turned to "signaled" state
@@ -475,6 +509,7 @@ protected:
 
     friend class CCacheData;    // calls Enter() and Leave()
     friend class CCacheHandles; // calls WaitSatisfied()
+    friend class CCacheDirData; // calls AddToIndex(), RemoveFromIndex() and FindTmpName()
 };
 
 //****************************************************************************
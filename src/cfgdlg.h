@@ -285,6 +285,8 @@ struct CConfiguration
 
     DWORD LastUsedSpeedLimit; // remembers the last used speed limit (users often repeat one number)
 
+    DWORD DiskCacheMaxSize; // size limit of the disk-cache in MB (tmp-files unpacked from archives and file systems)
+
     BOOL QuickSearchEnterAlt; // if it is TRUE, Quick Search is activated via Alt+letter
 
     // for displaying the items in the panel
@@ -4,8 +4,12 @@
 
 #include "precomp.h"
 
+#include <emmintrin.h>
+
 #include "codetbl.h"
 #include "cfgdlg.h"
+#include "cpuinfo.h"
+#include "benchsel.h"
 
 CCodeTables CodeTables;
 
@@ -893,6 +897,9 @@ void CCodeTables::RecognizeFileType(const char* pattern, int patternLen, BOOL fo
     lastCodePage[0] = 0;
     int winCodePageLen = (int)strlen(Table->WinCodePage);
     DWORD bestPenalty = 0xFFFFFFFF;
+    // pure ASCII text is the same after the conversion through tables preserving ASCII,
+    // so their penalty cannot be better than the one of the text without conversion
+    BOOL asciiOnly = IsAsciiOnly(pattern, patternLen);
     if (buf != NULL)
     {
         int i;
@@ -916,7 +923,10 @@ void CCodeTables::RecognizeFileType(const char* pattern, int patternLen, BOOL fo
                     n = buf3;
 
                     int nameLen = (int)strlen(n); // check if the "target" conversion is WinCodePage
-                    if (nameLen > winCodePageLen && StrICmp(n + nameLen - winCodePageLen, Table->WinCodePage) == 0)
+                    char* table = Table->Data[i]->Table;
+                    BOOL asciiPreserving = IsAsciiPreservingTable(table);
+                    if ((!asciiOnly || !asciiPreserving) &&
+                        nameLen > winCodePageLen && StrICmp(n + nameLen - winCodePageLen, Table->WinCodePage) == 0)
                     {
                         const char* s = n + nameLen - winCodePageLen;
                         while (s > n && (*(s - 1) <= ' ' || *(s - 1) == '-'))
@@ -926,12 +936,7 @@ void CCodeTables::RecognizeFileType(const char* pattern, int patternLen, BOOL fo
                         lastCodePage[l] = 0;
 
                         testBuf = buf;
-                        const char* src = pattern;
-                        const char* end = pattern + patternLen;
-                        char* dst = buf;
-                        char* table = Table->Data[i]->Table;
-                        while (src < end)
-                            *dst++ = table[(unsigned char)*src++];
+                        ConvertByTable(table, asciiPreserving, pattern, buf, patternLen);
                     }
                 }
             }
@@ -1145,3 +1150,190 @@ int CCodeTables::GetConversionToWinCodePage(const char* codePage)
     }
     return -1; // not found
 }
+
+//
+//*****************************************************************************
+// conversion through the encoding tables
+//
+
+BOOL IsAsciiPreservingTable(const char* table)
+{
+    int i;
+    for (i = 0; i < 128; i++)
+    {
+        if ((unsigned char)table[i] != i)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL IsAsciiOnly(const char* buf, int len)
+{
+    const unsigned char* s = (const unsigned char*)buf;
+    const unsigned char* end = s + len;
+    if (GetCpuFeatures() & CPU_FEATURE_SSE2)
+    {
+        __m128i acc = _mm_setzero_si128();
+        while (end - s >= 64) // OR four blocks together, test the high bits once per 64 bytes
+        {
+            acc = _mm_or_si128(acc, _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i*)s),
+                                                              _mm_loadu_si128((const __m128i*)(s + 16))),
+                                                 _mm_or_si128(_mm_loadu_si128((const __m128i*)(s + 32)),
+                                                              _mm_loadu_si128((const __m128i*)(s + 48)))));
+            if (_mm_movemask_epi8(acc) != 0)
+                return FALSE;
+            s += 64;
+        }
+        while (end - s >= 16)
+        {
+            if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)s)) != 0)
+                return FALSE;
+            s += 16;
+        }
+    }
+    while (s < end)
+    {
+        if (*s++ >= 128)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+void ConvertByTable(const char* table, BOOL asciiPreserving, const char* src, char* dst, int len)
+{
+    const unsigned char* t = (const unsigned char*)table;
+    const unsigned char* s = (const unsigned char*)src;
+    const unsigned char* end = s + len;
+    unsigned char* d = (unsigned char*)dst;
+    if (asciiPreserving && (GetCpuFeatures() & CPU_FEATURE_SSE2))
+    {
+        BOOL inPlace = (const unsigned char*)d == s;
+        while (end - s >= 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)s);
+            if (_mm_movemask_epi8(v) == 0) // only ASCII characters: nothing to convert
+            {
+                if (!inPlace)
+                    _mm_storeu_si128((__m128i*)d, v);
+            }
+            else
+            {
+                int i;
+                for (i = 0; i < 16; i++)
+                    d[i] = t[s[i]];
+            }
+            s += 16;
+            d += 16;
+        }
+    }
+    while (s < end)
+        *d++ = t[*s++];
+}
+
+#ifdef _DEBUG
+
+#define CODETBL_BENCH_SIZE (16 * 1024 * 1024) // size of the converted text
+#define CODETBL_BENCH_ROUNDS 4                // conversions of the text for each table and way
+#define CODETBL_BENCH_RECOGNIZE 1000          // RecognizeFileType() calls
+#define CODETBL_BENCH_RECOGNIZE_LEN 10000     // tested data size (as RECOGNIZE_FILE_TYPE_BUFFER_LEN in the viewer)
+
+void CodeTablesBenchmark(const char* dir)
+{
+    // text with words of ASCII letters, about 3% of characters are national ones (>= 128)
+    char* text = (char*)malloc(CODETBL_BENCH_SIZE);
+    char* out1 = (char*)malloc(CODETBL_BENCH_SIZE);
+    char* out2 = (char*)malloc(CODETBL_BENCH_SIZE);
+    if (text == NULL || out1 == NULL || out2 == NULL)
+    {
+        TRACE_E("CodeTablesBenchmark(): " << LOW_MEMORY);
+        if (text != NULL)
+            free(text);
+        if (out1 != NULL)
+            free(out1);
+        if (out2 != NULL)
+            free(out2);
+        return;
+    }
+    DWORD seed = 12345;
+    int i;
+    for (i = 0; i < CODETBL_BENCH_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        DWORD r = (seed >> 16) & 0x7FFF;
+        if (r % 97 == 0)
+            text[i] = '\n';
+        else if (r % 7 == 0)
+            text[i] = ' ';
+        else if (r % 33 == 0)
+            text[i] = (char)(0xC0 + (r & 0x3F));
+        else
+            text[i] = (char)('a' + r % 26);
+    }
+
+    LARGE_INTEGER freq, start;
+    QueryPerformanceFrequency(&freq);
+    const double megs = (double)CODETBL_BENCH_SIZE * CODETBL_BENCH_ROUNDS / (1024 * 1024);
+    int index = 0;
+    const char* name;
+    const char* table;
+    while (CodeTables.EnumCodeTables(NULL, &index, &name, &table))
+    {
+        if (name == NULL)
+            continue; // separator
+        const unsigned char* t = (const unsigned char*)table;
+        BOOL asciiPreserving = IsAsciiPreservingTable(table);
+
+        QueryPerformanceCounter(&start);
+        int round;
+        for (round = 0; round < CODETBL_BENCH_ROUNDS; round++)
+        {
+            const unsigned char* s = (const unsigned char*)text;
+            const unsigned char* end = s + CODETBL_BENCH_SIZE;
+            unsigned char* d = (unsigned char*)out1;
+            while (s < end)
+                *d++ = t[*s++];
+        }
+        double scalar = BenchSeconds(start, freq);
+
+        QueryPerformanceCounter(&start);
+        for (round = 0; round < CODETBL_BENCH_ROUNDS; round++)
+            ConvertByTable(table, asciiPreserving, text, out2, CODETBL_BENCH_SIZE);
+        double vector = BenchSeconds(start, freq);
+
+        if (memcmp(out1, out2, CODETBL_BENCH_SIZE) != 0)
+            TRACE_E("CodeTablesBenchmark(): ConvertByTable() returned a different result for " << name);
+        memcpy(out2, text, CODETBL_BENCH_SIZE);
+        ConvertByTable(table, asciiPreserving, out2, out2, CODETBL_BENCH_SIZE);
+        if (memcmp(out1, out2, CODETBL_BENCH_SIZE) != 0)
+            TRACE_E("CodeTablesBenchmark(): ConvertByTable() in place returned a different result for " << name);
+
+        TRACE_I("CodeTablesBenchmark(): " << name << (asciiPreserving ? "" : " (not preserving ASCII)") << ": bytewise " << (DWORD)(scalar > 0 ? megs / scalar : 0) << " MB/s, ConvertByTable " << (DWORD)(vector > 0 ? megs / vector : 0) << " MB/s");
+    }
+
+    // text type detection of text and of "binary" data (control characters in the ASCII range)
+    for (i = 0; i < 2; i++)
+    {
+        char* pattern = out1;
+        memcpy(pattern, text, CODETBL_BENCH_RECOGNIZE_LEN);
+        if (i == 1)
+        {
+            int j;
+            for (j = 0; j < CODETBL_BENCH_RECOGNIZE_LEN; j++)
+                pattern[j] = (char)((BYTE)pattern[j] & 0x1F);
+        }
+        BOOL isText;
+        char codePage[101];
+        QueryPerformanceCounter(&start);
+        int round;
+        for (round = 0; round < CODETBL_BENCH_RECOGNIZE; round++)
+            CodeTables.RecognizeFileType(pattern, CODETBL_BENCH_RECOGNIZE_LEN, FALSE, &isText, codePage);
+        double seconds = BenchSeconds(start, freq);
+        TRACE_I("CodeTablesBenchmark(): RecognizeFileType() on " << (i == 0 ? "text" : "binary data") << ": " << (DWORD)(seconds * 1000000 / CODETBL_BENCH_RECOGNIZE) << " us per call (isText=" << isText << ", code page " << codePage << ")");
+    }
+
+    free(text);
+    free(out1);
+    free(out2);
+}
+
+#endif // _DEBUG
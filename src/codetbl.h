@@ -119,3 +119,25 @@ public:
 };
 
 extern CCodeTables CodeTables;
+
+// ****************************************************************************
+// conversion through the encoding tables (CCodeTablesData::Table)
+
+// returns TRUE if 'table' leaves the ASCII characters (0-127) unchanged (true for all tables
+// except EBCDIC ones); such tables can be used in ConvertByTable() with 'asciiPreserving' TRUE
+BOOL IsAsciiPreservingTable(const char* table);
+
+// returns TRUE if 'buf' of length 'len' contains only ASCII characters (0-127)
+BOOL IsAsciiOnly(const char* buf, int len);
+
+// converts 'len' characters from 'src' into 'dst' through the encoding table 'table';
+// 'src' and 'dst' may be the same buffer (conversion in place), otherwise they must not
+// overlap; 'asciiPreserving' is the result of IsAsciiPreservingTable(table): with TRUE,
+// runs of ASCII characters are only copied (skipped in place) 16 characters at a time
+void ConvertByTable(const char* table, BOOL asciiPreserving, const char* src, char* dst, int len);
+
+#ifdef _DEBUG
+// compares the speed of ConvertByTable() with the conversion one character at a time
+// for all encoding tables and measures RecognizeFileType() (see bench.h)
+void CodeTablesBenchmark(const char* dir);
+#endif // _DEBUG
@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// ****************************************************************************
+// Runtime detection of CPU features used to select vectorized code paths
+// ****************************************************************************
+
+#pragma once
+
+#include <intrin.h>
+
+#define CPU_FEATURE_SSE2 0x00000001
+#define CPU_FEATURE_SSSE3 0x00000002
+#define CPU_FEATURE_SSE41 0x00000004
+#define CPU_FEATURE_SSE42 0x00000008
+#define CPU_FEATURE_PCLMUL 0x00000010 // PCLMULQDQ (carry-less multiplication)
+#define CPU_FEATURE_AVX2 0x00000020   // set only if the OS saves YMM registers
+#define CPU_FEATURE_SHA 0x00000040    // SHA-NI extensions
+#define CPU_FEATURE_BMI2 0x00000080
+
+// returns CPU_FEATURE_xxx flags of the current CPU; the result is computed at the first
+// call and cached (concurrent first calls are harmless, they compute the same value)
+inline DWORD GetCpuFeatures()
+{
+    static volatile LONG cachedFeatures = -1;
+    if (cachedFeatures != -1)
+        return (DWORD)cachedFeatures;
+
+    DWORD features = 0;
+    int regs[4]; // EAX, EBX, ECX, EDX
+    __cpuid(regs, 0);
+    int maxLeaf = regs[0];
+    if (maxLeaf >= 1)
+    {
+        __cpuid(regs, 1);
+        if (regs[3] & (1 << 26))
+            features |= CPU_FEATURE_SSE2;
+        if (regs[2] & (1 << 9))
+            features |= CPU_FEATURE_SSSE3;
+        if (regs[2] & (1 << 19))
+            features |= CPU_FEATURE_SSE41;
+        if (regs[2] & (1 << 20))
+            features |= CPU_FEATURE_SSE42;
+        if (regs[2] & (1 << 1))
+            features |= CPU_FEATURE_PCLMUL;
+        BOOL osAVX = (regs[2] & (1 << 27)) != 0 && // OSXSAVE
+                     (regs[2] & (1 << 28)) != 0 && // AVX
+                     (_xgetbv(0) & 6) == 6;        // XMM and YMM state enabled by the OS
+        if (maxLeaf >= 7)
+        {
+            __cpuidex(regs, 7, 0);
+            if (osAVX && (regs[1] & (1 << 5)))
+                features |= CPU_FEATURE_AVX2;
+            if (regs[1] & (1 << 29))
+                features |= CPU_FEATURE_SHA;
+            if (regs[1] & (1 << 8))
+                features |= CPU_FEATURE_BMI2;
+        }
+    }
+    cachedFeatures = (LONG)features;
+    return features;
+}
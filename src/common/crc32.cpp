@@ -7,6 +7,11 @@
 
 #pragma warning(3 : 4706) // warning C4706: assignment within conditional expression
 
+#include "trace.h"
+
+#include <immintrin.h>
+
+#include "cpuinfo.h"
 #include "crc32.h"
 
 #ifdef STATIC_CRC_TAB
@@ -93,42 +98,343 @@ void MakeCrcTable(DWORD* crcTab)
     }
 }
 
-DWORD UpdateCrc(char* buffer, unsigned length, DWORD crcVal, const DWORD* crcTab)
+//
+// ****************************************************************************
+// CRC kernels
+//
+// All kernels work with the inverted value of the CRC (the contents of the shift register).
+// Slice-by-16 processes 16 bytes by 16 table lookups, CrcTabs[k][n] is the CRC of the byte 'n'
+// followed by 'k' zero bytes. The PCLMULQDQ kernel folds 64 bytes per iteration by carry-less
+// multiplication (Intel: "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+// Instruction"), the rest is finished by slice-by-16.
+//
+
+#define CRC_POLY 0xedb88320
+
+#define CRC_KERNEL_BYTE 0    // one table lookup per byte (original implementation)
+#define CRC_KERNEL_SLICE16 1 // slice-by-16
+#define CRC_KERNEL_PCLMUL 2  // carry-less multiplication + slice-by-16
+
+static DWORD CrcTabs[16][256];
+static DWORD CrcX2nTab[32];                // x^(2^n) modulo the polynomial (for CombineCrc)
+static volatile LONG CrcKernel = -1;       // CRC_KERNEL_XXX used by UpdateCrc, -1 = tables are not ready
+static const DWORD* CrcTab = CrcTabs[0];   // table for the byte-wise processing
+
+// multiplies 'a' and 'b' modulo the polynomial (both are reflected, x^0 is the highest bit)
+static DWORD CrcMultModP(DWORD a, DWORD b)
+{
+    DWORD m = (DWORD)1 << 31;
+    DWORD p = 0;
+    while (1)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC_POLY : b >> 1;
+    }
+    return p;
+}
+
+// returns x^(n * 2^k) modulo the polynomial
+static DWORD CrcX2nModP(unsigned __int64 n, int k)
 {
-    register DWORD c; /* temporary variable */
+    DWORD p = (DWORD)1 << 31; // x^0
+    while (n)
+    {
+        if (n & 1)
+            p = CrcMultModP(CrcX2nTab[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
 
-    if (buffer == 0)
+// prepares tables and selects the kernel; concurrent calls are harmless (they compute the same
+// values, CrcKernel is set last)
+static void InitCrcKernels()
+{
+#ifdef STATIC_CRC_TAB
+    memcpy(CrcTabs[0], StaticCrcTab, sizeof(CrcTabs[0]));
+#else
+    MakeCrcTable(CrcTabs[0]);
+#endif
+    int n, k;
+    for (n = 0; n < 256; n++)
+    {
+        DWORD c = CrcTabs[0][n];
+        for (k = 1; k < 16; k++)
+        {
+            c = CrcTabs[0][c & 0xff] ^ (c >> 8);
+            CrcTabs[k][n] = c;
+        }
+    }
+    DWORD p = (DWORD)1 << 30; // x^1
+    CrcX2nTab[0] = p;
+    for (n = 1; n < 32; n++)
+        CrcX2nTab[n] = p = CrcMultModP(p, p);
+
+    DWORD cpu = GetCpuFeatures();
+    CrcKernel = (cpu & CPU_FEATURE_PCLMUL) && (cpu & CPU_FEATURE_SSE41) ? CRC_KERNEL_PCLMUL : CRC_KERNEL_SLICE16;
+}
+
+static DWORD CrcByteWise(const BYTE* buffer, DWORD length, DWORD c)
+{
+    while (length--)
+        c = CrcTab[(c ^ *buffer++) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+static DWORD CrcSlice16(const BYTE* buffer, DWORD length, DWORD c)
+{
+    while (length >= 16)
+    {
+        DWORD a = c ^ *(const DWORD UNALIGNED*)buffer;
+        DWORD b = *(const DWORD UNALIGNED*)(buffer + 4);
+        DWORD d = *(const DWORD UNALIGNED*)(buffer + 8);
+        DWORD e = *(const DWORD UNALIGNED*)(buffer + 12);
+        c = CrcTabs[15][a & 0xff] ^ CrcTabs[14][(a >> 8) & 0xff] ^
+            CrcTabs[13][(a >> 16) & 0xff] ^ CrcTabs[12][a >> 24] ^
+            CrcTabs[11][b & 0xff] ^ CrcTabs[10][(b >> 8) & 0xff] ^
+            CrcTabs[9][(b >> 16) & 0xff] ^ CrcTabs[8][b >> 24] ^
+            CrcTabs[7][d & 0xff] ^ CrcTabs[6][(d >> 8) & 0xff] ^
+            CrcTabs[5][(d >> 16) & 0xff] ^ CrcTabs[4][d >> 24] ^
+            CrcTabs[3][e & 0xff] ^ CrcTabs[2][(e >> 8) & 0xff] ^
+            CrcTabs[1][(e >> 16) & 0xff] ^ CrcTabs[0][e >> 24];
+        buffer += 16;
+        length -= 16;
+    }
+    return CrcByteWise(buffer, length, c);
+}
+
+// 'length' must be at least 64 and a multiple of 16
+static DWORD CrcPclmul(const BYTE* buffer, DWORD length, DWORD c)
+{
+    // x^(4*128+32) mod P, x^(4*128-32) mod P; x^(128+32) mod P, x^(128-32) mod P;
+    // x^64 mod P; floor(x^64 / P) and P (both with the x^32 term)
+    static const __declspec(align(16)) unsigned __int64 k1k2[2] = {0x0154442bd4, 0x01c6e41596};
+    static const __declspec(align(16)) unsigned __int64 k3k4[2] = {0x01751997d0, 0x00ccaa009e};
+    static const __declspec(align(16)) unsigned __int64 k5k0[2] = {0x0163cd6124, 0x0000000000};
+    static const __declspec(align(16)) unsigned __int64 poly[2] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buffer + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buffer + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buffer + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buffer + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+    buffer += 64;
+    length -= 64;
+
+    // fold four 128-bit lanes by 512 bits
+    while (length >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i*)(buffer + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buffer + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buffer + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buffer + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buffer += 64;
+        length -= 64;
+    }
+
+    // fold the lanes into one
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // fold the remaining 16-byte blocks
+    while (length >= 16)
     {
-        return c = INIT_CRC;
+        x2 = _mm_loadu_si128((const __m128i*)buffer);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buffer += 16;
+        length -= 16;
     }
-    else
+
+    // reduce 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (DWORD)_mm_extract_epi32(x1, 1);
+}
+
+static DWORD UpdateCrcKernel(int kernel, const BYTE* buffer, DWORD length, DWORD c)
+{
+    switch (kernel)
+    {
+    case CRC_KERNEL_PCLMUL:
     {
-        c = crcVal ^ 0xffffffffL;
-        int i = length % 8;
-        length -= i;
-        while (i)
+        if (length >= 64)
         {
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            i--;
+            DWORD blocks = length & ~15;
+            c = CrcPclmul(buffer, blocks, c);
+            buffer += blocks;
+            length -= blocks;
         }
-        while (length)
+        return CrcSlice16(buffer, length, c);
+    }
+
+    case CRC_KERNEL_SLICE16:
+        return CrcSlice16(buffer, length, c);
+
+    default:
+        return CrcByteWise(buffer, length, c);
+    }
+}
+
+DWORD UpdateCrc(char* buffer, unsigned length, DWORD crcVal, const DWORD* crcTab)
+{
+    if (buffer == 0)
+        return INIT_CRC;
+
+    if (CrcKernel == -1)
+        InitCrcKernels();
+    return UpdateCrcKernel(CrcKernel, (const BYTE*)buffer, length, crcVal ^ 0xffffffffL) ^ 0xffffffffL;
+}
+
+DWORD CombineCrc(DWORD crc1, DWORD crc2, unsigned __int64 length2)
+{
+    if (CrcKernel == -1)
+        InitCrcKernels();
+    return CrcMultModP(CrcX2nModP(length2, 3), crc1) ^ crc2;
+}
+
+//
+// ****************************************************************************
+// CrcBenchmark
+//
+
+#ifdef _DEBUG
+
+#define CRC_BENCH_SIZE (64 * 1024 * 1024) // size of the data
+#define CRC_BENCH_ROUNDS 4                // number of passes over the data per measurement
+
+static const char* CrcKernelNames[] = {"byte-wise", "slice-by-16", "PCLMULQDQ"};
+
+// compares all kernels with the byte-wise processing by StaticCrcTab on various lengths and
+// alignments, checks CombineCrc on splits of the data; returns TRUE if everything matches
+static BOOL CrcSelfTest(const BYTE* data)
+{
+    BOOL ok = TRUE;
+    static const char check[] = "123456789";
+    if (UpdateCrc((char*)check, 9, INIT_CRC, NULL) != 0xcbf43926)
+    {
+        TRACE_E("CrcSelfTest(): wrong CRC of the check string.");
+        ok = FALSE;
+    }
+    int kernelCount = CrcKernel == CRC_KERNEL_PCLMUL ? 3 : 2;
+    DWORD length;
+    for (length = 0; length < 2048 && ok; length += length < 300 ? 1 : 37)
+    {
+        int offset;
+        for (offset = 0; offset < 16 && ok; offset += 5)
         {
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-            length -= 8;
+            DWORD expected = 0xffffffff;
+            DWORD i;
+            for (i = 0; i < length; i++)
+                expected = StaticCrcTab[(expected ^ data[offset + i]) & 0xff] ^ (expected >> 8);
+            int kernel;
+            for (kernel = 0; kernel < kernelCount; kernel++)
+            {
+                if (UpdateCrcKernel(kernel, data + offset, length, 0xffffffff) != expected)
+                {
+                    TRACE_E("CrcSelfTest(): " << CrcKernelNames[kernel] << " failed at length " << length << ", offset " << offset);
+                    ok = FALSE;
+                }
+            }
+            DWORD split = length / 3;
+            DWORD crc1 = UpdateCrc((char*)data + offset, split, INIT_CRC, NULL);
+            DWORD crc2 = UpdateCrc((char*)data + offset + split, length - split, INIT_CRC, NULL);
+            if (CombineCrc(crc1, crc2, length - split) != (expected ^ 0xffffffff))
+            {
+                TRACE_E("CrcSelfTest(): CombineCrc failed at length " << length << ", split " << split);
+                ok = FALSE;
+            }
         }
-        /*
-    if (length) do 
+    }
+    return ok;
+}
+
+void CrcBenchmark(const char* dir)
+{
+    BYTE* data = (BYTE*)malloc(CRC_BENCH_SIZE);
+    if (data == NULL)
+    {
+        TRACE_E("CrcBenchmark(): " << LOW_MEMORY);
+        return;
+    }
+    DWORD seed = 12345;
+    int i;
+    for (i = 0; i < CRC_BENCH_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (BYTE)(seed >> 16);
+    }
+
+    if (CrcKernel == -1)
+        InitCrcKernels();
+    TRACE_I("CrcBenchmark(): self-test " << (CrcSelfTest(data) ? "passed" : "FAILED"));
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    int kernelCount = CrcKernel == CRC_KERNEL_PCLMUL ? 3 : 2;
+    DWORD crcs[3];
+    int kernel;
+    for (kernel = 0; kernel < kernelCount; kernel++)
     {
-      c = crcTab[((int)c ^ (*buffer++)) & 0xff] ^ (c >> 8);
-    } while (--length);
-    */
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        int round;
+        for (round = 0; round < CRC_BENCH_ROUNDS; round++)
+            crcs[kernel] = UpdateCrcKernel(kernel, data, CRC_BENCH_SIZE, 0xffffffff);
+        QueryPerformanceCounter(&end);
+        double seconds = (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+        DWORD speed = seconds > 0 ? (DWORD)((double)CRC_BENCH_SIZE * CRC_BENCH_ROUNDS / (1024 * 1024) / seconds) : 0;
+        TRACE_I("CrcBenchmark(): " << CrcKernelNames[kernel] << " " << speed << " MB/s");
+        if (crcs[kernel] != crcs[0])
+            TRACE_E("CrcBenchmark(): " << CrcKernelNames[kernel] << " returned a different CRC!");
     }
-    return c ^ 0xffffffffL; /* (instead of ~c for 64-bit machines) */
-}
\ No newline at end of file
+    free(data);
+}
+
+#endif // _DEBUG
@@ -3,7 +3,7 @@
 
 #pragma once
 
-//#define STATIC_CRC_TAB
+#define STATIC_CRC_TAB
 
 //size of crc tab in the memory
 #define CRC_TAB_SIZE 256 * sizeof(DWORD)
@@ -21,4 +21,16 @@ void MakeCrcTable(DWORD* crcTab);
 //run a set of bytes through the crc shift register, if buffer is a NULL
 //pointer, then initialize the crc shift register contents instead
 //return the current crc in either case
+//the kernel (PCLMULQDQ or slice-by-16) is selected by the CPU, it uses its own tables,
+//'crcTab' is not used any more (kept for compatibility, may be NULL)
 DWORD UpdateCrc(char* buffer, unsigned length, DWORD crcVal, const DWORD* crcTab);
+
+//returns crc of the concatenation of two blocks of data: 'crc1' of the first block and 'crc2'
+//of the second block with 'length2' bytes (blocks can be processed in parallel and merged)
+DWORD CombineCrc(DWORD crc1, DWORD crc2, unsigned __int64 length2);
+
+#ifdef _DEBUG
+//checks the kernels against the byte-wise processing by StaticCrcTab and measures
+//their speed (see bench.h)
+void CrcBenchmark(const char* dir);
+#endif // _DEBUG
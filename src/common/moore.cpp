@@ -19,7 +19,10 @@
 #include "messages.h"
 #include "handles.h"
 
+#include <immintrin.h>
+
 #include "str.h"
+#include "cpuinfo.h"
 #include "moore.h"
 
 //
@@ -148,6 +151,145 @@ void CSearchData::SetFlags(WORD flags)
         }
     }
     Initialize();
+    SetVectorSearch();
+}
+
+//
+// ****************************************************************************
+// SetVectorSearch
+//
+
+// returns in 'chars' the character 'c' and the character with the same lowercase
+// form; returns FALSE if there are more than two such characters (the vector filter
+// compares only two variants)
+static BOOL GetCaseVariants(BYTE c, BOOL caseSensitive, BYTE* chars)
+{
+    chars[0] = chars[1] = c;
+    if (!caseSensitive)
+    {
+        int count = 0;
+        int i;
+        for (i = 0; i < 256; i++)
+        {
+            if (LowerCase[i] == LowerCase[c])
+            {
+                if (count == 2)
+                    return FALSE;
+                chars[count++] = (BYTE)i;
+            }
+        }
+    }
+    return TRUE;
+}
+
+void CSearchData::SetVectorSearch()
+{
+    VectorSearch = svsNone;
+    // the vector search uses OriginalPattern, it cannot search backward
+    if (OriginalPattern == NULL || Length == 0 || (Flags & sfForward) == 0 || !IsGood())
+        return;
+
+    DWORD cpu = GetCpuFeatures();
+    if ((cpu & CPU_FEATURE_SSE2) == 0)
+        return;
+    BOOL caseSensitive = (Flags & sfCaseSensitive) != 0;
+    if (!GetCaseVariants((BYTE)OriginalPattern[0], caseSensitive, FirstChars) ||
+        !GetCaseVariants((BYTE)OriginalPattern[Length - 1], caseSensitive, LastChars))
+    {
+        return;
+    }
+    VectorSearch = (cpu & CPU_FEATURE_AVX2) ? svsAVX2 : svsSSE2;
+}
+
+//
+// ****************************************************************************
+// SearchForwardVector
+//
+
+// verifies a candidate found by the vector filter; the first and the last character
+// were already compared by the filter
+static inline BOOL VerifyCandidate(const char* text, const char* pattern, int length, BOOL caseSensitive)
+{
+    if (length <= 2)
+        return TRUE;
+    if (caseSensitive)
+        return memcmp(text + 1, pattern + 1, length - 2) == 0;
+    int i;
+    for (i = 1; i < length - 1; i++)
+    {
+        if (LowerCase[(BYTE)text[i]] != LowerCase[(BYTE)pattern[i]])
+            return FALSE;
+    }
+    return TRUE;
+}
+
+int CSearchData::SearchForwardVector(const char* text, int length, int start)
+{
+    BOOL caseSensitive = (Flags & sfCaseSensitive) != 0;
+    const char* pattern = OriginalPattern;
+    int l1 = Length - 1;
+    int i = start;
+
+    // the loops read only up to text[length - 1], mapped views of files may end right there
+    if (VectorSearch == svsAVX2)
+    {
+        __m256i first0 = _mm256_set1_epi8((char)FirstChars[0]);
+        __m256i first1 = _mm256_set1_epi8((char)FirstChars[1]);
+        __m256i last0 = _mm256_set1_epi8((char)LastChars[0]);
+        __m256i last1 = _mm256_set1_epi8((char)LastChars[1]);
+        for (; i + l1 + 32 <= length; i += 32)
+        {
+            __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(text + i));
+            __m256i blockLast = _mm256_loadu_si256((const __m256i*)(text + i + l1));
+            __m256i eqFirst = _mm256_or_si256(_mm256_cmpeq_epi8(blockFirst, first0),
+                                              _mm256_cmpeq_epi8(blockFirst, first1));
+            __m256i eqLast = _mm256_or_si256(_mm256_cmpeq_epi8(blockLast, last0),
+                                             _mm256_cmpeq_epi8(blockLast, last1));
+            unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(eqFirst, eqLast));
+            while (mask != 0)
+            {
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+                if (VerifyCandidate(text + i + bit, pattern, Length, caseSensitive))
+                    return i + (int)bit;
+                mask &= mask - 1;
+            }
+        }
+    }
+
+    __m128i first0 = _mm_set1_epi8((char)FirstChars[0]);
+    __m128i first1 = _mm_set1_epi8((char)FirstChars[1]);
+    __m128i last0 = _mm_set1_epi8((char)LastChars[0]);
+    __m128i last1 = _mm_set1_epi8((char)LastChars[1]);
+    for (; i + l1 + 16 <= length; i += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i*)(text + i + l1));
+        __m128i eqFirst = _mm_or_si128(_mm_cmpeq_epi8(blockFirst, first0), _mm_cmpeq_epi8(blockFirst, first1));
+        __m128i eqLast = _mm_or_si128(_mm_cmpeq_epi8(blockLast, last0), _mm_cmpeq_epi8(blockLast, last1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast));
+        while (mask != 0)
+        {
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            if (VerifyCandidate(text + i + bit, pattern, Length, caseSensitive))
+                return i + (int)bit;
+            mask &= mask - 1;
+        }
+    }
+
+    // the rest is shorter than one vector
+    for (; i + l1 < length; i++)
+    {
+        BYTE c = (BYTE)text[i];
+        BYTE d = (BYTE)text[i + l1];
+        if ((c == FirstChars[0] || c == FirstChars[1]) && (d == LastChars[0] || d == LastChars[1]) &&
+            VerifyCandidate(text + i, pattern, Length, caseSensitive))
+        {
+            return i;
+        }
+    }
+    return -1;
 }
 
 void CSearchData::Set(const char* pattern, WORD flags)
@@ -203,3 +345,80 @@ void CSearchData::Set(const char* pattern, const int length, WORD flags)
     }
     SetFlags(flags);
 }
+
+//
+// ****************************************************************************
+// SearchDataBenchmark
+//
+
+#ifdef _DEBUG
+
+#define SEARCH_BENCH_SIZE (64 * 1024 * 1024) // size of the searched text
+#define SEARCH_BENCH_ROUNDS 4                // number of searches of the whole text per measurement
+
+// searches the whole 'text' (the pattern is not there) SEARCH_BENCH_ROUNDS times and
+// returns the speed in MB/s
+static DWORD SearchDataBenchmarkRun(CSearchData* search, const char* text, BOOL vector)
+{
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    int found = 0;
+    int round;
+    for (round = 0; round < SEARCH_BENCH_ROUNDS; round++)
+    {
+        if (vector)
+            found += search->SearchForward(text, SEARCH_BENCH_SIZE, 0);
+        else
+            found += search->SearchForwardBM(text, SEARCH_BENCH_SIZE, 0);
+    }
+    QueryPerformanceCounter(&end);
+    if (found != -SEARCH_BENCH_ROUNDS)
+        TRACE_E("SearchDataBenchmark(): unexpected match of the pattern!");
+    double seconds = (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+    if (seconds <= 0)
+        return 0;
+    return (DWORD)((double)SEARCH_BENCH_SIZE * SEARCH_BENCH_ROUNDS / (1024 * 1024) / seconds);
+}
+
+void SearchDataBenchmark(const char* dir)
+{
+    // text of pseudo-random lowercase letters and spaces; the searched patterns end with
+    // a digit, so they are found neither case sensitively nor insensitively
+    char* text = (char*)malloc(SEARCH_BENCH_SIZE);
+    if (text == NULL)
+    {
+        TRACE_E("SearchDataBenchmark(): " << LOW_MEMORY);
+        return;
+    }
+    DWORD seed = 12345;
+    int i;
+    for (i = 0; i < SEARCH_BENCH_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        BYTE r = (BYTE)(seed >> 16);
+        text[i] = r % 7 == 0 ? ' ' : (char)('a' + r % 26);
+    }
+
+    static const char* patterns[] = {"the1", "quick brown fox jumps over laz1"};
+    int p;
+    for (p = 0; p < _countof(patterns); p++)
+    {
+        int cs;
+        for (cs = 1; cs >= 0; cs--)
+        {
+            CSearchData search;
+            search.Set(patterns[p], (WORD)(sfForward | (cs ? sfCaseSensitive : 0)));
+            DWORD bm = SearchDataBenchmarkRun(&search, text, FALSE);
+            DWORD vector = SearchDataBenchmarkRun(&search, text, TRUE);
+            TRACE_I("SearchDataBenchmark(): pattern length " << search.GetLength()
+                                                               << (cs ? ", case sensitive" : ", case insensitive")
+                                                               << ": Boyer-Moore " << bm << " MB/s, vector ("
+                                                               << (GetCpuFeatures() & CPU_FEATURE_AVX2 ? "AVX2" : "SSE2")
+                                                               << ") " << vector << " MB/s");
+        }
+    }
+    free(text);
+}
+
+#endif // _DEBUG
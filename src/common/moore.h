@@ -3,6 +3,12 @@
 
 // ****************************************************************************
 // Boyer-Moore algorithm for substring search
+//
+// Forward searches in longer texts use a vectorized algorithm (SSE2 or AVX2 is
+// selected at runtime): blocks of 16/32 positions are filtered by comparing the
+// first and the last character of the pattern at once and only the candidates
+// are verified. Case insensitive search compares both case variants of these
+// characters, so it does not need the lowercase copy of the pattern.
 // ****************************************************************************
 
 #pragma once
@@ -11,6 +17,14 @@
 #define sfCaseSensitive 0x01 // 0. bit = 1
 #define sfForward 0x02       // 1. bit = 1
 
+// minimal length of text for the vectorized search, shorter texts are searched by Boyer-Moore
+#define VECTOR_SEARCH_MIN_TEXT 64
+
+// vectorized search used by CSearchData::SearchForward
+#define svsNone 0 // not available (CPU, backward search or too many case variants of the first/last character)
+#define svsSSE2 1
+#define svsAVX2 2
+
 // ****************************************************************************
 
 class CSearchData
@@ -23,6 +37,9 @@ public:
         Length = 0;
         Pattern = NULL;
         Flags = 0;
+        VectorSearch = svsNone;
+        FirstChars[0] = FirstChars[1] = 0;
+        LastChars[0] = LastChars[1] = 0;
     }
 
     ~CSearchData()
@@ -56,16 +73,29 @@ public:
     inline int SearchForward(const char* text, int length, int start);
     inline int SearchBackward(const char* text, int length);
 
+    // forward search using only Boyer-Moore (SearchForward uses it for short texts)
+    inline int SearchForwardBM(const char* text, int length, int start);
+
 protected:
     int Minimum(int a, int b) { return (a < b) ? a : b; }
     int Maximum(int a, int b) { return (a > b) ? a : b; }
 
+    // vectorized forward search, called from SearchForward only if VectorSearch != svsNone
+    int SearchForwardVector(const char* text, int length, int start);
+
+    // chooses VectorSearch and fills FirstChars and LastChars; called from SetFlags
+    void SetVectorSearch();
+
     int* Fail1;            // fail array for current character
     int* Fail2;            // fail array for substring occurrence from right
     char* OriginalPattern; // original search pattern
     char* Pattern;         // search pattern in appropriate form (Flag)
     int Length;            // pattern length
 
+    BYTE VectorSearch;  // svsXXX: vectorized algorithm used by SearchForward
+    BYTE FirstChars[2]; // first character of the pattern (both case variants for case insensitive search)
+    BYTE LastChars[2];  // last character of the pattern (both case variants for case insensitive search)
+
 private:
     BOOL Initialize(); // called only from SetFlags
 
@@ -82,6 +112,13 @@ private:
 //
 
 int CSearchData::SearchForward(const char* text, int length, int start)
+{
+    if (VectorSearch != svsNone && length - start >= VECTOR_SEARCH_MIN_TEXT)
+        return SearchForwardVector(text, length, start);
+    return SearchForwardBM(text, length, start);
+}
+
+int CSearchData::SearchForwardBM(const char* text, int length, int start)
 {
     int l1 = Length - 1;
     int i, j = l1 + start;
@@ -163,3 +200,8 @@ int CSearchData::SearchBackward(const char* text, int length)
     }
     return -1;
 }
+
+#ifdef _DEBUG
+// compares Boyer-Moore with the vectorized search on short and long patterns (see bench.h)
+void SearchDataBenchmark(const char* dir);
+#endif // _DEBUG
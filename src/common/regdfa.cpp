@@ -0,0 +1,984 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include <windows.h>
+#include <crtdbg.h>
+#include <ostream>
+
+#if defined(_DEBUG) && defined(_MSC_VER) // without passing file+line to 'new' operator, list of memory leaks shows only 'crtdbg.h(552)'
+#define new new (_NORMAL_BLOCK, __FILE__, __LINE__)
+#endif
+
+#pragma warning(3 : 4706) // warning C4706: assignment within conditional expression
+
+#include "trace.h"
+#include "messages.h"
+#include "handles.h"
+
+#include "str.h"
+#include "moore.h"
+#include "regexp.h"
+#include "regdfa.h"
+
+// NFA node types
+#define rdnChar 0  // one character from the set 'Set', then 'Out'
+#define rdnSplit 1 // 'Out' or 'Out1'
+#define rdnEmpty 2 // 'Out'
+#define rdnBOL 3   // beginning of line, then 'Out'
+#define rdnEOL 4   // end of line, then 'Out'
+#define rdnMatch 5 // the whole expression matched
+
+// term types
+#define rdtSet 0   // character from the set 'Left'
+#define rdtBOL 1   // ^
+#define rdtEOL 2   // $
+#define rdtEmpty 3 // empty branch
+#define rdtCat 4   // 'Left' followed by 'Right'
+#define rdtAlt 5   // 'Left' | 'Right'
+#define rdtStar 6  // 'Left'*
+#define rdtPlus 7  // 'Left'+
+#define rdtQuest 8 // 'Left'?
+
+// DFA state flags
+#define rsfLineStart 0x01 // state at the beginning of line (^ can match)
+#define rsfAtEOL 0x02     // match is found if the line ends in this state
+
+// final DFA states
+#define RDFA_DEAD 0        // no match is possible in the rest of the line
+#define RDFA_MATCH 1       // match found
+#define RDFA_FIRST_STATE 2 // first ordinary state
+
+#define RDFA_CACHE_SIZE (256 * 1024) // size of the transition table when the cache of states is flushed
+#define RDFA_MIN_STATES 64           // the cache holds at least this number of states...
+#define RDFA_MAX_STATES 4096         // ...and at most this number
+#define RDFA_MIN_LITERAL 2           // minimal length of the literal for the prefilter
+
+#define RDFA_SET_SIZE 8 // DWORDs of one character set
+
+#define RDFA_IS_MULT(c) ((c) == '*' || (c) == '+' || (c) == '?')
+
+//
+// ****************************************************************************
+// CRegExpDFA
+//
+
+CRegExpDFA::CRegExpDFA()
+{
+    Nodes = NULL;
+    NodesCount = 0;
+    StartNode = -1;
+    Sets = NULL;
+    SetsCount = 0;
+    ClassCount = 0;
+    Trans = NULL;
+    StateSetOffs = NULL;
+    StateSetCount = NULL;
+    StateFlags = NULL;
+    StatesCount = 0;
+    StatesAllocated = 0;
+    MaxStates = 0;
+    FlushCount = 0;
+    SetPool = NULL;
+    SetPoolUsed = 0;
+    SetPoolAllocated = 0;
+    Hash = NULL;
+    HashSize = 0;
+    LineStartState = -1;
+    Unanchored = NULL;
+    UnanchoredCount = 0;
+    Work = NULL;
+    WorkCount = 0;
+    WorkMatch = FALSE;
+    Stack = NULL;
+    Mark = NULL;
+    MarkGen = 0;
+    UseLiteral = FALSE;
+    Parse = NULL;
+    Terms = NULL;
+    TermsCount = 0;
+    TermsAllocated = 0;
+    SetsAllocated = 0;
+}
+
+void CRegExpDFA::Release()
+{
+    if (Nodes != NULL)
+        free(Nodes);
+    if (Sets != NULL)
+        free(Sets);
+    if (Trans != NULL)
+        free(Trans);
+    if (StateSetOffs != NULL)
+        free(StateSetOffs);
+    if (StateSetCount != NULL)
+        free(StateSetCount);
+    if (StateFlags != NULL)
+        free(StateFlags);
+    if (SetPool != NULL)
+        free(SetPool);
+    if (Hash != NULL)
+        free(Hash);
+    if (Unanchored != NULL)
+        free(Unanchored);
+    if (Work != NULL)
+        free(Work);
+    if (Stack != NULL)
+        free(Stack);
+    if (Mark != NULL)
+        free(Mark);
+    if (Terms != NULL)
+        free(Terms);
+    Nodes = NULL;
+    NodesCount = 0;
+    Sets = NULL;
+    SetsCount = 0;
+    Trans = NULL;
+    StateSetOffs = NULL;
+    StateSetCount = NULL;
+    StateFlags = NULL;
+    StatesCount = 0;
+    StatesAllocated = 0;
+    SetPool = NULL;
+    SetPoolUsed = 0;
+    SetPoolAllocated = 0;
+    Hash = NULL;
+    LineStartState = -1;
+    Unanchored = NULL;
+    UnanchoredCount = 0;
+    Work = NULL;
+    Stack = NULL;
+    Mark = NULL;
+    UseLiteral = FALSE;
+    Terms = NULL;
+    TermsCount = 0;
+}
+
+BOOL CRegExpDFA::Set(const char* pattern, WORD flags)
+{
+    CALL_STACK_MESSAGE2("CRegExpDFA::Set(%s)", pattern);
+    Release();
+
+    int len = (int)strlen(pattern);
+    TermsAllocated = 3 * len + 4; // each character of the pattern adds at most three terms
+    SetsAllocated = len + 1;
+    Terms = (CRegDFATerm*)malloc(TermsAllocated * sizeof(CRegDFATerm));
+    Sets = (DWORD*)malloc(SetsAllocated * RDFA_SET_SIZE * sizeof(DWORD));
+    Nodes = (CRegDFANode*)malloc((TermsAllocated + 1) * sizeof(CRegDFANode)); // at most one node per term + rdnMatch
+    char* literal = (char*)malloc(2 * (len + 1));
+    if (Terms == NULL || Sets == NULL || Nodes == NULL || literal == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        if (literal != NULL)
+            free(literal);
+        Release();
+        return FALSE;
+    }
+
+    // parse the pattern and build the NFA
+    Parse = pattern;
+    int root = ParseAlternation(FALSE);
+    if (root == -1)
+    {
+        TRACE_E("CRegExpDFA::Set(): unable to parse regular expression " << pattern);
+        free(literal);
+        Release();
+        return FALSE;
+    }
+    StartNode = CompileTerm(root, AddNode(rdnMatch, -1, -1, -1));
+
+    // literal for the prefilter
+    int runLen = 0;
+    int bestLen = 0;
+    CollectLiteral(root, literal, runLen, literal + len + 1, bestLen);
+    if (bestLen >= RDFA_MIN_LITERAL)
+    {
+        literal[len + 1 + bestLen] = 0;
+        Literal.Set(literal + len + 1, bestLen, (WORD)(sfForward | (flags & sfCaseSensitive)));
+        UseLiteral = Literal.IsGood();
+    }
+    free(literal);
+    free(Terms); // the parse tree is not needed anymore
+    Terms = NULL;
+    TermsCount = 0;
+
+    ComputeClasses((flags & sfCaseSensitive) != 0);
+
+    // cache of states
+    MaxStates = RDFA_CACHE_SIZE / (ClassCount * (int)sizeof(int));
+    if (MaxStates < RDFA_MIN_STATES)
+        MaxStates = RDFA_MIN_STATES;
+    if (MaxStates > RDFA_MAX_STATES)
+        MaxStates = RDFA_MAX_STATES;
+    HashSize = 1;
+    while (HashSize < 2 * MaxStates)
+        HashSize <<= 1;
+    StatesAllocated = min(RDFA_MIN_STATES, MaxStates);
+    SetPoolAllocated = StatesAllocated * 8;
+    Trans = (int*)malloc(StatesAllocated * ClassCount * sizeof(int));
+    StateSetOffs = (int*)malloc(StatesAllocated * sizeof(int));
+    StateSetCount = (int*)malloc(StatesAllocated * sizeof(int));
+    StateFlags = (BYTE*)malloc(StatesAllocated);
+    SetPool = (int*)malloc(SetPoolAllocated * sizeof(int));
+    Hash = (int*)malloc(HashSize * sizeof(int));
+    Unanchored = (int*)malloc(NodesCount * sizeof(int));
+    Work = (int*)malloc(NodesCount * sizeof(int));
+    Stack = (int*)malloc(NodesCount * sizeof(int));
+    Mark = (DWORD*)malloc(NodesCount * sizeof(DWORD));
+    if (Trans == NULL || StateSetOffs == NULL || StateSetCount == NULL || StateFlags == NULL ||
+        SetPool == NULL || Hash == NULL || Unanchored == NULL || Work == NULL || Stack == NULL ||
+        Mark == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        Release();
+        return FALSE;
+    }
+    memset(Mark, 0, NodesCount * sizeof(DWORD));
+    MarkGen = 0;
+    FlushStates();
+
+    // states reached outside the beginning of line (match can start at any position)
+    NextMark();
+    WorkCount = 0;
+    WorkMatch = FALSE;
+    AddClosure(StartNode, FALSE);
+    memcpy(Unanchored, Work, WorkCount * sizeof(int));
+    UnanchoredCount = WorkCount;
+    return TRUE;
+}
+
+int CRegExpDFA::AddTerm(BYTE type, int left, int right)
+{
+    if (TermsCount >= TermsAllocated)
+    {
+        TRACE_E("CRegExpDFA::AddTerm(): unexpected situation!");
+        return -1;
+    }
+    CRegDFATerm* t = Terms + TermsCount;
+    t->Type = type;
+    t->Left = left;
+    t->Right = right;
+    return TermsCount++;
+}
+
+int CRegExpDFA::AddSet()
+{
+    if (SetsCount >= SetsAllocated)
+    {
+        TRACE_E("CRegExpDFA::AddSet(): unexpected situation!");
+        return -1;
+    }
+    memset(Sets + SetsCount * RDFA_SET_SIZE, 0, RDFA_SET_SIZE * sizeof(DWORD));
+    return SetsCount++;
+}
+
+int CRegExpDFA::ParseAlternation(BOOL paren)
+{
+    int term = ParseBranch();
+    while (term != -1 && *Parse == '|')
+    {
+        Parse++;
+        int right = ParseBranch();
+        term = right != -1 ? AddTerm(rdtAlt, term, right) : -1;
+    }
+    if (term == -1)
+        return -1;
+    if (paren)
+    {
+        if (*Parse++ != ')')
+            return -1; // unmatched ()
+    }
+    else
+    {
+        if (*Parse != 0)
+            return -1; // unmatched ()
+    }
+    return term;
+}
+
+int CRegExpDFA::ParseBranch()
+{
+    int term = -1;
+    while (*Parse != 0 && *Parse != '|' && *Parse != ')')
+    {
+        int piece = ParsePiece();
+        if (piece == -1)
+            return -1;
+        term = term == -1 ? piece : AddTerm(rdtCat, term, piece);
+        if (term == -1)
+            return -1;
+    }
+    if (term == -1) // empty branch
+        term = AddTerm(rdtEmpty, -1, -1);
+    return term;
+}
+
+int CRegExpDFA::ParsePiece()
+{
+    int atom = ParseAtom();
+    if (atom == -1 || !RDFA_IS_MULT(*Parse))
+        return atom;
+
+    BYTE type;
+    switch (*Parse++)
+    {
+    case '*':
+        type = rdtStar;
+        break;
+    case '+':
+        type = rdtPlus;
+        break;
+    default:
+        type = rdtQuest;
+        break;
+    }
+    if (RDFA_IS_MULT(*Parse))
+        return -1; // nested *?+
+    return AddTerm(type, atom, -1);
+}
+
+int CRegExpDFA::ParseAtom()
+{
+    char c = *Parse++;
+    switch (c)
+    {
+    case '^':
+        return AddTerm(rdtBOL, -1, -1);
+    case '$':
+        return AddTerm(rdtEOL, -1, -1);
+
+    case '.':
+    {
+        int set = AddSet();
+        if (set == -1)
+            return -1;
+        DWORD* bits = Sets + set * RDFA_SET_SIZE;
+        memset(bits, 0xFF, RDFA_SET_SIZE * sizeof(DWORD));
+        bits[0] &= ~1; // any character except NUL
+        return AddTerm(rdtSet, set, -1);
+    }
+
+    case '[':
+        return ParseSet();
+    case '(':
+        return ParseAlternation(TRUE);
+
+    case 0:
+    case '|':
+    case ')':
+    case '?':
+    case '+':
+    case '*':
+        return -1; // ?+* follows nothing
+
+    case '\\':
+    {
+        if (*Parse == 0)
+            return -1; // trailing backslash
+        c = *Parse++;
+        break;
+    }
+    }
+
+    // ordinary character
+    int set = AddSet();
+    if (set == -1)
+        return -1;
+    BYTE b = (BYTE)c;
+    Sets[set * RDFA_SET_SIZE + (b >> 5)] |= 1u << (b & 31);
+    return AddTerm(rdtSet, set, -1);
+}
+
+int CRegExpDFA::ParseSet()
+{
+    int set = AddSet();
+    if (set == -1)
+        return -1;
+    DWORD* bits = Sets + set * RDFA_SET_SIZE;
+
+    // the same rules as for ANYOF and ANYBUT in regatom
+    BOOL complement = FALSE;
+    if (*Parse == '^')
+    {
+        complement = TRUE;
+        Parse++;
+    }
+    BYTE b;
+    if (*Parse == ']' || *Parse == '-')
+    {
+        b = (BYTE)*Parse++;
+        bits[b >> 5] |= 1u << (b & 31);
+    }
+    while (*Parse != 0 && *Parse != ']')
+    {
+        if (*Parse == '-')
+        {
+            Parse++;
+            if (*Parse == ']' || *Parse == 0)
+                bits['-' >> 5] |= 1u << ('-' & 31);
+            else
+            {
+                int from = (BYTE)*(Parse - 2) + 1;
+                int to = (BYTE)*Parse;
+                if (from > to + 1)
+                    return -1; // invalid [] range
+                for (; from <= to; from++)
+                    bits[from >> 5] |= 1u << (from & 31);
+                Parse++;
+            }
+        }
+        else
+        {
+            b = (BYTE)*Parse++;
+            bits[b >> 5] |= 1u << (b & 31);
+        }
+    }
+    if (*Parse != ']')
+        return -1; // unmatched []
+    Parse++;
+
+    if (complement)
+    {
+        int i;
+        for (i = 0; i < RDFA_SET_SIZE; i++)
+            bits[i] = ~bits[i];
+    }
+    bits[0] &= ~1; // NUL ends the line, it is never matched
+    return AddTerm(rdtSet, set, -1);
+}
+
+int CRegExpDFA::AddNode(BYTE type, int out, int out1, int set)
+{
+    CRegDFANode* n = Nodes + NodesCount;
+    n->Type = type;
+    n->Out = out;
+    n->Out1 = out1;
+    n->Set = set;
+    return NodesCount++;
+}
+
+int CRegExpDFA::CompileTerm(int term, int next)
+{
+    CRegDFATerm* t = Terms + term;
+    switch (t->Type)
+    {
+    case rdtSet:
+        return AddNode(rdnChar, next, -1, t->Left);
+    case rdtBOL:
+        return AddNode(rdnBOL, next, -1, -1);
+    case rdtEOL:
+        return AddNode(rdnEOL, next, -1, -1);
+    case rdtEmpty:
+        return next;
+    case rdtCat:
+        return CompileTerm(t->Left, CompileTerm(t->Right, next));
+
+    case rdtAlt:
+    {
+        int left = CompileTerm(t->Left, next);
+        int right = CompileTerm(t->Right, next);
+        return AddNode(rdnSplit, left, right, -1);
+    }
+
+    case rdtStar:
+    {
+        int split = AddNode(rdnSplit, -1, next, -1);
+        Nodes[split].Out = CompileTerm(t->Left, split);
+        return split;
+    }
+
+    case rdtPlus:
+    {
+        int split = AddNode(rdnSplit, -1, next, -1);
+        Nodes[split].Out = CompileTerm(t->Left, split);
+        return Nodes[split].Out;
+    }
+
+    default: // rdtQuest
+    {
+        int body = CompileTerm(t->Left, next);
+        return AddNode(rdnSplit, body, next, -1);
+    }
+    }
+}
+
+void CRegExpDFA::CollectLiteral(int term, char* run, int& runLen, char* best, int& bestLen)
+{
+    CRegDFATerm* t = Terms + term;
+    if (t->Type == rdtCat)
+    {
+        CollectLiteral(t->Left, run, runLen, best, bestLen);
+        CollectLiteral(t->Right, run, runLen, best, bestLen);
+        return;
+    }
+    if (t->Type == rdtSet)
+    {
+        // is it a set of just one character?
+        DWORD* bits = Sets + t->Left * RDFA_SET_SIZE;
+        int count = 0;
+        int c = 0;
+        int i;
+        for (i = 0; i < 256 && count < 2; i++)
+        {
+            if (bits[i >> 5] & (1u << (i & 31)))
+            {
+                count++;
+                c = i;
+            }
+        }
+        if (count == 1)
+        {
+            run[runLen++] = (char)c;
+            if (runLen > bestLen)
+            {
+                memcpy(best, run, runLen);
+                bestLen = runLen;
+            }
+            return;
+        }
+    }
+    runLen = 0; // anything else interrupts the sequence
+}
+
+void CRegExpDFA::ComputeClasses(BOOL caseSensitive)
+{
+    // start with one class of all characters (except NUL) and split the classes by each set
+    BYTE cls[256];
+    cls[0] = 0;
+    memset(cls + 1, 1, 255);
+    int count = 2;
+    short map[2][256];
+    int s;
+    for (s = 0; s < SetsCount; s++)
+    {
+        DWORD* bits = Sets + s * RDFA_SET_SIZE;
+        memset(map, 0xFF, sizeof(map));
+        count = 1;
+        int b;
+        for (b = 1; b < 256; b++)
+        {
+            int in = (bits[b >> 5] >> (b & 31)) & 1;
+            if (map[in][cls[b]] == -1)
+                map[in][cls[b]] = (short)count++;
+            cls[b] = (BYTE)map[in][cls[b]];
+        }
+    }
+    ClassCount = count;
+
+    int b;
+    for (b = 255; b >= 0; b--)
+        ClassRep[cls[b]] = (BYTE)b;
+    for (b = 0; b < 256; b++)
+        ByteClass[b] = caseSensitive ? cls[b] : cls[LowerCase[b]];
+    ByteClass[0] = 0;
+}
+
+void CRegExpDFA::NextMark()
+{
+    if (++MarkGen == 0)
+    {
+        memset(Mark, 0, NodesCount * sizeof(DWORD));
+        MarkGen = 1;
+    }
+}
+
+void CRegExpDFA::AddClosure(int node, BOOL lineStart)
+{
+    if (Mark[node] == MarkGen)
+        return;
+    Mark[node] = MarkGen;
+    int sp = 0;
+    Stack[sp++] = node;
+    while (sp > 0)
+    {
+        CRegDFANode* n = Nodes + Stack[--sp];
+        int out = -1;
+        int out1 = -1;
+        switch (n->Type)
+        {
+        case rdnChar:
+        case rdnEOL:
+            Work[WorkCount++] = (int)(n - Nodes); // states of the automaton consist of these nodes
+            break;
+        case rdnMatch:
+            WorkMatch = TRUE;
+            break;
+        case rdnSplit:
+            out = n->Out;
+            out1 = n->Out1;
+            break;
+        case rdnEmpty:
+            out = n->Out;
+            break;
+        case rdnBOL:
+            if (lineStart)
+                out = n->Out;
+            break;
+        }
+        if (out != -1 && Mark[out] != MarkGen)
+        {
+            Mark[out] = MarkGen;
+            Stack[sp++] = out;
+        }
+        if (out1 != -1 && Mark[out1] != MarkGen)
+        {
+            Mark[out1] = MarkGen;
+            Stack[sp++] = out1;
+        }
+    }
+}
+
+BOOL CRegExpDFA::MatchAtEOL(int state)
+{
+    NextMark();
+    BOOL lineStart = (StateFlags[state] & rsfLineStart) != 0;
+    int sp = 0;
+    const int* nodes = SetPool + StateSetOffs[state];
+    int count = StateSetCount[state];
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        CRegDFANode* n = Nodes + nodes[i];
+        if (n->Type == rdnEOL && Mark[n->Out] != MarkGen)
+        {
+            Mark[n->Out] = MarkGen;
+            Stack[sp++] = n->Out;
+        }
+    }
+    while (sp > 0)
+    {
+        CRegDFANode* n = Nodes + Stack[--sp];
+        int out = -1;
+        int out1 = -1;
+        switch (n->Type)
+        {
+        case rdnMatch:
+            return TRUE;
+        case rdnSplit:
+            out = n->Out;
+            out1 = n->Out1;
+            break;
+        case rdnEmpty:
+        case rdnEOL:
+            out = n->Out;
+            break;
+        case rdnBOL:
+            if (lineStart) // empty line
+                out = n->Out;
+            break;
+        }
+        if (out != -1 && Mark[out] != MarkGen)
+        {
+            Mark[out] = MarkGen;
+            Stack[sp++] = out;
+        }
+        if (out1 != -1 && Mark[out1] != MarkGen)
+        {
+            Mark[out1] = MarkGen;
+            Stack[sp++] = out1;
+        }
+    }
+    return FALSE;
+}
+
+void CRegExpDFA::FlushStates()
+{
+    if (StatesCount > RDFA_FIRST_STATE)
+        FlushCount++;
+    StatesCount = RDFA_FIRST_STATE; // final states stay
+    SetPoolUsed = 0;
+    LineStartState = -1;
+    int i;
+    for (i = 0; i < HashSize; i++)
+        Hash[i] = -1;
+}
+
+int CRegExpDFA::AddState(BOOL lineStart)
+{
+    if (WorkCount == 0)
+        return RDFA_DEAD;
+
+    // sort the list of nodes (it is short, insertion sort is enough)
+    int i;
+    for (i = 1; i < WorkCount; i++)
+    {
+        int n = Work[i];
+        int j = i;
+        while (j > 0 && Work[j - 1] > n)
+        {
+            Work[j] = Work[j - 1];
+            j--;
+        }
+        Work[j] = n;
+    }
+
+    DWORD hash = lineStart ? 0x9E3779B9 : 2166136261;
+    for (i = 0; i < WorkCount; i++)
+        hash = (hash ^ (DWORD)Work[i]) * 16777619;
+    int slot = (int)(hash & (HashSize - 1));
+    while (Hash[slot] != -1)
+    {
+        int s = Hash[slot];
+        if (StateSetCount[s] == WorkCount &&
+            ((StateFlags[s] & rsfLineStart) != 0) == (lineStart != FALSE) &&
+            memcmp(SetPool + StateSetOffs[s], Work, WorkCount * sizeof(int)) == 0)
+        {
+            return s; // existing state
+        }
+        slot = (slot + 1) & (HashSize - 1);
+    }
+
+    // new state
+    if (StatesCount >= MaxStates)
+    {
+        FlushStates(); // the cache is full, start again (the table is empty now)
+        slot = (int)(hash & (HashSize - 1));
+    }
+    if (StatesCount >= StatesAllocated)
+    {
+        int count = min(2 * StatesAllocated, MaxStates);
+        int* trans = (int*)realloc(Trans, count * ClassCount * sizeof(int));
+        if (trans != NULL)
+            Trans = trans;
+        int* offs = (int*)realloc(StateSetOffs, count * sizeof(int));
+        if (offs != NULL)
+            StateSetOffs = offs;
+        int* counts = (int*)realloc(StateSetCount, count * sizeof(int));
+        if (counts != NULL)
+            StateSetCount = counts;
+        BYTE* flags = (BYTE*)realloc(StateFlags, count);
+        if (flags != NULL)
+            StateFlags = flags;
+        if (trans == NULL || offs == NULL || counts == NULL || flags == NULL)
+        {
+            TRACE_E(LOW_MEMORY);
+            return -1;
+        }
+        StatesAllocated = count;
+    }
+    if (SetPoolUsed + WorkCount > SetPoolAllocated)
+    {
+        int count = max(2 * SetPoolAllocated, SetPoolUsed + WorkCount);
+        int* pool = (int*)realloc(SetPool, count * sizeof(int));
+        if (pool == NULL)
+        {
+            TRACE_E(LOW_MEMORY);
+            return -1;
+        }
+        SetPool = pool;
+        SetPoolAllocated = count;
+    }
+
+    int s = StatesCount++;
+    StateSetOffs[s] = SetPoolUsed;
+    StateSetCount[s] = WorkCount;
+    memcpy(SetPool + SetPoolUsed, Work, WorkCount * sizeof(int));
+    SetPoolUsed += WorkCount;
+    StateFlags[s] = lineStart ? rsfLineStart : 0;
+    if (MatchAtEOL(s))
+        StateFlags[s] |= rsfAtEOL;
+    int* trans = Trans + s * ClassCount;
+    for (i = 0; i < ClassCount; i++)
+        trans[i] = -1;
+    Hash[slot] = s;
+    return s;
+}
+
+int CRegExpDFA::GetLineStartState()
+{
+    NextMark();
+    WorkCount = 0;
+    WorkMatch = FALSE;
+    AddClosure(StartNode, TRUE);
+    LineStartState = WorkMatch ? RDFA_MATCH : AddState(TRUE);
+    return LineStartState;
+}
+
+int CRegExpDFA::ComputeNext(int state, int cls)
+{
+    int next;
+    if (cls == 0) // NUL ends the line
+        next = (StateFlags[state] & rsfAtEOL) ? RDFA_MATCH : RDFA_DEAD;
+    else
+    {
+        DWORD flushCount = FlushCount;
+        BYTE c = ClassRep[cls];
+        NextMark();
+        WorkCount = 0;
+        WorkMatch = FALSE;
+        const int* nodes = SetPool + StateSetOffs[state];
+        int count = StateSetCount[state];
+        int i;
+        for (i = 0; i < count; i++)
+        {
+            CRegDFANode* n = Nodes + nodes[i];
+            if (n->Type == rdnChar && (Sets[n->Set * RDFA_SET_SIZE + (c >> 5)] & (1u << (c & 31))))
+                AddClosure(n->Out, FALSE);
+        }
+        if (WorkMatch)
+            next = RDFA_MATCH;
+        else
+        {
+            for (i = 0; i < UnanchoredCount; i++) // match can also start after this character
+            {
+                int n = Unanchored[i];
+                if (Mark[n] != MarkGen)
+                {
+                    Mark[n] = MarkGen;
+                    Work[WorkCount++] = n;
+                }
+            }
+            next = AddState(FALSE);
+            if (next == -1)
+                return -1;
+            if (FlushCount != flushCount)
+                return next; // 'state' does not exist anymore
+        }
+    }
+    Trans[state * ClassCount + cls] = next;
+    return next;
+}
+
+int CRegExpDFA::TestLine(const char* start, const char* end)
+{
+    if (Nodes == NULL)
+        return rdfaError;
+    int state = LineStartState;
+    if (state == -1)
+    {
+        state = GetLineStartState();
+        if (state == -1)
+            return rdfaError;
+    }
+    const BYTE* s = (const BYTE*)start;
+    const BYTE* e = (const BYTE*)end;
+    while (state >= RDFA_FIRST_STATE)
+    {
+        if (s >= e)
+            return (StateFlags[state] & rsfAtEOL) ? rdfaMatch : rdfaNoMatch;
+        int cls = ByteClass[*s++];
+        int next = Trans[state * ClassCount + cls];
+        if (next == -1)
+        {
+            next = ComputeNext(state, cls);
+            if (next == -1)
+                return rdfaError;
+        }
+        state = next;
+    }
+    return state == RDFA_MATCH ? rdfaMatch : rdfaNoMatch;
+}
+
+//
+// ****************************************************************************
+// RegExpDFABenchmark
+//
+
+#ifdef _DEBUG
+
+#define REGDFA_BENCH_SIZE (16 * 1024 * 1024) // size of the searched text
+
+// tests all lines of 'text' and returns number of lines containing a match; 'speed'
+// returns the speed in MB/s
+static int RegExpDFABenchmarkRun(CRegularExpression* regExp, const char* text, BOOL dfa, DWORD& speed)
+{
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    CRegExpDFA* automaton = regExp->GetDFA();
+    int found = 0;
+    const char* line = text;
+    const char* textEnd = text + REGDFA_BENCH_SIZE;
+    while (line < textEnd)
+    {
+        const char* lineEnd = line;
+        while (*lineEnd != '\n')
+            lineEnd++;
+        if (dfa)
+        {
+            if (!automaton->HasLiteral() ||
+                automaton->FindLiteral(line, (int)(lineEnd - line), 0) != -1)
+            {
+                if (automaton->TestLine(line, lineEnd) == rdfaMatch)
+                    found++;
+            }
+        }
+        else
+        {
+            int foundLen;
+            if (regExp->SetLine(line, lineEnd) && regExp->SearchForward(0, foundLen) != -1)
+                found++;
+        }
+        line = lineEnd + 1;
+    }
+    QueryPerformanceCounter(&end);
+    double seconds = (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+    speed = seconds > 0 ? (DWORD)((double)REGDFA_BENCH_SIZE / (1024 * 1024) / seconds) : 0;
+    return found;
+}
+
+void RegExpDFABenchmark(const char* dir)
+{
+    // lines of pseudo-random words from a small alphabet (so that the patterns are found
+    // on some of the lines) and numbers
+    char* text = (char*)malloc(REGDFA_BENCH_SIZE);
+    if (text == NULL)
+    {
+        TRACE_E("RegExpDFABenchmark(): " << LOW_MEMORY);
+        return;
+    }
+    DWORD seed = 12345;
+    int lineLen = 0;
+    int i;
+    for (i = 0; i < REGDFA_BENCH_SIZE - 1; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        BYTE r = (BYTE)(seed >> 16);
+        if (lineLen > 20 && r % 61 == 0 || lineLen >= 200)
+        {
+            text[i] = '\n';
+            lineLen = 0;
+        }
+        else
+        {
+            text[i] = r % 6 == 0 ? ' ' : r % 5 == 0 ? (char)('0' + r % 10)
+                                                    : (char)((r & 0x80 ? 'A' : 'a') + r % 8);
+            lineLen++;
+        }
+    }
+    text[REGDFA_BENCH_SIZE - 1] = '\n';
+
+    static const char* patterns[] = {"ab+c[0-9]", "^[a-h]+ [0-9]+", "(ab|cd)*ef[0-9]x", "[0-9][0-9][0-9]-$",
+                                     "hag.*deb", "a.*b.*c.*d.*e.*f.*g"};
+    int p;
+    for (p = 0; p < _countof(patterns); p++)
+    {
+        int cs;
+        for (cs = 1; cs >= 0; cs--)
+        {
+            CRegularExpression regExp;
+            if (!regExp.Set(patterns[p], (WORD)(sfForward | (cs ? sfCaseSensitive : 0))) ||
+                regExp.GetDFA() == NULL)
+            {
+                TRACE_E("RegExpDFABenchmark(): unable to compile " << patterns[p]);
+                continue;
+            }
+            DWORD regexecSpeed, dfaSpeed;
+            int regexecFound = RegExpDFABenchmarkRun(&regExp, text, FALSE, regexecSpeed);
+            int dfaFound = RegExpDFABenchmarkRun(&regExp, text, TRUE, dfaSpeed);
+            if (regexecFound != dfaFound)
+            {
+                TRACE_E("RegExpDFABenchmark(): different results for " << patterns[p] << ": regexec "
+                                                                       << regexecFound << " lines, automaton " << dfaFound << " lines");
+            }
+            TRACE_I("RegExpDFABenchmark(): " << patterns[p] << (cs ? ", case sensitive" : ", case insensitive")
+                                             << (regExp.GetDFA()->HasLiteral() ? ", literal prefilter" : "")
+                                             << ": " << dfaFound << " lines, regexec " << regexecSpeed
+                                             << " MB/s, automaton " << dfaSpeed << " MB/s");
+        }
+    }
+    free(text);
+}
+
+#endif // _DEBUG
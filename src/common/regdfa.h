@@ -0,0 +1,156 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// ****************************************************************************
+// Automaton (lazy DFA) engine for regular expressions
+//
+// Understands the same syntax as regcomp (see regexp.cpp): ^ $ . [] [^] ( ) |
+// * + ? and \x. The expression is compiled into a Thompson NFA, states of the
+// DFA are built lazily during the search (only states really reached by the
+// searched text are created) and their cache is flushed when it grows too big.
+// Each character of a line is examined just once, so the search time is linear
+// in the length of the text (regexec backtracks, which can be exponential).
+//
+// The engine only answers whether a line contains a match. Position of the match
+// (and of subexpressions) is still found by regexec, which is needed only for
+// lines accepted by the automaton.
+//
+// If every match has to contain some literal (e.g. "include" for "#include *<.*>"),
+// the literal is available as a prefilter: texts without the literal can be skipped
+// using the (vectorized) CSearchData search without examining them at all.
+// ****************************************************************************
+
+#pragma once
+
+// results of CRegExpDFA::TestLine
+#define rdfaNoMatch 0 // line does not contain a match
+#define rdfaMatch 1   // line contains a match
+#define rdfaError -1  // low memory, the automaton cannot be used (use regexec)
+
+// NFA node
+struct CRegDFANode
+{
+    BYTE Type; // rdnXXX, see regdfa.cpp
+    int Out;   // next node
+    int Out1;  // second next node (rdnSplit)
+    int Set;   // index of the character set (rdnChar)
+};
+
+// term of the parsed expression
+struct CRegDFATerm
+{
+    BYTE Type; // rdtXXX, see regdfa.cpp
+    int Left;  // (first) operand; index of the character set for rdtSet
+    int Right; // second operand (rdtCat, rdtAlt)
+};
+
+class CRegExpDFA
+{
+protected:
+    // compiled NFA
+    CRegDFANode* Nodes;
+    int NodesCount;
+    int StartNode;
+    DWORD* Sets; // character sets of rdnChar nodes (bitmaps of 256 bits = 8 DWORDs)
+    int SetsCount;
+
+    // characters which cannot be distinguished by the expression form one class;
+    // class 0 is reserved for NUL, which ends the line (as in regexec)
+    BYTE ByteClass[256]; // class of the character (case insensitive: class of the lowercase character)
+    BYTE ClassRep[256];  // one character of each class
+    int ClassCount;
+
+    // cache of DFA states; states 0 (no match is possible) and 1 (match found) are final
+    int* Trans;         // transitions: Trans[state * ClassCount + class], -1 = not computed yet
+    int* StateSetOffs;  // beginning of the NFA node list of the state in SetPool
+    int* StateSetCount; // number of NFA nodes of the state
+    BYTE* StateFlags;   // rsfXXX, see regdfa.cpp
+    int StatesCount;
+    int StatesAllocated;
+    int MaxStates;      // limit of the cache, then it is flushed
+    DWORD FlushCount;   // number of flushes of the cache (transitions computed before a flush are not stored)
+    int* SetPool;       // lists of NFA nodes (sorted) of the states
+    int SetPoolUsed;
+    int SetPoolAllocated;
+    int* Hash; // open addressing hash table of states (-1 = empty)
+    int HashSize;
+    int LineStartState; // state at the beginning of line, -1 = not created yet
+
+    // NFA nodes in the closure of StartNode outside the beginning of line (unanchored search)
+    int* Unanchored;
+    int UnanchoredCount;
+
+    // work buffers for computing closures
+    int* Work;
+    int WorkCount;
+    BOOL WorkMatch; // closure contains the rdnMatch node
+    int* Stack;
+    DWORD* Mark;
+    DWORD MarkGen;
+
+    // literal contained in every match (prefilter)
+    CSearchData Literal;
+    BOOL UseLiteral; // FALSE = there is no such literal, Literal is not used
+
+    // parser state (valid only in Set)
+    const char* Parse;
+    CRegDFATerm* Terms;
+    int TermsCount;
+    int TermsAllocated;
+    int SetsAllocated;
+
+public:
+    CRegExpDFA();
+    ~CRegExpDFA() { Release(); }
+
+    // compiles 'pattern' (syntax already checked by regcomp; for case insensitive
+    // search it has to be lowercase like for regcomp), only sfCaseSensitive is used
+    // from 'flags'; returns FALSE if the pattern cannot be compiled (low memory)
+    BOOL Set(const char* pattern, WORD flags);
+    void Release();
+
+    BOOL IsGood() const { return Nodes != NULL; }
+
+    // tests the line [start, end); NUL ends the line like in regexec; returns rdfaXXX
+    int TestLine(const char* start, const char* end);
+
+    // literal prefilter: TRUE if every match contains the literal
+    BOOL HasLiteral() const { return UseLiteral; }
+    int GetLiteralLength() const { return Literal.GetLength(); }
+    // returns offset of the first occurrence of the literal in 'text' from 'start' or -1
+    int FindLiteral(const char* text, int length, int start) { return Literal.SearchForward(text, length, start); }
+
+protected:
+    // parser of the expression (same grammar as reg, regbranch, regpiece and regatom
+    // in regexp.cpp), returns index of the term or -1 on error
+    int ParseAlternation(BOOL paren);
+    int ParseBranch();
+    int ParsePiece();
+    int ParseAtom();
+    int ParseSet();
+    int AddTerm(BYTE type, int left, int right);
+    int AddSet();
+
+    // NFA construction: returns the first node of 'term' followed by the node 'next'
+    int CompileTerm(int term, int next);
+    int AddNode(BYTE type, int out, int out1, int set);
+
+    // finds the longest sequence of characters in the concatenation of the top level
+    void CollectLiteral(int term, char* run, int& runLen, char* best, int& bestLen);
+    void ComputeClasses(BOOL caseSensitive);
+
+    // adds the closure of 'node' to Work
+    void AddClosure(int node, BOOL lineStart);
+    // finds or creates the state for NFA node list Work, returns the state or -1 (low memory)
+    int AddState(BOOL lineStart);
+    BOOL MatchAtEOL(int state);
+    void FlushStates();
+    int GetLineStartState();
+    int ComputeNext(int state, int cls);
+    void NextMark();
+};
+
+#ifdef _DEBUG
+// compares regexec with the automaton engine on lines of a synthetic text (see bench.h)
+void RegExpDFABenchmark(const char* dir);
+#endif // _DEBUG
@@ -41,7 +41,9 @@
 
 //#include "trace.h" so it can be attached to plugins as well, there's no TRACE here yet anyway
 #include "str.h"
+#include "moore.h"
 #include "regexp.h"
+#include "regdfa.h"
 
 //*****************************************************************************
 //*****************************************************************************
@@ -100,6 +102,18 @@ void regerror(const char* s)
 // CRegularExpression
 //
 
+CRegularExpression::~CRegularExpression()
+{
+    if (Expression != NULL)
+        free(Expression);
+    if (OriginalPattern != NULL)
+        free(OriginalPattern);
+    if (Line != NULL)
+        free(Line);
+    if (DFA != NULL)
+        delete DFA;
+}
+
 BOOL CRegularExpression::Set(const char* pattern, WORD flags)
 {
     if (OriginalPattern != NULL)
@@ -177,6 +191,23 @@ BOOL CRegularExpression::SetFlags(WORD flags)
             LastError = LastErrorText = RegExpErrorText(reeLowMemory);
     }
 
+    // the automaton tests whole lines, so it is always built from the forward expression;
+    // it only speeds up the search, regexec is used without it
+    if (DFA != NULL)
+    {
+        delete DFA;
+        DFA = NULL;
+    }
+    if (Expression != NULL && LastErrorText == NULL)
+    {
+        DFA = new CRegExpDFA;
+        if (DFA != NULL && !DFA->Set(pattern, Flags))
+        {
+            delete DFA;
+            DFA = NULL;
+        }
+    }
+
     if ((Flags & sfCaseSensitive) == 0)
         free(pattern);
     return Expression != NULL && LastErrorText == NULL;
@@ -237,6 +268,13 @@ BOOL CRegularExpression::SetLine(const char* start, const char* end)
     return TRUE;
 }
 
+int CRegularExpression::TestLine(const char* start, const char* end)
+{
+    if (DFA == NULL)
+        return rdfaError;
+    return DFA->TestLine(start, end);
+}
+
 int CRegularExpression::SearchForward(int start, int& foundLen)
 {
     if (start <= LineLength && regexec(Expression, Line, start) == 1)
@@ -71,6 +71,8 @@ const char* RegExpErrorText(CRegExpErrors err);
 // CRegularExpression
 //
 
+class CRegExpDFA;
+
 class CRegularExpression
 {
 public:
@@ -87,6 +89,8 @@ protected:
     int Allocated;             // how many bytes are allocated
     int LineLength;            // current line length
 
+    CRegExpDFA* DFA; // automaton engine for fast testing of lines (see regdfa.h), NULL = not available
+
 public:
     CRegularExpression()
     {
@@ -98,20 +102,14 @@ public:
         Allocated = 0;
         LineLength = 0;
         LastErrorText = NULL;
+        DFA = NULL;
     }
 
-    ~CRegularExpression()
-    {
-        if (Expression != NULL)
-            free(Expression);
-        if (OriginalPattern != NULL)
-            free(OriginalPattern);
-        if (Line != NULL)
-            free(Line);
-    }
+    ~CRegularExpression();
 
     BOOL IsGood() const { return OriginalPattern != NULL && Expression != NULL; }
     const char* GetPattern() const { return OriginalPattern; }
+    WORD GetFlags() const { return Flags; }
 
     const char* GetLastErrorText() const { return LastErrorText; }
     BOOL Set(const char* pattern, WORD flags); // returns FALSE on error (call GetLastErrorText method)
@@ -122,6 +120,13 @@ public:
     int SearchForward(int start, int& foundLen);
     int SearchBackward(int length, int& foundLen);
 
+    // fast test of the line [start, end) by the automaton engine, SetLine is not needed;
+    // returns rdfaMatch or rdfaNoMatch, rdfaError if the automaton is not available
+    // (then use SetLine and SearchForward/SearchBackward)
+    int TestLine(const char* start, const char* end);
+    // returns the automaton engine (e.g. for its literal prefilter) or NULL
+    CRegExpDFA* GetDFA() const { return DFA; }
+
     // replaces variables \1 ... \9 with text captured by corresponding parentheses
     // 'pattern' je vzor kterym se nahrazuje nalezeny match, 'buffer' buffer
     // for output, 'bufSize' maximum text size including terminating NULL
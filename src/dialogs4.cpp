@@ -371,6 +371,8 @@ CConfiguration::CConfiguration()
 
     LastUsedSpeedLimit = 1024 * 1024; // default 1 MB/s
 
+    DiskCacheMaxSize = 100; // 100 MB
+
     QuickSearchEnterAlt = FALSE;
 
     // for displaying items in the panel
@@ -0,0 +1,114 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "fasthash.h"
+
+#define FASTHASH_C1 0x87c37b91114253d5ULL
+#define FASTHASH_C2 0x4cf5ad432745937fULL
+
+static inline unsigned __int64 FastHashMix(unsigned __int64 k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+void CFastHash128::Reset()
+{
+    H1 = 0;
+    H2 = 0;
+    Length = 0;
+    TailLength = 0;
+}
+
+void CFastHash128::Blocks(const BYTE* data, DWORD count)
+{
+    unsigned __int64 h1 = H1;
+    unsigned __int64 h2 = H2;
+    const BYTE* end = data + 16 * (size_t)count;
+    for (; data < end; data += 16)
+    {
+        unsigned __int64 k1 = *(const unsigned __int64*)data; // x86/x64 allow unaligned access
+        unsigned __int64 k2 = *(const unsigned __int64*)(data + 8);
+
+        k1 *= FASTHASH_C1;
+        k1 = _rotl64(k1, 31);
+        k1 *= FASTHASH_C2;
+        h1 ^= k1;
+        h1 = _rotl64(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= FASTHASH_C2;
+        k2 = _rotl64(k2, 33);
+        k2 *= FASTHASH_C1;
+        h2 ^= k2;
+        h2 = _rotl64(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+    H1 = h1;
+    H2 = h2;
+}
+
+void CFastHash128::Update(const void* data, DWORD size)
+{
+    const BYTE* d = (const BYTE*)data;
+    Length += size;
+    if (TailLength > 0) // complete the block from the previous call first
+    {
+        DWORD n = min(16 - TailLength, size);
+        memcpy(Tail + TailLength, d, n);
+        TailLength += n;
+        d += n;
+        size -= n;
+        if (TailLength < 16)
+            return;
+        Blocks(Tail, 1);
+        TailLength = 0;
+    }
+    Blocks(d, size / 16);
+    TailLength = size % 16;
+    memcpy(Tail, d + (size - TailLength), TailLength);
+}
+
+void CFastHash128::Finalize(BYTE* digest)
+{
+    unsigned __int64 k1 = 0;
+    unsigned __int64 k2 = 0;
+    int i;
+    for (i = (int)TailLength - 1; i >= 8; i--)
+        k2 = (k2 << 8) | Tail[i];
+    for (i = min((int)TailLength, 8) - 1; i >= 0; i--)
+        k1 = (k1 << 8) | Tail[i];
+    if (TailLength > 8)
+    {
+        k2 *= FASTHASH_C2;
+        k2 = _rotl64(k2, 33);
+        k2 *= FASTHASH_C1;
+        H2 ^= k2;
+    }
+    if (TailLength > 0)
+    {
+        k1 *= FASTHASH_C1;
+        k1 = _rotl64(k1, 31);
+        k1 *= FASTHASH_C2;
+        H1 ^= k1;
+    }
+
+    H1 ^= Length;
+    H2 ^= Length;
+    H1 += H2;
+    H2 += H1;
+    H1 = FastHashMix(H1);
+    H2 = FastHashMix(H2);
+    H1 += H2;
+    H2 += H1;
+    memcpy(digest, &H1, 8);
+    memcpy(digest + 8, &H2, 8);
+}
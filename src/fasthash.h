@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+//
+// ****************************************************************************
+// CFastHash128
+//
+// Fast non-cryptographic 128-bit hash (MurmurHash3 x64 128 by Austin Appleby, public
+// domain) with an incremental interface. Much faster than MD5, used for comparing
+// contents of files (search for duplicate files), not for security purposes.
+//
+
+#define FASTHASH128_SIZE 16 // size of the digest in bytes
+
+class CFastHash128
+{
+protected:
+    unsigned __int64 H1, H2;
+    unsigned __int64 Length; // number of hashed bytes
+    BYTE Tail[16];           // bytes not forming a whole block yet
+    DWORD TailLength;        // number of bytes in Tail
+
+public:
+    CFastHash128() { Reset(); }
+
+    // starts a new digest
+    void Reset();
+
+    void Update(const void* data, DWORD size);
+
+    // finishes the digest and stores it to 'digest' (FASTHASH128_SIZE bytes)
+    void Finalize(BYTE* digest);
+
+protected:
+    // hashes 'count' blocks of 16 bytes
+    void Blocks(const BYTE* data, DWORD count);
+};
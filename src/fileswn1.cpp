@@ -1756,16 +1756,31 @@ void CFilesWindow::SelectUnselect(BOOL forceIncludeDirs, BOOL select, BOOL showM
             else
                 start = 0;
             int i = includeDirs ? start : Dirs->Count;
+            BOOL* agree = NULL; // results of the mask group for all directories followed by all files
+            if (showMaskDlg)    // in the case of *.* we will not call agree mask
+            {
+                agree = (BOOL*)malloc(max(1, count) * sizeof(BOOL));
+                if (agree != NULL) // classify the whole listing at once
+                {
+                    if (includeDirs)
+                        mask.AgreeMasks(Dirs, TRUE, agree);
+                    mask.AgreeMasks(Files, FALSE, agree + dirsCount);
+                }
+                else
+                    TRACE_E(LOW_MEMORY); // we will test names one by one
+            }
             BOOL changed = FALSE;
             for (; i < count; i++)
             {
                 CFileData* d = (i < dirsCount) ? &Dirs->At(i) : &Files->At(i - dirsCount);
-                if (!showMaskDlg || mask.AgreeMasks(d->Name, i < dirsCount ? NULL : d->Ext)) // in the case of *.* we will not call agree mask
+                if (!showMaskDlg || (agree != NULL ? agree[i] : mask.AgreeMasks(d->Name, i < dirsCount ? NULL : d->Ext)))
                 {
                     SetSel(select, d);
                     changed = TRUE;
                 }
             }
+            if (agree != NULL)
+                free(agree);
             if (changed)
             {
                 PostMessage(HWindow, WM_USER_SELCHANGED, 0, 0);
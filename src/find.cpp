@@ -6,7 +6,7 @@
 
 #include "cfgdlg.h"
 #include "find.h"
-#include "md5.h"
+#include "fasthash.h"
 
 char* FindNamedHistory[FIND_NAMED_HISTORY_SIZE];
 char* FindLookInHistory[FIND_LOOKIN_HISTORY_SIZE];
@@ -656,6 +656,547 @@ BOOL CFindIgnore::Set(int index, BOOL enabled, const char* path)
     return TRUE;
 }
 
+//*********************************************************************************
+//
+// CDuplicateDigestCache
+//
+// Digests of file contents computed while searching for duplicate files. Items are
+// identified by the full path, size and time of the last write of the file, so repeated
+// searches (e.g. with refined criteria) do not read unchanged files again. The least
+// recently used items are dropped when the items take more than DUPLICATES_CACHE_MAX_SIZE.
+//
+
+#define DUPLICATES_CACHE_MAX_SIZE (32 * 1024 * 1024) // memory taken by items and their paths
+#define DUPLICATES_CACHE_MIN_BUCKETS 4096            // initial size of the hash table
+
+// CDuplicateDigestItem::Flags
+#define ddfSample 0x01 // Sample is valid
+#define ddfFull 0x02   // Full is valid
+
+struct CDuplicateDigestItem
+{
+    char* Path; // full name of the file
+    DWORD PathHash;
+    CQuadWord Size;
+    FILETIME LastWrite;
+    BYTE Flags;                          // ddfXXX
+    BYTE Sample[DUPLICATES_DIGEST_SIZE]; // digest of the head and tail samples
+    BYTE Full[DUPLICATES_DIGEST_SIZE];   // digest of the whole content
+    CDuplicateDigestItem* Next;          // next item in the same bucket
+    CDuplicateDigestItem* Newer;         // list of items ordered by the last use
+    CDuplicateDigestItem* Older;
+};
+
+class CDuplicateDigestCache
+{
+protected:
+    CRITICAL_SECTION Section;
+    CDuplicateDigestItem** Buckets;
+    int BucketsCount; // power of two
+    int ItemsCount;
+    size_t ItemsSize;             // memory taken by the items (see GetItemSize)
+    CDuplicateDigestItem* Newest; // the most recently used item
+    CDuplicateDigestItem* Oldest; // the least recently used item, dropped first
+
+public:
+    CDuplicateDigestCache();
+    ~CDuplicateDigestCache();
+
+    // returns TRUE and 'digest' (of the whole content if 'full' is TRUE, otherwise of
+    // the samples) if it is known for the file 'path' of size 'size' written at 'lastWrite'
+    BOOL Get(const char* path, const CQuadWord& size, const FILETIME& lastWrite, BOOL full, BYTE* digest);
+
+    // stores the digest of the file
+    void Put(const char* path, const CQuadWord& size, const FILETIME& lastWrite, BOOL full, const BYTE* digest);
+
+protected:
+    void Clear();
+
+    // returns the item for 'path' or NULL; call only inside the critical section
+    CDuplicateDigestItem* Find(const char* path, DWORD hash);
+
+    // moves 'item' to the head of the list of used items (it may be outside of the list)
+    void Touch(CDuplicateDigestItem* item);
+
+    // removes and releases the least recently used item
+    void DropOldest();
+
+    static DWORD GetPathHash(const char* path);
+    static size_t GetItemSize(const char* path) { return sizeof(CDuplicateDigestItem) + strlen(path) + 1; }
+};
+
+CDuplicateDigestCache DuplicateDigestCache;
+
+CDuplicateDigestCache::CDuplicateDigestCache()
+{
+    InitializeCriticalSection(&Section);
+    Buckets = NULL;
+    BucketsCount = 0;
+    ItemsCount = 0;
+    ItemsSize = 0;
+    Newest = NULL;
+    Oldest = NULL;
+}
+
+CDuplicateDigestCache::~CDuplicateDigestCache()
+{
+    Clear();
+    DeleteCriticalSection(&Section);
+}
+
+void CDuplicateDigestCache::Clear()
+{
+    if (Buckets != NULL)
+    {
+        int i;
+        for (i = 0; i < BucketsCount; i++)
+        {
+            CDuplicateDigestItem* item = Buckets[i];
+            while (item != NULL)
+            {
+                CDuplicateDigestItem* next = item->Next;
+                free(item->Path);
+                delete item;
+                item = next;
+            }
+        }
+        free(Buckets);
+    }
+    Buckets = NULL;
+    BucketsCount = 0;
+    ItemsCount = 0;
+    ItemsSize = 0;
+    Newest = NULL;
+    Oldest = NULL;
+}
+
+void CDuplicateDigestCache::Touch(CDuplicateDigestItem* item)
+{
+    if (item == Newest)
+        return;
+    if (item->Older != NULL)
+        item->Older->Newer = item->Newer;
+    if (item->Newer != NULL)
+        item->Newer->Older = item->Older;
+    if (item == Oldest)
+        Oldest = item->Newer;
+    item->Older = Newest;
+    item->Newer = NULL;
+    if (Newest != NULL)
+        Newest->Newer = item;
+    Newest = item;
+    if (Oldest == NULL)
+        Oldest = item;
+}
+
+void CDuplicateDigestCache::DropOldest()
+{
+    CDuplicateDigestItem* item = Oldest;
+    Oldest = item->Newer;
+    if (Oldest != NULL)
+        Oldest->Older = NULL;
+    else
+        Newest = NULL;
+    CDuplicateDigestItem** prev = &Buckets[item->PathHash & (BucketsCount - 1)];
+    while (*prev != item)
+        prev = &(*prev)->Next;
+    *prev = item->Next;
+    ItemsCount--;
+    ItemsSize -= GetItemSize(item->Path);
+    free(item->Path);
+    delete item;
+}
+
+DWORD CDuplicateDigestCache::GetPathHash(const char* path)
+{
+    DWORD hash = 2166136261; // FNV-1a, case insensitive
+    while (*path != 0)
+        hash = (hash ^ LowerCase[*path++]) * 16777619;
+    return hash;
+}
+
+CDuplicateDigestItem* CDuplicateDigestCache::Find(const char* path, DWORD hash)
+{
+    if (Buckets == NULL)
+        return NULL;
+    CDuplicateDigestItem* item = Buckets[hash & (BucketsCount - 1)];
+    while (item != NULL && (item->PathHash != hash || StrICmp(item->Path, path) != 0))
+        item = item->Next;
+    return item;
+}
+
+BOOL CDuplicateDigestCache::Get(const char* path, const CQuadWord& size, const FILETIME& lastWrite,
+                                BOOL full, BYTE* digest)
+{
+    EnterCriticalSection(&Section);
+    CDuplicateDigestItem* item = Find(path, GetPathHash(path));
+    BOOL found = item != NULL && item->Size == size && CompareFileTime(&item->LastWrite, &lastWrite) == 0 &&
+                 (item->Flags & (full ? ddfFull : ddfSample)) != 0;
+    if (found)
+    {
+        memcpy(digest, full ? item->Full : item->Sample, DUPLICATES_DIGEST_SIZE);
+        Touch(item);
+    }
+    LeaveCriticalSection(&Section);
+    return found;
+}
+
+void CDuplicateDigestCache::Put(const char* path, const CQuadWord& size, const FILETIME& lastWrite,
+                                BOOL full, const BYTE* digest)
+{
+    EnterCriticalSection(&Section);
+    DWORD hash = GetPathHash(path);
+    CDuplicateDigestItem* item = Find(path, hash);
+    if (item == NULL)
+    {
+        size_t itemSize = GetItemSize(path);
+        while (Oldest != NULL && ItemsSize + itemSize > DUPLICATES_CACHE_MAX_SIZE)
+            DropOldest();
+        if (ItemsCount >= 2 * BucketsCount) // enlarge the hash table
+        {
+            int count = max(2 * BucketsCount, DUPLICATES_CACHE_MIN_BUCKETS);
+            CDuplicateDigestItem** buckets = (CDuplicateDigestItem**)calloc(count, sizeof(CDuplicateDigestItem*));
+            if (buckets != NULL)
+            {
+                int i;
+                for (i = 0; i < BucketsCount; i++)
+                {
+                    CDuplicateDigestItem* it = Buckets[i];
+                    while (it != NULL)
+                    {
+                        CDuplicateDigestItem* next = it->Next;
+                        it->Next = buckets[it->PathHash & (count - 1)];
+                        buckets[it->PathHash & (count - 1)] = it;
+                        it = next;
+                    }
+                }
+                if (Buckets != NULL)
+                    free(Buckets);
+                Buckets = buckets;
+                BucketsCount = count;
+            }
+            else
+                TRACE_E(LOW_MEMORY); // it is only a cache, keep longer chains
+        }
+        if (Buckets != NULL)
+        {
+            item = new CDuplicateDigestItem;
+            char* p = DupStr(path);
+            if (item != NULL && p != NULL)
+            {
+                item->Path = p;
+                item->PathHash = hash;
+                item->Flags = 0;
+                item->Size = size;
+                item->LastWrite = lastWrite;
+                item->Next = Buckets[hash & (BucketsCount - 1)];
+                Buckets[hash & (BucketsCount - 1)] = item;
+                item->Newer = NULL;
+                item->Older = NULL;
+                ItemsCount++;
+                ItemsSize += itemSize;
+            }
+            else
+            {
+                TRACE_E(LOW_MEMORY);
+                if (item != NULL)
+                    delete item;
+                if (p != NULL)
+                    free(p);
+                item = NULL;
+            }
+        }
+    }
+    if (item != NULL)
+    {
+        if (item->Size != size || CompareFileTime(&item->LastWrite, &lastWrite) != 0)
+        { // the file was changed, the stored digests are invalid
+            item->Size = size;
+            item->LastWrite = lastWrite;
+            item->Flags = 0;
+        }
+        memcpy(full ? item->Full : item->Sample, digest, DUPLICATES_DIGEST_SIZE);
+        item->Flags |= full ? ddfFull : ddfSample;
+        Touch(item);
+    }
+    LeaveCriticalSection(&Section);
+}
+
+//*********************************************************************************
+//
+// CDuplicateHasher
+//
+// Computes digests of candidates for duplicate files on several threads. The first pass
+// reads only samples from the head and the tail of the files (files of the same size
+// usually differ there already), the second pass reads the whole content of the files
+// whose samples match. Files are hashed by CFastHash128.
+//
+
+#define DUPLICATES_SAMPLE_SIZE 16384                        // size of the head and tail samples
+#define DUPLICATES_SAMPLE_SPAN (2 * DUPLICATES_SAMPLE_SIZE) // files up to this size are read whole in the first pass
+#define DUPLICATES_BUFFER_SIZE (1024 * 1024)                // buffer for reading the files
+#define DUPLICATES_MAX_THREADS 16                           // maximal number of hashing threads
+#define DUPLICATES_PROGRESS_DELAY 200                       // period of progress updates in milliseconds
+
+// CDuplicateHashJob::State
+#define dhjPending 0 // not processed (the search was stopped)
+#define dhjDone 1    // digest is stored at (BYTE*)File->Group
+#define dhjFailed 2  // the file could not be read (logged)
+
+struct CDuplicateHashJob
+{
+    CFoundFilesData* File;
+    BYTE State; // dhjXXX
+};
+
+class CDuplicateHasher
+{
+protected:
+    CGrepData* Data;
+    CDuplicateHashJob* Jobs;
+    int JobsCount;
+    BOOL Full;                   // TRUE = whole content, FALSE = head and tail samples
+    volatile LONG NextJob;       // index of the next job to process
+    volatile LONGLONG ReadBytes; // bytes hashed by all threads (for the progress)
+    LONGLONG TotalBytes;         // bytes to hash in all jobs
+    int Progress;                // shown progress in percent
+
+public:
+    CDuplicateHasher(CGrepData* data, CDuplicateHashJob* jobs, int jobsCount, BOOL full, LONGLONG totalBytes);
+
+    // computes digests of all jobs (until the search is stopped)
+    void Run();
+
+protected:
+    static DWORD WINAPI HashThread(void* param);
+    static unsigned HashThreadEH(void* param);
+    void HashBody();
+
+    // computes the digest of 'file' using 'buffer' (DUPLICATES_BUFFER_SIZE bytes)
+    BOOL HashFile(CFoundFilesData* file, BYTE* buffer);
+
+    // reads at most 'limit' bytes (to the end of the file if 'limit' is -1) and adds them to 'hash'
+    BOOL ReadAndHash(HANDLE hFile, const char* path, CFastHash128* hash, BYTE* buffer, DWORD limit);
+
+    void AddLog(const char* path, int textResID, DWORD err);
+    void ShowProgress();
+};
+
+CDuplicateHasher::CDuplicateHasher(CGrepData* data, CDuplicateHashJob* jobs, int jobsCount, BOOL full,
+                                   LONGLONG totalBytes)
+{
+    Data = data;
+    Jobs = jobs;
+    JobsCount = jobsCount;
+    Full = full;
+    NextJob = 0;
+    ReadBytes = 0;
+    TotalBytes = totalBytes;
+    Progress = -1;
+}
+
+void CDuplicateHasher::Run()
+{
+    CALL_STACK_MESSAGE2("CDuplicateHasher::Run(%d)", Full);
+    DWORD startTick = GetTickCount();
+
+    // the samples are small reads bound by the latency of the disk, so more threads
+    // than processors are used; whole contents are limited by the disk throughput
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int count = Full ? (int)si.dwNumberOfProcessors : 2 * (int)si.dwNumberOfProcessors;
+    if (count > DUPLICATES_MAX_THREADS)
+        count = DUPLICATES_MAX_THREADS;
+    if (count > JobsCount)
+        count = JobsCount;
+
+    HANDLE threads[DUPLICATES_MAX_THREADS];
+    int started = 0;
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        DWORD threadId;
+        threads[started] = HANDLES(CreateThread(NULL, 0, HashThread, this, 0, &threadId));
+        if (threads[started] == NULL)
+        {
+            TRACE_E("CDuplicateHasher::Run(): unable to start hashing thread " << i);
+            break;
+        }
+        started++;
+    }
+
+    if (started > 0)
+    {
+        while (WaitForMultipleObjects(started, threads, TRUE, DUPLICATES_PROGRESS_DELAY) == WAIT_TIMEOUT)
+            ShowProgress();
+        for (i = 0; i < started; i++)
+            HANDLES(CloseHandle(threads[i]));
+    }
+    else
+        HashBody(); // no thread, hash at least in this one
+    ShowProgress();
+
+    DWORD ms = GetTickCount() - startTick;
+    if (ms == 0)
+        ms = 1;
+    TRACE_I("CDuplicateHasher: " << (Full ? "whole contents" : "samples") << " of " << JobsCount << " files, "
+                                 << started << " threads, " << (int)(ReadBytes / 1024 / 1024) << " MB in " << ms
+                                 << " ms (" << (int)(ReadBytes * 1000 / ms / 1024 / 1024) << " MB/s)"
+                                 << (Data->StopSearch ? ", stopped" : ""));
+}
+
+unsigned CDuplicateHasher::HashThreadEH(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    __try
+    {
+#endif // CALLSTK_DISABLE
+        SetThreadNameInVCAndTrace("Duplicates Hasher");
+        ((CDuplicateHasher*)param)->HashBody();
+        return 0;
+#ifndef CALLSTK_DISABLE
+    }
+    __except (CCallStack::HandleException(GetExceptionInformation()))
+    {
+        TRACE_I("Thread Duplicates Hasher: calling ExitProcess(1).");
+        //    ExitProcess(1);
+        TerminateProcess(GetCurrentProcess(), 1); // harder exit (this call still performs some operations)
+        return 1;
+    }
+#endif // CALLSTK_DISABLE
+}
+
+DWORD WINAPI CDuplicateHasher::HashThread(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    CCallStack stack;
+#endif // CALLSTK_DISABLE
+    return HashThreadEH(param);
+}
+
+void CDuplicateHasher::HashBody()
+{
+    CALL_STACK_MESSAGE1("CDuplicateHasher::HashBody()");
+    BYTE* buffer = (BYTE*)malloc(DUPLICATES_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        TRACE_E(LOW_MEMORY); // jobs are processed by the other threads
+        return;
+    }
+    while (!Data->StopSearch)
+    {
+        LONG index = InterlockedIncrement(&NextJob) - 1;
+        if (index >= JobsCount)
+            break;
+        CDuplicateHashJob* job = Jobs + index;
+        job->State = HashFile(job->File, buffer) ? dhjDone : dhjFailed;
+    }
+    free(buffer);
+}
+
+BOOL CDuplicateHasher::HashFile(CFoundFilesData* file, BYTE* buffer)
+{
+    // build full path to the file
+    char fullPath[MAX_PATH];
+    lstrcpyn(fullPath, file->Path, MAX_PATH);
+    SalPathAppend(fullPath, file->Name, MAX_PATH);
+
+    BYTE* digest = (BYTE*)file->Group;
+    if (DuplicateDigestCache.Get(fullPath, file->Size, file->LastWrite, Full, digest))
+    {
+        InterlockedExchangeAdd64(&ReadBytes, Full ? (LONGLONG)file->Size.Value : (LONGLONG)min(file->Size.Value, (unsigned __int64)DUPLICATES_SAMPLE_SPAN));
+        return TRUE;
+    }
+
+    Data->SearchingText->Set(fullPath); // set the current file
+
+    HANDLE hFile = HANDLES_Q(CreateFileUtf8(fullPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        AddLog(fullPath, IDS_ERROR_OPENING_FILE2, GetLastError());
+        return FALSE;
+    }
+
+    CFastHash128 hash;
+    BOOL ok;
+    if (Full || file->Size <= CQuadWord(DUPLICATES_SAMPLE_SPAN, 0))
+        ok = ReadAndHash(hFile, fullPath, &hash, buffer, (DWORD)-1);
+    else
+    {
+        ok = ReadAndHash(hFile, fullPath, &hash, buffer, DUPLICATES_SAMPLE_SIZE);
+        if (ok)
+        {
+            LARGE_INTEGER tail;
+            tail.QuadPart = (LONGLONG)file->Size.Value - DUPLICATES_SAMPLE_SIZE;
+            if (SetFilePointerEx(hFile, tail, NULL, FILE_BEGIN))
+                ok = ReadAndHash(hFile, fullPath, &hash, buffer, DUPLICATES_SAMPLE_SIZE);
+            else
+            {
+                AddLog(fullPath, IDS_ERROR_READING_FILE2, GetLastError());
+                ok = FALSE;
+            }
+        }
+    }
+    HANDLES(CloseHandle(hFile));
+    if (!ok)
+        return FALSE;
+
+    hash.Finalize(digest);
+    DuplicateDigestCache.Put(fullPath, file->Size, file->LastWrite, Full, digest);
+    return TRUE;
+}
+
+BOOL CDuplicateHasher::ReadAndHash(HANDLE hFile, const char* path, CFastHash128* hash, BYTE* buffer, DWORD limit)
+{
+    while (limit > 0)
+    {
+        DWORD read; // number of bytes that were actually read
+        if (!ReadFile(hFile, buffer, min(limit, (DWORD)DUPLICATES_BUFFER_SIZE), &read, NULL))
+        {
+            AddLog(path, IDS_ERROR_READING_FILE2, GetLastError());
+            return FALSE;
+        }
+
+        // does the user want to stop the operation?
+        if (Data->StopSearch)
+            return FALSE;
+
+        if (read == 0) // end of the file
+            break;
+        hash->Update(buffer, read);
+        InterlockedExchangeAdd64(&ReadBytes, read);
+        if (limit != (DWORD)-1)
+            limit -= read;
+    }
+    return TRUE;
+}
+
+void CDuplicateHasher::AddLog(const char* path, int textResID, DWORD err)
+{
+    char buf[MAX_PATH + 100];
+    sprintf(buf, LoadStr(textResID), GetErrorText(err));
+    FIND_LOG_ITEM log;
+    log.Flags = FLI_ERROR;
+    log.Text = buf;
+    log.Path = path;
+    SendMessage(Data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+}
+
+void CDuplicateHasher::ShowProgress()
+{
+    LONGLONG read = InterlockedExchangeAdd64(&ReadBytes, 0);
+    int progress = read >= TotalBytes ? (TotalBytes == 0 ? 0 : 100) : (int)(read * 100 / TotalBytes);
+    if (progress != Progress)
+    {
+        Progress = progress;
+        char buff[100];
+        buff[0] = (BYTE)progress; // pass the numeric value directly instead of a string
+        buff[1] = 0;
+        Data->SearchingText2->Set(buff); // update the total progress
+    }
+}
+
 //*********************************************************************************
 //
 // CDuplicateCandidates
@@ -664,8 +1205,9 @@ BOOL CFindIgnore::Set(int index, BOOL enabled, const char* path)
 // 1) In the first phase, all files matching the Find criteria are added
 //    to the CDuplicateCandidates object using the Add method.
 // 2) Then the Examine() method is called which sorts the array using data->FindDupFlags criteria. If file contents
-//    are compared, MD5 digests are calculated for potentially identical files.
-//    Then, the array is sorted again and single files are removed so
+//    are compared, digests of head and tail samples are calculated for files of the same size, then (for
+//    files with matching samples) digests of the whole contents, see CDuplicateHasher. After each step
+//    the array is sorted again and single files are removed so
 //    Only files that appear at least twice remain in the array.
 //    These get a Group variable so that sets can be distinguished in the result window.
 //
@@ -675,50 +1217,44 @@ class CDuplicateCandidates : public TIndirectArray<CFoundFilesData>
 public:
     CDuplicateCandidates() : TIndirectArray<CFoundFilesData>(2000, 4000) {}
 
-    // - loading/calculating MD5 digests
+    // - loading/calculating digests of the contents
     // - removing single files
     // - setting the Group variable
     // - setting the Different flag
     void Examine(CGrepData* data);
 
 protected:
-    // compares two records using criteria byName, bySize and byMD5
+    // compares two records using criteria byName, bySize and byDigest
     // byPath is a criterium with the lowest priority and is used only for clearer output
-    int CompareFunc(CFoundFilesData* f1, CFoundFilesData* f2, BOOL byName, BOOL bySize, BOOL byMD5, BOOL byPath);
+    int CompareFunc(CFoundFilesData* f1, CFoundFilesData* f2, BOOL byName, BOOL bySize, BOOL byDigest, BOOL byPath);
 
-    // sort stored files by byName, bySize and byMD5 criteria
-    void QuickSort(int left, int right, BOOL byName, BOOL bySize, BOOL byMD5);
+    // sort stored files by byName, bySize and byDigest criteria
+    void QuickSort(int left, int right, BOOL byName, BOOL bySize, BOOL byDigest);
 
     // goes through all stored items and uses CompareFunc to identify those that
     // appear only once; those are then removed from the array
     // before calling this method, the array must be sorted with QuickSort
-    void RemoveSingleFiles(BOOL byName, BOOL bySize, BOOL byMD5);
+    void RemoveSingleFiles(BOOL byName, BOOL bySize, BOOL byDigest);
 
     // goes through all stored items and uses CompareFunc assign them
     // to groups; Alternates the Different bit for the groups  (0, 1, 0, 1, 0, 1, ...)
     // before calling this method, the array must be sorted with QuickSort
-    void SetDifferentFlag(BOOL byName, BOOL bySize, BOOL byMD5);
+    void SetDifferentFlag(BOOL byName, BOOL bySize, BOOL byDigest);
 
     // goes through all stored items and uses the Different flag to assign
     // Group values; groups are numbered increasingly (0, 1, 2, 3, 4, 5, ...)
     void SetGroupByDifferentFlag();
 
-    // compute MD5 from the file 'file'
-    // 'progress' is the numeric value shown in the status bar (optimized so we do not
-    // update the same porgress repeatedly)
-    // 'readSize' holds the number of bytes read so far across all files
-    // 'totalSize' is the total number of bytes of all files for which the MD5 digest
-    // will be determined
-    // the method returns TRUE, if the MD5 value was successfully read; the digest is stored at
-    // (BYTE*)data->Group
-    // the method returns FALSE on read errors or when the user aborts the operation
-    // (then, the variable data->StopSearch is set to TRUE)
-    BOOL GetMD5Digest(CGrepData* data, CFoundFilesData* file,
-                      int* progress, CQuadWord* readSize, const CQuadWord* totalSize);
+    // computes digests of files larger than 0 bytes ('full' is FALSE: of the head and tail
+    // samples) or of the whole content of files larger than the samples ('full' is TRUE);
+    // the digest is stored at (BYTE*)data->Group; files which could not be read and files
+    // not processed because the user stopped the search are removed from the array;
+    // returns FALSE on lack of memory
+    BOOL ComputeDigests(CGrepData* data, BOOL full);
 };
 
 int CDuplicateCandidates::CompareFunc(CFoundFilesData* f1, CFoundFilesData* f2,
-                                      BOOL byName, BOOL bySize, BOOL byMD5, BOOL byPath)
+                                      BOOL byName, BOOL bySize, BOOL byDigest, BOOL byPath)
 {
     int res;
     if (bySize)
@@ -735,10 +1271,10 @@ int CDuplicateCandidates::CompareFunc(CFoundFilesData* f1, CFoundFilesData* f2,
             {
                 if (f1->Size == f2->Size)
                 {
-                    if (!byMD5 || f1->Size == CQuadWord(0, 0))
+                    if (!byDigest || f1->Size == CQuadWord(0, 0))
                         res = 0;
                     else
-                        res = memcmp((void*)f1->Group, (void*)f2->Group, MD5_DIGEST_SIZE);
+                        res = memcmp((void*)f1->Group, (void*)f2->Group, DUPLICATES_DIGEST_SIZE);
                 }
                 else
                     res = 1;
@@ -755,7 +1291,7 @@ int CDuplicateCandidates::CompareFunc(CFoundFilesData* f1, CFoundFilesData* f2,
     return res;
 }
 
-void CDuplicateCandidates::QuickSort(int left, int right, BOOL byName, BOOL bySize, BOOL byMD5)
+void CDuplicateCandidates::QuickSort(int left, int right, BOOL byName, BOOL bySize, BOOL byDigest)
 {
 
 LABEL_QuickSort:
@@ -765,9 +1301,9 @@ LABEL_QuickSort:
 
     do
     {
-        while (CompareFunc(At(i), pivot, byName, bySize, byMD5, TRUE) < 0 && i < right)
+        while (CompareFunc(At(i), pivot, byName, bySize, byDigest, TRUE) < 0 && i < right)
             i++;
-        while (CompareFunc(pivot, At(j), byName, bySize, byMD5, TRUE) < 0 && j > left)
+        while (CompareFunc(pivot, At(j), byName, bySize, byDigest, TRUE) < 0 && j > left)
             j--;
 
         if (i <= j)
@@ -781,8 +1317,8 @@ LABEL_QuickSort:
     } while (i <= j);
 
     // the following "nice" code was replaced by a version that saves stack space (max. log(N) recursion depth)
-    //  if (left < j) QuickSort(left, j, byName, bySize, byMD5);
-    //  if (i < right) QuickSort(i, right, byName, bySize, byMD5);
+    //  if (left < j) QuickSort(left, j, byName, bySize, byDigest);
+    //  if (i < right) QuickSort(i, right, byName, bySize, byDigest);
 
     if (left < j)
     {
@@ -790,13 +1326,13 @@ LABEL_QuickSort:
         {
             if (j - left < right - i) // both halves must be sorted: send the smaller half to recursion and handle the other via "goto"
             {
-                QuickSort(left, j, byName, bySize, byMD5);
+                QuickSort(left, j, byName, bySize, byDigest);
                 left = i;
                 goto LABEL_QuickSort;
             }
             else
             {
-                QuickSort(i, right, byName, bySize, byMD5);
+                QuickSort(i, right, byName, bySize, byDigest);
                 right = j;
                 goto LABEL_QuickSort;
             }
@@ -817,103 +1353,64 @@ LABEL_QuickSort:
     }
 }
 
-#define DUPLICATES_BUFFER_SIZE 16384 // buffer size for MD5 calculation
-
-BOOL CDuplicateCandidates::GetMD5Digest(CGrepData* data, CFoundFilesData* file,
-                                        int* progress, CQuadWord* readSize, const CQuadWord* totalSize)
+BOOL CDuplicateCandidates::ComputeDigests(CGrepData* data, BOOL full)
 {
-    // build full path to the file
-    char fullPath[MAX_PATH];
-    lstrcpyn(fullPath, file->Path, MAX_PATH);
-    SalPathAppend(fullPath, file->Name, MAX_PATH);
-
-    data->SearchingText->Set(fullPath); // set the current file
+    // only files larger than the samples need the digest of the whole content
+    CQuadWord minSize(full ? DUPLICATES_SAMPLE_SPAN : 0, 0);
+    int jobsCount = 0;
+    int i;
+    for (i = 0; i < Count; i++)
+    {
+        if (At(i)->Size > minSize)
+            jobsCount++;
+    }
+    if (jobsCount == 0)
+        return TRUE;
 
-    // open the file for reading with sequential access
-    HANDLE hFile = HANDLES_Q(CreateFileUtf8(fullPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
-    if (hFile != INVALID_HANDLE_VALUE)
+    CDuplicateHashJob* jobs = (CDuplicateHashJob*)malloc(jobsCount * sizeof(CDuplicateHashJob));
+    if (jobs == NULL)
     {
-        BYTE buffer[DUPLICATES_BUFFER_SIZE];
-        MD5 context;
-        DWORD read; // number of bytes that were actually read
-        while (TRUE)
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    LONGLONG totalBytes = 0; // for progress
+    CDuplicateHashJob* job = jobs;
+    for (i = 0; i < Count; i++)
+    {
+        CFoundFilesData* file = At(i);
+        if (file->Size > minSize)
         {
-            // read a segment from a file 'file' into 'buffer'
-            if (!ReadFile(hFile, buffer, DUPLICATES_BUFFER_SIZE, &read, NULL))
-            {
-                // error reading the file
-                DWORD err = GetLastError();
-                HANDLES(CloseHandle(hFile));
-
-                char buf[MAX_PATH + 100];
-                sprintf(buf, LoadStr(IDS_ERROR_READING_FILE2), GetErrorText(err));
-                FIND_LOG_ITEM log;
-                log.Flags = FLI_ERROR;
-                log.Text = buf;
-                log.Path = fullPath;
-                SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
-
-                return FALSE;
-            }
-
-            // does the user want to stop the operation?
-            if (data->StopSearch)
-            {
-                HANDLES(CloseHandle(hFile));
-                return FALSE;
-            }
-
-            // if anything was read, update the MD5
-            if (read > 0)
-            {
-                context.update(buffer, read);
+            job->File = file;
+            job->State = dhjPending;
+            job++;
+            totalBytes += full ? (LONGLONG)file->Size.Value : (LONGLONG)min(file->Size.Value, (unsigned __int64)DUPLICATES_SAMPLE_SPAN);
+        }
+    }
 
-                // compute and display progress (if the 'progress' value changed)
-                *readSize += CQuadWord(read, 0);
-                char buff[100];
-                int newProgress = *readSize >= *totalSize ? (totalSize->Value == 0 ? 0 : 100) : (int)((*readSize * CQuadWord(100, 0)) / *totalSize).Value;
-                if (newProgress != *progress)
-                {
-                    *progress = newProgress;
-                    buff[0] = (BYTE)newProgress; // pass the numeric value directly instead of a string
-                    buff[1] = 0;
-                    data->SearchingText2->Set(buff); // update the total progress
-                }
-            }
+    CDuplicateHasher hasher(data, jobs, jobsCount, full, totalBytes);
+    hasher.Run();
 
-            // if fewer bytes were read than the buffer size, we are done
-            if (read != DUPLICATES_BUFFER_SIZE)
-                break;
+    // exclude files without the digest from candidates: an error occurred during reading
+    // the file (but the user wants to continue) or the user stopped searching (show at least
+    // the duplicates that have been already found)
+    job = jobs + jobsCount - 1;
+    for (i = Count - 1; i >= 0; i--)
+    {
+        if (At(i)->Size > minSize)
+        {
+            if (job->State != dhjDone)
+                Delete(i);
+            job--;
         }
-        HANDLES(CloseHandle(hFile));
+    }
+    free(jobs);
+    return TRUE;
+}
 
-        context.finalize();
-        memcpy((BYTE*)file->Group, context.digest, MD5_DIGEST_SIZE);
-
-        return TRUE;
-    }
-    else
-    {
-        // error occured while opening the file
-        DWORD err = GetLastError();
-
-        char buf[MAX_PATH + 100];
-        sprintf(buf, LoadStr(IDS_ERROR_OPENING_FILE2), GetErrorText(err));
-        FIND_LOG_ITEM log;
-        log.Flags = FLI_ERROR;
-        log.Text = buf;
-        log.Path = fullPath;
-        SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
-
-        return FALSE;
-    }
-}
-
-void CDuplicateCandidates::RemoveSingleFiles(BOOL byName, BOOL bySize, BOOL byMD5)
-{
-    if (Count == 0)
-        return;
+void CDuplicateCandidates::RemoveSingleFiles(BOOL byName, BOOL bySize, BOOL byDigest)
+{
+    if (Count == 0)
+        return;
 
     CFoundFilesData* lastData = Count > 0 ? At(Count - 1) : NULL;
     int lastDataIndex = Count - 1;
@@ -921,7 +1418,7 @@ void CDuplicateCandidates::RemoveSingleFiles(BOOL byName, BOOL bySize, BOOL byMD
     int i;
     for (i = Count - 2; i >= 0; i--)
     {
-        if (CompareFunc(At(i), lastData, byName, bySize, byMD5, FALSE) == 0)
+        if (CompareFunc(At(i), lastData, byName, bySize, byDigest, FALSE) == 0)
         {
             lastIsSingle = FALSE;
         }
@@ -944,7 +1441,7 @@ void CDuplicateCandidates::RemoveSingleFiles(BOOL byName, BOOL bySize, BOOL byMD
     }
 }
 
-void CDuplicateCandidates::SetDifferentFlag(BOOL byName, BOOL bySize, BOOL byMD5)
+void CDuplicateCandidates::SetDifferentFlag(BOOL byName, BOOL bySize, BOOL byDigest)
 {
     if (Count == 0)
         return;
@@ -960,7 +1457,7 @@ void CDuplicateCandidates::SetDifferentFlag(BOOL byName, BOOL bySize, BOOL byMD5
     for (i = 1; i < Count; i++)
     {
         CFoundFilesData* data = At(i);
-        if (CompareFunc(data, lastData, byName, bySize, byMD5, FALSE) == 0)
+        if (CompareFunc(data, lastData, byName, bySize, byDigest, FALSE) == 0)
         {
             data->Different = different;
         }
@@ -1016,7 +1513,7 @@ void CDuplicateCandidates::Examine(CGrepData* data)
     BOOL bySize = (data->FindDupFlags & FIND_DUPLICATES_SIZE) != 0;
     BOOL byContent = bySize && (data->FindDupFlags & FIND_DUPLICATES_CONTENT) != 0;
 
-    // search completed, preparing results (MD5 computation may still follow)
+    // search completed, preparing results (computation of digests may still follow)
     data->SearchingText->Set(LoadStr(IDS_FIND_DUPS_RESULTS));
 
     // sort them according to selected criteria
@@ -1025,11 +1522,11 @@ void CDuplicateCandidates::Examine(CGrepData* data)
     // remove items that occur only once
     RemoveSingleFiles(byName, bySize, FALSE);
 
-    CMD5Digest* digest = NULL;
+    CDuplicatesDigest* digest = NULL;
     if (byContent)
     {
-        // for files larger than 0 bytes we'll compute MD5
-        // allocate memory for MD5 digests at once
+        // for files larger than 0 bytes we'll compute digests
+        // allocate memory for digests at once
 
         // determine the number of files with size greater than 0 bytes
         DWORD count = 0;
@@ -1043,8 +1540,8 @@ void CDuplicateCandidates::Examine(CGrepData* data)
 
         if (count > 0)
         {
-            // allocate memory for MD5 digests in one array
-            digest = (CMD5Digest*)malloc(count * sizeof(CMD5Digest));
+            // allocate memory for digests in one array
+            digest = (CDuplicatesDigest*)malloc(count * sizeof(CDuplicatesDigest));
             if (digest == NULL)
             {
                 TRACE_E(LOW_MEMORY);
@@ -1052,7 +1549,7 @@ void CDuplicateCandidates::Examine(CGrepData* data)
             }
 
             // set up the pointers
-            CMD5Digest* iterator = digest;
+            CDuplicatesDigest* iterator = digest;
             for (i = 0; i < Count; i++)
             {
                 CFoundFilesData* file = At(i);
@@ -1065,46 +1562,28 @@ void CDuplicateCandidates::Examine(CGrepData* data)
                     file->Group = 0;
             }
 
-            // determine total file size for progress
-            CQuadWord totalSize(0, 0);
-            for (i = 0; i < Count; i++)
-                totalSize += At(i)->Size;
-
-            // retrieve the MD5 digest of files
-            CQuadWord readSize(0, 0);
-            int progress = -1;
-            for (i = Count - 1; i >= 0; i--)
+            // 1) digests of the samples from the head and tail of files (of the whole
+            //    content of small files)
+            // 2) digests of the whole content of larger files whose samples match
+            int pass;
+            for (pass = 0; pass < 2; pass++)
             {
-                CFoundFilesData* file = At(i);
-                if (file->Size > CQuadWord(0, 0))
+                if (!ComputeDigests(data, pass == 1))
                 {
-                    if (!GetMD5Digest(data, file, &progress, &readSize, &totalSize))
-                    {
-                        if (data->StopSearch)
-                        {
-                            // the user wants to stop searching
-                            // trim the unprocessed items
-                            int j;
-                            for (j = 0; j <= i; j++)
-                                Delete(0);
-                            break; // show at least the duplicates that have been already found
-                        }
-                        // an error occurred during reading the file but the user wants to continue
-                        // exclude the file from candidates
-                        Delete(i);
-                    }
+                    free(digest);
+                    return;
                 }
-            }
 
-            // search finished, preparing results
-            data->SearchingText->Set(LoadStr(IDS_FIND_DUPS_RESULTS));
+                // search finished, preparing results
+                data->SearchingText->Set(LoadStr(IDS_FIND_DUPS_RESULTS));
 
-            // sort the files again
-            if (Count > 0)
-                QuickSort(0, Count - 1, byName, bySize, TRUE);
+                // sort the files again
+                if (Count > 0)
+                    QuickSort(0, Count - 1, byName, bySize, TRUE);
 
-            // remove items that occur only once
-            RemoveSingleFiles(byName, bySize, TRUE);
+                // remove items that occur only once
+                RemoveSingleFiles(byName, bySize, TRUE);
+            }
         }
     }
 
@@ -1157,7 +1636,9 @@ void CSearchForData::Set(const char* dir, const char* masksGroup, BOOL includeSu
 // Search engine
 //
 
-#define SEARCH_SIZE 10000 // must be greater than the maximum string length
+// size of the block searched between tests of StopSearch; the vectorized search of CSearchData
+// scans it in a fraction of a millisecond, bigger blocks only save re-scanning of the overlaps
+#define SEARCH_SIZE 0x100000 // must be greater than the maximum string length
 
 int SearchForward(CGrepData* data, char* txt, int size, int off)
 {
@@ -1186,7 +1667,8 @@ int SearchForward(CGrepData* data, char* txt, int size, int off)
 // ****************************************************************************
 
 BOOL TestFileContentAux(BOOL& ok, CQuadWord& fileOffset, const CQuadWord& totalSize,
-                        DWORD viewSize, const char* path, char* txt, CGrepData* data)
+                        DWORD viewSize, const char* path, char* txt, CGrepData* data,
+                        CRegularExpression* regExp)
 {
     __try
     {
@@ -1200,6 +1682,12 @@ BOOL TestFileContentAux(BOOL& ok, CQuadWord& fileOffset, const CQuadWord& totalS
             beg = txt;
             totalEnd = txt + viewSize;
 
+            // literal prefilter of the automaton: lines without the literal contained in every
+            // match are not tested at all; 'literal' is its next occurrence (totalEnd = none)
+            CRegExpDFA* dfa = regExp->GetDFA();
+            BOOL useLiteral = dfa != NULL && dfa->HasLiteral();
+            const char* literal = NULL;
+
             while (!data->StopSearch && beg < totalEnd)
             {
                 end = beg;
@@ -1254,13 +1742,38 @@ BOOL TestFileContentAux(BOOL& ok, CQuadWord& fileOffset, const CQuadWord& totalS
                 }
 
                 // line beg->end
-                if (data->RegExp.SetLine(beg, end))
+                if (useLiteral)
+                {
+                    if (literal == NULL || literal < beg)
+                    {
+                        int off = dfa->FindLiteral(beg, (int)(totalEnd - beg), 0);
+                        literal = off != -1 ? beg + off : totalEnd;
+                    }
+                    if (literal + dfa->GetLiteralLength() > end) // the line does not contain the literal
+                    {
+                        beg = nextBeg;
+                        continue;
+                    }
+                }
+                // the automaton decides in linear time, regexec is needed only to check whole words
+                int test = regExp->TestLine(beg, end);
+                if (test == rdfaNoMatch)
+                {
+                    beg = nextBeg;
+                    continue;
+                }
+                if (test == rdfaMatch && !data->WholeWords)
+                {
+                    ok = TRUE; // found
+                    break;
+                }
+                if (regExp->SetLine(beg, end))
                 {
                     int foundLen, start = 0;
 
                 GREP_REGEXP_NEXT:
 
-                    int found = data->RegExp.SearchForward(start, foundLen);
+                    int found = regExp->SearchForward(start, foundLen);
                     if (found != -1)
                     {
                         if (data->WholeWords)
@@ -1287,7 +1800,7 @@ BOOL TestFileContentAux(BOOL& ok, CQuadWord& fileOffset, const CQuadWord& totalS
                 {
                     FIND_LOG_ITEM log;
                     log.Flags = FLI_ERROR;
-                    log.Text = data->RegExp.GetLastErrorText();
+                    log.Text = regExp->GetLastErrorText();
                     log.Path = NULL;
                     SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
                     return FALSE; // do not search this file further
@@ -1356,7 +1869,10 @@ BOOL TestFileContentAux(BOOL& ok, CQuadWord& fileOffset, const CQuadWord& totalS
     }
 }
 
-BOOL TestFileContent(DWORD sizeLow, DWORD sizeHigh, const char* path, CGrepData* data, BOOL isLink)
+// 'regExp' is the regular expression used for searching (data->RegExp or a private copy of
+// a parallel search worker, CRegularExpression keeps the state of the searched line)
+BOOL TestFileContent(DWORD sizeLow, DWORD sizeHigh, const char* path, CGrepData* data, BOOL isLink,
+                     CRegularExpression* regExp)
 {
     CQuadWord totalSize(sizeLow, sizeHigh);
     CQuadWord fileOffset(0, 0);
@@ -1404,7 +1920,7 @@ BOOL TestFileContent(DWORD sizeLow, DWORD sizeHigh, const char* path, CGrepData*
                             // let the file view be examined
                             DWORD diff = (DWORD)(fileOffset - mapFileOffset).Value;
                             BOOL err2 = !TestFileContentAux(ok, fileOffset, totalSize, viewSize - diff,
-                                                            path, txt + diff, data);
+                                                            path, txt + diff, data, regExp);
                             HANDLES(UnmapViewOfFile(txt));
                             if (err2 || ok)
                                 break;
@@ -1615,7 +2131,7 @@ void SearchDirectory(char (&path)[MAX_PATH], char* end, int startPathLen,
                                     // links: file.nFileSizeLow == 0 && file.nFileSizeHigh == 0, the file size
                                     // must be additionally obtained via SalGetFileSize()
                                     BOOL isLink = (file.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
-                                    ok = TestFileContent(file.nFileSizeLow, file.nFileSizeHigh, path, data, isLink);
+                                    ok = TestFileContent(file.nFileSizeLow, file.nFileSizeHigh, path, data, isLink, &data->RegExp);
                                 }
                             }
                             else
@@ -1630,91 +2146,765 @@ void SearchDirectory(char (&path)[MAX_PATH], char* end, int startPathLen,
                                 else
                                     *end = 0;
 
-                                AddFoundItem(path, file.cFileName, file.nFileSizeLow, file.nFileSizeHigh,
-                                             file.dwFileAttributes, &file.ftLastWriteTime, isDir, data,
-                                             duplicateCandidates);
+                                AddFoundItem(path, file.cFileName, file.nFileSizeLow, file.nFileSizeHigh,
+                                             file.dwFileAttributes, &file.ftLastWriteTime, isDir, data,
+                                             duplicateCandidates);
+
+                                if (end - path > 3)
+                                    *(end - 1) = '\\';
+                                else
+                                    *end = 0;
+                            }
+                        }
+                    }
+                }
+                if (isDir && includeSubDirs && !ignoreDir) // directory + not "." or ".."
+                {
+                    int l = (int)strlen(file.cFileName);
+
+                    if ((end - path) + l + 1 /* 1 za backslash */ < _countof(path))
+                    {
+                        BOOL searchNow = TRUE;
+
+                        if (dirStack != NULL)
+                        {
+                            // just store for later search
+                            char* newFileName = new char[l + 1];
+                            if (newFileName != NULL)
+                            {
+                                memmove(newFileName, file.cFileName, l + 1);
+                                if (dirStackCount < dirStack->Count)
+                                {
+                                    // no need to assign an item - we have space
+                                    dirStack->At(dirStackCount) = newFileName;
+                                    dirStackCount++;
+                                    searchNow = FALSE;
+                                }
+                                else
+                                {
+                                    // we must allocate a new item in the array
+                                    dirStack->Add(newFileName);
+                                    if (dirStack->IsGood())
+                                    {
+                                        dirStackCount++;
+                                        searchNow = FALSE;
+                                    }
+                                    else
+                                    {
+                                        dirStack->ResetState();
+                                        delete[] newFileName;
+                                    }
+                                }
+                            }
+                        }
+
+                        if (searchNow)
+                        {
+                            // out of memory - we will not use dirStack
+                            strcpy_s(end, _countof(path) - (end - path), file.cFileName);
+                            strcat_s(end, _countof(path) - (end - path), "\\");
+                            l++;
+                            SearchDirectory(path, end + l, startPathLen, masksGroup, includeSubDirs, data, NULL,
+                                            0, duplicateCandidates, ignoreList, message);
+                        }
+                    }
+                    else
+                    {
+                        FIND_LOG_ITEM log;
+                        log.Flags = FLI_ERROR;
+                        log.Text = LoadStr(IDS_TOOLONGNAME);
+                        strcpy_s(end, _countof(path) - (end - path), file.cFileName);
+                        log.Path = path;
+                        SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+                    }
+                }
+            }
+            else // too long file-name
+            {
+                FIND_LOG_ITEM log;
+                log.Flags = FLI_ERROR;
+                log.Text = LoadStr(IDS_TOOLONGNAME);
+                *end = 0;
+                strcpy_s(message, path);
+                strcat_s(message, file.cFileName);
+                log.Path = message;
+                SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+            }
+            if (data->StopSearch)
+            {
+                testFindNextErr = FALSE;
+                break;
+            }
+        } while (FindNextFileW(find, &fileW));
+        DWORD err = GetLastError();
+        HANDLES(FindClose(find));
+
+        if (testFindNextErr && err != ERROR_NO_MORE_FILES)
+        {
+            if (end - path > 3)
+                *(end - 1) = 0;
+            else
+                *end = 0;
+
+            sprintf(message, LoadStr(IDS_DIRERRORFORMAT), GetErrorText(err));
+            FIND_LOG_ITEM log;
+            log.Flags = FLI_ERROR;
+            log.Text = message;
+            log.Path = path;
+            SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+
+            if (end - path > 3)
+                *(end - 1) = '\\';
+            else
+                *end = 0;
+        }
+
+        // search through directories
+        if (dirStack != NULL)
+        {
+            int i;
+            for (i = dirStackEnterCount; i < dirStackCount; i++)
+            {
+                char* newFileName = (char*)dirStack->At(i);
+                if (!data->StopSearch) // may be set during SearchDirectory
+                {
+                    strcpy_s(end, _countof(path) - (end - path), newFileName);
+                    strcat_s(end, _countof(path) - (end - path), "\\");
+                    SearchDirectory(path, end + strlen(end), startPathLen, masksGroup, includeSubDirs, data,
+                                    dirStack, dirStackCount, duplicateCandidates, ignoreList, message);
+                }
+            }
+            // and release data from this level
+            for (i = dirStackEnterCount; i < dirStackCount; i++)
+                delete[] dirStack->At(i);
+        }
+    }
+    else
+    {
+        DWORD err = GetLastError();
+        if (err != ERROR_FILE_NOT_FOUND && err != ERROR_NO_MORE_FILES)
+        {
+            if (end - path > 3)
+                *(end - 1) = 0;
+            else
+                *end = 0;
+
+            sprintf(message, LoadStr(IDS_DIRERRORFORMAT), GetErrorText(err));
+
+            FIND_LOG_ITEM log;
+            log.Flags = FLI_ERROR | FLI_IGNORE;
+            log.Text = message;
+            log.Path = path;
+            SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+
+            if (end - path > 3)
+                *(end - 1) = '\\';
+            else
+                *end = 0;
+        }
+    }
+    *end = 0;
+}
+
+//*********************************************************************************
+//
+// CFindWorkPool
+//
+// Parallel search engine used instead of SearchDirectory when searching new data.
+// Work is split into items: a directory to enumerate or a file whose content should
+// be searched. Every worker owns a queue of items; it takes its own items from the
+// end (depth first, the paths stay hot in the cache) and when it runs out of work it
+// steals the oldest items from the queues of other workers. A content search of a
+// large tree on a slow (network) disk thus keeps several requests in flight at once.
+// Found items are delivered to the list view in batches.
+//
+
+#define FIND_POOL_MAX_WORKERS 16   // maximum number of worker threads
+#define FIND_POOL_RESULT_BATCH 64  // number of found items delivered to the list view at once
+#define FIND_POOL_RESULT_DELAY 200 // maximum time (in ms) a found item waits in the worker's batch
+#define FIND_POOL_IDLE_WAIT 50     // timeout (in ms) of an idle worker waiting for new work
+
+struct CFindWorkItem
+{
+    char* Path;    // directory: full path ending with a backslash; file: full path of the file
+    int NameOffs;  // file: offset of the name in 'Path'
+    int RootIndex; // index of the searched root in CFindWorkPool::Roots
+    BOOL IsDir;
+    DWORD Attr; // file: attributes, size and time of the last write (for AddFoundItem)
+    DWORD SizeLow;
+    DWORD SizeHigh;
+    FILETIME LastWrite;
+
+    CFindWorkItem()
+    {
+        Path = NULL;
+        NameOffs = 0;
+        RootIndex = 0;
+        IsDir = FALSE;
+        Attr = 0;
+        SizeLow = SizeHigh = 0;
+        ZeroMemory(&LastWrite, sizeof(LastWrite));
+    }
+    ~CFindWorkItem()
+    {
+        if (Path != NULL)
+            free(Path);
+    }
+};
+
+struct CFindWorkRoot
+{
+    CMaskGroup* MasksGroup;
+    BOOL IncludeSubDirs;
+    int StartPathLen; // length of the searched root path (see CFindIgnore::Contains)
+};
+
+class CFindWorkPool;
+
+class CFindWorker
+{
+public:
+    CFindWorkPool* Pool;
+    HANDLE Thread;
+
+    CRITICAL_SECTION QueueSection;      // guards Queue and QueueHead
+    TDirectArray<CFindWorkItem*> Queue; // items [QueueHead, Queue.Count) are valid
+    int QueueHead;                      // index of the oldest item (it is stolen first)
+
+    CRegularExpression RegExp;               // private copy of CGrepData::RegExp (it keeps line state)
+    TIndirectArray<CFoundFilesData> Results; // found items waiting for delivery to the list view
+    DWORD ResultsTick;                       // GetTickCount() of the oldest item in 'Results'
+
+    char Message[2 * MAX_PATH]; // buffer for error texts
+
+public:
+    CFindWorker();
+    ~CFindWorker();
+
+    BOOL Push(CFindWorkItem* item); // returns FALSE on low memory (the item is not queued)
+    CFindWorkItem* Pop();   // takes the newest item of this worker
+    CFindWorkItem* Steal(); // takes the oldest item of this worker (called by other workers)
+};
+
+class CFindWorkPool
+{
+protected:
+    CGrepData* Data;
+    CDuplicateCandidates* DuplicateCandidates; // if not NULL, found items are collected here
+    CFindIgnore* IgnoreList;                   // may be NULL
+
+    TDirectArray<CFindWorkRoot> Roots;
+
+    CFindWorker* Workers;
+    int WorkerCount;
+
+    volatile LONG Pending;   // number of queued items plus items being processed
+    volatile LONG IdleCount; // number of workers waiting for work
+    HANDLE WorkEvent;        // auto-reset: new work was queued
+    HANDLE DoneEvent;        // manual-reset: no work is left (Pending dropped to zero)
+
+    CRITICAL_SECTION ResultsSection; // serializes delivery of found items
+
+    // statistics for the trace (bench) output
+    volatile LONG DirsCount;
+    volatile LONG FilesCount;
+    volatile LONG GrepCount;
+    volatile __int64 GrepBytes;
+
+public:
+    CFindWorkPool(CGrepData* data, CDuplicateCandidates* duplicateCandidates, CFindIgnore* ignoreList);
+    ~CFindWorkPool();
+
+    // number of workers used for searching; returns 1 if the parallel search should not be used
+    static int GetWorkerCount();
+
+    // creates 'workers' worker structures; returns FALSE on low memory or regexp error
+    BOOL Init(int workers);
+
+    // adds a searched root; 'dir' must end with a backslash; masks must be prepared
+    BOOL AddRoot(const char* dir, CMaskGroup* masksGroup, BOOL includeSubDirs);
+
+    // runs the search and waits for its end (all items processed or data->StopSearch)
+    // returns FALSE if worker threads could not be started (nothing was searched)
+    BOOL Run();
+
+protected:
+    static DWORD WINAPI WorkerThread(void* param);
+    static unsigned WorkerThreadEH(void* param);
+    void WorkerBody(CFindWorker* worker);
+
+    CFindWorkItem* GetWork(CFindWorker* worker);
+    void AddWork(CFindWorker* worker, CFindWorkItem* item); // takes ownership of 'item'
+    void ItemDone();
+
+    void EnumDirectory(CFindWorker* worker, CFindWorkItem* item);
+    void GrepFile(CFindWorker* worker, CFindWorkItem* item);
+
+    // adds a found item; files of 'path' (ending with a backslash) are added with the path
+    // without the backslash (same as in SearchDirectory)
+    void AddFound(CFindWorker* worker, const char* path, const char* name, DWORD sizeLow, DWORD sizeHigh,
+                  DWORD attr, const FILETIME* lastWrite, BOOL isDir);
+    void FlushResults(CFindWorker* worker, BOOL force);
+    void AddLog(DWORD flags, const char* text, const char* path);
+};
+
+CFindWorker::CFindWorker()
+    : Queue(256, 1024), Results(FIND_POOL_RESULT_BATCH, FIND_POOL_RESULT_BATCH)
+{
+    Pool = NULL;
+    Thread = NULL;
+    QueueHead = 0;
+    ResultsTick = 0;
+    Message[0] = 0;
+    HANDLES(InitializeCriticalSection(&QueueSection));
+}
+
+CFindWorker::~CFindWorker()
+{
+    int i;
+    for (i = QueueHead; i < Queue.Count; i++)
+        delete Queue[i];
+    Results.DestroyMembers();
+    HANDLES(DeleteCriticalSection(&QueueSection));
+}
+
+BOOL CFindWorker::Push(CFindWorkItem* item)
+{
+    HANDLES(EnterCriticalSection(&QueueSection));
+    if (QueueHead > 0 && QueueHead == Queue.Count)
+    { // everything was taken, start from the beginning of the array again
+        Queue.DetachMembers();
+        QueueHead = 0;
+    }
+    Queue.Add(item);
+    BOOL good = Queue.IsGood();
+    if (!good)
+        Queue.ResetState();
+    HANDLES(LeaveCriticalSection(&QueueSection));
+    return good;
+}
+
+CFindWorkItem* CFindWorker::Pop()
+{
+    CFindWorkItem* item = NULL;
+    HANDLES(EnterCriticalSection(&QueueSection));
+    if (Queue.Count > QueueHead)
+    {
+        item = Queue[Queue.Count - 1];
+        Queue.Detach(Queue.Count - 1);
+        if (!Queue.IsGood())
+            Queue.ResetState(); // the array could not be shrunk, does not matter
+        if (Queue.Count == QueueHead)
+        {
+            Queue.DetachMembers();
+            QueueHead = 0;
+        }
+    }
+    HANDLES(LeaveCriticalSection(&QueueSection));
+    return item;
+}
+
+CFindWorkItem* CFindWorker::Steal()
+{
+    CFindWorkItem* item = NULL;
+    if (!TryEnterCriticalSection(&QueueSection))
+        return NULL; // the owner or another thief is busy here, try the next worker
+    if (Queue.Count > QueueHead)
+        item = Queue[QueueHead++];
+    HANDLES(LeaveCriticalSection(&QueueSection));
+    return item;
+}
+
+CFindWorkPool::CFindWorkPool(CGrepData* data, CDuplicateCandidates* duplicateCandidates,
+                             CFindIgnore* ignoreList) : Roots(10, 10)
+{
+    Data = data;
+    DuplicateCandidates = duplicateCandidates;
+    IgnoreList = ignoreList;
+    Workers = NULL;
+    WorkerCount = 0;
+    Pending = 0;
+    IdleCount = 0;
+    WorkEvent = HANDLES(CreateEvent(NULL, FALSE, FALSE, NULL));
+    DoneEvent = HANDLES(CreateEvent(NULL, TRUE, FALSE, NULL));
+    HANDLES(InitializeCriticalSection(&ResultsSection));
+    DirsCount = 0;
+    FilesCount = 0;
+    GrepCount = 0;
+    GrepBytes = 0;
+}
+
+CFindWorkPool::~CFindWorkPool()
+{
+    if (Workers != NULL)
+        delete[] Workers;
+    if (WorkEvent != NULL)
+        HANDLES(CloseHandle(WorkEvent));
+    if (DoneEvent != NULL)
+        HANDLES(CloseHandle(DoneEvent));
+    HANDLES(DeleteCriticalSection(&ResultsSection));
+}
+
+int CFindWorkPool::GetWorkerCount()
+{
+    // searching is mostly bound by the latency of the disk (network), so we use more
+    // threads than processors to keep more requests in flight
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int count = 2 * (int)si.dwNumberOfProcessors;
+    if (count < 2)
+        count = 2;
+    if (count > FIND_POOL_MAX_WORKERS)
+        count = FIND_POOL_MAX_WORKERS;
+    return count;
+}
+
+BOOL CFindWorkPool::Init(int workers)
+{
+    if (WorkEvent == NULL || DoneEvent == NULL)
+        return FALSE;
+    Workers = new CFindWorker[workers];
+    if (Workers == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    WorkerCount = workers;
+    int i;
+    for (i = 0; i < WorkerCount; i++)
+    {
+        Workers[i].Pool = this;
+        if (Data->Grep && Data->Regular)
+        {
+            if (!Workers[i].RegExp.Set(Data->RegExp.GetPattern(), Data->RegExp.GetFlags()))
+            {
+                TRACE_E("CFindWorkPool::Init(): unable to copy regular expression: " << Workers[i].RegExp.GetLastErrorText());
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+BOOL CFindWorkPool::AddRoot(const char* dir, CMaskGroup* masksGroup, BOOL includeSubDirs)
+{
+    CFindWorkRoot root;
+    root.MasksGroup = masksGroup;
+    root.IncludeSubDirs = includeSubDirs;
+    root.StartPathLen = (int)strlen(dir);
+    Roots.Add(root);
+    if (!Roots.IsGood())
+    {
+        Roots.ResetState();
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+
+    CFindWorkItem* item = new CFindWorkItem;
+    if (item == NULL || (item->Path = DupStr(dir)) == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        if (item != NULL)
+            delete item;
+        return FALSE;
+    }
+    item->IsDir = TRUE;
+    item->RootIndex = Roots.Count - 1;
+    // distribute the roots among the workers, the rest is done by stealing
+    AddWork(&Workers[item->RootIndex % WorkerCount], item);
+    return TRUE;
+}
+
+void CFindWorkPool::AddWork(CFindWorker* worker, CFindWorkItem* item)
+{
+    // count the item before it is visible, otherwise another worker could steal it
+    // and finish it before the increment and Pending would drop to zero too early
+    InterlockedIncrement(&Pending);
+    if (!worker->Push(item))
+    {
+        TRACE_E(LOW_MEMORY);
+        delete item;
+        ItemDone();
+        return;
+    }
+    if (IdleCount > 0)
+        SetEvent(WorkEvent);
+}
+
+void CFindWorkPool::ItemDone()
+{
+    if (InterlockedDecrement(&Pending) == 0)
+        SetEvent(DoneEvent);
+}
+
+CFindWorkItem* CFindWorkPool::GetWork(CFindWorker* worker)
+{
+    CFindWorkItem* item = worker->Pop();
+    if (item == NULL)
+    {
+        // steal from the other workers, start with the next one so the thieves spread out
+        int index = (int)(worker - Workers);
+        int i;
+        for (i = 1; i < WorkerCount && item == NULL; i++)
+            item = Workers[(index + i) % WorkerCount].Steal();
+    }
+    return item;
+}
+
+BOOL CFindWorkPool::Run()
+{
+    DWORD startTick = GetTickCount();
+    HANDLE threads[FIND_POOL_MAX_WORKERS];
+    int started = 0;
+    int i;
+    for (i = 0; i < WorkerCount; i++)
+    {
+        DWORD threadId;
+        Workers[i].Thread = HANDLES(CreateThread(NULL, 0, WorkerThread, &Workers[i], 0, &threadId));
+        if (Workers[i].Thread == NULL)
+        {
+            TRACE_E("CFindWorkPool::Run(): unable to start worker thread " << i);
+            break;
+        }
+        threads[started++] = Workers[i].Thread;
+    }
+    if (started == 0)
+        return FALSE;
+    if (started < WorkerCount)
+    {
+        // queued items of the workers that were not started are stolen by the running ones
+        TRACE_I("CFindWorkPool::Run(): running only " << started << " workers");
+    }
+
+    WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+    for (i = 0; i < started; i++)
+    {
+        HANDLES(CloseHandle(Workers[i].Thread));
+        Workers[i].Thread = NULL;
+    }
+
+    DWORD ms = GetTickCount() - startTick;
+    if (ms == 0)
+        ms = 1;
+    TRACE_I("CFindWorkPool: " << started << " workers, " << DirsCount << " directories, " << FilesCount << " files in "
+                              << ms << " ms (" << (int)((__int64)FilesCount * 1000 / ms) << " files/s), grep: " << GrepCount
+                              << " files, " << (int)(GrepBytes / 1024 / 1024) << " MB ("
+                              << (int)(GrepBytes * 1000 / ms / 1024 / 1024) << " MB/s)" << (Data->StopSearch ? ", stopped" : ""));
+    return TRUE;
+}
+
+unsigned CFindWorkPool::WorkerThreadEH(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    __try
+    {
+#endif // CALLSTK_DISABLE
+        SetThreadNameInVCAndTrace("Grep Worker");
+        CFindWorker* worker = (CFindWorker*)param;
+        worker->Pool->WorkerBody(worker);
+        return 0;
+#ifndef CALLSTK_DISABLE
+    }
+    __except (CCallStack::HandleException(GetExceptionInformation()))
+    {
+        TRACE_I("Thread Grep Worker: calling ExitProcess(1).");
+        //    ExitProcess(1);
+        TerminateProcess(GetCurrentProcess(), 1); // harder exit (this call still performs some operations)
+        return 1;
+    }
+#endif // CALLSTK_DISABLE
+}
+
+DWORD WINAPI CFindWorkPool::WorkerThread(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    CCallStack stack;
+#endif // CALLSTK_DISABLE
+    return WorkerThreadEH(param);
+}
+
+void CFindWorkPool::WorkerBody(CFindWorker* worker)
+{
+    CALL_STACK_MESSAGE1("CFindWorkPool::WorkerBody()");
+    while (!Data->StopSearch)
+    {
+        CFindWorkItem* item = GetWork(worker);
+        if (item != NULL)
+        {
+            if (item->IsDir)
+                EnumDirectory(worker, item);
+            else
+                GrepFile(worker, item);
+            delete item;
+            ItemDone();
+            FlushResults(worker, FALSE);
+            continue;
+        }
+
+        if (Pending == 0)
+            break; // everything is done
+
+        // no work for us now; deliver what we have and wait until someone queues more
+        FlushResults(worker, TRUE);
+        InterlockedIncrement(&IdleCount);
+        HANDLE events[2] = {DoneEvent, WorkEvent};
+        WaitForMultipleObjects(2, events, FALSE, FIND_POOL_IDLE_WAIT);
+        InterlockedDecrement(&IdleCount);
+    }
+    FlushResults(worker, TRUE);
+    SetEvent(WorkEvent); // wake up another idle worker so it can notice the end too
+}
+
+void CFindWorkPool::AddLog(DWORD flags, const char* text, const char* path)
+{
+    FIND_LOG_ITEM log;
+    log.Flags = flags;
+    log.Text = text;
+    log.Path = path;
+    SendMessage(Data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+}
+
+void CFindWorkPool::EnumDirectory(CFindWorker* worker, CFindWorkItem* item)
+{
+    SLOW_CALL_STACK_MESSAGE2("CFindWorkPool::EnumDirectory(%s)", item->Path);
+    CFindWorkRoot* root = &Roots[item->RootIndex];
+
+    char path[MAX_PATH];
+    lstrcpyn(path, item->Path, MAX_PATH);
+    char* end = path + strlen(path);
+
+    if (IgnoreList != NULL && IgnoreList->Contains(path, root->StartPathLen))
+    {
+        AddLog(FLI_INFO, LoadStr(IDS_FINDLOG_SKIP), path);
+        return;
+    }
+
+    if ((end - path) + 1 < _countof(path))
+        strcpy_s(end, _countof(path) - (end - path), "*");
+    else
+    {
+        AddLog(FLI_ERROR, LoadStr(IDS_TOOLONGNAME), path);
+        return;
+    }
+
+    InterlockedIncrement(&DirsCount);
 
-                                if (end - path > 3)
-                                    *(end - 1) = '\\';
-                                else
-                                    *end = 0;
-                            }
-                        }
-                    }
-                }
-                if (isDir && includeSubDirs && !ignoreDir) // directory + not "." or ".."
+    WIN32_FIND_DATAW fileW;
+    WIN32_FIND_DATA file;
+    CStrP pathW(ConvertAllocUtf8ToWide(path, -1));
+    HANDLE find = pathW != NULL ? HANDLES_Q(FindFirstFileW(pathW, &fileW)) : INVALID_HANDLE_VALUE;
+    // path without the trailing backslash (except for root "C:\"), used for found items and in the log
+    char* cut = end - path > 3 ? end - 1 : end;
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        *cut = 0;
+        Data->SearchingText->Set(path); // set the current path
+        *cut = '\\';
+        *end = 0;
+
+        BOOL testFindNextErr = TRUE;
+        do
+        {
+            ConvertFindDataWToUtf8(fileW, &file);
+            BOOL isDir = (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            BOOL ignoreDir = isDir && (lstrcmp(file.cFileName, ".") == 0 || lstrcmp(file.cFileName, "..") == 0);
+            if (ignoreDir || (end - path) + lstrlen(file.cFileName) < _countof(path))
+            {
+                // deliver found items of long-running directory listings too
+                FlushResults(worker, FALSE);
+
+                if (file.cFileName[0] != 0 && !ignoreDir)
                 {
-                    int l = (int)strlen(file.cFileName);
+                    InterlockedIncrement(&FilesCount);
 
-                    if ((end - path) + l + 1 /* 1 za backslash */ < _countof(path))
+                    // test the criteria attributes, size, date and time
+                    CQuadWord size(file.nFileSizeLow, file.nFileSizeHigh);
+                    if (Data->Criteria.Test(file.dwFileAttributes, &size, &file.ftLastWriteTime) &&
+                        root->MasksGroup->AgreeMasks(file.cFileName, NULL))
                     {
-                        BOOL searchNow = TRUE;
-
-                        if (dirStack != NULL)
+                        if (Data->Grep)
                         {
-                            // just store for later search
-                            char* newFileName = new char[l + 1];
-                            if (newFileName != NULL)
+                            if (!isDir) // a directory cannot be grepped
                             {
-                                memmove(newFileName, file.cFileName, l + 1);
-                                if (dirStackCount < dirStack->Count)
-                                {
-                                    // no need to assign an item - we have space
-                                    dirStack->At(dirStackCount) = newFileName;
-                                    dirStackCount++;
-                                    searchNow = FALSE;
-                                }
-                                else
+                                // the content is searched by the first worker that gets to it
+                                CFindWorkItem* fileItem = new CFindWorkItem;
+                                if (fileItem != NULL)
                                 {
-                                    // we must allocate a new item in the array
-                                    dirStack->Add(newFileName);
-                                    if (dirStack->IsGood())
+                                    strcpy_s(end, _countof(path) - (end - path), file.cFileName);
+                                    fileItem->Path = DupStr(path);
+                                    *end = 0;
+                                    if (fileItem->Path != NULL)
                                     {
-                                        dirStackCount++;
-                                        searchNow = FALSE;
+                                        fileItem->NameOffs = (int)(end - path);
+                                        fileItem->RootIndex = item->RootIndex;
+                                        fileItem->Attr = file.dwFileAttributes;
+                                        fileItem->SizeLow = file.nFileSizeLow;
+                                        fileItem->SizeHigh = file.nFileSizeHigh;
+                                        fileItem->LastWrite = file.ftLastWriteTime;
+                                        AddWork(worker, fileItem);
                                     }
                                     else
                                     {
-                                        dirStack->ResetState();
-                                        delete[] newFileName;
+                                        delete fileItem;
+                                        fileItem = NULL;
                                     }
                                 }
+                                if (fileItem == NULL)
+                                    TRACE_E(LOW_MEMORY);
                             }
                         }
-
-                        if (searchNow)
+                        else
+                        {
+                            *cut = 0;
+                            AddFound(worker, path, file.cFileName, file.nFileSizeLow, file.nFileSizeHigh,
+                                     file.dwFileAttributes, &file.ftLastWriteTime, isDir);
+                            *cut = '\\';
+                            *end = 0;
+                        }
+                    }
+                }
+                if (isDir && root->IncludeSubDirs && !ignoreDir) // directory + not "." or ".."
+                {
+                    int l = (int)strlen(file.cFileName);
+                    if ((end - path) + l + 1 /* 1 for backslash */ < _countof(path))
+                    {
+                        CFindWorkItem* dirItem = new CFindWorkItem;
+                        if (dirItem != NULL)
                         {
-                            // out of memory - we will not use dirStack
                             strcpy_s(end, _countof(path) - (end - path), file.cFileName);
                             strcat_s(end, _countof(path) - (end - path), "\\");
-                            l++;
-                            SearchDirectory(path, end + l, startPathLen, masksGroup, includeSubDirs, data, NULL,
-                                            0, duplicateCandidates, ignoreList, message);
+                            dirItem->Path = DupStr(path);
+                            *end = 0;
+                            if (dirItem->Path != NULL)
+                            {
+                                dirItem->IsDir = TRUE;
+                                dirItem->RootIndex = item->RootIndex;
+                                AddWork(worker, dirItem);
+                            }
+                            else
+                            {
+                                delete dirItem;
+                                dirItem = NULL;
+                            }
                         }
+                        if (dirItem == NULL)
+                            TRACE_E(LOW_MEMORY);
                     }
                     else
                     {
-                        FIND_LOG_ITEM log;
-                        log.Flags = FLI_ERROR;
-                        log.Text = LoadStr(IDS_TOOLONGNAME);
                         strcpy_s(end, _countof(path) - (end - path), file.cFileName);
-                        log.Path = path;
-                        SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+                        AddLog(FLI_ERROR, LoadStr(IDS_TOOLONGNAME), path);
+                        *end = 0;
                     }
                 }
             }
             else // too long file-name
             {
-                FIND_LOG_ITEM log;
-                log.Flags = FLI_ERROR;
-                log.Text = LoadStr(IDS_TOOLONGNAME);
-                *end = 0;
-                strcpy_s(message, path);
-                strcat_s(message, file.cFileName);
-                log.Path = message;
-                SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+                strcpy_s(worker->Message, path);
+                strcat_s(worker->Message, file.cFileName);
+                AddLog(FLI_ERROR, LoadStr(IDS_TOOLONGNAME), worker->Message);
             }
-            if (data->StopSearch)
+            if (Data->StopSearch)
             {
                 testFindNextErr = FALSE;
                 break;
@@ -1725,71 +2915,286 @@ void SearchDirectory(char (&path)[MAX_PATH], char* end, int startPathLen,
 
         if (testFindNextErr && err != ERROR_NO_MORE_FILES)
         {
-            if (end - path > 3)
-                *(end - 1) = 0;
-            else
-                *end = 0;
+            *cut = 0;
+            sprintf(worker->Message, LoadStr(IDS_DIRERRORFORMAT), GetErrorText(err));
+            AddLog(FLI_ERROR, worker->Message, path);
+        }
+    }
+    else
+    {
+        DWORD err = GetLastError();
+        if (err != ERROR_FILE_NOT_FOUND && err != ERROR_NO_MORE_FILES)
+        {
+            *cut = 0;
+            sprintf(worker->Message, LoadStr(IDS_DIRERRORFORMAT), GetErrorText(err));
+            AddLog(FLI_ERROR | FLI_IGNORE, worker->Message, path);
+        }
+    }
+}
 
-            sprintf(message, LoadStr(IDS_DIRERRORFORMAT), GetErrorText(err));
-            FIND_LOG_ITEM log;
-            log.Flags = FLI_ERROR;
-            log.Text = message;
-            log.Path = path;
-            SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+void CFindWorkPool::GrepFile(CFindWorker* worker, CFindWorkItem* item)
+{
+    // links: SizeLow == 0 && SizeHigh == 0, the file size must be additionally
+    // obtained via SalGetFileSize() (done in TestFileContent)
+    BOOL isLink = (item->Attr & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    BOOL ok = TestFileContent(item->SizeLow, item->SizeHigh, item->Path, Data, isLink,
+                              Data->Regular ? &worker->RegExp : NULL);
+    InterlockedIncrement(&GrepCount);
+    InterlockedExchangeAdd64(&GrepBytes, CQuadWord(item->SizeLow, item->SizeHigh).Value);
+    if (ok)
+    {
+        // found items have the path without the trailing backslash (except for root "C:\")
+        char* name = item->Path + item->NameOffs;
+        char* cut = item->NameOffs > 3 ? name - 1 : name;
+        char nameBuf[MAX_PATH];
+        lstrcpyn(nameBuf, name, MAX_PATH);
+        *cut = 0;
+        AddFound(worker, item->Path, nameBuf, item->SizeLow, item->SizeHigh, item->Attr, &item->LastWrite, FALSE);
+    }
+}
 
-            if (end - path > 3)
-                *(end - 1) = '\\';
-            else
-                *end = 0;
-        }
+void CFindWorkPool::AddFound(CFindWorker* worker, const char* path, const char* name, DWORD sizeLow,
+                             DWORD sizeHigh, DWORD attr, const FILETIME* lastWrite, BOOL isDir)
+{
+    if (DuplicateCandidates != NULL)
+    {
+        // candidates are examined after the whole search, there is nothing to show now
+        HANDLES(EnterCriticalSection(&ResultsSection));
+        AddFoundItem(path, name, sizeLow, sizeHigh, attr, lastWrite, isDir, Data, DuplicateCandidates);
+        HANDLES(LeaveCriticalSection(&ResultsSection));
+        return;
+    }
 
-        // search through directories
-        if (dirStack != NULL)
+    CFoundFilesData* foundData = new CFoundFilesData;
+    if (foundData != NULL)
+    {
+        if (foundData->Set(path, name, CQuadWord(sizeLow, sizeHigh), attr, lastWrite, isDir))
         {
-            int i;
-            for (i = dirStackEnterCount; i < dirStackCount; i++)
+            if (worker->Results.Count == 0)
+                worker->ResultsTick = GetTickCount();
+            worker->Results.Add(foundData);
+            if (!worker->Results.IsGood())
             {
-                char* newFileName = (char*)dirStack->At(i);
-                if (!data->StopSearch) // may be set during SearchDirectory
-                {
-                    strcpy_s(end, _countof(path) - (end - path), newFileName);
-                    strcat_s(end, _countof(path) - (end - path), "\\");
-                    SearchDirectory(path, end + strlen(end), startPathLen, masksGroup, includeSubDirs, data,
-                                    dirStack, dirStackCount, duplicateCandidates, ignoreList, message);
-                }
+                worker->Results.ResetState();
+                delete foundData;
+                foundData = NULL;
             }
-            // and release data from this level
-            for (i = dirStackEnterCount; i < dirStackCount; i++)
-                delete[] dirStack->At(i);
         }
+        else
+        {
+            delete foundData;
+            foundData = NULL;
+        }
+    }
+    if (foundData == NULL)
+    {
+        AddLog(FLI_ERROR, LoadStr(IDS_CANTSHOWRESULTS), NULL);
+        Data->StopSearch = TRUE;
+        return;
+    }
+    FlushResults(worker, FALSE);
+}
+
+void CFindWorkPool::FlushResults(CFindWorker* worker, BOOL force)
+{
+    DWORD tick = GetTickCount();
+    if (worker->Results.Count == 0)
+    {
+        // nothing of ours; the other workers may have added items without showing them
+        if (!Data->NeedRefresh || tick - Data->FoundVisibleTick < 500)
+            return;
     }
     else
     {
-        DWORD err = GetLastError();
-        if (err != ERROR_FILE_NOT_FOUND && err != ERROR_NO_MORE_FILES)
+        if (!force && worker->Results.Count < FIND_POOL_RESULT_BATCH &&
+            tick - worker->ResultsTick < FIND_POOL_RESULT_DELAY)
         {
-            if (end - path > 3)
-                *(end - 1) = 0;
-            else
-                *end = 0;
+            return;
+        }
+    }
 
-            sprintf(message, LoadStr(IDS_DIRERRORFORMAT), GetErrorText(err));
+    if (Data->FoundFilesListView == NULL) // benchmark without the Find dialog, results are not needed
+    {
+        worker->Results.DestroyMembers();
+        return;
+    }
 
-            FIND_LOG_ITEM log;
-            log.Flags = FLI_ERROR | FLI_IGNORE;
-            log.Text = message;
-            log.Path = path;
-            SendMessage(data->HWindow, WM_USER_ADDLOG, (WPARAM)&log, 0);
+    BOOL refresh = FALSE;
+    BOOL lowMem = FALSE;
+    HANDLES(EnterCriticalSection(&ResultsSection));
+    int i;
+    for (i = 0; i < worker->Results.Count; i++)
+    {
+        Data->FoundFilesListView->Add(worker->Results[i]);
+        if (!Data->FoundFilesListView->IsGood())
+        {
+            Data->FoundFilesListView->ResetState();
+            lowMem = TRUE;
+            break;
+        }
+    }
+    // items not taken by the list view are released
+    int j;
+    for (j = i; j < worker->Results.Count; j++)
+        delete worker->Results[j];
+    worker->Results.DetachMembers();
+
+    // request a listview redraw after every 100 added items
+    // also after 0.5 seconds has passed since the last redraw
+    if (Data->FoundFilesListView->GetCount() >= Data->FoundVisibleCount + 100 ||
+        tick - Data->FoundVisibleTick >= 500)
+    {
+        refresh = TRUE;
+        Data->NeedRefresh = FALSE;
+    }
+    else
+        Data->NeedRefresh = TRUE; // we will redraw at latest after 0.5 second
+    HANDLES(LeaveCriticalSection(&ResultsSection));
 
-            if (end - path > 3)
-                *(end - 1) = '\\';
-            else
-                *end = 0;
+    if (refresh)
+        SendMessage(Data->HWindow, WM_USER_ADDFILE, 0, 0);
+    if (lowMem)
+    {
+        AddLog(FLI_ERROR, LoadStr(IDS_CANTSHOWRESULTS), NULL);
+        Data->StopSearch = TRUE;
+    }
+}
+
+#ifdef _DEBUG
+
+#define FIND_BENCH_DIRS 40         // number of directories in the synthetic tree (two levels)
+#define FIND_BENCH_FILES 100       // number of files in each directory
+#define FIND_BENCH_FILE_SIZE 65536 // size of each file
+
+// creates a synthetic tree of text files in 'dir' (unless it already exists)
+BOOL FindBenchmarkCreateTree(const char* dir)
+{
+    char path[MAX_PATH];
+    lstrcpyn(path, dir, MAX_PATH);
+    if (!SalPathAppend(path, "findbench", MAX_PATH))
+        return FALSE;
+    if (GetFileAttributes(path) != INVALID_FILE_ATTRIBUTES)
+        return TRUE; // created by a previous run
+    if (!CreateDirectory(path, NULL))
+        return FALSE;
+
+    char* buffer = (char*)malloc(FIND_BENCH_FILE_SIZE);
+    if (buffer == NULL)
+        return FALSE;
+    static const char* words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "salamander", "panel",
+                                  "viewer", "archive", "plugin", "0123456789", "Error:", "\r\n"};
+    DWORD seed = 12345;
+    int len = 0;
+    while (len < FIND_BENCH_FILE_SIZE)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char* w = words[(seed >> 16) % _countof(words)];
+        while (*w != 0 && len < FIND_BENCH_FILE_SIZE)
+            buffer[len++] = *w++;
+        if (len < FIND_BENCH_FILE_SIZE)
+            buffer[len++] = ' ';
+    }
+
+    BOOL ok = TRUE;
+    char* end = path + strlen(path);
+    int d;
+    for (d = 0; ok && d < FIND_BENCH_DIRS; d++)
+    {
+        // every fourth directory is nested in the previous one to get some depth
+        if (d % 4 == 0)
+            sprintf(end, "\\d%03d", d);
+        else
+            sprintf(end, "\\d%03d\\d%03d", d - d % 4, d);
+        if (!CreateDirectory(path, NULL))
+        {
+            ok = FALSE;
+            break;
+        }
+        char* fileEnd = path + strlen(path);
+        int f;
+        for (f = 0; ok && f < FIND_BENCH_FILES; f++)
+        {
+            sprintf(fileEnd, "\\file%03d.txt", f);
+            HANDLE file = HANDLES_Q(CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL));
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                ok = FALSE;
+                break;
+            }
+            DWORD written;
+            if (!WriteFile(file, buffer, FIND_BENCH_FILE_SIZE, &written, NULL) || written != FIND_BENCH_FILE_SIZE)
+                ok = FALSE;
+            HANDLES(CloseHandle(file));
         }
     }
-    *end = 0;
+    free(buffer);
+    return ok;
+}
+
+void FindBenchmark(const char* dir)
+{
+    CALL_STACK_MESSAGE2("FindBenchmark(%s)", dir);
+    if (!FindBenchmarkCreateTree(dir))
+    {
+        TRACE_E("FindBenchmark(): unable to create synthetic tree in " << dir);
+        return;
+    }
+    char root[MAX_PATH];
+    lstrcpyn(root, dir, MAX_PATH);
+    SalPathAppend(root, "findbench\\", MAX_PATH);
+
+    CSearchingString searchingText;
+    CSearchingString searchingText2;
+    CGrepData* data = new CGrepData;
+    if (data == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return;
+    }
+    data->FindDuplicates = FALSE;
+    data->FindDupFlags = 0;
+    data->Refine = 0;
+    data->WholeWords = FALSE;
+    data->Regular = FALSE;
+    data->EOL_CRLF = data->EOL_CR = data->EOL_LF = TRUE;
+    data->AttributesMask = data->AttributesValue = 0;
+    data->Criteria.PrepareForTest();
+    data->SearchStopped = FALSE;
+    data->HWindow = NULL;
+    data->Data = NULL;
+    data->FoundFilesListView = NULL;
+    data->FoundVisibleCount = 0;
+    data->FoundVisibleTick = GetTickCount();
+    data->NeedRefresh = FALSE;
+    data->SearchingText = &searchingText;
+    data->SearchingText2 = &searchingText2;
+    // the pattern is not present in the tree, all files are scanned completely
+    data->SearchData.Set("pattern that is not there", sfForward);
+
+    CMaskGroup masks("*");
+    int errorPos;
+    masks.PrepareMasks(errorPos);
+
+    // first pass: enumeration only, second and third pass: content search with one
+    // worker and with the default number of workers (results go to the trace)
+    int pass;
+    for (pass = 0; pass < 3; pass++)
+    {
+        data->Grep = pass > 0;
+        data->StopSearch = FALSE;
+        CFindWorkPool* pool = new CFindWorkPool(data, NULL, NULL);
+        if (pool != NULL)
+        {
+            if (pool->Init(pass == 1 ? 1 : CFindWorkPool::GetWorkerCount()) && pool->AddRoot(root, &masks, TRUE))
+                pool->Run();
+            delete pool;
+        }
+    }
+    delete data;
 }
 
+#endif // _DEBUG
+
 void RefineData(CMaskGroup* masksGroup, CGrepData* data)
 {
     int refineCount = data->FoundFilesListView->GetDataForRefineCount();
@@ -1839,7 +3244,7 @@ void RefineData(CMaskGroup* masksGroup, CGrepData* data)
                 // links: refineData->Size == 0, the file size must be additionally obtained via SalGetFileSize()
                 BOOL isLink = (refineData->Attr & FILE_ATTRIBUTE_REPARSE_POINT) != 0; // size == 0, the file size must be obtained via SalGetFileSize()
                 ok = TestFileContent(refineData->Size.LoDWord, refineData->Size.HiDWord,
-                                     fullPath, data, isLink);
+                                     fullPath, data, isLink, &data->RegExp);
             }
         }
 
@@ -1897,7 +3302,7 @@ unsigned GrepThreadFBody(void* ptr)
     {
         // if we search for duplicates, data are primarily placed into this array
         // after scanning all directories, the array is sorted (by name or by size)
-        // if content is checked, MD5 is calculated for ambiguous cases
+        // if content is checked, digests are calculated for ambiguous cases
         // afterwards the data are passed to FoundFilesListView
         CDuplicateCandidates* duplicateCandidates = NULL;
         if (data->FindDuplicates)
@@ -1910,7 +3315,63 @@ unsigned GrepThreadFBody(void* ptr)
             }
         }
 
-        if (!data->StopSearch)
+        // prefer the parallel search engine; if it cannot be used, search serially
+        BOOL searched = FALSE;
+        int workers = data->StopSearch ? 1 : CFindWorkPool::GetWorkerCount();
+        if (workers > 1)
+        {
+            // create a local copy of the ignore list since it has to be processed anyway
+            // and as a bonus the user can edit the ignore list while searching
+            CFindIgnore* ignoreList = new CFindIgnore;
+            if (ignoreList == NULL)
+                TRACE_E(LOW_MEMORY); // the algorithm will run even without the ignore list
+            else
+            {
+                if (!ignoreList->Prepare(&FindIgnore))
+                {
+                    delete ignoreList;
+                    ignoreList = NULL;
+                }
+            }
+
+            CFindWorkPool* pool = new CFindWorkPool(data, duplicateCandidates, ignoreList);
+            if (pool != NULL && pool->Init(workers))
+            {
+                BOOL rootsOK = TRUE;
+                int i;
+                for (i = 0; i < data->Data->Count; i++)
+                {
+                    strcpy_s(path, data->Data->At(i)->Dir);
+                    int len = (int)strlen(path);
+                    if (path[len - 1] != '\\')
+                        strcat_s(path, "\\");
+                    CMaskGroup* mg = &data->Data->At(i)->MasksGroup;
+                    int errorPos;
+                    if (!mg->PrepareMasks(errorPos))
+                    {
+                        TRACE_E("PrepareMasks failed errorPos=" << errorPos);
+                        data->StopSearch = TRUE;
+                        break;
+                    }
+                    if (!pool->AddRoot(path, mg, data->Data->At(i)->IncludeSubDirs))
+                    {
+                        rootsOK = FALSE;
+                        break;
+                    }
+                }
+                if (data->StopSearch || rootsOK && pool->Run())
+                    searched = TRUE;
+            }
+            if (pool != NULL)
+                delete pool;
+            else
+                TRACE_E(LOW_MEMORY);
+
+            if (ignoreList != NULL)
+                delete ignoreList;
+        }
+
+        if (!searched && !data->StopSearch)
         {
             int i;
             for (i = 0; i < data->Data->Count; i++)
@@ -57,6 +57,11 @@ void ClearFindHistory(BOOL dataOnly);
 
 DWORD WINAPI GrepThreadF(void* ptr); // body of the grep thread
 
+#ifdef _DEBUG
+// measures the parallel search engine on a synthetic tree created in 'dir' (see bench.h)
+void FindBenchmark(const char* dir);
+#endif // _DEBUG
+
 extern HACCEL FindDialogAccelTable;
 
 class CFoundFilesListView;
@@ -486,11 +491,11 @@ protected:
 // CFoundFilesListView
 //
 
-#define MD5_DIGEST_SIZE 16
+#define DUPLICATES_DIGEST_SIZE 16 // FASTHASH128_SIZE
 
-struct CMD5Digest
+struct CDuplicatesDigest
 {
-    BYTE Digest[MD5_DIGEST_SIZE];
+    BYTE Digest[DUPLICATES_DIGEST_SIZE];
 };
 
 struct CFoundFilesData
@@ -503,7 +508,7 @@ struct CFoundFilesData
 
     // 'Group' is used in two ways:
     // 1) while searching for duplicate files, when contents are compared,
-    //    it holds a pointer to CMD5Digest with the computed MD5 of the file
+    //    it holds a pointer to CDuplicatesDigest with the computed digest of the file
     // 2) before passing duplicate search results to the ListView
     //    it contains a number connecting multiple files into an equivalent group
     DWORD_PTR Group;
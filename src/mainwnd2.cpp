@@ -449,6 +449,7 @@ const char* CONFIG_IFPATHISINACCESSIBLEGOTOISMYDOCS_REG = "If Path Is Inaccessib
 const char* CONFIG_IFPATHISINACCESSIBLEGOTO_REG = "If Path Is Inaccessible Go To";
 const char* CONFIG_HOTPATH_AUTOCONFIG = "Auto Configurate Hot Paths";
 const char* CONFIG_LASTUSEDSPEEDLIM_REG = "Speed Limit";
+const char* CONFIG_DISKCACHEMAXSIZE_REG = "Disk Cache Max Size";
 const char* CONFIG_QUICKSEARCHENTER_REG = "Quick Search Enter Alt";
 const char* CONFIG_CHD_SHOWMYDOC = "Change Drive Show My Documents";
 const char* CONFIG_CHD_SHOWANOTHER = "Change Drive Show Another";
@@ -1799,6 +1800,8 @@ void CMainWindow::SaveConfig(HWND parent)
                          &Configuration.HotPathAutoConfig, sizeof(DWORD));
                 SetValue(actKey, CONFIG_LASTUSEDSPEEDLIM_REG, REG_DWORD,
                          &Configuration.LastUsedSpeedLimit, sizeof(DWORD));
+                SetValue(actKey, CONFIG_DISKCACHEMAXSIZE_REG, REG_DWORD,
+                         &Configuration.DiskCacheMaxSize, sizeof(DWORD));
                 SetValue(actKey, CONFIG_QUICKSEARCHENTER_REG, REG_DWORD,
                          &Configuration.QuickSearchEnterAlt, sizeof(DWORD));
                 SetValue(actKey, CONFIG_CHD_SHOWMYDOC, REG_DWORD,
@@ -3313,6 +3316,8 @@ BOOL CMainWindow::LoadConfig(BOOL importingOldConfig, const CCommandLineParams*
                      &Configuration.HotPathAutoConfig, sizeof(DWORD));
             GetValue(actKey, CONFIG_LASTUSEDSPEEDLIM_REG, REG_DWORD,
                      &Configuration.LastUsedSpeedLimit, sizeof(DWORD));
+            GetValue(actKey, CONFIG_DISKCACHEMAXSIZE_REG, REG_DWORD,
+                     &Configuration.DiskCacheMaxSize, sizeof(DWORD));
             GetValue(actKey, CONFIG_QUICKSEARCHENTER_REG, REG_DWORD,
                      &Configuration.QuickSearchEnterAlt, sizeof(DWORD));
             GetValue(actKey, CONFIG_CHD_SHOWMYDOC, REG_DWORD,
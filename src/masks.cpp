@@ -293,20 +293,22 @@ BOOL AgreeQSMask(const char* filename, BOOL hasExtension, const char* mask, BOOL
 //
 
 CMaskGroup::CMaskGroup()
-    : PreparedMasks(10, 10)
+    : PreparedMasks(10, 10), ExtTrie(16, 64), Automata(2, 4)
 {
     MasksString[0] = 0;
     NeedPrepare = FALSE;
     ExtendedMode = FALSE;
-    MasksHashArray = NULL;
-    MasksHashArraySize = 0;
+    IncludeAll = FALSE;
+    ExcludeAll = FALSE;
+    SomeExclude = FALSE;
 }
 
 CMaskGroup::CMaskGroup(const char* masks, BOOL extendedMode)
-    : PreparedMasks(10, 10)
+    : PreparedMasks(10, 10), ExtTrie(16, 64), Automata(2, 4)
 {
-    MasksHashArray = NULL;
-    MasksHashArraySize = 0;
+    IncludeAll = FALSE;
+    ExcludeAll = FALSE;
+    SomeExclude = FALSE;
     SetMasksString(masks, extendedMode);
 }
 
@@ -327,7 +329,7 @@ void CMaskGroup::Release()
         }
     }
     PreparedMasks.DestroyMembers();
-    ReleaseMasksHashArray();
+    ReleaseCompiledMasks();
 }
 
 CMaskGroup&
@@ -348,31 +350,16 @@ CMaskGroup::operator=(const CMaskGroup& s)
     return *this;
 }
 
-void CMaskGroup::ReleaseMasksHashArray()
+void CMaskGroup::ReleaseCompiledMasks()
 {
-    if (MasksHashArray != NULL)
-    {
-        int i;
-        for (i = 0; i < MasksHashArraySize; i++)
-        {
-            if (MasksHashArray[i].Mask != NULL) // if this array element is not empty
-            {
-                free(MasksHashArray[i].Mask);
-                CMasksHashEntry* next = MasksHashArray[i].Next;
-                while (next != NULL) // if there are multiple masks at the same entry (hash)
-                {
-                    CMasksHashEntry* nextNext = next->Next;
-                    if (next->Mask != NULL)
-                        free(next->Mask);
-                    free(next);
-                    next = nextNext;
-                }
-            }
-        }
-        free(MasksHashArray); // so destructors of objects in the array aren't called
-        MasksHashArray = NULL;
-        MasksHashArraySize = 0;
-    }
+    int i;
+    for (i = 0; i < Automata.Count; i++)
+        free(Automata[i]);
+    Automata.DestroyMembers();
+    ExtTrie.DestroyMembers();
+    IncludeAll = FALSE;
+    ExcludeAll = FALSE;
+    SomeExclude = FALSE;
 }
 
 void CMaskGroup::SetMasksString(const char* masks, BOOL extendedMode)
@@ -410,22 +397,6 @@ BOOL CMaskGroup::GetExtendedMode()
     return ExtendedMode;
 }
 
-#define COMPUTEMASKGROUPHASH(hash, exten) \
-    { \
-        const unsigned char* __CMGH_ext = (exten); \
-        if (*__CMGH_ext != 0) \
-        { \
-            hash = (LowerCase[*__CMGH_ext] - 'a'); \
-            if (*++__CMGH_ext != 0) \
-            { \
-                hash += 3 * (LowerCase[*__CMGH_ext] - 'a'); \
-                if (*++__CMGH_ext != 0) \
-                    hash += 7 * (LowerCase[*__CMGH_ext] - 'a'); \
-            } \
-        } \
-        hash = hash % MasksHashArraySize; \
-    }
-
 BOOL CMaskGroup::PrepareMasks(int& errorPos, const char* masksString)
 {
     CALL_STACK_MESSAGE1("CMaskGroup::PrepareMasks(,)");
@@ -437,15 +408,14 @@ BOOL CMaskGroup::PrepareMasks(int& errorPos, const char* masksString)
         if (PreparedMasks[i] != NULL)
             free(PreparedMasks[i]);
     PreparedMasks.DestroyMembers();
-    ReleaseMasksHashArray();
+    ReleaseCompiledMasks();
 
     const char* useMasksString = masksString == NULL ? MasksString : masksString;
     const char* s = useMasksString;
     char buf[MAX_PATH];
     char maskBuf[MAX_PATH];
-    int excludePos = -1;   // if not -1, all following masks are exclude type
-                           // and will be inserted at the beginning of the array
-    int hashableMasks = 0; // number of masks that can be hashed (MASK_OPTIMIZE_EXTENSION + CMaskItemFlags::Exclude==0)
+    int excludePos = -1; // if not -1, all following masks are exclude type
+                         // and will be inserted at the beginning of the array
 
     // to avoid unnecessary reallocations for longer arrays, set a reasonable delta
     int masksLen = (int)strlen(s);
@@ -512,11 +482,7 @@ BOOL CMaskGroup::PrepareMasks(int& errorPos, const char* masksString)
                                     iter++;
                             }
                             if (*iter == 0)
-                            {
                                 flags->Optimize = MASK_OPTIMIZE_EXTENSION;
-                                if (excludePos == -1)
-                                    hashableMasks++;
-                            }
                         }
                     }
                     flags->Exclude = excludePos != -1 ? 1 : 0;
@@ -588,162 +554,306 @@ BOOL CMaskGroup::PrepareMasks(int& errorPos, const char* masksString)
         s++;
     }
 
-    if (hashableMasks >= 10) // to be worthwhile there should be at least 10
+    CompileMasks();
+    NeedPrepare = FALSE;
+    return TRUE;
+}
+
+void CMaskGroup::CompileMasks()
+{
+    CALL_STACK_MESSAGE1("CMaskGroup::CompileMasks()");
+    int count = 0; // number of masks left in PreparedMasks
+    int i;
+    for (i = 0; i < PreparedMasks.Count; i++)
+    {
+        char* mask = PreparedMasks[i];
+        CMaskItemFlags* flags = (CMaskItemFlags*)mask;
+        if (flags->Exclude == 1)
+            SomeExclude = TRUE;
+        BOOL compiled;
+        if (flags->Optimize == MASK_OPTIMIZE_ALL) // *.*; *
+        {
+            if (flags->Exclude == 1)
+                ExcludeAll = TRUE;
+            else
+                IncludeAll = TRUE;
+            compiled = TRUE;
+        }
+        else
+        {
+            if (flags->Optimize == MASK_OPTIMIZE_EXTENSION) // *.xxxx
+                compiled = AddExtToTrie(mask + 3, flags->Exclude == 1);
+            else
+                compiled = AddMaskToAutomata(mask + 1, flags->Exclude == 1);
+        }
+        if (compiled)
+            free(mask);
+        else
+            PreparedMasks[count++] = mask; // keep the order (exclude masks stay before include masks)
+    }
+    if (count < PreparedMasks.Count)
+    {
+        PreparedMasks.Detach(count, PreparedMasks.Count - count);
+        if (!PreparedMasks.IsGood())
+            PreparedMasks.ResetState(); // Detach always succeeds (at most the array won't shift, which is fine)
+    }
+}
+
+BOOL CMaskGroup::AddExtToTrie(const char* ext, BOOL exclude)
+{
+    CMaskExtTrieNode newNode;
+    newNode.Char = 0;
+    newNode.Agree = 0;
+    newNode.FirstChild = -1;
+    newNode.NextSibling = -1;
+    if (ExtTrie.Count == 0) // add the root
     {
-        MasksHashArraySize = 2 * hashableMasks;
-        MasksHashArray = (CMasksHashEntry*)malloc(MasksHashArraySize * sizeof(CMasksHashEntry));
-        if (MasksHashArray != NULL)
+        ExtTrie.Add(newNode);
+        if (!ExtTrie.IsGood())
         {
-            memset(MasksHashArray, 0, MasksHashArraySize * sizeof(CMasksHashEntry));
-            int i2;
-            for (i2 = PreparedMasks.Count - 1; i2 >= 0; i2--)
+            ExtTrie.ResetState();
+            return FALSE;
+        }
+    }
+    int node = 0;
+    while (*ext != 0)
+    {
+        BYTE c = LowerCase[*ext++];
+        int child = ExtTrie[node].FirstChild;
+        while (child != -1 && ExtTrie[child].Char != c)
+            child = ExtTrie[child].NextSibling;
+        if (child == -1) // the extension continues with a new character, add a node for it
+        {
+            newNode.Char = c;
+            newNode.NextSibling = ExtTrie[node].FirstChild;
+            child = ExtTrie.Add(newNode);
+            if (!ExtTrie.IsGood())
             {
-                CMaskItemFlags* mask = (CMaskItemFlags*)PreparedMasks[i2];
-                if (mask->Optimize == MASK_OPTIMIZE_EXTENSION &&
-                    mask->Exclude == 0)
-                { // this mask can be hashed; add it to the hash array
-                    DWORD hash = 0;
-                    COMPUTEMASKGROUPHASH(hash, (unsigned char*)mask + 3);
-                    if (MasksHashArray[hash].Mask == NULL)
-                    {
-                        MasksHashArray[hash].Mask = mask;
-                        PreparedMasks.Detach(i2);
-                        if (!PreparedMasks.IsGood())
-                            PreparedMasks.ResetState(); // Detach always succeeds (at most the array won't shift, which is fine)
-                    }
-                    else
-                    {
-                        CMasksHashEntry* next = &MasksHashArray[hash];
-                        while (next->Next != NULL)
-                        {
-                            next = next->Next;
-                        }
-                        next->Next = (CMasksHashEntry*)malloc(sizeof(CMasksHashEntry));
-                        if (next->Next != NULL)
-                        {
-                            next->Next->Mask = mask;
-                            next->Next->Next = NULL;
-                            PreparedMasks.Detach(i2);
-                            if (!PreparedMasks.IsGood())
-                                PreparedMasks.ResetState(); // Detach always succeeds (at most the array won't shift, which is fine)
-                        }
-                        else // out of memory -> nothing happens, we skip this one mask
-                            TRACE_E(LOW_MEMORY);
-                    }
-                }
+                ExtTrie.ResetState(); // already added nodes don't matter, they have no Agree flags
+                return FALSE;
             }
-            /*
-#ifdef _DEBUG
-      int maxDepth = 0;
-      int squareOfDepths = 0;
-      int usedIndexes = 0;
-      for (i = 0; i < MasksHashArraySize; i++)
-      {
-        CMasksHashEntry *next = &MasksHashArray[i];
-        if (next->Mask != NULL)
-        {
-          int depth = 1;
-          while (next->Next != NULL)
-          {
-            next = next->Next;
-            depth++;
-          }
-          if (depth > maxDepth) maxDepth = depth;
-          if (depth > 1) squareOfDepths += depth * depth;
-          usedIndexes++;
+            ExtTrie[node].FirstChild = child;
         }
-      }
-      TRACE_I("CMaskGroup::PrepareMasks(): maxHashDepth=" << maxDepth << ", count=" <<
-              hashableMasks << ", squareOfDepths=" << squareOfDepths << ", usedIndexes=" << usedIndexes);
-#endif // _DEBUG
-*/
-        }
-        else // out of memory -> we simply won't accelerate searching in masks
+        node = child;
+    }
+    ExtTrie[node].Agree |= exclude ? MASK_TRIE_EXCLUDE : MASK_TRIE_INCLUDE;
+    return TRUE;
+}
+
+BOOL CMaskGroup::AddMaskToAutomata(const char* mask, BOOL exclude)
+{
+    int states = 1; // state 0 (nothing matched yet)
+    const char* m;
+    for (m = mask; *m != 0; m++)
+    {
+        if (*m != '*')
+            states++;
+    }
+    if (states > MASK_AUTOMATON_STATES)
+        return FALSE; // too long mask, AgreeMask will be used for it
+
+    CMaskAutomaton* a = Automata.Count > 0 ? Automata[Automata.Count - 1] : NULL;
+    if (a == NULL || a->Exclude != exclude || a->UsedStates + states > MASK_AUTOMATON_STATES)
+    {
+        a = (CMaskAutomaton*)malloc(sizeof(CMaskAutomaton));
+        if (a == NULL)
         {
             TRACE_E(LOW_MEMORY);
-            MasksHashArraySize = 0;
+            return FALSE;
+        }
+        memset(a, 0, sizeof(CMaskAutomaton));
+        a->Exclude = exclude;
+        Automata.Add(a);
+        if (!Automata.IsGood())
+        {
+            free(a);
+            Automata.ResetState();
+            return FALSE;
         }
     }
-    NeedPrepare = FALSE;
+
+    int state = a->UsedStates;
+    a->Init |= (unsigned __int64)1 << state;
+    for (m = mask; *m != 0; m++)
+    {
+        if (*m == '*') // any characters may be read in the current state
+        {
+            a->Loops |= (unsigned __int64)1 << state;
+            continue;
+        }
+        // names without extension match also masks ending with "." or ".*" (see AgreeMask)
+        if (*m == '.' && (*(m + 1) == 0 || *(m + 1) == '*' && *(m + 2) == 0))
+            a->FinalNoExt |= (unsigned __int64)1 << state;
+        state++;
+        unsigned __int64 bit = (unsigned __int64)1 << state;
+        int c;
+        if (*m == '?')
+        {
+            for (c = 1; c < 256; c++)
+                a->CharStates[c] |= bit;
+        }
+        else
+        {
+            BYTE lower = LowerCase[*m];
+            BOOL digit = ExtendedMode && *m == '#';
+            for (c = 1; c < 256; c++)
+            {
+                if (LowerCase[c] == lower || digit && c >= '0' && c <= '9')
+                    a->CharStates[c] |= bit;
+            }
+        }
+    }
+    a->Final |= (unsigned __int64)1 << state;
+    a->UsedStates = state + 1;
     return TRUE;
 }
 
-BOOL CMaskGroup::AgreeMasks(const char* fileName, const char* fileExt)
+DWORD CMaskGroup::FindExtInTrie(const char* ext)
 {
-    if (NeedPrepare)
-        TRACE_E("CMaskGroup::AgreeMasks: PrepareMasks must be called before AgreeMasks!");
+    const CMaskExtTrieNode* nodes = ExtTrie.GetData();
+    int node = 0;
+    while (*ext != 0)
+    {
+        BYTE c = LowerCase[*ext++];
+        node = nodes[node].FirstChild;
+        while (node != -1 && nodes[node].Char != c)
+            node = nodes[node].NextSibling;
+        if (node == -1)
+            return 0;
+    }
+    return nodes[node].Agree;
+}
 
-    SLOW_CALL_STACK_MESSAGE3("CMaskGroup::AgreeMasks(%s, %s)", fileName, fileExt);
-    if (fileExt == NULL)
+// returns TRUE if 'fileName' matches some of the masks compiled in automaton 'a'
+static inline BOOL RunMaskAutomaton(const CMaskAutomaton* a, const char* fileName, BOOL hasExtension)
+{
+    unsigned __int64 states = a->Init;
+    const unsigned char* n = (const unsigned char*)fileName;
+    while (*n != 0)
     {
-        int tmpLen = lstrlen(fileName);
-        fileExt = fileName + tmpLen;
-        while (--fileExt >= fileName && *fileExt != '.')
-            ;
-        if (fileExt < fileName)
-            fileExt = fileName + tmpLen; // ".cvspass" in Windows is an extension ...
-        else
-            fileExt++;
+        states = ((states << 1) & a->CharStates[*n++]) | (states & a->Loops);
+        if (states == 0)
+            return FALSE;
     }
+    return (states & (hasExtension ? a->Final : (a->Final | a->FinalNoExt))) != 0;
+}
+
+// returns the extension of 'fileName' (pointer to the terminator of 'fileName' if it has none)
+static inline const char* FindMaskFileExt(const char* fileName, int fileNameLen)
+{
+    const char* fileExt = fileName + fileNameLen;
+    while (--fileExt >= fileName && *fileExt != '.')
+        ;
+    if (fileExt < fileName)
+        return fileName + fileNameLen; // ".cvspass" in Windows is an extension ...
+    return fileExt + 1;
+}
+
+BOOL CMaskGroup::AgreeMasksAux(const char* fileName, const char* fileExt)
+{
+    if (ExcludeAll)
+        return FALSE;
+
     const char* ext = fileExt;
     if (*ext == 0 && *fileName == '.' && *(ext - 1) != '.') // may be the ".cvspass" case; ".." has no extension
     {
         TRACE_E("CMaskGroup::AgreeMasks: Unexpected situation: fileName starts with '.' but fileExt points to end of name: " << fileName);
         ext = fileName + 1;
     }
+    BOOL hasExtension = *fileExt != 0;
+
+    // first all exclude masks, then the include ones
+    DWORD extAgree = ExtTrie.Count > 0 ? FindExtInTrie(ext) : 0;
+    if (extAgree & MASK_TRIE_EXCLUDE)
+        return FALSE;
+    int firstInclude = 0;
+    for (; firstInclude < Automata.Count && Automata[firstInclude]->Exclude; firstInclude++)
+    {
+        if (RunMaskAutomaton(Automata[firstInclude], fileName, hasExtension))
+            return FALSE;
+    }
     int i;
-    for (i = 0; i < PreparedMasks.Count; i++)
+    for (i = 0; i < PreparedMasks.Count; i++) // masks which were not compiled
     {
         char* mask = PreparedMasks[i];
-        if (mask != NULL)
+        CMaskItemFlags* flags = (CMaskItemFlags*)mask;
+        if (flags->Exclude == 0)
+            break; // exclude masks are stored before include masks
+        if (flags->Optimize == MASK_OPTIMIZE_EXTENSION) // *.xxxx
         {
-            CMaskItemFlags* flags = (CMaskItemFlags*)mask;
-            if (flags->Exclude == 1)
-            {
-                if (flags->Optimize == MASK_OPTIMIZE_ALL) // *.*; *
-                    return FALSE;
-                if (flags->Optimize == MASK_OPTIMIZE_EXTENSION) // *.xxxx
-                {
-                    if (StrICmp(ext, mask + 3) == 0)
-                        return FALSE;
-                    else
-                        continue;
-                }
-                mask++;
-                if (AgreeMask(fileName, mask, *fileExt != 0, ExtendedMode))
-                    return FALSE;
-            }
-            else
-            {
-                if (flags->Optimize == MASK_OPTIMIZE_ALL) // *.*; *
-                    return TRUE;
-                if (flags->Optimize == MASK_OPTIMIZE_EXTENSION) // *.xxxx
-                {
-                    if (StrICmp(ext, mask + 3) == 0)
-                        return TRUE;
-                    else
-                        continue;
-                }
-                mask++;
-                if (AgreeMask(fileName, mask, *fileExt != 0, ExtendedMode))
-                    return TRUE;
-            }
+            if (StrICmp(ext, mask + 3) == 0)
+                return FALSE;
+        }
+        else
+        {
+            if (AgreeMask(fileName, mask + 1, hasExtension, ExtendedMode))
+                return FALSE;
         }
     }
-    if (MasksHashArray != NULL) // there are still some masks in the hash array
+
+    if (IncludeAll || (extAgree & MASK_TRIE_INCLUDE))
+        return TRUE;
+    for (; firstInclude < Automata.Count; firstInclude++)
+    {
+        if (RunMaskAutomaton(Automata[firstInclude], fileName, hasExtension))
+            return TRUE;
+    }
+    for (; i < PreparedMasks.Count; i++)
     {
-        DWORD hash = 0;
-        COMPUTEMASKGROUPHASH(hash, (unsigned char*)ext);
-        CMasksHashEntry* item = &MasksHashArray[hash];
-        if (item->Mask != NULL)
+        char* mask = PreparedMasks[i];
+        CMaskItemFlags* flags = (CMaskItemFlags*)mask;
+        if (flags->Optimize == MASK_OPTIMIZE_EXTENSION) // *.xxxx
         {
-            do
-            {
-                if (StrICmp(ext, ((char*)item->Mask) + 3) == 0)
-                    return TRUE;
-                item = item->Next;
-            } while (item != NULL);
+            if (StrICmp(ext, mask + 3) == 0)
+                return TRUE;
+        }
+        else
+        {
+            if (AgreeMask(fileName, mask + 1, hasExtension, ExtendedMode))
+                return TRUE;
         }
     }
     return FALSE;
 }
+
+BOOL CMaskGroup::AgreeMasks(const char* fileName, const char* fileExt)
+{
+    if (NeedPrepare)
+        TRACE_E("CMaskGroup::AgreeMasks: PrepareMasks must be called before AgreeMasks!");
+
+    SLOW_CALL_STACK_MESSAGE3("CMaskGroup::AgreeMasks(%s, %s)", fileName, fileExt);
+    if (fileExt == NULL)
+        fileExt = FindMaskFileExt(fileName, lstrlen(fileName));
+    return AgreeMasksAux(fileName, fileExt);
+}
+
+int CMaskGroup::AgreeMasks(CFilesArray* files, BOOL dirs, BOOL* agree)
+{
+    if (NeedPrepare)
+        TRACE_E("CMaskGroup::AgreeMasks: PrepareMasks must be called before AgreeMasks!");
+
+    CALL_STACK_MESSAGE3("CMaskGroup::AgreeMasks(, %d,) count=%d", dirs, files->Count);
+    int count = files->Count;
+    if (ExcludeAll || count == 0)
+    {
+        if (count > 0)
+            memset(agree, 0, count * sizeof(BOOL));
+        return 0;
+    }
+    int i;
+    if (IncludeAll && !SomeExclude) // "*" or "*.*" without exclude masks -> all names match
+    {
+        for (i = 0; i < count; i++)
+            agree[i] = TRUE;
+        return count;
+    }
+    int agreeCount = 0;
+    const CFileData* f = files->GetData();
+    for (i = 0; i < count; i++, f++)
+    {
+        agree[i] = AgreeMasksAux(f->Name, dirs ? FindMaskFileExt(f->Name, f->NameLen) : f->Ext);
+        if (agree[i])
+            agreeCount++;
+    }
+    return agreeCount;
+}
@@ -28,6 +28,7 @@ char* MaskName(char* buffer, int bufSize, const char* name, const char* mask);
 //   2) Call PrepareMasks to build internal data; if it fails, display the error
 //      location and after fixing the mask, return to step (2).
 //   3) Call AgreeMasks at any time to check whether a name matches the mask group.
+//      Whole listings (CFilesArray) can be checked at once by the second AgreeMasks variant.
 //   4) If SetMasksString is called again, continue from step (2).
 //
 // Mask:
@@ -66,22 +67,48 @@ struct CMaskItemFlags
                            // exclude masks are stored before include masks in PreparedMasks array
 };
 
-struct CMasksHashEntry
+#define MASK_TRIE_INCLUDE 0x01 // an include mask "*.xxxx" ends in this trie node
+#define MASK_TRIE_EXCLUDE 0x02 // an exclude mask "*.xxxx" ends in this trie node
+
+struct CMaskExtTrieNode
+{
+    BYTE Char;       // character (converted to lowercase) leading to this node; unused in the root
+    BYTE Agree;      // combination of MASK_TRIE_xxx flags
+    int FirstChild;  // index of the first child in CMaskGroup::ExtTrie, -1 = no children
+    int NextSibling; // index of the next child of the parent node, -1 = last child
+};
+
+#define MASK_AUTOMATON_STATES 64 // number of states (bits) available in one CMaskAutomaton
+
+// Several general masks compiled into one bit-parallel automaton (shift-and extended by '*'):
+// a mask with N characters (not counting '*') occupies N+1 consecutive states, state 'i' means
+// "first 'i' characters of the mask were matched"; all masks in one automaton are either
+// exclude or include masks
+struct CMaskAutomaton
 {
-    CMaskItemFlags* Mask;  // internal mask representation, see CMaskItemFlags for the format
-    CMasksHashEntry* Next; // next entry with the same hash
+    unsigned __int64 CharStates[256]; // for each character of the name: states which may be entered by reading it
+    unsigned __int64 Init;            // initial states (state 0 of each mask)
+    unsigned __int64 Loops;           // states followed by '*' in the mask (reading any character keeps them)
+    unsigned __int64 Final;           // states in which the whole mask was matched
+    unsigned __int64 FinalNoExt;      // final states only for names without extension (masks ending with "." or ".*")
+    int UsedStates;                   // number of states already used
+    BOOL Exclude;                     // TRUE = automaton contains exclude masks
 };
 
 class CMaskGroup
 {
 protected:
     char MasksString[MAX_GROUPMASK];   // mask group passed in the constructor or in PrepareMasks
-    TDirectArray<char*> PreparedMasks; // internal mask representation; for the format see CMaskItemFlags - may not contain all masks, some may be in MasksHashArray
+    TDirectArray<char*> PreparedMasks; // internal mask representation; for the format see CMaskItemFlags - contains only masks which were not compiled (see CompileMasks)
     BOOL NeedPrepare;                  // is it necessary to call the PrepareMasks method before using 'PreparedMasks'?
     BOOL ExtendedMode;
 
-    CMasksHashEntry* MasksHashArray; // if not NULL, it is a hash array containing all masks with MASK_OPTIMIZE_EXTENSION format (only those with CMaskItemFlags::Exclude==0)
-    int MasksHashArraySize;          // size of MasksHashArray (twice the number of stored masks)
+    // compiled form of the mask group (built by CompileMasks at the end of PrepareMasks)
+    BOOL IncludeAll;                        // TRUE = group contains include mask "*" or "*.*"
+    BOOL ExcludeAll;                        // TRUE = group contains exclude mask "*" or "*.*"
+    BOOL SomeExclude;                       // TRUE = group contains some exclude mask
+    TDirectArray<CMaskExtTrieNode> ExtTrie; // trie of extensions from all "*.xxxx" masks (include and exclude), root has index 0
+    TDirectArray<CMaskAutomaton*> Automata; // automata with all remaining masks (exclude automata come first)
 
 public:
     CMaskGroup();
@@ -119,7 +146,32 @@ public:
     // if fileExt == NULL, the extension will be searched for - this is slower
     BOOL AgreeMasks(const char* fileName, const char* fileExt);
 
+    // Determines for all names in 'files' at once whether they match the mask group;
+    // 'agree' is an array of at least files->Count items, for each name it receives TRUE
+    // if the name matches, otherwise FALSE; if 'dirs' is TRUE, 'files' contains directories
+    // and their extensions are searched for (as with AgreeMasks(name, NULL)), otherwise
+    // CFileData::Ext is used; returns the number of matching names
+    int AgreeMasks(CFilesArray* files, BOOL dirs, BOOL* agree);
+
 protected:
-    // releases the hash array MasksHashArray
-    void ReleaseMasksHashArray();
+    // compiles masks from PreparedMasks into IncludeAll, ExcludeAll, ExtTrie and Automata;
+    // compiled masks are removed from PreparedMasks, masks which cannot be compiled
+    // (too long or out of memory) stay there
+    void CompileMasks();
+
+    // adds extension 'ext' of mask "*.xxxx" into ExtTrie; returns FALSE if out of memory
+    BOOL AddExtToTrie(const char* ext, BOOL exclude);
+
+    // adds mask 'mask' (after PrepareMask) into Automata; returns FALSE if the mask is too
+    // long for the automaton or out of memory
+    BOOL AddMaskToAutomata(const char* mask, BOOL exclude);
+
+    // returns MASK_TRIE_xxx flags of extension 'ext' (0 if 'ext' is not in ExtTrie)
+    DWORD FindExtInTrie(const char* ext);
+
+    // AgreeMasks for 'fileExt' != NULL
+    BOOL AgreeMasksAux(const char* fileName, const char* fileExt);
+
+    // releases the compiled form of the mask group
+    void ReleaseCompiledMasks();
 };
@@ -114,6 +114,15 @@ BOOL C7zClient::OpenArchive(const char* fileName, IInArchive** archive, UString&
     if (!CreateObject(&IID_IInArchive, (void**)&a))
         return FALSE;
 
+    // number of threads for decoding (multi-threaded mixer: BCJ2 and the main coder of a folder run in parallel)
+    CMyComPtr<ISetProperties> setProperties;
+    if (a->QueryInterface(IID_ISetProperties, (void**)&setProperties) == S_OK)
+    {
+        const wchar_t* names[] = {L"mt"};
+        NWindows::NCOM::CPropVariant values[] = {(UINT32)GetNumThreads()};
+        setProperties->SetProperties(names, values, 1); // on failure 7za.dll keeps its defaults
+    }
+
     CRetryableInFileStream* fileSpec = new CRetryableInFileStream(NULL);
     CMyComPtr<IInStream> file = fileSpec;
 
@@ -1008,6 +1017,11 @@ C7zClient::SetCompressionParams(IOutArchive* outArchive, CCompressParams* compre
         names.Add(L"s");
         values.push_back(NWindows::NCOM::CPropVariant(compressParams->SolidArchive ? L"2g" : L"off"));
 
+        // number of threads; LZMA2 splits the stream into blocks packed in parallel, LZMA uses at most two threads;
+        // each LZMA2 block thread has its own encoder, so there are only as many threads as fit into memory
+        names.Add(L"mt");
+        values.push_back(NWindows::NCOM::CPropVariant((UINT32)ClampPackThreads(compressParams, GetNumThreads())));
+
         // TODO: multi volume options
 
         // set compression parameters only if we are really compressing
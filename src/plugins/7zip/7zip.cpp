@@ -88,6 +88,7 @@ const char* CONFIG_COMPRESS_METHOD = "Compression Method";
 const char* CONFIG_DICT_SIZE = "Dictionary Size";
 const char* CONFIG_WORD_SIZE = "Word Size";
 const char* CONFIG_SOLID_ARCHIVE = "Solid Archive";
+const char* CONFIG_NUM_THREADS = "Threads";
 
 // menu id
 #define IDM_TESTARCHIVE 1
@@ -420,6 +421,68 @@ BOOL CPluginInterface::Release(HWND parent, BOOL force)
     return TRUE;
 }
 
+int GetNumThreads()
+{
+    if (Config.NumThreads > 0)
+        return Config.NumThreads;
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return min((int)si.dwNumberOfProcessors, MAX_NUM_THREADS);
+}
+
+// memory used by the encoders packing with 'params' on 'numThreads' threads,
+// estimated the same way as in the 7-Zip GUI
+static UINT64 GetPackMemoryUsage(const CCompressParams* params, int numThreads)
+{
+    if (params->CompressLevel == COMPRESS_LEVEL_STORE || params->Method == CCompressParams::PPMd)
+        return 0; // no encoder or a single threaded one, the number of threads does not matter
+
+    UINT32 dict = (UINT32)params->DictSize * 1024;
+    // hash table of the match finder
+    UINT32 hs = dict - 1;
+    hs |= hs >> 1;
+    hs |= hs >> 2;
+    hs |= hs >> 4;
+    hs |= hs >> 8;
+    hs |= hs >> 16;
+    hs >>= 1;
+    hs |= 0xFFFF;
+    if (hs > (1 << 24))
+        hs >>= 1;
+    hs++;
+    UINT64 size = (UINT64)hs * 4 + (UINT64)dict * 4;
+    if (params->CompressLevel >= COMPRESS_LEVEL_NORMAL)
+        size += (UINT64)dict * 4; // binary tree match finder
+    size += 2 << 20;
+    int matchThreads = 1;
+    if (numThreads > 1 && params->CompressLevel >= COMPRESS_LEVEL_NORMAL)
+    {
+        size += (2 << 20) + (4 << 20); // the match finder runs in its own thread
+        matchThreads = 2;
+    }
+    // LZMA2 packs blocks in parallel, each of them with its own encoder
+    int blockThreads = max(numThreads / matchThreads, 1);
+    if (params->Method == CCompressParams::LZMA || blockThreads == 1)
+        return size + (UINT64)dict * 3 / 2;
+    UINT64 chunk = max((UINT64)dict << 2, (UINT64)1 << 20);
+    chunk = max(min(chunk, (UINT64)1 << 28), (UINT64)dict);
+    return (size + chunk * 2) * blockThreads;
+}
+
+int ClampPackThreads(const CCompressParams* params, int numThreads)
+{
+    MEMORYSTATUSEX ms;
+    ms.dwLength = sizeof(ms);
+    if (!GlobalMemoryStatusEx(&ms))
+        return numThreads;
+    // 7za.dll runs in our process, leave some address space to Salamander
+    const UINT64 reserve = 64 << 20;
+    UINT64 limit = min(ms.ullAvailPhys, ms.ullAvailVirtual > reserve ? ms.ullAvailVirtual - reserve : 0);
+    while (numThreads > 1 && GetPackMemoryUsage(params, numThreads) > limit)
+        numThreads--;
+    return numThreads;
+}
+
 void CPluginInterface::SetDefaultConfiguration()
 {
     Config.ExtendedListInfo = FALSE;
@@ -434,10 +497,12 @@ void CPluginInterface::SetDefaultConfiguration()
     Config.ShowExtendedOptions = TRUE;
 
     Config.CompressParams.CompressLevel = COMPRESS_LEVEL_NORMAL;
-    Config.CompressParams.Method = CCompressParams::LZMA;
+    Config.CompressParams.Method = CCompressParams::LZMA2; // LZMA2 can be packed by all threads
     Config.CompressParams.DictSize = 16 * 1024; // Dictionary Size in KB
     Config.CompressParams.WordSize = 32;
     Config.CompressParams.SolidArchive = TRUE;
+
+    Config.NumThreads = 0; // as many as CPUs
 }
 
 void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRegistryAbstract* registry)
@@ -469,6 +534,10 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
         registry->GetValue(regKey, CONFIG_COL_METHOD_FIXEDWIDTH, REG_DWORD, &Config.ColumnMethodFixedWidth, sizeof(DWORD));
         registry->GetValue(regKey, CONFIG_COL_METHOD_WIDTH, REG_DWORD, &Config.ColumnMethodWidth, sizeof(DWORD));
 
+        registry->GetValue(regKey, CONFIG_NUM_THREADS, REG_DWORD, &Config.NumThreads, sizeof(DWORD));
+        if (Config.NumThreads < 0 || Config.NumThreads > MAX_NUM_THREADS)
+            Config.NumThreads = 0;
+
         if (ConfigVersion >= 1)
         {
             // compress params
@@ -501,6 +570,8 @@ void CPluginInterface::SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     registry->SetValue(regKey, CONFIG_COL_METHOD_FIXEDWIDTH, REG_DWORD, &Config.ColumnMethodFixedWidth, sizeof(DWORD));
     registry->SetValue(regKey, CONFIG_COL_METHOD_WIDTH, REG_DWORD, &Config.ColumnMethodWidth, sizeof(DWORD));
 
+    registry->SetValue(regKey, CONFIG_NUM_THREADS, REG_DWORD, &Config.NumThreads, sizeof(DWORD));
+
     // config version == 2
     // compress params
     registry->SetValue(regKey, CONFIG_COMPRESS_LEVEL, REG_DWORD, &Config.CompressParams.CompressLevel, sizeof(DWORD));
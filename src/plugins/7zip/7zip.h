@@ -193,8 +193,17 @@ struct CConfig
 
     // version 2
     CCompressParams CompressParams;
+
+    int NumThreads; // number of threads used by 7za.dll for packing and unpacking, 0 = number of CPUs
 };
 
+// returns the number of threads 7za.dll should use according to the configuration
+int GetNumThreads();
+
+// returns 'numThreads' reduced so that the encoders packing with 'params' fit into
+// the available physical memory and address space
+int ClampPackThreads(const CCompressParams* params, int numThreads);
+
 // configuration
 extern CConfig Config;
 
@@ -223,6 +232,9 @@ extern CPluginInterface PluginInterface;
 #define COMPRESS_LEVEL_MAXIMUM 7
 #define COMPRESS_LEVEL_ULTRA 9
 
+// the most threads 7za.dll can use (LZMA2 encoder limit)
+#define MAX_NUM_THREADS 32
+
 #define DUMP_MEM_OBJECTS
 
 #if defined(DUMP_MEM_OBJECTS) && defined(_DEBUG)
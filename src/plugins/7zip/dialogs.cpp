@@ -32,7 +32,7 @@ CResDataPair CompressLevel[] =
 CResDataPair CompressMethod[] =
     {
         {IDS_METHOD_LZMA, CCompressParams::LZMA},
-        //  { IDS_METHOD_LZMA2, CCompressParams::LZMA2 },
+        {IDS_METHOD_LZMA2, CCompressParams::LZMA2},
         {IDS_METHOD_PPMD, CCompressParams::PPMd},
 };
 
@@ -76,6 +76,14 @@ void SetComboCurSelData(HWND hWnd, DWORD data)
     }
 }
 
+DWORD GetComboCurSelData(HWND hWnd, DWORD def)
+{
+    int curSel = (int)SendMessage(hWnd, CB_GETCURSEL, (WPARAM)0, (LPARAM)0);
+    if (curSel == CB_ERR)
+        return def;
+    return (DWORD)SendMessage(hWnd, CB_GETITEMDATA, (WPARAM)curSel, (LPARAM)0);
+}
+
 //
 // CCompressParamsDlg
 //
@@ -194,6 +202,13 @@ void CCompressParamsDlg::Transfer(CTransferInfo& ti)
     ti.CheckBox(IDCfgSolidArchive, CompressParams->SolidArchive);
 }
 
+void CCompressParamsDlg::GetParams(CCompressParams* params)
+{
+    params->CompressLevel = GetComboCurSelData(GetDlgItem(HWindow, IDCfgCompressLevel), params->CompressLevel);
+    params->Method = (CCompressParams::EMethod)GetComboCurSelData(GetDlgItem(HWindow, IDCfgCompressMethod), params->Method);
+    params->DictSize = GetComboCurSelData(GetDlgItem(HWindow, IDCfgDictSize), params->DictSize);
+}
+
 void CCompressParamsDlg::FillCompressLevelCombo()
 {
     SendMessage(GetDlgItem(HWindow, IDCfgCompressLevel), CB_RESETCONTENT, 0, 0);
@@ -470,6 +485,47 @@ void CConfigurationDialog::Transfer(CTransferInfo& ti)
     ti.CheckBox(IDC_CFG_LISTINFOMETHOD, Cfg.ListInfoMethod);
 
     CompressParamsDlg.Transfer(ti);
+
+    // number of threads
+    if (ti.Type == ttDataToWindow)
+        FillNumThreadsCombo(Cfg.NumThreads); // for the compression parameters set above
+    else if (ti.Type == ttDataFromWindow)
+    {
+        int curSel = (int)SendMessage(GetDlgItem(HWindow, IDC_CFG_NUM_THREADS), CB_GETCURSEL, (WPARAM)0, (LPARAM)0);
+        if (curSel != CB_ERR)
+            Cfg.NumThreads = (int)SendMessage(GetDlgItem(HWindow, IDC_CFG_NUM_THREADS), CB_GETITEMDATA, (WPARAM)curSel, (LPARAM)0);
+    }
+}
+
+void CConfigurationDialog::FillNumThreadsCombo(int sel)
+{
+    HWND combo = GetDlgItem(HWindow, IDC_CFG_NUM_THREADS);
+    SendMessage(combo, CB_RESETCONTENT, 0, 0);
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int cpus = min((int)si.dwNumberOfProcessors, MAX_NUM_THREADS);
+
+    // each packing thread needs its encoder, offer only as many threads as fit into
+    // the memory for the compression parameters chosen in the dialog
+    CCompressParams params = Cfg.CompressParams;
+    CompressParamsDlg.GetParams(&params);
+    int maxThreads = ClampPackThreads(&params, min(2 * cpus, MAX_NUM_THREADS));
+
+    // 0 means "as many as CPUs", then offer up to twice the number of CPUs
+    char buffer[100];
+    int i;
+    for (i = 0; i <= maxThreads; i++)
+    {
+        if (i == 0)
+            sprintf(buffer, LoadStr(IDS_NUM_THREADS_AUTO), ClampPackThreads(&params, cpus));
+        else
+            sprintf(buffer, "%d", i);
+        int res = (int)SendMessage(combo, CB_ADDSTRING, 0, (LPARAM)buffer);
+        if (res != CB_ERR)
+            SendMessage(combo, CB_SETITEMDATA, (WPARAM)res, (LPARAM)i);
+    }
+    SetComboCurSelData(combo, min(sel, maxThreads));
 }
 
 INT_PTR
@@ -483,6 +539,8 @@ CConfigurationDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
         EnableWindow(GetDlgItem(HWindow, IDC_CFG_LISTINFOMETHOD), Cfg.ExtendedListInfo);
 
         CompressParamsDlg.HWindow = HWindow;
+        FillNumThreadsCombo(Cfg.NumThreads);
+
         break; // request focus from DefDlgProc
     }
 
@@ -507,6 +565,14 @@ CConfigurationDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
 
     CompressParamsDlg.DialogProc(uMsg, wParam, lParam);
 
+    // the number of threads fitting into the memory depends on the compression parameters
+    if (uMsg == WM_COMMAND && HIWORD(wParam) == CBN_SELENDOK &&
+        (LOWORD(wParam) == IDC_CFG_COMPRESS_LEVEL || LOWORD(wParam) == IDC_CFG_COMPRESS_METHOD ||
+         LOWORD(wParam) == IDC_CFG_DICT_SIZE))
+    {
+        FillNumThreadsCombo((int)GetComboCurSelData(GetDlgItem(HWindow, IDC_CFG_NUM_THREADS), Cfg.NumThreads));
+    }
+
     return CCommonDialog::DialogProc(uMsg, wParam, lParam);
 }
 
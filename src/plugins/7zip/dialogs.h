@@ -44,6 +44,9 @@ public:
                        int IDCfgWordSize, int IDCfgSolidArchive);
     virtual void Transfer(CTransferInfo& ti);
 
+    // reads the level, method and dictionary size currently chosen in the dialog
+    void GetParams(CCompressParams* params);
+
     INT_PTR DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam);
 
 protected:
@@ -72,6 +75,9 @@ public:
     virtual void Transfer(CTransferInfo& ti);
 
 protected:
+    // 'sel' is the number of threads to select, at most the number fitting into the memory
+    void FillNumThreadsCombo(int sel);
+
     INT_PTR DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam);
 };
 
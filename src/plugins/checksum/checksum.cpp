@@ -8,6 +8,7 @@
 #include "checksum.h"
 #include "misc.h"
 #include "dialogs.h"
+#include "hashpipe.h"
 
 // ****************************************************************************
 
@@ -130,6 +131,10 @@ CPluginInterfaceAbstract* WINAPI SalamanderPluginEntry(CSalamanderPluginEntryAbs
 
     salamander->SetPluginHomePageURL("www.altap.cz");
 
+#ifdef _DEBUG
+    RunHashBenchmark(); // only if requested by OPENSAL_BENCHMARK
+#endif // _DEBUG
+
     return &PluginInterface;
 }
 
@@ -7,12 +7,13 @@
 #include "checksum.rh2"
 #include "lang\lang.rh"
 #include "dialogs.h"
+#include "hashpipe.h"
 #include "misc.h"
 
 CWindowQueue ModelessQueue("CheckSum Modeless Windows");  // list of all modeless windows
 CThreadQueue ThreadQueue("CheckSum Dialogs and Workers"); // list of all dialog and worker threads
 
-#define BUFSIZE (4 * 65536) // buffer size for reading
+#define BUFSIZE (4 * 65536) // buffer size for reading (must not exceed HASHPIPE_BUFFER_SIZE)
 
 #define GET_X_LPARAM(lp) ((int)(short)LOWORD(lp))
 #define GET_Y_LPARAM(lp) ((int)(short)HIWORD(lp))
@@ -638,16 +639,57 @@ BOOL CCalculateDialog::GetFileList()
     return ret;
 }
 
-class CCalculateThread : public CCRCMD5Thread
+class CCalculateThread : public CCRCMD5Thread, public CHashPipelineSink
 {
 public:
-    CCalculateThread(CCalculateDialog* dlg, BOOL* terminate) : CCRCMD5Thread(terminate) { dialog = dlg; };
+    CCalculateThread(CCalculateDialog* dlg, BOOL* terminate) : CCRCMD5Thread(terminate)
+    {
+        dialog = dlg;
+        nCalculators = 0;
+        canceledShown = FALSE;
+    };
     virtual unsigned Body();
 
+    // results of the hashing pipeline, they come in the order of the files
+    virtual void FileDone(CHashPipeResult* result);
+
 protected:
     CCalculateDialog* dialog;
+    int nCalculators;
+    BOOL canceledShown; // IDS_CANCELED is shown at the first file which was not finished
 };
 
+void CCalculateThread::FileDone(CHashPipeResult* result)
+{
+    if (!result->Aborted)
+    {
+        // store the results in the list
+        char text[2 * DIGEST_MAX_SIZE + 1];
+        int j;
+        for (j = 0; j < nCalculators; j++)
+        {
+            text[0] = 0;
+            int k;
+            for (k = 0; k < result->DigestLen[j]; k++)
+                sprintf(text + k * 2, "%02X", result->Digest[j][k]);
+            dialog->SetItemTextAndIcon(result->File, 2 + j, text);
+        }
+    }
+    else
+    {
+        // the file was skipped because of a read error (it is already marked) or the work was canceled
+        if (*Terminate && !canceledShown)
+        {
+            dialog->SetItemTextAndIcon(result->File, 2, LoadStr(IDS_CANCELED));
+            canceledShown = TRUE;
+        }
+    }
+    // the file is finished, the list may show it and move to the next one (the files after
+    // ScrollIndex can still be written by this thread, see CSFVMD5Dialog::SetItemTextAndIcon())
+    if (!*Terminate && result->File + 1 < dialog->FileList.Count)
+        dialog->ScrollToItem(result->File + 1);
+}
+
 unsigned CCalculateThread::Body()
 {
     CALL_STACK_MESSAGE1("CCalculateThread::Body()");
@@ -657,7 +699,6 @@ unsigned CCalculateThread::Body()
     BOOL skipAllReadErrors = FALSE;
     BOOL skip;
     CHashAlgo* pCalculators[HT_COUNT];
-    int nCalculators = 0;
 
     int ii;
     for (ii = 0; ii < HT_COUNT; ii++)
@@ -680,14 +721,26 @@ unsigned CCalculateThread::Body()
         }
     }
 
+    // reading of the files is overlapped with computing of the hashes, each algorithm runs
+    // in its own thread; results are passed back to this thread by FileDone()
+    CHashPipeline pipeline(this, Terminate);
+    if (!pipeline.Start(pCalculators, nCalculators))
+    {
+        while (nCalculators > 0)
+            delete pCalculators[--nCalculators];
+        if (dialog->FileList.Count > 0)
+            dialog->SetItemTextAndIcon(0, 2, LoadStr(IDS_CANCELED));
+        TRACE_I("End");
+        PostMessage(dialog->HWindow, WM_USER_ENDWORK, 0, 0);
+        return 0;
+    }
+
     // while the worker thread runs, the array is not modified (the number of items + indices do
     // not change = no need to synchronize access to them)
     int silent = 0;
+    dialog->ScrollToItem(0);
     for (int i = 0; i < dialog->FileList.Count && !*Terminate; i++)
     {
-        // scroll to the current item (only if the previous one is visible, i.e. the user did not jump to the top)
-        dialog->ScrollToItem(i);
-
         // open the file
         HANDLE hFile;
         char path[MAX_PATH];
@@ -724,16 +777,14 @@ unsigned CCalculateThread::Body()
             continue;
         }
 
-        // Now calculates the hashes
-        int j;
-        for (j = 0; j < nCalculators; j++)
-            pCalculators[j]->Init();
-
+        // Now read the file for the hashing lanes
+        pipeline.BeginFile(i);
+        DWORD flags = hpbFirst;
         DWORD nr;
         CQuadWord done(0, 0);
         do
         {
-            char buffer[BUFSIZE];
+            char* buffer = pipeline.GetBuffer();
             if (!SafeReadFile(hFile, buffer, BUFSIZE, &nr, path, dialog->HWindow, &skippedReadError, &skipAllReadErrors))
             {
                 nr = 0; // read error
@@ -763,11 +814,19 @@ unsigned CCalculateThread::Body()
                 }
                 else
                     *Terminate = TRUE;
+                pipeline.Submit(0, hpbAbort);
             }
-            if (nr > 0)
+            else
             {
-                for (int j2 = 0; j2 < nCalculators; j2++)
-                    pCalculators[j2]->Update(buffer, nr);
+                if (nr < BUFSIZE)
+                    flags |= hpbLast;
+                else
+                {
+                    if (*Terminate) // the rest of the file will not be read
+                        flags |= hpbAbort;
+                }
+                pipeline.Submit(nr, flags);
+                flags = 0;
                 dialog->IncreaseProgress(CQuadWord(nr, 0));
                 done += CQuadWord(nr, 0);
             }
@@ -775,34 +834,11 @@ unsigned CCalculateThread::Body()
         if (!*Terminate)
             dialog->IncreaseProgress(CQuadWord(FILE_SIZE_FIX, 0));
         CloseHandle(hFile);
-
-        // store the results in the list
-        if (!*Terminate && !skippedReadError)
-        {
-            for (int k = 0; k < nCalculators; k++)
-                pCalculators[k]->Finalize();
-
-            char digest[DIGEST_MAX_SIZE];
-            char text[2 * DIGEST_MAX_SIZE + 1];
-
-            int j2;
-            for (j2 = 0; j2 < nCalculators; j2++)
-            {
-                int len = pCalculators[j2]->GetDigest(digest, SizeOf(digest));
-                text[0] = 0;
-                int k2;
-                for (k2 = 0; k2 < len; k2++)
-                    sprintf(text + k2 * 2, "%02X", digest[k2]);
-                dialog->SetItemTextAndIcon(i, 2 + j2, text);
-            }
-        }
-        else
-        {
-            if (*Terminate)
-                dialog->SetItemTextAndIcon(i, 2, LoadStr(IDS_CANCELED));
-        }
     }
 
+    // wait for the hashes of the files still in the lanes
+    pipeline.Finish();
+
     while (nCalculators > 0)
         delete pCalculators[--nCalculators];
     TRACE_I("End");
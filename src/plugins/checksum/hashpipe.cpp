@@ -0,0 +1,433 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include "checksum.h"
+#include "wrappers.h"
+#include "dialogs.h"
+#include "hashpipe.h"
+#include "benchsel.h"
+#include "tomcrypt\tomcrypt.h"
+
+//
+// ****************************************************************************
+// CHashPipeline
+//
+
+CHashPipeline::CHashPipeline(CHashPipelineSink* sink, BOOL* terminate)
+{
+    Sink = sink;
+    Terminate = terminate;
+    LanesCount = 0;
+    Threads = FALSE;
+    Memory = NULL;
+    FreeBuffers = NULL;
+    Submitted = 0;
+    ResultsFirst = 0;
+    ResultsCount = 0;
+    ResultDone = NULL;
+    Current = NULL;
+}
+
+CHashPipeline::~CHashPipeline()
+{
+    Finish();
+    if (FreeBuffers != NULL)
+        HANDLES(CloseHandle(FreeBuffers));
+    if (ResultDone != NULL)
+        HANDLES(CloseHandle(ResultDone));
+    if (Memory != NULL)
+        free(Memory);
+}
+
+BOOL CHashPipeline::Start(CHashAlgo** algos, int count)
+{
+    CALL_STACK_MESSAGE2("CHashPipeline::Start(, %d)", count);
+    if (count > HASHPIPE_MAX_LANES)
+    {
+        TRACE_E("CHashPipeline::Start(): too many algorithms!");
+        return FALSE;
+    }
+    Memory = (char*)malloc(HASHPIPE_BUFFERS * HASHPIPE_BUFFER_SIZE);
+    if (Memory == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    int i;
+    for (i = 0; i < HASHPIPE_BUFFERS; i++)
+    {
+        Buffers[i].Data = Memory + i * HASHPIPE_BUFFER_SIZE;
+        Buffers[i].Pending = 0;
+    }
+
+    LanesCount = count;
+    for (i = 0; i < count; i++)
+    {
+        Lanes[i].Pipeline = this;
+        Lanes[i].Algo = algos[i];
+        Lanes[i].Index = i;
+        Lanes[i].Filled = NULL;
+        Lanes[i].Thread = NULL;
+        Lanes[i].Processed = 0;
+    }
+
+    FreeBuffers = HANDLES(CreateSemaphore(NULL, HASHPIPE_BUFFERS, HASHPIPE_BUFFERS, NULL));
+    ResultDone = HANDLES(CreateEvent(NULL, FALSE, FALSE, NULL));
+    Threads = FreeBuffers != NULL && ResultDone != NULL;
+    for (i = 0; Threads && i < count; i++)
+    {
+        // one extra count for the request to quit, see StopLanes()
+        Lanes[i].Filled = HANDLES(CreateSemaphore(NULL, 0, HASHPIPE_BUFFERS + 1, NULL));
+        if (Lanes[i].Filled == NULL ||
+            (Lanes[i].Thread = ThreadQueue.StartThread(LaneBody, &Lanes[i])) == NULL)
+        {
+            Threads = FALSE;
+        }
+    }
+    if (!Threads)
+    {
+        TRACE_E("CHashPipeline::Start(): unable to start lanes, hashing in the reading thread.");
+        StopLanes();
+    }
+    return TRUE;
+}
+
+void CHashPipeline::StopLanes()
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::StopLanes()");
+    int i;
+    for (i = 0; i < LanesCount; i++)
+    {
+        CHashPipeLane* lane = &Lanes[i];
+        if (lane->Thread != NULL)
+        {
+            ReleaseSemaphore(lane->Filled, 1, NULL); // a signal without a buffer = quit
+            ThreadQueue.WaitForExit(lane->Thread, INFINITE);
+            lane->Thread = NULL;
+        }
+        if (lane->Filled != NULL)
+        {
+            HANDLES(CloseHandle(lane->Filled));
+            lane->Filled = NULL;
+        }
+    }
+}
+
+unsigned WINAPI
+CHashPipeline::LaneBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::LaneBody()");
+    CHashPipeLane* lane = (CHashPipeLane*)param;
+    CHashPipeline* pipeline = lane->Pipeline;
+    SetThreadNameInVCAndTrace("Hash Lane");
+    while (WaitForSingleObject(lane->Filled, INFINITE) == WAIT_OBJECT_0)
+    {
+        // each submitted buffer releases the semaphore once after increasing Submitted,
+        // so a signal without a buffer can only be the request to quit
+        if (lane->Processed == pipeline->Submitted)
+            break;
+        pipeline->Process(lane, &pipeline->Buffers[lane->Processed % HASHPIPE_BUFFERS]);
+        lane->Processed++;
+    }
+    return 0;
+}
+
+void CHashPipeline::Process(CHashPipeLane* lane, CHashPipeBuffer* buffer)
+{
+    CHashPipeResult* result = buffer->Result;
+    if ((buffer->Flags & hpbAbort) == 0 && !result->Aborted)
+    {
+        if (*Terminate)
+            result->Aborted = TRUE; // the digests of the file would not be complete
+        else
+        {
+            CHashAlgo* algo = lane->Algo;
+            if (buffer->Flags & hpbFirst)
+                algo->Init();
+            if (buffer->Size > 0)
+                algo->Update(buffer->Data, buffer->Size);
+            if (buffer->Flags & hpbLast)
+            {
+                algo->Finalize();
+                result->DigestLen[lane->Index] = algo->GetDigest(result->Digest[lane->Index], DIGEST_MAX_SIZE);
+            }
+        }
+    }
+    if ((buffer->Flags & (hpbLast | hpbAbort)) != 0 && InterlockedDecrement(&result->Pending) == 0 && Threads)
+        SetEvent(ResultDone);
+    // buffers are processed by all lanes in the same order, so the free ones always follow
+    // the last filled one in the ring
+    if (InterlockedDecrement(&buffer->Pending) == 0 && Threads)
+        ReleaseSemaphore(FreeBuffers, 1, NULL);
+}
+
+void CHashPipeline::BeginFile(int file)
+{
+    if (Current != NULL)
+        TRACE_E("CHashPipeline::BeginFile(): the previous file was not finished!");
+    PassResults(HASHPIPE_FILES - 1);
+    CHashPipeResult* result = &Results[(ResultsFirst + ResultsCount) % HASHPIPE_FILES];
+    result->File = file;
+    result->Aborted = FALSE;
+    result->Pending = LanesCount;
+    int i;
+    for (i = 0; i < LanesCount; i++)
+        result->DigestLen[i] = 0;
+    ResultsCount++;
+    Current = result;
+}
+
+char* CHashPipeline::GetBuffer()
+{
+    if (Threads)
+        WaitForSingleObject(FreeBuffers, INFINITE); // lanes always make progress, so the wait ends
+    return Buffers[Submitted % HASHPIPE_BUFFERS].Data;
+}
+
+void CHashPipeline::Submit(DWORD size, DWORD flags)
+{
+    if (Current == NULL)
+    {
+        TRACE_E("CHashPipeline::Submit(): BeginFile() was not called!");
+        return;
+    }
+    CHashPipeBuffer* buffer = &Buffers[Submitted % HASHPIPE_BUFFERS];
+    buffer->Size = size;
+    buffer->Flags = flags;
+    buffer->Result = Current;
+    buffer->Pending = LanesCount;
+    if (flags & hpbAbort)
+        Current->Aborted = TRUE;
+    if (flags & (hpbLast | hpbAbort))
+        Current = NULL;
+
+    int i;
+    if (Threads)
+    {
+        InterlockedIncrement(&Submitted);
+        for (i = 0; i < LanesCount; i++)
+            ReleaseSemaphore(Lanes[i].Filled, 1, NULL);
+    }
+    else
+    {
+        for (i = 0; i < LanesCount; i++)
+            Process(&Lanes[i], buffer);
+        Submitted++;
+    }
+    PassResults(HASHPIPE_FILES);
+}
+
+void CHashPipeline::PassResults(int maxCount)
+{
+    while (ResultsCount > 0)
+    {
+        CHashPipeResult* result = &Results[ResultsFirst];
+        if (result == Current || result->Pending > 0)
+        {
+            if (ResultsCount <= maxCount || result == Current)
+                break;
+            WaitForSingleObject(ResultDone, INFINITE);
+            continue;
+        }
+        Sink->FileDone(result);
+        ResultsFirst = (ResultsFirst + 1) % HASHPIPE_FILES;
+        ResultsCount--;
+    }
+}
+
+void CHashPipeline::Finish()
+{
+    CALL_STACK_MESSAGE1("CHashPipeline::Finish()");
+    if (Current != NULL) // the file was not finished (should not happen), drop it
+    {
+        GetBuffer();
+        Submit(0, hpbAbort);
+    }
+    PassResults(0);
+    StopLanes();
+}
+
+//
+// ****************************************************************************
+// RunHashBenchmark
+//
+
+#ifdef _DEBUG
+
+#define HASHBENCH_DATA_SIZE (64 * 1024 * 1024) // hashed data (also the size of the "large files" workload)
+
+class CHashBenchmarkSink : public CHashPipelineSink
+{
+public:
+    int Files;
+
+    CHashBenchmarkSink() { Files = 0; }
+    virtual void FileDone(CHashPipeResult* result)
+    {
+        if (result->Aborted)
+            TRACE_E("CHashBenchmarkSink::FileDone(): file " << result->File << " was aborted!");
+        Files++;
+    }
+};
+
+// hashes HASHBENCH_DATA_SIZE bytes of 'data' by one algorithm, returns its digest
+static void HashBenchmarkAlgo(const char* name, CHashAlgo* algo, const char* data, char* digest, int* digestLen)
+{
+    LARGE_INTEGER freq, start;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    algo->Init();
+    DWORD off;
+    for (off = 0; off < HASHBENCH_DATA_SIZE; off += HASHPIPE_BUFFER_SIZE)
+        algo->Update(data + off, HASHPIPE_BUFFER_SIZE);
+    algo->Finalize();
+    *digestLen = algo->GetDigest(digest, DIGEST_MAX_SIZE);
+    double seconds = BenchSeconds(start, freq);
+    TRACE_I("RunHashBenchmark(): " << name << ": " << (int)(HASHBENCH_DATA_SIZE / 1048576.0 / seconds) << " MB/s");
+}
+
+// hashes 'files' files of 'fileSize' bytes from 'data' by all algorithms, either in one
+// thread like before the pipeline existed or by the pipeline; returns MB/s
+static int HashBenchmarkWorkload(CHashAlgo** algos, int count, const char* data, DWORD fileSize, int files,
+                                 BOOL pipelined)
+{
+    LARGE_INTEGER freq, start;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    if (pipelined)
+    {
+        CHashBenchmarkSink sink;
+        BOOL terminate = FALSE;
+        CHashPipeline pipeline(&sink, &terminate);
+        if (!pipeline.Start(algos, count))
+            return 0;
+        int f;
+        for (f = 0; f < files; f++)
+        {
+            // the "reading" copies the data like ReadFile from the system cache
+            const char* src = data + (f * (DWORD_PTR)fileSize) % HASHBENCH_DATA_SIZE;
+            pipeline.BeginFile(f);
+            DWORD flags = hpbFirst;
+            DWORD off = 0;
+            DWORD n;
+            do
+            {
+                char* buffer = pipeline.GetBuffer();
+                n = min(fileSize - off, (DWORD)HASHPIPE_BUFFER_SIZE);
+                memcpy(buffer, src + off, n);
+                off += n;
+                if (n < HASHPIPE_BUFFER_SIZE)
+                    flags |= hpbLast;
+                pipeline.Submit(n, flags);
+                flags = 0;
+            } while (n == HASHPIPE_BUFFER_SIZE);
+        }
+        pipeline.Finish();
+        if (sink.Files != files)
+            TRACE_E("HashBenchmarkWorkload(): " << sink.Files << " results instead of " << files);
+    }
+    else
+    {
+        char* buffer = (char*)malloc(HASHPIPE_BUFFER_SIZE);
+        if (buffer == NULL)
+            return 0;
+        int f;
+        for (f = 0; f < files; f++)
+        {
+            const char* src = data + (f * (DWORD_PTR)fileSize) % HASHBENCH_DATA_SIZE;
+            int i;
+            for (i = 0; i < count; i++)
+                algos[i]->Init();
+            DWORD off = 0;
+            DWORD n;
+            do
+            {
+                n = min(fileSize - off, (DWORD)HASHPIPE_BUFFER_SIZE);
+                memcpy(buffer, src + off, n);
+                off += n;
+                for (i = 0; i < count; i++)
+                    algos[i]->Update(buffer, n);
+            } while (n == HASHPIPE_BUFFER_SIZE);
+            char digest[DIGEST_MAX_SIZE];
+            for (i = 0; i < count; i++)
+            {
+                algos[i]->Finalize();
+                algos[i]->GetDigest(digest, DIGEST_MAX_SIZE);
+            }
+        }
+        free(buffer);
+    }
+    double seconds = BenchSeconds(start, freq);
+    return (int)((double)fileSize * files / 1048576.0 / seconds);
+}
+
+void RunHashBenchmark()
+{
+    if (!IsBenchmarkSelected("checksum"))
+        return;
+
+    CALL_STACK_MESSAGE1("RunHashBenchmark()");
+    TRACE_I("RunHashBenchmark(): begin, SHA extensions: " << (sha_ni_available() ? "yes" : "no"));
+    char* data = (char*)malloc(HASHBENCH_DATA_SIZE);
+    if (data == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return;
+    }
+    DWORD seed = 0x12345678;
+    DWORD i;
+    for (i = 0; i < HASHBENCH_DATA_SIZE / sizeof(DWORD); i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        ((DWORD*)data)[i] = seed;
+    }
+
+    static const char* algoNames[HT_COUNT] = {"CRC", "MD5", "SHA1", "SHA256", "SHA512"};
+    static THashFactory factories[HT_COUNT] = {CRCFactory, MD5Factory, SHA1Factory, SHA256Factory, SHA512Factory};
+    CHashAlgo* algos[HT_COUNT];
+    int count = 0;
+    int a;
+    for (a = 0; a < HT_COUNT; a++)
+    {
+        CHashAlgo* algo = factories[a]();
+        if (algo == NULL)
+        {
+            TRACE_E("RunHashBenchmark(): unable to create " << algoNames[a]);
+            continue;
+        }
+        algos[count++] = algo;
+
+        // throughput of each algorithm, SHA1 and SHA256 also without the SHA extensions
+        char digest[DIGEST_MAX_SIZE];
+        int digestLen;
+        HashBenchmarkAlgo(algoNames[a], algo, data, digest, &digestLen);
+        if ((a == HT_SHA1 || a == HT_SHA256) && sha_ni_available())
+        {
+            char name[50];
+            sprintf(name, "%s (portable)", algoNames[a]);
+            char digest2[DIGEST_MAX_SIZE];
+            int digestLen2;
+            sha_ni_enable(FALSE);
+            HashBenchmarkAlgo(name, algo, data, digest2, &digestLen2);
+            sha_ni_enable(TRUE);
+            if (digestLen != digestLen2 || memcmp(digest, digest2, digestLen) != 0)
+                TRACE_E("RunHashBenchmark(): " << algoNames[a] << " digests of the SHA extensions and of the portable code differ!");
+        }
+    }
+
+    // all algorithms at once, in one thread and by the pipeline
+    TRACE_I("RunHashBenchmark(): all algorithms, 4096 files of 16 KB: serial "
+            << HashBenchmarkWorkload(algos, count, data, 16 * 1024, 4096, FALSE) << " MB/s, pipelined "
+            << HashBenchmarkWorkload(algos, count, data, 16 * 1024, 4096, TRUE) << " MB/s");
+    TRACE_I("RunHashBenchmark(): all algorithms, 4 files of 16 MB: serial "
+            << HashBenchmarkWorkload(algos, count, data, 16 * 1024 * 1024, 4, FALSE) << " MB/s, pipelined "
+            << HashBenchmarkWorkload(algos, count, data, 16 * 1024 * 1024, 4, TRUE) << " MB/s");
+
+    while (count > 0)
+        delete algos[--count];
+    free(data);
+    TRACE_I("RunHashBenchmark(): end");
+}
+
+#endif // _DEBUG
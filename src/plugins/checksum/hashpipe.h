@@ -0,0 +1,125 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+//
+// ****************************************************************************
+// CHashPipeline
+//
+// Overlaps reading of files with computing of their hashes: the reading thread fills
+// buffers of a ring and each algorithm (CHashAlgo) is computed in its own thread (lane),
+// which processes the buffers in order. A small file takes a single buffer, so up to
+// HASHPIPE_FILES files are in flight. Results are passed back to the reading thread in
+// the order of the files (see CHashPipelineSink), so the worker thread of the dialog
+// stays the only thread which writes to the file list.
+//
+
+#define HASHPIPE_BUFFER_SIZE (4 * 65536) // size of one buffer of the ring
+#define HASHPIPE_BUFFERS 16              // number of buffers in the ring
+#define HASHPIPE_FILES 16                // maximal number of files in flight
+#define HASHPIPE_MAX_LANES HT_COUNT      // maximal number of algorithms
+
+// flags of CHashPipeline::Submit()
+#define hpbFirst 0x01 // first buffer of the file (lanes start new digests)
+#define hpbLast 0x02  // last buffer of the file (lanes finish the digests)
+#define hpbAbort 0x04 // reading of the file failed, lanes drop its digests (the buffer is empty)
+
+struct CHashPipeResult
+{
+    int File;              // index of the file (see CHashPipeline::BeginFile)
+    volatile LONG Aborted; // TRUE = digests are not valid (read error or the work was terminated)
+    volatile LONG Pending; // number of lanes which did not finish the file yet
+    int DigestLen[HASHPIPE_MAX_LANES];
+    char Digest[HASHPIPE_MAX_LANES][DIGEST_MAX_SIZE];
+};
+
+class CHashPipelineSink
+{
+public:
+    // called in the reading thread for finished files in the order of CHashPipeline::BeginFile()
+    // calls; digests are in the order of the algorithms passed to CHashPipeline::Start()
+    virtual void FileDone(CHashPipeResult* result) = 0;
+};
+
+class CHashPipeline;
+
+struct CHashPipeBuffer
+{
+    char* Data;
+    DWORD Size;
+    DWORD Flags;             // hpbXXX
+    CHashPipeResult* Result; // file the data belong to
+    volatile LONG Pending;   // number of lanes which did not process the buffer yet
+};
+
+struct CHashPipeLane
+{
+    CHashPipeline* Pipeline;
+    CHashAlgo* Algo;
+    int Index;
+    HANDLE Filled;  // semaphore: buffers submitted to the lane
+    HANDLE Thread;  // NULL = the lane thread is not running
+    LONG Processed; // number of buffers processed by the lane
+};
+
+class CHashPipeline
+{
+protected:
+    CHashPipelineSink* Sink;
+    BOOL* Terminate; // TRUE = the user cancelled the work, lanes skip the rest of data
+
+    CHashPipeLane Lanes[HASHPIPE_MAX_LANES];
+    int LanesCount;
+    BOOL Threads; // TRUE = lanes run in their threads, FALSE = buffers are hashed by Submit()
+
+    char* Memory; // data of all buffers
+    CHashPipeBuffer Buffers[HASHPIPE_BUFFERS];
+    HANDLE FreeBuffers;      // semaphore: buffers which can be filled
+    volatile LONG Submitted; // number of submitted buffers (the next one is Buffers[Submitted % HASHPIPE_BUFFERS])
+
+    CHashPipeResult Results[HASHPIPE_FILES];
+    int ResultsFirst;         // the oldest file in flight
+    int ResultsCount;         // number of files in flight
+    HANDLE ResultDone;        // auto-reset event: a lane finished some file
+    CHashPipeResult* Current; // file being read, NULL = none
+
+public:
+    CHashPipeline(CHashPipelineSink* sink, BOOL* terminate);
+    ~CHashPipeline();
+
+    // starts lanes for 'count' algorithms; returns FALSE on lack of memory; if the threads
+    // cannot be started, buffers are hashed in the reading thread
+    BOOL Start(CHashAlgo** algos, int count);
+
+    // starts the file 'file'; waits for the oldest file if HASHPIPE_FILES files are in flight
+    void BeginFile(int file);
+
+    // returns a buffer of HASHPIPE_BUFFER_SIZE bytes for data of the current file, waits
+    // for a free buffer; each call must be followed by Submit()
+    char* GetBuffer();
+
+    // passes 'size' bytes of the buffer from GetBuffer() to the lanes, 'flags' are hpbXXX;
+    // the file ends with hpbLast or hpbAbort; passes results of the finished files to the sink
+    void Submit(DWORD size, DWORD flags);
+
+    // waits for all files in flight and passes their results, stops the lanes
+    void Finish();
+
+protected:
+    // passes results of the finished files to the sink, waits while more than 'maxCount'
+    // files are in flight
+    void PassResults(int maxCount);
+
+    void Process(CHashPipeLane* lane, CHashPipeBuffer* buffer);
+    void StopLanes();
+
+    static unsigned WINAPI LaneBody(void* param);
+};
+
+#ifdef _DEBUG
+// throughput of the algorithms and of the pipeline on data in memory (no disk and no UI),
+// started when loading the plugin if the environment variable OPENSAL_BENCHMARK contains
+// "checksum" (or is "all"); results are reported as TRACE_I messages
+void RunHashBenchmark();
+#endif // _DEBUG
@@ -199,6 +199,23 @@ static int sha256_compress(hash_state * md, unsigned char *buf)
 }
 #endif
 
+/* compress runs of 512-bit blocks, by the SHA extensions of the CPU if it has them */
+static int sha256_compress_blocks(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    int err;
+
+    if (sha_ni_available()) {
+        sha256_ni_compress(md->sha256.state, buf, blocks);
+        return CRYPT_OK;
+    }
+    for (; blocks > 0; blocks--, buf += 64) {
+        if ((err = sha256_compress(md, (unsigned char *)buf)) != CRYPT_OK) {
+            return err;
+        }
+    }
+    return CRYPT_OK;
+}
+
 /**
    Initialize the hash state
    @param md   The hash state you wish to initialize
@@ -228,7 +245,7 @@ int sha256_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
-HASH_PROCESS(sha256_process, sha256_compress, sha256, 64)
+HASH_PROCESS_BLOCKS(sha256_process, sha256_compress_blocks, sha256, 64)
 
 /**
    Terminate the hash to get the digest
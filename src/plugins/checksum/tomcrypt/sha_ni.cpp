@@ -0,0 +1,249 @@
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ *
+ * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
+ */
+#include "precomp.h"
+#include "tomcrypt.h"
+#include <intrin.h>
+
+/**
+  @file sha_ni.c
+  LTC_SHA1 and LTC_SHA256 compression by the SHA extensions of x86 CPUs (SHA-NI).
+  The kernels are used by sha1_process and sha256_process when the CPU supports
+  the extensions (checked at runtime), otherwise the portable code is used.
+*/
+
+#if defined(LTC_SHA1) || defined(LTC_SHA256)
+
+static volatile long sha_ni_state = -1; /* -1 = not detected yet, 0 = not used, 1 = used */
+
+/**
+   Tests whether the SHA extensions (and SSSE3 + SSE4.1 used with them) can be used
+   @return 1 if the kernels can be used
+*/
+int sha_ni_available(void)
+{
+    if (sha_ni_state == -1) {
+        int regs[4], available = 0; /* EAX, EBX, ECX, EDX */
+        __cpuid(regs, 0);
+        if (regs[0] >= 7) {
+            __cpuid(regs, 1);
+            if ((regs[2] & (1 << 9)) != 0 && (regs[2] & (1 << 19)) != 0) { /* SSSE3 + SSE4.1 */
+                __cpuidex(regs, 7, 0);
+                available = (regs[1] & (1 << 29)) != 0; /* SHA */
+            }
+        }
+        sha_ni_state = available;
+    }
+    return (int)sha_ni_state;
+}
+
+/**
+   Enables or disables use of the SHA extensions (for comparison of the portable code)
+   @param enable  Nonzero to use the extensions when the CPU supports them
+*/
+void sha_ni_enable(int enable)
+{
+    sha_ni_state = -1;
+    if (!enable || !sha_ni_available()) {
+        sha_ni_state = 0;
+    }
+}
+
+#endif
+
+#ifdef LTC_SHA1
+
+/**
+   Compresses whole blocks by the SHA extensions
+   @param state   The state (5 words) of the hash
+   @param in      The blocks
+   @param blocks  The number of 64-byte blocks
+*/
+void sha1_ni_compress(ulong32 *state, const unsigned char *in, unsigned long blocks)
+{
+    __m128i abcd, e0, e1, abcd_save, e0_save, m0, m1, m2, m3;
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+/* rounds of group 'g' (words 4g..4g+3 in 'm'); 'e' gets the next E, 'en' is the other one */
+#define SHA1NI_ROUNDS(e, en, m, f)                 \
+    e = _mm_sha1nexte_epu32(e, m);                 \
+    en = abcd;                                     \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+
+    /* message schedule of group g (m0 = group g, m1..m3 = groups g+1..g+3):
+       msg1 of group g-1 (for g+3), xor into group g+2 and msg2 of group g+1 */
+#define SHA1NI_MSG1(mp, m) mp = _mm_sha1msg1_epu32(mp, m);
+#define SHA1NI_XOR(m2, m) m2 = _mm_xor_si128(m2, m);
+#define SHA1NI_MSG2(m1, m) m1 = _mm_sha1msg2_epu32(m1, m);
+
+    while (blocks-- > 0) {
+        abcd_save = abcd;
+        e0_save = e0;
+
+        /* rounds 0-3 */
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 0)), mask);
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        /* rounds 4-15 */
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), mask);
+        SHA1NI_ROUNDS(e1, e0, m1, 0)
+        SHA1NI_MSG1(m0, m1)
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 32)), mask);
+        SHA1NI_ROUNDS(e0, e1, m2, 0)
+        SHA1NI_MSG1(m1, m2)
+        SHA1NI_XOR(m0, m2)
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 48)), mask);
+        SHA1NI_MSG2(m0, m3)
+        SHA1NI_ROUNDS(e1, e0, m3, 0)
+        SHA1NI_MSG1(m2, m3)
+        SHA1NI_XOR(m1, m3)
+
+        /* rounds 16-67 (groups 4-16), the registers rotate */
+        SHA1NI_MSG2(m1, m0) SHA1NI_ROUNDS(e0, e1, m0, 0) SHA1NI_MSG1(m3, m0) SHA1NI_XOR(m2, m0)
+        SHA1NI_MSG2(m2, m1) SHA1NI_ROUNDS(e1, e0, m1, 1) SHA1NI_MSG1(m0, m1) SHA1NI_XOR(m3, m1)
+        SHA1NI_MSG2(m3, m2) SHA1NI_ROUNDS(e0, e1, m2, 1) SHA1NI_MSG1(m1, m2) SHA1NI_XOR(m0, m2)
+        SHA1NI_MSG2(m0, m3) SHA1NI_ROUNDS(e1, e0, m3, 1) SHA1NI_MSG1(m2, m3) SHA1NI_XOR(m1, m3)
+        SHA1NI_MSG2(m1, m0) SHA1NI_ROUNDS(e0, e1, m0, 1) SHA1NI_MSG1(m3, m0) SHA1NI_XOR(m2, m0)
+        SHA1NI_MSG2(m2, m1) SHA1NI_ROUNDS(e1, e0, m1, 1) SHA1NI_MSG1(m0, m1) SHA1NI_XOR(m3, m1)
+        SHA1NI_MSG2(m3, m2) SHA1NI_ROUNDS(e0, e1, m2, 2) SHA1NI_MSG1(m1, m2) SHA1NI_XOR(m0, m2)
+        SHA1NI_MSG2(m0, m3) SHA1NI_ROUNDS(e1, e0, m3, 2) SHA1NI_MSG1(m2, m3) SHA1NI_XOR(m1, m3)
+        SHA1NI_MSG2(m1, m0) SHA1NI_ROUNDS(e0, e1, m0, 2) SHA1NI_MSG1(m3, m0) SHA1NI_XOR(m2, m0)
+        SHA1NI_MSG2(m2, m1) SHA1NI_ROUNDS(e1, e0, m1, 2) SHA1NI_MSG1(m0, m1) SHA1NI_XOR(m3, m1)
+        SHA1NI_MSG2(m3, m2) SHA1NI_ROUNDS(e0, e1, m2, 2) SHA1NI_MSG1(m1, m2) SHA1NI_XOR(m0, m2)
+        SHA1NI_MSG2(m0, m3) SHA1NI_ROUNDS(e1, e0, m3, 3) SHA1NI_MSG1(m2, m3) SHA1NI_XOR(m1, m3)
+        SHA1NI_MSG2(m1, m0) SHA1NI_ROUNDS(e0, e1, m0, 3) SHA1NI_MSG1(m3, m0) SHA1NI_XOR(m2, m0)
+
+        /* rounds 68-79 */
+        SHA1NI_MSG2(m2, m1) SHA1NI_ROUNDS(e1, e0, m1, 3) SHA1NI_XOR(m3, m1)
+        SHA1NI_MSG2(m3, m2) SHA1NI_ROUNDS(e0, e1, m2, 3)
+        SHA1NI_ROUNDS(e1, e0, m3, 3)
+
+        /* add the state of the previous block */
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+
+        in += 64;
+    }
+
+#undef SHA1NI_ROUNDS
+#undef SHA1NI_MSG1
+#undef SHA1NI_XOR
+#undef SHA1NI_MSG2
+
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (ulong32)_mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+#ifdef LTC_SHA256
+
+static const ulong32 sha256_ni_k[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL,
+    0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL, 0xd807aa98UL, 0x12835b01UL,
+    0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL,
+    0xc19bf174UL, 0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+    0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL, 0x983e5152UL,
+    0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL,
+    0x06ca6351UL, 0x14292967UL, 0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL,
+    0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL,
+    0xd6990624UL, 0xf40e3585UL, 0x106aa070UL, 0x19a4c116UL, 0x1e376c08UL,
+    0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL,
+    0x682e6ff3UL, 0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+    0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+/**
+   Compresses whole blocks by the SHA extensions
+   @param state   The state (8 words) of the hash
+   @param in      The blocks
+   @param blocks  The number of 64-byte blocks
+*/
+void sha256_ni_compress(ulong32 *state, const unsigned char *in, unsigned long blocks)
+{
+    __m128i state0, state1, abef_save, cdgh_save, msg, tmp, m0, m1, m2, m3;
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    /* the extensions keep the state as ABEF and CDGH */
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);      /* CDAB */
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)), 0x1B); /* EFGH */
+    state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); /* CDGH */
+
+/* four rounds of group 'g' (words 4g..4g+3 in 'm') */
+#define SHA256NI_ROUNDS(m, g)                                                            \
+    msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *)(sha256_ni_k + 4 * (g)))); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);                                 \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+
+/* completes words of the next group in 'm' (msg1 already applied) from the last two groups 'mp2' and 'mp1' */
+#define SHA256NI_SCHEDULE(m, mp2, mp1) \
+    m = _mm_sha256msg2_epu32(_mm_add_epi32(m, _mm_alignr_epi8(mp1, mp2, 4)), mp1);
+
+    while (blocks-- > 0) {
+        abef_save = state0;
+        cdgh_save = state1;
+
+        /* rounds 0-15 */
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 0)), mask);
+        SHA256NI_ROUNDS(m0, 0)
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), mask);
+        SHA256NI_ROUNDS(m1, 1)
+        m0 = _mm_sha256msg1_epu32(m0, m1);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 32)), mask);
+        SHA256NI_ROUNDS(m2, 2)
+        m1 = _mm_sha256msg1_epu32(m1, m2);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 48)), mask);
+        SHA256NI_ROUNDS(m3, 3)
+        SHA256NI_SCHEDULE(m0, m2, m3)
+        m2 = _mm_sha256msg1_epu32(m2, m3);
+
+        /* rounds 16-51 (groups 4-12), the registers rotate; words of the next group
+           are completed before msg1 overwrites the previous group */
+        SHA256NI_ROUNDS(m0, 4) SHA256NI_SCHEDULE(m1, m3, m0) m3 = _mm_sha256msg1_epu32(m3, m0);
+        SHA256NI_ROUNDS(m1, 5) SHA256NI_SCHEDULE(m2, m0, m1) m0 = _mm_sha256msg1_epu32(m0, m1);
+        SHA256NI_ROUNDS(m2, 6) SHA256NI_SCHEDULE(m3, m1, m2) m1 = _mm_sha256msg1_epu32(m1, m2);
+        SHA256NI_ROUNDS(m3, 7) SHA256NI_SCHEDULE(m0, m2, m3) m2 = _mm_sha256msg1_epu32(m2, m3);
+        SHA256NI_ROUNDS(m0, 8) SHA256NI_SCHEDULE(m1, m3, m0) m3 = _mm_sha256msg1_epu32(m3, m0);
+        SHA256NI_ROUNDS(m1, 9) SHA256NI_SCHEDULE(m2, m0, m1) m0 = _mm_sha256msg1_epu32(m0, m1);
+        SHA256NI_ROUNDS(m2, 10) SHA256NI_SCHEDULE(m3, m1, m2) m1 = _mm_sha256msg1_epu32(m1, m2);
+        SHA256NI_ROUNDS(m3, 11) SHA256NI_SCHEDULE(m0, m2, m3) m2 = _mm_sha256msg1_epu32(m2, m3);
+        SHA256NI_ROUNDS(m0, 12) SHA256NI_SCHEDULE(m1, m3, m0) m3 = _mm_sha256msg1_epu32(m3, m0);
+
+        /* rounds 52-63 */
+        SHA256NI_ROUNDS(m1, 13) SHA256NI_SCHEDULE(m2, m0, m1)
+        SHA256NI_ROUNDS(m2, 14) SHA256NI_SCHEDULE(m3, m1, m2)
+        SHA256NI_ROUNDS(m3, 15)
+
+        /* add the state of the previous block */
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+
+        in += 64;
+    }
+
+#undef SHA256NI_ROUNDS
+#undef SHA256NI_SCHEDULE
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);       /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);    /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0); /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);    /* HGFE */
+    _mm_storeu_si128((__m128i *)state, state0);
+    _mm_storeu_si128((__m128i *)(state + 4), state1);
+}
+
+#endif
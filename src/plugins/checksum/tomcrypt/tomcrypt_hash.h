@@ -377,6 +377,52 @@ int func_name (hash_state * md, const unsigned char *in, unsigned long inlen)
     return CRYPT_OK;                                                                        \
 }
 
+/* like HASH_PROCESS, but runs of whole blocks are passed to 'compress_name' at once
+   ('compress_name (md, in, blocks)'), so a vectorized kernel can process them in one call */
+#define HASH_PROCESS_BLOCKS(func_name, compress_name, state_var, block_size)                \
+int func_name (hash_state * md, const unsigned char *in, unsigned long inlen)               \
+{                                                                                           \
+    unsigned long n;                                                                        \
+    int           err;                                                                      \
+    LTC_ARGCHK(md != NULL);                                                                 \
+    LTC_ARGCHK(in != NULL);                                                                 \
+    if (md-> state_var .curlen > sizeof(md-> state_var .buf)) {                             \
+       return CRYPT_INVALID_ARG;                                                            \
+    }                                                                                       \
+    while (inlen > 0) {                                                                     \
+        if (md-> state_var .curlen == 0 && inlen >= block_size) {                           \
+           n = inlen / block_size;                                                          \
+           if ((err = compress_name (md, in, n)) != CRYPT_OK) {                             \
+              return err;                                                                   \
+           }                                                                                \
+           n             *= block_size;                                                     \
+           md-> state_var .length += (ulong64)n * 8;                                        \
+           in             += n;                                                             \
+           inlen          -= n;                                                             \
+        } else {                                                                            \
+           n = MIN(inlen, (block_size - md-> state_var .curlen));                           \
+           memcpy(md-> state_var .buf + md-> state_var.curlen, in, (size_t)n);              \
+           md-> state_var .curlen += n;                                                     \
+           in             += n;                                                             \
+           inlen          -= n;                                                             \
+           if (md-> state_var .curlen == block_size) {                                      \
+              if ((err = compress_name (md, md-> state_var .buf, 1)) != CRYPT_OK) {         \
+                 return err;                                                                \
+              }                                                                             \
+              md-> state_var .length += 8*block_size;                                       \
+              md-> state_var .curlen = 0;                                                   \
+           }                                                                                \
+       }                                                                                    \
+    }                                                                                       \
+    return CRYPT_OK;                                                                        \
+}
+
+/* SHA extensions of x86 CPUs (SHA-NI), see sha_ni.cpp */
+int sha_ni_available(void);
+void sha_ni_enable(int enable);
+void sha1_ni_compress(ulong32 *state, const unsigned char *in, unsigned long blocks);
+void sha256_ni_compress(ulong32 *state, const unsigned char *in, unsigned long blocks);
+
 /* $Source$ */
 /* $Revision$ */
 /* $Date$ */
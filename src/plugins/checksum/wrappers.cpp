@@ -74,7 +74,7 @@ protected:
     virtual int GetDigestLen() { return 20; }; // ensure DIGEST_MAX_SIZE remains large enough!
 
 private:
-    CSalSHA1 sha1;
+    hash_state sha1;
 };
 
 class CSHA256Algo : public CGenericHashAlgo
@@ -382,13 +382,21 @@ bool CSHA1Algo::IsOK()
 
 bool CSHA1Algo::Init()
 {
-    SalamanderCrypt->SHA1Init(&sha1);
+    if (sha1_init(&sha1) != CRYPT_OK)
+    {
+        TRACE_E("sha1_init internal error!");
+        return false;
+    }
     return true;
 }
 
 bool CSHA1Algo::Update(const char* buf, DWORD size)
 {
-    SalamanderCrypt->SHA1Update(&sha1, (BYTE*)buf, size);
+    if (sha1_process(&sha1, (const unsigned char*)buf, size) != CRYPT_OK)
+    {
+        TRACE_E("sha1_process internal error!");
+        return false;
+    }
     return true;
 }
 
@@ -401,8 +409,10 @@ int CSHA1Algo::GetDigest(char* buf, DWORD bufsize)
 {
     if (bufsize >= 20)
     {
-        SalamanderCrypt->SHA1Final(&sha1, (LPBYTE)buf);
-        return 20;
+        if (sha1_done(&sha1, (unsigned char*)buf) == CRYPT_OK)
+            return 20;
+        else
+            TRACE_E("sha1_done internal error!");
     }
     else
     {
@@ -0,0 +1,377 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include <emmintrin.h>
+#include <intrin.h>
+#include "benchsel.h"
+
+// SSE2 is always present on x64, on x86 we test it once
+static BOOL SSE2Available = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+
+// returns the index of the first byte that differs in 'p0' and 'p1' ('size' if none)
+static DWORD FindMismatch(const BYTE* p0, const BYTE* p1, DWORD size)
+{
+    DWORD i = 0;
+    if (SSE2Available)
+    {
+        // 64 bytes per iteration while they are equal, the exact position is found below
+        for (; i + 64 <= size; i += 64)
+        {
+            __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i)), _mm_loadu_si128((const __m128i*)(p1 + i)));
+            __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i + 16)), _mm_loadu_si128((const __m128i*)(p1 + i + 16)));
+            __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i + 32)), _mm_loadu_si128((const __m128i*)(p1 + i + 32)));
+            __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i + 48)), _mm_loadu_si128((const __m128i*)(p1 + i + 48)));
+            if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3))) != 0xFFFF)
+                break;
+        }
+        for (; i + 16 <= size; i += 16)
+        {
+            int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i)),
+                                                         _mm_loadu_si128((const __m128i*)(p1 + i))));
+            if (equal != 0xFFFF)
+            {
+                unsigned long bit;
+                _BitScanForward(&bit, ~equal & 0xFFFF);
+                return i + bit;
+            }
+        }
+    }
+    while (i < size && p0[i] == p1[i])
+        i++;
+    return i;
+}
+
+// returns the index of the first byte that is equal in 'p0' and 'p1' ('size' if none)
+static DWORD FindMatch(const BYTE* p0, const BYTE* p1, DWORD size)
+{
+    DWORD i = 0;
+    if (SSE2Available)
+    {
+        for (; i + 64 <= size; i += 64)
+        {
+            __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i)), _mm_loadu_si128((const __m128i*)(p1 + i)));
+            __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i + 16)), _mm_loadu_si128((const __m128i*)(p1 + i + 16)));
+            __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i + 32)), _mm_loadu_si128((const __m128i*)(p1 + i + 32)));
+            __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i + 48)), _mm_loadu_si128((const __m128i*)(p1 + i + 48)));
+            if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(e0, e1), _mm_or_si128(e2, e3))) != 0)
+                break;
+        }
+        for (; i + 16 <= size; i += 16)
+        {
+            int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p0 + i)),
+                                                         _mm_loadu_si128((const __m128i*)(p1 + i))));
+            if (equal != 0)
+            {
+                unsigned long bit;
+                _BitScanForward(&bit, equal);
+                return i + bit;
+            }
+        }
+    }
+    while (i < size && p0[i] != p1[i])
+        i++;
+    return i;
+}
+
+// ****************************************************************************
+//
+// CBinaryComparator
+//
+
+CBinaryComparator::CBinaryComparator()
+{
+    CALL_STACK_MESSAGE1("CBinaryComparator::CBinaryComparator()");
+    CommonSize = Offset = 0;
+    Data[0] = Data[1] = NULL;
+    DataSize = DataPos = 0;
+    StartTime = GetTickCount();
+}
+
+int CBinaryComparator::SetFiles(HANDLE file0, HANDLE file1)
+{
+    CALL_STACK_MESSAGE1("CBinaryComparator::SetFiles(, )");
+    HANDLE files[2] = {file0, file1};
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        switch (Files[i].SetFile(files[i]))
+        {
+        case 1:
+            return i + 1;
+        case 2:
+            return 3;
+        }
+    }
+    for (i = 0; i < 2; i++)
+    {
+        if (!Files[i].Start())
+            return i + 1;
+    }
+    CommonSize = __min(Files[0].GetFileSize(), Files[1].GetFileSize());
+    Offset = 0;
+    StartTime = GetTickCount();
+    return 0;
+}
+
+int CBinaryComparator::Skip(BOOL equal, const int& CancelFlag)
+{
+    CALL_STACK_MESSAGE_NONE
+    if (Offset >= CommonSize)
+        return bcrFound;
+
+    if (DataPos >= DataSize)
+    {
+        // both files are read by blocks of the same size, so the blocks always
+        // start at the same offset
+        DWORD size[2];
+        int i;
+        for (i = 0; i < 2; i++)
+        {
+            if (Data[i] != NULL)
+            {
+                Files[i].ReleaseBlock();
+                Data[i] = NULL;
+            }
+            Data[i] = Files[i].GetBlock(size[i], CancelFlag);
+            if (Data[i] == NULL)
+                return CancelFlag ? bcrCanceled : (i == 0 ? bcrReadError0 : bcrReadError1);
+        }
+        for (i = 0; i < 2; i++)
+        {
+            // a short block is the last one; if the file was shortened meanwhile,
+            // compare what we have read, no further block will come
+            if (size[i] < READAHEAD_BLOCK_SIZE && Offset + size[i] < CommonSize)
+            {
+                TRACE_E("CBinaryComparator::Skip(): unexpected end of file at offset " << Offset + size[i]);
+                CommonSize = Offset + size[i];
+            }
+        }
+        DataSize = (DWORD)__min(__min(size[0], size[1]), CommonSize - Offset);
+        DataPos = 0;
+        if (DataSize == 0)
+            return bcrFound;
+    }
+
+    DWORD size = DataSize - DataPos;
+    DWORD skipped = equal ? FindMismatch(Data[0] + DataPos, Data[1] + DataPos, size) : FindMatch(Data[0] + DataPos, Data[1] + DataPos, size);
+    DataPos += skipped;
+    Offset += skipped;
+    if (CancelFlag)
+        return bcrCanceled;
+    return skipped < size || Offset >= CommonSize ? bcrFound : bcrContinue;
+}
+
+DWORD CBinaryComparator::GetThroughput()
+{
+    DWORD ms = GetTickCount() - StartTime;
+    return ms == 0 ? 0 : (DWORD)(Offset / 1024 * 1000 / 1024 / ms);
+}
+
+#ifdef _DEBUG
+
+// ****************************************************************************
+//
+// BinaryCompareBenchmark
+//
+
+#define BINCOMP_BENCH_KERNEL (64 * 1024 * 1024)                // size of buffers compared in memory
+#define BINCOMP_BENCH_FILE ((QWORD)1024 * 1024 * 1024)         // size of the compared files
+#define BINCOMP_BENCH_CHANGE_EVERY (3 * 1024 * 1024 + 12345)   // distance of changes in the second file
+#define BINCOMP_BENCH_OLD_BLOCK (32 * 1024)                    // reading and comparing as before CBinaryComparator
+
+// creates the benchmark file unless it exists with the right size already
+static BOOL CreateBenchFile(const char* name, BOOL changed)
+{
+    HANDLE file = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size;
+        BOOL ok = GetFileSizeEx(file, &size) && (QWORD)size.QuadPart == BINCOMP_BENCH_FILE;
+        CloseHandle(file);
+        if (ok)
+            return TRUE;
+    }
+    file = CreateFile(name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return FALSE;
+    const DWORD bufSize = 1024 * 1024;
+    LPBYTE buf = (LPBYTE)malloc(bufSize);
+    BOOL ok = buf != NULL;
+    DWORD seed = 12345;
+    QWORD offset;
+    for (offset = 0; ok && offset < BINCOMP_BENCH_FILE; offset += bufSize)
+    {
+        DWORD i;
+        for (i = 0; i < bufSize; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            buf[i] = (BYTE)(seed >> 16);
+        }
+        if (changed)
+        {
+            // short changes and one long changed region
+            QWORD change = (offset + BINCOMP_BENCH_CHANGE_EVERY - 1) / BINCOMP_BENCH_CHANGE_EVERY * BINCOMP_BENCH_CHANGE_EVERY;
+            for (; change < offset + bufSize; change += BINCOMP_BENCH_CHANGE_EVERY)
+                buf[change - offset] ^= 0xFF;
+            if (offset >= BINCOMP_BENCH_FILE / 2 && offset < BINCOMP_BENCH_FILE / 2 + 8 * bufSize)
+            {
+                for (i = 0; i < bufSize; i++)
+                    buf[i] = (BYTE)~buf[i];
+            }
+        }
+        DWORD written;
+        ok = WriteFile(file, buf, bufSize, &written, NULL) && written == bufSize;
+    }
+    if (buf != NULL)
+        free(buf);
+    CloseHandle(file);
+    return ok;
+}
+
+static void BinaryCompareBenchmark(const char* dir)
+{
+    LARGE_INTEGER freq, start;
+    QueryPerformanceFrequency(&freq);
+
+    // kernels: equal buffers (the difference is in the last byte) and different buffers
+    LPBYTE buf0 = (LPBYTE)malloc(BINCOMP_BENCH_KERNEL);
+    LPBYTE buf1 = (LPBYTE)malloc(BINCOMP_BENCH_KERNEL);
+    if (buf0 != NULL && buf1 != NULL)
+    {
+        memset(buf0, 0x5A, BINCOMP_BENCH_KERNEL);
+        memset(buf1, 0x5A, BINCOMP_BENCH_KERNEL);
+        buf1[BINCOMP_BENCH_KERNEL - 1] = 0;
+        const double megs = (double)BINCOMP_BENCH_KERNEL / (1024 * 1024);
+
+        QueryPerformanceCounter(&start);
+        DWORD i = 0;
+        while (i < BINCOMP_BENCH_KERNEL && buf0[i] == buf1[i])
+            i++;
+        double bytewise = BenchSeconds(start, freq);
+        QueryPerformanceCounter(&start);
+        DWORD j = FindMismatch(buf0, buf1, BINCOMP_BENCH_KERNEL);
+        double vector = BenchSeconds(start, freq);
+        if (i != j)
+            TRACE_E("BinaryCompareBenchmark(): FindMismatch() returned " << j << " instead of " << i);
+        TRACE_I("BinaryCompareBenchmark(): equal data: bytewise " << (DWORD)(bytewise > 0 ? megs / bytewise : 0) << " MB/s, FindMismatch " << (DWORD)(vector > 0 ? megs / vector : 0) << " MB/s");
+
+        memset(buf1, 0xA5, BINCOMP_BENCH_KERNEL);
+        buf1[BINCOMP_BENCH_KERNEL - 1] = 0x5A;
+        QueryPerformanceCounter(&start);
+        i = 0;
+        while (i < BINCOMP_BENCH_KERNEL && buf0[i] != buf1[i])
+            i++;
+        bytewise = BenchSeconds(start, freq);
+        QueryPerformanceCounter(&start);
+        j = FindMatch(buf0, buf1, BINCOMP_BENCH_KERNEL);
+        vector = BenchSeconds(start, freq);
+        if (i != j)
+            TRACE_E("BinaryCompareBenchmark(): FindMatch() returned " << j << " instead of " << i);
+        TRACE_I("BinaryCompareBenchmark(): different data: bytewise " << (DWORD)(bytewise > 0 ? megs / bytewise : 0) << " MB/s, FindMatch " << (DWORD)(vector > 0 ? megs / vector : 0) << " MB/s");
+    }
+    else
+        TRACE_E("BinaryCompareBenchmark(): low memory");
+    if (buf0 != NULL)
+        free(buf0);
+    if (buf1 != NULL)
+        free(buf1);
+
+    // files: synchronous reading of 32 KB blocks compared bytewise (as before
+    // CBinaryComparator) and CBinaryComparator
+    char name[2][MAX_PATH];
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        lstrcpyn(name[i], dir, MAX_PATH);
+        SG->SalPathAppend(name[i], i == 0 ? "fcbench1.bin" : "fcbench2.bin", MAX_PATH);
+        if (!CreateBenchFile(name[i], i == 1))
+        {
+            TRACE_E("BinaryCompareBenchmark(): unable to create " << name[i] << ", error " << GetLastError());
+            return;
+        }
+    }
+    HANDLE file[2];
+    for (i = 0; i < 2; i++)
+        file[i] = CreateFile(name[i], GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file[0] != INVALID_HANDLE_VALUE && file[1] != INVALID_HANDLE_VALUE)
+    {
+        const double megs = (double)BINCOMP_BENCH_FILE / (1024 * 1024);
+        BYTE* block[2];
+        block[0] = (BYTE*)malloc(BINCOMP_BENCH_OLD_BLOCK);
+        block[1] = (BYTE*)malloc(BINCOMP_BENCH_OLD_BLOCK);
+        DWORD oldRuns = 0;
+        BOOL inRun = FALSE;
+        QueryPerformanceCounter(&start);
+        while (block[0] != NULL && block[1] != NULL)
+        {
+            DWORD read[2];
+            if (!ReadFile(file[0], block[0], BINCOMP_BENCH_OLD_BLOCK, &read[0], NULL) ||
+                !ReadFile(file[1], block[1], BINCOMP_BENCH_OLD_BLOCK, &read[1], NULL) ||
+                read[0] == 0)
+            {
+                break;
+            }
+            DWORD k;
+            for (k = 0; k < read[0]; k++)
+            {
+                BOOL differ = block[0][k] != block[1][k];
+                if (differ && !inRun)
+                    oldRuns++;
+                inRun = differ;
+            }
+        }
+        double old = BenchSeconds(start, freq);
+        if (block[0] != NULL)
+            free(block[0]);
+        if (block[1] != NULL)
+            free(block[1]);
+
+        CBinaryComparator comparator;
+        DWORD runs = 0;
+        QueryPerformanceCounter(&start);
+        int ret = comparator.SetFiles(file[0], file[1]);
+        int cancel = 0;
+        while (ret == 0 && !comparator.AtEnd())
+        {
+            while ((ret = comparator.Skip(TRUE, cancel)) == bcrContinue)
+                ;
+            if (ret != bcrFound || comparator.AtEnd())
+                break;
+            runs++;
+            while ((ret = comparator.Skip(FALSE, cancel)) == bcrContinue)
+                ;
+            if (ret != bcrFound)
+                break;
+        }
+        double engine = BenchSeconds(start, freq);
+        if (ret != bcrFound || runs != oldRuns)
+            TRACE_E("BinaryCompareBenchmark(): CBinaryComparator failed (" << ret << ") or found " << runs << " instead of " << oldRuns << " differences");
+        TRACE_I("BinaryCompareBenchmark(): files: 32 KB blocks compared bytewise " << (DWORD)(old > 0 ? megs / old : 0) << " MB/s, CBinaryComparator " << (DWORD)(engine > 0 ? megs / engine : 0) << " MB/s (its own counter " << comparator.GetThroughput() << " MB/s), " << runs << " differences");
+    }
+    else
+        TRACE_E("BinaryCompareBenchmark(): unable to open the files, error " << GetLastError());
+    for (i = 0; i < 2; i++)
+    {
+        if (file[i] != INVALID_HANDLE_VALUE)
+            CloseHandle(file[i]);
+    }
+}
+
+void RunBinaryCompareBenchmark()
+{
+    if (!IsBenchmarkSelected("bincomp"))
+        return;
+
+    char dir[MAX_PATH];
+    if (!GetBenchmarkDir(dir))
+    {
+        TRACE_E("RunBinaryCompareBenchmark(): unable to get directory for benchmark data.");
+        return;
+    }
+    TRACE_I("Benchmark \"bincomp\": begin");
+    BinaryCompareBenchmark(dir);
+    TRACE_I("Benchmark \"bincomp\": end");
+}
+
+#endif // _DEBUG
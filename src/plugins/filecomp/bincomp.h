@@ -0,0 +1,59 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// ****************************************************************************
+//
+// CBinaryComparator -- walks through two files at once, both are read ahead in
+// their own threads, runs of equal and differing bytes are skipped by an SSE2
+// kernel
+//
+
+enum CBinaryCompareResult
+{
+    bcrFound,      // Skip() has stopped at the end of the run (or at the end of the shorter file)
+    bcrContinue,   // the whole block was skipped, call Skip() again (progress can be reported)
+    bcrReadError0, // reading of the first file has failed, see GetLastError()
+    bcrReadError1, // reading of the second file has failed, see GetLastError()
+    bcrCanceled    // CancelFlag was set
+};
+
+class CBinaryComparator
+{
+    CReadAheadFile Files[2];
+    QWORD CommonSize; // size of the shorter file
+    QWORD Offset;     // current position in both files
+    LPBYTE Data[2];   // current blocks of both files, NULL if we do not hold them
+    DWORD DataSize;   // size of the data common to both blocks
+    DWORD DataPos;    // position of Offset in the blocks
+    DWORD StartTime;  // GetTickCount() when the reading has started
+
+public:
+    CBinaryComparator();
+
+    // starts reading of both files; returns 0 on success, 1 or 2 on error of the first
+    // or the second file (see GetLastError()), 3 on low memory
+    int SetFiles(HANDLE file0, HANDLE file1);
+
+    // moves the position behind the run of equal (equal == TRUE) or differing bytes,
+    // it stops at the end of the shorter file at most; returns CBinaryCompareResult
+    int Skip(BOOL equal, const int& CancelFlag);
+
+    QWORD GetOffset() { return Offset; }
+    BOOL AtEnd() { return Offset >= CommonSize; }
+
+    // percents of the data compared so far
+    int GetProgress() { return CommonSize == 0 ? 100 : (int)(Offset * 100 / CommonSize); }
+
+    // throughput since SetFiles() in MB/s (data read from each file)
+    DWORD GetThroughput();
+};
+
+#ifdef _DEBUG
+
+// starts BinaryCompareBenchmark() if the environment variable OPENSAL_BENCHMARK
+// contains "bincomp" (see bench.h of Salamander)
+void RunBinaryCompareBenchmark();
+
+#endif // _DEBUG
@@ -131,33 +131,149 @@ struct CLineEqual
     }
 };
 
+// ****************************************************************************
+//
+// Hashing of lines in several threads
+//
+
+#define HASH_MAX_THREADS 8             // maximal number of threads hashing lines
+#define HASH_MIN_LINES_PER_THREAD 8192 // smaller parts are not worth starting a thread
+
+template <class CChar>
+struct CHashedLine
+{
+    const CChar* Line;
+    size_t Hash; // hash of the line with case and white space normalized as requested
+};
+
+template <class CChar>
+struct CHashedLineHash
+{
+    size_t operator()(const CHashedLine<CChar>* line) const { return line->Hash; }
+};
+
+template <class CChar, class CLineIterator, class CCaseConverter>
+struct CHashedLineEqual
+{
+    CLineEqual<CChar, CLineIterator, CCaseConverter> LineEqual;
+    bool operator()(const CHashedLine<CChar>* first, const CHashedLine<CChar>* second) const
+    {
+        return first->Hash == second->Hash && LineEqual(first->Line, second->Line);
+    }
+};
+
+template <class CChar, class CLineIterator, class CCaseConverter>
+struct CLineHasher
+{
+    CHashedLine<CChar>* Begin;
+    CHashedLine<CChar>* End;
+    const int* Cancel;
+
+    void Run()
+    {
+        CHash<CChar, CLineIterator, CCaseConverter> hash;
+        CHashedLine<CChar>* line;
+        for (line = Begin; line < End; ++line)
+        {
+            if (((line - Begin) & 0xFFF) == 0 && *Cancel)
+                return; // the caller tests the cancel flag itself
+            line->Hash = hash(line->Line);
+        }
+    }
+
+    static DWORD WINAPI ThreadBody(void* param)
+    {
+        ((CLineHasher*)param)->Run();
+        return 0;
+    }
+};
+
+// computes 'Hash' of 'count' lines; the lines are split into contiguous parts
+// hashed in parallel, the first part is hashed by the calling thread
+template <class CChar, class CLineIterator, class CCaseConverter>
+void HashLines(CHashedLine<CChar>* lines, size_t count, const int& cancel)
+{
+    typedef CLineHasher<CChar, CLineIterator, CCaseConverter> CHasher;
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    size_t parts = min(size_t(si.dwNumberOfProcessors), count / HASH_MIN_LINES_PER_THREAD);
+    parts = max(size_t(1), min(parts, size_t(HASH_MAX_THREADS)));
+
+    CHasher hashers[HASH_MAX_THREADS];
+    HANDLE threads[HASH_MAX_THREADS];
+    DWORD started = 0;
+    size_t i;
+    for (i = 0; i < parts; ++i)
+    {
+        hashers[i].Begin = lines + count * i / parts;
+        hashers[i].End = lines + count * (i + 1) / parts;
+        hashers[i].Cancel = &cancel;
+    }
+    for (i = 1; i < parts; ++i)
+    {
+        HANDLE thread = CreateThread(NULL, 0, CHasher::ThreadBody, &hashers[i], 0, NULL);
+        if (thread == NULL)
+        {
+            TRACE_E("HashLines(): unable to start thread, error " << GetLastError());
+            break;
+        }
+        threads[started++] = thread;
+    }
+    hashers[0].Run();
+    for (; i < parts; ++i) // parts whose thread could not be started
+        hashers[i].Run();
+    if (started > 0)
+    {
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+        DWORD j;
+        for (j = 0; j < started; ++j)
+            CloseHandle(threads[j]);
+    }
+}
+
 template <class CChar>
 template <class CCaseConverter, class CLineIterator>
 void CFilecompCoWorkerOptimized<CChar>::IdentifyLines(CFilecompCoWorkerBase<CChar>::CFCFileData (&files)[2], CIndexes (&compareData)[2], const int& cancel)
 {
     typedef vector<CChar*> CLineBuffer;
     typedef unordered_map<
-        const CChar*, size_t,
-        CHash<CChar, CLineIterator, CCaseConverter>,
-        CLineEqual<CChar, CLineIterator, CCaseConverter>>
+        const CHashedLine<CChar>*, size_t,
+        CHashedLineHash<CChar>,
+        CHashedLineEqual<CChar, CLineIterator, CCaseConverter>>
         CLineClasses;
 
+    // hash (and normalize) lines of both files in parallel, only the classes
+    // are then assigned sequentially
+    vector<CHashedLine<CChar>> lines(files[0].Lines.size() - 1 + files[1].Lines.size() - 1);
+    typename vector<CHashedLine<CChar>>::iterator hashed = lines.begin();
+    int i;
+    for (i = 0; i < 2; ++i)
+    {
+        typename CLineBuffer::iterator line = files[i].Lines.begin();
+        for (; line < files[i].Lines.end() - 1; ++line, ++hashed)
+            hashed->Line = *line;
+    }
+    if (!lines.empty())
+        HashLines<CChar, CLineIterator, CCaseConverter>(&lines[0], lines.size(), cancel);
+    if (cancel)
+        throw CFilecompWorker::CAbortByUserException();
+
     CLineClasses classes;
+    classes.reserve(lines.size());
     size_t next = 0; // next class ID
 
-    int i;
+    hashed = lines.begin();
     for (i = 0; i < 2; ++i)
     {
         // reserve space
         compareData[i].resize(files[i].Lines.size() - 1);
         // indentify each line
-        typename CLineBuffer::iterator line = files[i].Lines.begin();
         CIndexes::iterator eqvclass = compareData[i].begin();
-        for (; line < files[i].Lines.end() - 1; ++line, ++eqvclass)
+        for (; eqvclass < compareData[i].end(); ++hashed, ++eqvclass)
         {
-
             std::pair<CLineClasses::iterator, bool> ir =
-                classes.insert(CLineClasses::value_type(*line, next));
+                classes.insert(CLineClasses::value_type(&*hashed, next));
             if (ir.second)
                 next++; // new class created
             *eqvclass = ir.first->second;
@@ -222,14 +338,25 @@ void CFilecompCoWorkerOptimized<CChar>::Compare(CTextFileReader (&reader)[2])
         }
 
         // compare the two sequences sequence
-        d = diff(
-            0, compareData[0].size(),
-            0, compareData[1].size(),
-            sequence_comparator(
-                compareData[0].begin(),
-                compareData[1].begin()),
-            CEditScriptBuilder(editScript),
-            this->CancelFlag);
+        if (this->Options.HistogramDiff)
+        {
+            d = histogram_diff(
+                compareData[0].begin(), compareData[0].size(),
+                compareData[1].begin(), compareData[1].size(),
+                CEditScriptBuilder(editScript),
+                this->CancelFlag);
+        }
+        else
+        {
+            d = diff(
+                0, compareData[0].size(),
+                0, compareData[1].size(),
+                sequence_comparator(
+                    compareData[0].begin(),
+                    compareData[1].begin()),
+                CEditScriptBuilder(editScript),
+                this->CancelFlag);
+        }
         if (d == -1)
             CFilecompWorker::CException::Raise(IDS_INTERNALERROR, 0);
         /*  if (d == 0) We now let the file display
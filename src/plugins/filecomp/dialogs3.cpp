@@ -234,6 +234,8 @@ void CAdvancedOptionsDialog::Transfer(CTransferInfo& ti)
     if (!PNormalizeString)
         EnableWindow(GetDlgItem(HWindow, IDC_NORMALIZATION_FORM), FALSE);
 
+    ti.CheckBox(IDC_HISTOGRAMDIFF, Options.HistogramDiff);
+
     ti.CheckBox(IDC_USEINFUTURE, *SetDefault);
 
     if (ti.Type == ttDataFromWindow)
@@ -392,6 +394,7 @@ void CPropPageDefaultOptions::Transfer(CTransferInfo& ti)
         break;
     }
     ti.CheckBox(IDC_NORMALIZATION_FORM, Options.NormalizationForm);
+    ti.CheckBox(IDC_HISTOGRAMDIFF, Options.HistogramDiff);
     // line ends
     BOOL select;
     if (ti.Type == ttDataToWindow)
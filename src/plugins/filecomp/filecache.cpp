@@ -3,126 +3,196 @@
 
 #include "precomp.h"
 
-#include <assert.h>
+#define READAHEAD_READ_SIZE (1024 * 1024)            // one ReadFile, READAHEAD_BLOCK_SIZE must be its multiple
+#define READAHEAD_UNBUFFERED_MIN (256 * 1024 * 1024) // larger files are read without the system cache
+#define READAHEAD_ERROR 0xFFFFFFFF                   // BlockSize of the block whose reading has failed
 
-#define SECTOR_SIZE 4096              // We seek at offsets being multiples of SECTOR_SIZE
-#define BUFFER_SIZE (2 * 1024 * 1024) // We read at most this amount from a file at a sequence of BLOCK_READ_SIZE reads
-#define BLOCK_READ_SIZE (32 * 1024)   // Atomic size of one ReadFile. BUFFER_SIZE must be a multiple of BLOCK_READ_SIZE
-
-CCachedFile::CCachedFile(/*DWORD minViewSize*/)
+CReadAheadFile::CReadAheadFile()
 {
-    CALL_STACK_MESSAGE1("CCachedFile::CCachedFile" /*, minViewSize*/);
+    CALL_STACK_MESSAGE1("CReadAheadFile::CReadAheadFile()");
     File = INVALID_HANDLE_VALUE;
-    BufferOffset = FileSize = 0;
-    BufferSize = DataInBufSize = 0;
+    FileSize = 0;
     Buffer = NULL;
+    Error = ERROR_SUCCESS;
+    Head = 0;
+    HasBlock = FALSE;
+    LastBlock = FALSE;
+    Free = Filled = Stop = Thread = NULL;
 }
 
-void CCachedFile::Destroy()
+void CReadAheadFile::Destroy()
 {
-    CALL_STACK_MESSAGE1("CCachedFile::Destroy()");
+    CALL_STACK_MESSAGE1("CReadAheadFile::Destroy()");
+    if (Thread != NULL)
+    {
+        // the thread finishes the current ReadFile at most
+        SetEvent(Stop);
+        WaitForSingleObject(Thread, INFINITE);
+        CloseHandle(Thread);
+        Thread = NULL;
+    }
+    if (Free != NULL)
+    {
+        CloseHandle(Free);
+        Free = NULL;
+    }
+    if (Filled != NULL)
+    {
+        CloseHandle(Filled);
+        Filled = NULL;
+    }
+    if (Stop != NULL)
+    {
+        CloseHandle(Stop);
+        Stop = NULL;
+    }
     if (File != INVALID_HANDLE_VALUE)
     {
         CloseHandle(File);
         File = INVALID_HANDLE_VALUE;
     }
-    if (Buffer)
+    if (Buffer != NULL)
     {
-        free(Buffer);
+        VirtualFree(Buffer, 0, MEM_RELEASE);
         Buffer = NULL;
-        BufferSize = 0;
     }
+    HasBlock = FALSE;
 }
 
-DWORD CCachedFile::GetMinViewSize()
-{
-    return BLOCK_READ_SIZE;
-}
-
-int CCachedFile::SetFile(HANDLE file)
+int CReadAheadFile::SetFile(HANDLE file)
 {
+    CALL_STACK_MESSAGE1("CReadAheadFile::SetFile()");
     BY_HANDLE_FILE_INFORMATION fi;
 
-    CALL_STACK_MESSAGE1("CCachedFile::SetFile(, )");
     Destroy();
     if (!GetFileInformationByHandle(file, &fi))
-    {
         return 1;
-    }
-    // Allocate slightly more to accomodate aligned seeking in ReadBuffer
-    Buffer = (LPBYTE)malloc(BUFFER_SIZE + SECTOR_SIZE);
-    if (!Buffer)
-    {
+    FileSize = MAKEQWORD(fi.nFileSizeLow, fi.nFileSizeHigh);
+    // VirtualAlloc returns page aligned memory, as reading without the cache requires
+    Buffer = (LPBYTE)VirtualAlloc(NULL, READAHEAD_BLOCKS * READAHEAD_BLOCK_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    if (Buffer == NULL)
         return 2;
+    // the file is read by our thread, it needs its own handle (file pointer)
+    if (FileSize >= READAHEAD_UNBUFFERED_MIN)
+    {
+        File = ReOpenFile(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN);
+        if (File == INVALID_HANDLE_VALUE)
+            TRACE_I("CReadAheadFile::SetFile(): unable to read the file without the cache, error " << GetLastError());
     }
-    BufferSize = BUFFER_SIZE;
-    FileSize = MAKEQWORD(fi.nFileSizeLow, fi.nFileSizeHigh);
-    if (!DuplicateHandle(GetCurrentProcess(), file, GetCurrentProcess(), &File, 0, FALSE, DUPLICATE_SAME_ACCESS))
+    if (File == INVALID_HANDLE_VALUE &&
+        !DuplicateHandle(GetCurrentProcess(), file, GetCurrentProcess(), &File, 0, FALSE, DUPLICATE_SAME_ACCESS))
     {
+        File = INVALID_HANDLE_VALUE;
         return 1;
     }
     return 0;
 }
 
-LPBYTE CCachedFile::ReadBuffer(QWORD offset, DWORD size, const int& CancelFlag)
+BOOL CReadAheadFile::Start()
 {
-    CALL_STACK_MESSAGE_NONE
-    // CALL_STACK_MESSAGE2("CCachedFile::ReadBuffer(, 0x%X)", size);
-    if (FileSize == 0)
-        return NULL;
-
-    if ((offset < BufferOffset) || (offset + size > BufferOffset + DataInBufSize))
+    CALL_STACK_MESSAGE1("CReadAheadFile::Start()");
+    if (File == INVALID_HANDLE_VALUE || Thread != NULL)
     {
-        LARGE_INTEGER li;
-        ;
-        DWORD err;
+        TRACE_E("CReadAheadFile::Start(): the file is not set or it is already being read.");
+        return FALSE;
+    }
+    LARGE_INTEGER li;
+    li.QuadPart = 0;
+    if (!SetFilePointerEx(File, li, NULL, FILE_BEGIN))
+        return FALSE;
+    Head = 0;
+    HasBlock = FALSE;
+    LastBlock = FALSE;
+    Free = CreateSemaphore(NULL, READAHEAD_BLOCKS, READAHEAD_BLOCKS, NULL);
+    Filled = CreateSemaphore(NULL, 0, READAHEAD_BLOCKS, NULL);
+    Stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (Free == NULL || Filled == NULL || Stop == NULL)
+        return FALSE;
+    DWORD id;
+    Thread = CreateThread(NULL, 0, ThreadBody, this, 0, &id);
+    return Thread != NULL;
+}
 
-        // Space for optimization: Instead of dummy SetFilePointer and possibly partially rereading
-        // what we already have, we can do some memcpy. But then we might not read from sector boundary
-        BufferOffset = offset / SECTOR_SIZE * SECTOR_SIZE; // Align to "cluster" size
-        li.QuadPart = BufferOffset;
-        DataInBufSize = 0;
-        err = SetFilePointer(File, li.LowPart, &li.HighPart, FILE_BEGIN);
-        if ((0xFFFFFFFF == err) && (GetLastError() != NO_ERROR))
-        {
-            return NULL;
-        }
+DWORD WINAPI
+CReadAheadFile::ThreadBody(void* param)
+{
+    ((CReadAheadFile*)param)->ReadBlocks();
+    return 0;
+}
 
-        size_t nOfs = 0;
-        DWORD nTotalToRead = (DWORD)__max(size + (offset - BufferOffset), (DWORD)__min(BufferSize, FileSize - BufferOffset));
-        DWORD initialTicks = GetTickCount();
+void CReadAheadFile::ReadBlocks()
+{
+    HANDLE objects[2] = {Stop, Free};
+    int tail = 0; // block being filled
+    for (;;)
+    {
+        if (WaitForMultipleObjects(2, objects, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+            break; // Stop is signaled (or an error)
 
-        // Reading 32KB chunks bases on code for File Compare in Salamand.exe
-        // Reading 2MB in 32KB blocks is reportedly the fastest approach on W2K & WXP,
-        // but slightly slower on Vista, when both files reside on the same HDD,
-        // than reading 2MB at once.
-        // Reading small chunks also improves performance on slow networks.
-        while (nTotalToRead > 0)
+        LPBYTE block = Buffer + tail * READAHEAD_BLOCK_SIZE;
+        DWORD size = 0;
+        BOOL failed = FALSE;
+        while (size < READAHEAD_BLOCK_SIZE && WaitForSingleObject(Stop, 0) == WAIT_TIMEOUT)
         {
-            DWORD nBytesRead, nBytesToRead = __min(nTotalToRead, BLOCK_READ_SIZE);
-            DWORD ticks = GetTickCount();
-            if (!ReadFile(File, Buffer + nOfs, nBytesToRead, &nBytesRead, NULL) || (nBytesRead != nBytesToRead))
+            DWORD read;
+            if (!ReadFile(File, block + size, READAHEAD_READ_SIZE, &read, NULL))
             {
-                return NULL;
+                Error = GetLastError();
+                failed = TRUE;
+                break;
             }
-            nOfs += nBytesRead;
-            nTotalToRead -= nBytesRead;
-            DataInBufSize += nBytesRead;
-            if (CancelFlag)
-            {
+            size += read;
+            if (read < READAHEAD_READ_SIZE)
+                break; // end of the file
+        }
+        BlockSize[tail] = failed ? READAHEAD_ERROR : size;
+        ReleaseSemaphore(Filled, 1, NULL);
+        if (failed || size < READAHEAD_BLOCK_SIZE)
+            break; // the last block (or stopped)
+        tail = (tail + 1) % READAHEAD_BLOCKS;
+    }
+}
+
+LPBYTE CReadAheadFile::GetBlock(DWORD& size, const int& CancelFlag)
+{
+    CALL_STACK_MESSAGE_NONE
+    if (!HasBlock)
+    {
+        if (LastBlock)
+        {
+            // the thread has finished, waiting for Filled would never end
+            SetLastError(ERROR_HANDLE_EOF);
+            return NULL;
+        }
+        for (;;)
+        {
+            DWORD wait = WaitForSingleObject(Filled, 100);
+            if (wait == WAIT_OBJECT_0)
+                break;
+            if (wait != WAIT_TIMEOUT || CancelFlag)
                 return NULL;
-            }
-            if ((GetTickCount() - ticks > 200) || (GetTickCount() - initialTicks > 2000))
-            {
-                // Too slow network (or FDD or ...)
-                // We have read enough -> break
-                assert(offset - BufferOffset + size <= DataInBufSize);
-                if (offset - BufferOffset + size <= DataInBufSize)
-                {
-                    break;
-                }
-            }
         }
+        HasBlock = TRUE;
+    }
+    if (BlockSize[Head] == READAHEAD_ERROR)
+    {
+        SetLastError(Error);
+        return NULL;
+    }
+    size = BlockSize[Head];
+    if (size < READAHEAD_BLOCK_SIZE)
+        LastBlock = TRUE;
+    return Buffer + Head * READAHEAD_BLOCK_SIZE;
+}
+
+void CReadAheadFile::ReleaseBlock()
+{
+    CALL_STACK_MESSAGE_NONE
+    if (HasBlock)
+    {
+        HasBlock = FALSE;
+        Head = (Head + 1) % READAHEAD_BLOCKS;
+        ReleaseSemaphore(Free, 1, NULL);
     }
-    return Buffer + (offset - BufferOffset);
 }
@@ -3,21 +3,52 @@
 
 #pragma once
 
-class CCachedFile
+#define READAHEAD_BLOCK_SIZE (4 * 1024 * 1024) // size of one block handed out by GetBlock()
+#define READAHEAD_BLOCKS 4                     // blocks in the ring: one is processed, the others are being read
+
+// Sequential reading of a file in its own thread: while the caller processes one
+// block, the following blocks are already being read, so reading of the compared
+// files overlaps with each other and with the comparison. Large files are read
+// without the system cache (directly to our blocks, they would only push more useful
+// data out of the cache).
+class CReadAheadFile
 {
     HANDLE File;
     QWORD FileSize;
-    LPBYTE Buffer;
-    DWORD BufferSize;    // Size of allocated Buffer
-    DWORD DataInBufSize; // Size of valid data in Buffer
-    QWORD BufferOffset;  // Offset of Buffer in file
+    LPBYTE Buffer;                     // READAHEAD_BLOCKS blocks of READAHEAD_BLOCK_SIZE bytes
+    DWORD BlockSize[READAHEAD_BLOCKS]; // valid data in the block, READAHEAD_ERROR if reading failed
+    DWORD Error;                       // error of the failed read
+    int Head;                          // block returned by GetBlock()
+    BOOL HasBlock;                     // Head was returned and not released yet
+    BOOL LastBlock;                    // the last block was returned, the thread reads nothing more
+    HANDLE Free;                       // semaphore: number of blocks the thread can fill
+    HANDLE Filled;                     // semaphore: number of blocks ready for GetBlock()
+    HANDLE Stop;                       // event: terminates the thread
+    HANDLE Thread;
 
 public:
-    CCachedFile(/*DWORD minViewSize = 512*1024*/);
-    ~CCachedFile() { Destroy(); }
+    CReadAheadFile();
+    ~CReadAheadFile() { Destroy(); }
     void Destroy();
+
+    // returns 0 on success, 1 on error (see GetLastError()), 2 on low memory
     int SetFile(HANDLE file);
-    DWORD GetMinViewSize();
-    LPBYTE ReadBuffer(QWORD offset, DWORD size, const int& CancelFlag);
+
+    // starts reading from the beginning of the file; returns FALSE on error
+    BOOL Start();
+
+    // waits for the next block and returns it (the same block until ReleaseBlock() is
+    // called), 'size' is READAHEAD_BLOCK_SIZE except for the last block, which is shorter
+    // (possibly empty); after the last block it fails with ERROR_HANDLE_EOF; returns NULL
+    // on error (see GetLastError()) or if CancelFlag is set
+    LPBYTE GetBlock(DWORD& size, const int& CancelFlag);
+
+    // the block returned by GetBlock() can be reused for reading
+    void ReleaseBlock();
+
     QWORD GetFileSize() { return FileSize; }
+
+protected:
+    static DWORD WINAPI ThreadBody(void* param);
+    void ReadBlocks();
 };
@@ -40,6 +40,7 @@ const char* CONFIG_LOADONSTART = "Load On Start";
 const char* CONFIG_VIEW_HORIZONTAL = "Horizontal View";
 const char* CONFIG_AUTO_COPY = "Auto-Copy Selection";
 const char* CONFIG_NORMALIZATION_FORM = "Normalization Form";
+const char* CONFIG_HISTOGRAM_DIFF = "Histogram Diff";
 const char* CONFIG_ENCODING0 = "Encoding 0";
 const char* CONFIG_ENCODING1 = "Encoding 1";
 const char* CONFIG_ENDIANS0 = "Endians 0";
@@ -107,6 +108,10 @@ CPluginInterfaceAbstract* WINAPI SalamanderPluginEntry(CSalamanderPluginEntryAbs
     // still referenced)
     CRemoteComparator::CreateRemoteComparator();
 
+#ifdef _DEBUG
+    RunBinaryCompareBenchmark();
+#endif // _DEBUG
+
     return &PluginInterface;
 }
 
@@ -281,6 +286,8 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
                 DWORD dw;
                 if (registry->GetValue(regKey, CONFIG_NORMALIZATION_FORM, REG_DWORD, &dw, sizeof(DWORD)))
                     DefCompareOptions.NormalizationForm = dw ? TRUE : FALSE;
+                if (registry->GetValue(regKey, CONFIG_HISTOGRAM_DIFF, REG_DWORD, &dw, sizeof(DWORD)))
+                    DefCompareOptions.HistogramDiff = dw ? TRUE : FALSE;
             }
             // history of recently used files
             TCHAR buf[32];
@@ -366,6 +373,8 @@ void CPluginInterface::SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     registry->SetValue(regKey, CONFIG_INPUTENCTABLE1, REG_SZ, DefCompareOptions.ASCII8InputEncTableName[1], int(strlen(DefCompareOptions.ASCII8InputEncTableName[1])));
     dw = DefCompareOptions.NormalizationForm;
     registry->SetValue(regKey, CONFIG_NORMALIZATION_FORM, REG_DWORD, &dw, sizeof(DWORD));
+    dw = DefCompareOptions.HistogramDiff;
+    registry->SetValue(regKey, CONFIG_HISTOGRAM_DIFF, REG_DWORD, &dw, sizeof(DWORD));
     // history of recently used files
     BOOL b;
     if (SG->GetConfigParameter(SALCFG_SAVEHISTORY, &b, sizeof(BOOL), NULL) && b)
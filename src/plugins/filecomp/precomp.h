@@ -70,6 +70,7 @@
 #include "mtxtout.h"
 #include "filemap.h"
 #include "filecache.h"
+#include "bincomp.h"
 #include "textio.h"
 #include "worker.h"
 #include "cwbase.h"
@@ -34,7 +34,8 @@ CCompareOptions DefaultCompareOptions =
         {// char ASCII8InputEncTableName[2][101];
          "",
          ""},
-        TRUE //  BOOL           NormalizationForm;
+        TRUE, //  BOOL           NormalizationForm;
+        FALSE //  BOOL           HistogramDiff;
 };
 
 // ****************************************************************************
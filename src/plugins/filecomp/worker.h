@@ -57,6 +57,10 @@ struct CCompareOptions
 
     // Normalize Unicode texts to Normalization Form C using normaliz.dll
     BOOL NormalizationForm;
+
+    // Align changed lines on lines that are rare in the first file (histogram
+    // diff), otherwise compute the shortest edit script (Myers' algorithm)
+    BOOL HistogramDiff;
 };
 
 extern CCompareOptions DefaultCompareOptions;
@@ -313,11 +317,17 @@ protected:
 
     CWorkerFileData Files[2];
 
+    // progress of the binary comparison last reported to MainWindow
+    int ProgressPct;
+    DWORD ProgressChanges;
+    DWORD ProgressTicks;
+
     virtual unsigned Body();
     void GuardedBody();
     void CompareBinaryFiles();
-    int CompareBinaryFilesAux(CCachedFile (&cf)[2], QWORD& changeOffs);
-    int FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs, CBinaryChanges& changes);
+    int CompareBinaryFilesAux(CBinaryComparator& comparator, QWORD& changeOffs);
+    int FindDifferencesBody(CBinaryComparator& comparator, QWORD changeOffs, CBinaryChanges& changes);
+    void ReportBinaryProgress(CBinaryComparator& comparator, DWORD changes);
 
     template <class CChar>
     void CompareTextFiles(CTextFileReader (&reader)[2])
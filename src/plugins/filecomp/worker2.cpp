@@ -5,26 +5,27 @@
 
 void CFilecompWorker::CompareBinaryFiles()
 {
-    CCachedFile cf[2];
+    CBinaryComparator comparator;
     int i;
 
-    for (i = 0; i < 2; i++)
+    int err = comparator.SetFiles(Files[0].File, Files[1].File);
+    switch (err)
     {
-        switch (cf[i].SetFile(Files[i].File))
-        {
-        case 1:
-            CException::Raise(IDS_ACCESFILE, GetLastError(), Files[i].Name);
-            break;
-        case 2:
-            CException(LoadStr(IDS_LOWMEM));
-            break;
-        }
+    case 1:
+    case 2:
+        CException::Raise(IDS_ACCESFILE, GetLastError(), Files[err - 1].Name);
+        break;
+    case 3:
+        throw CException(LoadStr(IDS_LOWMEM));
     }
+    ProgressPct = 0;
+    ProgressChanges = 0;
+    ProgressTicks = GetTickCount() - 1000;
 
     // This finds the first difference. The FC window shows empty panes in the meantime. Do we really need this?
     // Can we skip it?
     QWORD changeOffs = 0;
-    int ret = CompareBinaryFilesAux(cf, changeOffs);
+    int ret = CompareBinaryFilesAux(comparator, changeOffs);
     if (ret < 0)
     {
         if (ret + 2 < 0)
@@ -52,7 +53,7 @@ void CFilecompWorker::CompareBinaryFiles()
         CBinaryChanges changes;
 
         TRACE_I("FindingDifferences");
-        ret = FindDifferencesBody(cf, changeOffs, changes);
+        ret = FindDifferencesBody(comparator, changeOffs, changes);
         if (ret == 0)
         {
             HWND comboHWnd = (HWND)SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SETCHANGES, (LPARAM)&changes);
@@ -117,167 +118,65 @@ void CFilecompWorker::CompareBinaryFiles()
     }
 }
 
-// Finds the first difference. Do we really need this function?
-int CFilecompWorker::CompareBinaryFilesAux(CCachedFile (&cf)[2], QWORD& changeOffs)
+void CFilecompWorker::ReportBinaryProgress(CBinaryComparator& comparator, DWORD changes)
 {
     CALL_STACK_MESSAGE_NONE
-    unsigned int blokSize = cf[0].GetMinViewSize();
-    DWORD size, tickCount = GetTickCount() - 1000;
-    QWORD remain = __min(Files[0].Size, Files[1].Size);
-    QWORD offset = 0, totalSize;
-    LPBYTE ptr0, ptr1, start, end;
-    int ret = 0, pct = 0;
-
-    totalSize = remain;
-
-    while (remain)
+    int pct = comparator.GetProgress();
+    if ((pct != ProgressPct || changes != ProgressChanges) && GetTickCount() - ProgressTicks > 500)
     {
-        size = (DWORD)__min(blokSize, remain);
-
-        int newPct = (int)((100 * (totalSize - remain)) / totalSize);
-
-        if (pct != newPct)
-        {
-            if ((GetTickCount() - tickCount) > 500)
-            {
-                tickCount = GetTickCount();
-                pct = newPct;
-                SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(pct, 0));
-            }
-        }
-
-        ptr0 = cf[0].ReadBuffer(offset, size, CancelFlag);
-        if (!ptr0)
-            return CancelFlag ? -3 : -2;
-
-        ptr1 = cf[1].ReadBuffer(offset, size, CancelFlag);
-        if (!ptr1)
-            return CancelFlag ? -3 : -1;
-
-        start = ptr0;
-        end = ptr0 + size;
-        if (size > sizeof(int) - 1)
-        {
-            end -= sizeof(int) - 1;
-            while (ptr0 < end && *(int*)ptr0 == *(int*)ptr1)
-                ptr0 += sizeof(int), ptr1 += sizeof(int);
-            end += sizeof(int) - 1;
-        }
-
-        while (ptr0 < end && *ptr0 == *ptr1)
-            ptr0++, ptr1++;
-
-        if (ptr0 < end)
-        {
-            ret = 1;
-            break;
-        }
-
-        remain -= size;
-        offset += size;
-
-        if (CancelFlag)
-            return -3;
+        ProgressTicks = GetTickCount();
+        ProgressPct = pct;
+        ProgressChanges = changes;
+        SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(pct, changes));
     }
+}
 
-    if (ret)
-        changeOffs = ptr0 - start + offset;
-    else
+// Finds the first difference. Do we really need this function?
+int CFilecompWorker::CompareBinaryFilesAux(CBinaryComparator& comparator, QWORD& changeOffs)
+{
+    CALL_STACK_MESSAGE_NONE
+    int res;
+    while ((res = comparator.Skip(TRUE, CancelFlag)) == bcrContinue)
+        ReportBinaryProgress(comparator, 0);
+    switch (res)
     {
-        if (Files[0].Size != Files[1].Size)
-        {
-            changeOffs = __min(Files[0].Size, Files[1].Size);
-            ret = 1;
-        }
+    case bcrReadError0:
+        return -2;
+    case bcrReadError1:
+        return -1;
+    case bcrCanceled:
+        return -3;
     }
 
-    if (!ret)
-    {
-        // The files are equal -> set progress to 100%
-        SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(100, 0));
-    }
-    return ret;
+    changeOffs = comparator.GetOffset(); // the end of the shorter file if they differ only in size
+    if (!comparator.AtEnd() || Files[0].Size != Files[1].Size)
+        return 1;
+
+    // The files are equal -> set progress to 100%
+    SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(100, 0));
+    TRACE_I("Binary comparison: " << comparator.GetThroughput() << " MB/s");
+    return 0;
 }
 
-int CFilecompWorker::FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs, CBinaryChanges& changes)
+int CFilecompWorker::FindDifferencesBody(CBinaryComparator& comparator, QWORD changeOffs, CBinaryChanges& changes)
 {
     CALL_STACK_MESSAGE1("CFilecompWorker::FindDifferencesBody(, , )");
 
-    unsigned int blokSize = cf[0].GetMinViewSize();
-    QWORD remain, totalSize;
-    QWORD offset = changeOffs;
-    LPBYTE ptr0, ptr1, start, end;
-    QWORD offsetSave;
-    QWORD lenghtSave;
-    int pct = 0;
-    DWORD lastChangesSize = -1;
-    DWORD tickCount = GetTickCount() - 1000;
-
-    totalSize = __min(Files[0].Size, Files[1].Size);
+    QWORD maxSize = __max(Files[0].Size, Files[1].Size);
+    int res;
 
+    // the comparator stays at changeOffs, where CompareBinaryFilesAux has stopped
     for (;;)
     {
-        // determine the length of the difference
-        // offset points to the start of the difference
-
-        offsetSave = offset;
-        remain = totalSize - offset;
-        while (remain)
-        {
-            int newPct = (int)((100 * (totalSize - remain)) / totalSize);
-
-            if (pct != newPct || lastChangesSize != changes.size())
-            {
-                if ((GetTickCount() - tickCount) > 500)
-                {
-                    tickCount = GetTickCount();
-                    pct = newPct;
-                    lastChangesSize = (DWORD)changes.size();
-                    SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(pct, lastChangesSize));
-                }
-            }
-
-            DWORD size = (DWORD)__min(blokSize, remain);
-
-            ptr0 = cf[0].ReadBuffer(offset, size, CancelFlag);
-            if (!ptr0)
-                return CancelFlag ? 4 : 1;
-
-            ptr1 = cf[1].ReadBuffer(offset, size, CancelFlag);
-            if (!ptr1)
-                return CancelFlag ? 4 : 2;
-
-            start = ptr0;
-            end = ptr0 + size;
-
-            while (ptr0 < end && *ptr0 != *ptr1)
-                ptr0++, ptr1++;
-
-            if (ptr0 < end)
-                break;
-
-            remain -= size;
-            offset += size;
-
-            if (CancelFlag)
-                return 4;
-        }
-
-        if (remain)
-        {
-            lenghtSave = (ptr0 - start + offset) - offsetSave;
-        }
-        else
-        {
-            if (Files[0].Size != Files[1].Size)
-            {
-                lenghtSave = __max(Files[0].Size, Files[1].Size) - offsetSave;
-            }
-            else
-            {
-                lenghtSave = Files[0].Size - offsetSave;
-            }
-        }
+        // find the end of the difference starting at the current offset; runs of
+        // differing bytes continue over the blocks read, a run reaching the end of
+        // the shorter file includes the rest of the longer one
+        QWORD offsetSave = comparator.GetOffset();
+        while ((res = comparator.Skip(FALSE, CancelFlag)) == bcrContinue)
+            ReportBinaryProgress(comparator, (DWORD)changes.size());
+        if (res != bcrFound)
+            break;
+        QWORD lenghtSave = (comparator.AtEnd() ? maxSize : comparator.GetOffset()) - offsetSave;
 
         if (lenghtSave)
         {
@@ -307,69 +206,27 @@ int CFilecompWorker::FindDifferencesBody(CCachedFile (&cf)[2], QWORD changeOffs,
             CBinaryChange* change = &changes.back();
             SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_ADD_CHANGE, (LPARAM)change);
         }
-        else
-            break;
-
-        // look for the start of the next difference
-        offset = changes.back().Offset + changes.back().Length; // starts after the last difference
-        if (offset >= totalSize)
+        if (comparator.AtEnd())
             break; // already at the end of the file
-        remain = totalSize - offset;
-
-        while (remain)
-        {
-            int newPct = (int)((100 * (totalSize - remain)) / totalSize);
 
-            if (pct != newPct || lastChangesSize != changes.size())
-            {
-                if ((GetTickCount() - tickCount) > 500)
-                {
-                    tickCount = GetTickCount();
-                    pct = newPct;
-                    lastChangesSize = (DWORD)changes.size();
-                    SendMessage(MainWindow, WM_USER_WORKERNOTIFIES, WN_SET_PROGRESS, MAKELPARAM(pct, lastChangesSize));
-                }
-            }
-
-            // compare data in chunks of the requested size
-            DWORD size = (DWORD)__min(blokSize, remain);
-
-            ptr0 = cf[0].ReadBuffer(offset, size, CancelFlag);
-            if (!ptr0)
-                return CancelFlag ? 4 : 1;
-
-            ptr1 = cf[1].ReadBuffer(offset, size, CancelFlag);
-            if (!ptr1)
-                return CancelFlag ? 4 : 2;
-
-            start = ptr0;
-            end = ptr0 + size;
-            if (size > sizeof(int) - 1)
-            {
-                end -= sizeof(int) - 1;
-                while (ptr0 < end && *(int*)ptr0 == *(int*)ptr1)
-                    ptr0 += sizeof(int), ptr1 += sizeof(int);
-                end += sizeof(int) - 1;
-            }
-
-            while (ptr0 < end && *ptr0 == *ptr1)
-                ptr0++, ptr1++;
-
-            if (ptr0 < end)
-                break;
-
-            remain -= size;
-            offset += size;
-
-            if (CancelFlag)
-                return 4;
-        }
-
-        if (remain)
-        {
-            offset = ptr0 - start + offset; // offset now points to the start of the next difference
-        }
+        // look for the start of the next difference
+        while ((res = comparator.Skip(TRUE, CancelFlag)) == bcrContinue)
+            ReportBinaryProgress(comparator, (DWORD)changes.size());
+        if (res != bcrFound)
+            break;
+        if (comparator.AtEnd() && Files[0].Size == Files[1].Size)
+            break; // no more differences
     }
 
+    switch (res)
+    {
+    case bcrReadError0:
+        return 1;
+    case bcrReadError1:
+        return 2;
+    case bcrCanceled:
+        return 4;
+    }
+    TRACE_I("Binary comparison: " << comparator.GetThroughput() << " MB/s");
     return 0; // succes
 }
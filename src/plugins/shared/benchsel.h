@@ -0,0 +1,66 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+//****************************************************************************
+//
+// Copyright (c) 2023 Open Salamander Authors
+//
+// This is a part of the Open Salamander SDK library.
+//
+//****************************************************************************
+
+#pragma once
+
+//
+// ****************************************************************************
+// Selection of benchmarks
+//
+// Shared by the benchmarks of Salamander (see bench.h) and of the plugins, so that
+// all of them are driven by the same environment variables: OPENSAL_BENCHMARK
+// contains the names of the benchmarks to start separated by ';' ("all" starts all
+// of them), synthetic data are created in the directory from OPENSAL_BENCHMARK_DIR
+// (%TEMP% by default).
+//
+
+#ifdef _DEBUG
+
+// returns TRUE if OPENSAL_BENCHMARK selects benchmark 'name'
+inline BOOL IsBenchmarkSelected(const char* name)
+{
+    char names[500];
+    if (GetEnvironmentVariableA("OPENSAL_BENCHMARK", names, _countof(names)) == 0)
+        return FALSE;
+    if (_stricmp(names, "all") == 0)
+        return TRUE;
+    size_t len = strlen(name);
+    const char* s = names;
+    while (*s != 0)
+    {
+        const char* end = strchr(s, ';');
+        if (end == NULL)
+            end = s + strlen(s);
+        if ((size_t)(end - s) == len && _strnicmp(s, name, len) == 0)
+            return TRUE;
+        s = *end == ';' ? end + 1 : end;
+    }
+    return FALSE;
+}
+
+// returns the directory for the data of benchmarks in 'dir' (MAX_PATH characters);
+// returns FALSE if it cannot be obtained
+inline BOOL GetBenchmarkDir(char* dir)
+{
+    return GetEnvironmentVariableA("OPENSAL_BENCHMARK_DIR", dir, MAX_PATH) != 0 ||
+           GetTempPathA(MAX_PATH, dir) != 0;
+}
+
+// returns seconds elapsed since 'start' (from QueryPerformanceCounter), 'freq' is
+// the result of QueryPerformanceFrequency
+inline double BenchSeconds(const LARGE_INTEGER& start, const LARGE_INTEGER& freq)
+{
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    return (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+}
+
+#endif // _DEBUG
@@ -49,6 +49,35 @@
 //
 // ****************************************************************************
 //
+// histogram_diff - computes an edit script anchored on rare lines
+//
+// Prototype
+//
+//   template<class iterator, class edit_t>
+//   ptrdiff_t histogram_diff(const iterator a, size_t n, const iterator b,
+//       size_t m, const edit_t &edit, const int & cancel = 0, ptrdiff_t dmax =
+//       INT_MAX);
+//
+// Description
+//
+//   Compares sequences `a[0..n)' and `b[0..m)' of equivalence class IDs
+//   (small non-negative integers, e.g. IDs of lines with the same contents).
+//   The longest common run containing the element that occurs least often in
+//   the first sequence (ideally once, like in the patience diff) is taken as
+//   an anchor and both sides of it are solved recursively. Regions without a
+//   usable anchor are passed to `diff', so the memory stays linear.
+//
+//   The result is not always the shortest edit script but it usually follows
+//   the structure of the text better (moved blocks, blank lines and braces do
+//   not get matched across unrelated changes) and it is much faster on large
+//   files with many differences.
+//
+//   `edit', `cancel' and `dmax' have the same meaning as for `diff'; the
+//   value returned is the number of inserted and deleted elements.
+//
+//
+// ****************************************************************************
+//
 // Some helper classes are defined in this header. See below.
 //
 // null_edit -- accepts op, off, len and does nothing, useful when you need
@@ -541,3 +570,209 @@ diff_t<equal_t, edit_t>::operator()(
 
     return d;
 }
+
+// ****************************************************************************
+//
+// histogram_diff
+//
+
+// forwards edit operations to the edit object of histogram_diff, so that
+// `diff' called for a region reports to the same (possibly stateful) object
+template <class edit_t>
+class edit_forwarder
+{
+public:
+    edit_forwarder(edit_t& edit) : edit(&edit) {}
+    void operator()(char op, size_t off, size_t len) const { (*edit)(op, off, len); }
+
+protected:
+    edit_t* edit;
+};
+
+template <class iterator, class edit_t>
+class histogram_diff_t
+{
+public:
+    histogram_diff_t(const iterator& a, const iterator& b, const edit_t& edit,
+                     const int& cancel, ptrdiff_t dmax)
+        : a(a), b(b), edit(edit), cancel(cancel), dmax(dmax), d(0), generation(0) {}
+
+    ptrdiff_t operator()(size_t n, size_t m);
+
+protected:
+    enum
+    {
+        max_chain = 64 // elements occuring more often in a region are never used as anchors
+    };
+
+    // a region waiting to be solved or a match waiting to be reported (n == m)
+    struct task
+    {
+        size_t aoff, n, boff, m;
+        bool match;
+        task(size_t aoff, size_t n, size_t boff, size_t m, bool match)
+            : aoff(aoff), n(n), boff(boff), m(m), match(match) {}
+    };
+
+    const iterator a;
+    const iterator b;
+    edit_t edit;
+    const int& cancel;
+    ptrdiff_t dmax;
+    ptrdiff_t d; // inserted + deleted so far
+
+    // histogram of the current region of `a', valid for classes with
+    // stamp[c] == generation
+    size_t generation;
+    std::vector<size_t> stamp;
+    std::vector<size_t> count;
+    std::vector<ptrdiff_t> head; // first occurence of the class in the region
+    std::vector<ptrdiff_t> next; // next occurence of the same class, indexed by position in `a'
+    std::vector<ptrdiff_t> buf;  // buffer for `diff'
+    std::vector<task> tasks;
+
+    bool solve(size_t aoff, size_t n, size_t boff, size_t m);
+};
+
+template <class iterator, class edit_t>
+ptrdiff_t
+histogram_diff(const iterator a, size_t n, const iterator b, size_t m,
+               const edit_t& edit, const int& cancel = 0, ptrdiff_t dmax = INT_MAX)
+{
+    return histogram_diff_t<iterator, edit_t>(a, b, edit, cancel, dmax)(n, m);
+}
+
+template <class iterator, class edit_t>
+ptrdiff_t
+histogram_diff_t<iterator, edit_t>::operator()(size_t n, size_t m)
+{
+    size_t classes = 0;
+    size_t i;
+    for (i = 0; i < n; i++)
+        classes = std::max(classes, size_t(a[i]) + 1);
+    for (i = 0; i < m; i++)
+        classes = std::max(classes, size_t(b[i]) + 1);
+    stamp.assign(classes, 0);
+    count.resize(classes);
+    head.resize(classes);
+    next.resize(n);
+
+    // the tasks are kept on an explicit stack, the left part of a region is
+    // always on the top, so the edit script is reported from the left to the
+    // right and deep recursion cannot exhaust the thread stack
+    tasks.push_back(task(0, n, 0, m, false));
+    while (!tasks.empty())
+    {
+        task t = tasks.back();
+        tasks.pop_back();
+        if (t.match)
+            edit(diff_base::ed_match, t.aoff, t.n);
+        else
+        {
+            if (!solve(t.aoff, t.n, t.boff, t.m))
+                return dmax;
+        }
+    }
+    return d;
+}
+
+template <class iterator, class edit_t>
+bool histogram_diff_t<iterator, edit_t>::solve(size_t aoff, size_t n, size_t boff, size_t m)
+{
+    if (cancel)
+        throw diff_exception();
+
+    // eat common prefix, report it and postpone the common suffix
+    size_t p = 0;
+    while (p < n && p < m && a[aoff + p] == b[boff + p])
+        p++;
+    edit(diff_base::ed_match, aoff, p);
+    aoff += p, n -= p;
+    boff += p, m -= p;
+    size_t s = 0;
+    while (s < n && s < m && a[aoff + n - s - 1] == b[boff + m - s - 1])
+        s++;
+    n -= s, m -= s;
+    if (s > 0)
+        tasks.push_back(task(aoff + n, s, boff + m, s, true));
+
+    if (n == 0 || m == 0)
+    {
+        edit(diff_base::ed_delete, aoff, n);
+        edit(diff_base::ed_insert, boff, m);
+        d += n + m;
+        return d < dmax;
+    }
+
+    // build the histogram of the region of `a', the chains go from the left
+    generation++;
+    ptrdiff_t i;
+    for (i = ptrdiff_t(aoff + n) - 1; i >= ptrdiff_t(aoff); i--)
+    {
+        size_t c = size_t(a[i]);
+        if (stamp[c] != generation)
+        {
+            stamp[c] = generation;
+            count[c] = 0;
+            head[c] = -1;
+        }
+        count[c]++;
+        next[i] = head[c];
+        head[c] = i;
+    }
+
+    // find the longest common run containing the rarest element
+    size_t lowcount = max_chain + 1;
+    size_t bestA = 0, bestB = 0, bestLen = 0;
+    size_t j = boff;
+    while (j < boff + m)
+    {
+        size_t c = size_t(b[j]);
+        size_t jnext = j + 1;
+        if (stamp[c] == generation && count[c] <= lowcount && count[c] <= max_chain)
+        {
+            for (i = head[c]; i != -1;)
+            {
+                size_t as = i, bs = j, ae = i + 1, be = j + 1;
+                size_t rc = count[c];
+                while (as > aoff && bs > boff && a[as - 1] == b[bs - 1])
+                {
+                    as--, bs--;
+                    rc = std::min(rc, count[size_t(a[as])]);
+                }
+                while (ae < aoff + n && be < boff + m && a[ae] == b[be])
+                {
+                    rc = std::min(rc, count[size_t(a[ae])]);
+                    ae++, be++;
+                }
+                if (jnext < be)
+                    jnext = be;
+                if (rc < lowcount || (rc == lowcount && ae - as > bestLen))
+                {
+                    lowcount = rc;
+                    bestA = as, bestB = bs, bestLen = ae - as;
+                }
+                // skip occurences inside of the run just found
+                while (i != -1 && size_t(i) < ae)
+                    i = next[i];
+            }
+        }
+        j = jnext;
+    }
+
+    if (bestLen == 0)
+    {
+        // no usable anchor (only frequent elements), use the Myers' algorithm
+        ptrdiff_t rest = diff(aoff, n, boff, m, sequence_comparator(a, b),
+                              edit_forwarder<edit_t>(edit), cancel, dmax - d, buf);
+        d += rest;
+        return d < dmax;
+    }
+
+    // solve the left part first, then report the anchor, then the right part
+    tasks.push_back(task(bestA + bestLen, aoff + n - bestA - bestLen,
+                         bestB + bestLen, boff + m - bestB - bestLen, false));
+    tasks.push_back(task(bestA, bestLen, bestB, bestLen, true));
+    tasks.push_back(task(aoff, bestA - aoff, boff, bestB - boff, false));
+    return true;
+}
@@ -4,13 +4,15 @@
 #include "../fileio.h"
 #include "bzlib.h"
 #include "bzip.h"
+#include "pbunzip.h"
 
 #include "..\tar.rh"
 #include "..\tar.rh2"
 #include "..\lang\lang.rh"
 
 CBZip::CBZip(const char *filename, HANDLE file, unsigned char *buffer, unsigned long start, unsigned long read, CQuadWord inputSize):
-  CZippedFile(filename, file, buffer, start, read, inputSize), BZStream(NULL), EndReached(FALSE)
+  CZippedFile(filename, file, buffer, start, read, inputSize), BZStream(NULL), EndReached(FALSE),
+  Pool(NULL), PoolTried(FALSE)
 {
   CALL_STACK_MESSAGE2("CBZip::CBZip(%s, , , )", filename);
   
@@ -72,6 +74,8 @@ CBZip::CBZip(const char *filename, HANDLE file, unsigned char *buffer, unsigned
 CBZip::~CBZip()
 {
   CALL_STACK_MESSAGE1("CBZip::~CBZip()");
+  if (Pool)
+    delete Pool;
   if (BZStream)
   {
     int ret = BZ2_bzDecompressEnd(BZStream);
@@ -82,11 +86,54 @@ CBZip::~CBZip()
   }
 }
 
+// hands the rest of the archive over to the parallel decompression if it is worth it
+void
+CBZip::StartPool()
+{
+  CALL_STACK_MESSAGE1("CBZip::StartPool()");
+  PoolTried = TRUE;
+  // nothing may have been decompressed yet, the pool starts at the stream header
+  if (DataEnd - DataStart < 4 || InputSize < StreamPos + CQuadWord(PBUNZIP_MIN_SIZE, 0))
+    return;
+  Pool = new CBUnzipPool;
+  if (Pool == NULL)
+    return;
+  if (!Pool->Init(File, DataStart, (DWORD)(DataEnd - DataStart), StreamPos, InputSize))
+  {
+    delete Pool;
+    Pool = NULL;
+    return;
+  }
+  // the pool reads the file from now on
+  DataStart = DataEnd;
+}
+
 BOOL
 CBZip::DecompressBlock(unsigned short needed)
 {
   if (EndReached)
     return TRUE;
+  if (!PoolTried)
+    StartPool();
+  if (Pool != NULL)
+  {
+    DWORD read, lastError = 0;
+    CQuadWord inPos = StreamPos;
+    unsigned int err = Pool->Read(ExtrEnd, BUFSIZE - (DWORD)(ExtrEnd - Window), read, inPos, lastError);
+    if (err != 0)
+    {
+      Ok = FALSE;
+      ErrorCode = err;
+      LastError = lastError;
+      return FALSE;
+    }
+    ExtrEnd += read;
+    StreamPos = inPos;
+    // the pool fills the whole buffer unless the stream has ended
+    if (ExtrEnd < Window + BUFSIZE)
+      EndReached = TRUE;
+    return TRUE;
+  }
   int ret = BZ_OK;
   while (ret != BZ_STREAM_END && ExtrEnd < Window + BUFSIZE)
   {
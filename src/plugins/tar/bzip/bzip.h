@@ -1,6 +1,8 @@
 ﻿#ifndef __BZIP_H__
 #define __BZIP_H__
 
+class CBUnzipPool;
+
 class CBZip: public CZippedFile
 {
   public:
@@ -15,7 +17,11 @@ class CBZip: public CZippedFile
     BOOL EndReached;          // set, when all data was extracted
 
     bz_stream *BZStream;
+    CBUnzipPool *Pool;        // parallel decompression (see pbunzip.h), NULL = serial
+    BOOL PoolTried;           // Pool was already attempted to start
+
     virtual BOOL DecompressBlock(unsigned short needed);
+    void StartPool();
 };
 
 #endif // __BZIP_H__
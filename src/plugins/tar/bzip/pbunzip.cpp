@@ -0,0 +1,715 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "../dlldefs.h"
+#include "bzlib.h"
+#include "pbunzip.h"
+
+#include "..\tar.rh"
+#include "..\tar.rh2"
+#include "..\lang\lang.rh"
+
+#define BZIP_BLOCK_MAGIC 0x314159265359ui64 // pi
+#define BZIP_END_MAGIC 0x177245385090ui64   // sqrt(pi)
+#define BZIP_MAGIC_MASK 0xFFFFFFFFFFFFui64
+
+//
+// ****************************************************************************
+// Bit helpers, bit 0 is the most significant bit of the first byte (as in bzip2);
+// the buffers have one spare byte behind the data
+//
+
+static unsigned GetByteAt(const unsigned char* src, DWORD bit)
+{
+    const unsigned char* p = src + (bit >> 3);
+    unsigned shift = bit & 7;
+    if (shift == 0)
+        return *p;
+    return ((p[0] << shift) | (p[1] >> (8 - shift))) & 0xFF;
+}
+
+// ORs the byte to the destination, which must be zeroed
+static void PutByteAt(unsigned char* dst, DWORD bit, unsigned value)
+{
+    unsigned char* p = dst + (bit >> 3);
+    unsigned shift = bit & 7;
+    p[0] |= (unsigned char)(value >> shift);
+    if (shift != 0)
+        p[1] |= (unsigned char)(value << (8 - shift));
+}
+
+static void CopyBits(unsigned char* dst, DWORD dstBit, const unsigned char* src, DWORD srcBit, DWORD count)
+{
+    while (count >= 8)
+    {
+        PutByteAt(dst, dstBit, GetByteAt(src, srcBit));
+        dstBit += 8;
+        srcBit += 8;
+        count -= 8;
+    }
+    if (count > 0)
+        PutByteAt(dst, dstBit, GetByteAt(src, srcBit) & (0xFF00 >> count));
+}
+
+// writes 'count' (a multiple of 8) least significant bits of 'value'
+static void PutBits(unsigned char* dst, DWORD dstBit, unsigned __int64 value, int count)
+{
+    for (count -= 8; count >= 0; count -= 8)
+    {
+        PutByteAt(dst, dstBit, (unsigned)(value >> count) & 0xFF);
+        dstBit += 8;
+    }
+}
+
+static DWORD GetDWordAt(const unsigned char* src, DWORD bit)
+{
+    return (GetByteAt(src, bit) << 24) | (GetByteAt(src, bit + 8) << 16) |
+           (GetByteAt(src, bit + 16) << 8) | GetByteAt(src, bit + 24);
+}
+
+//
+// ****************************************************************************
+// CBUnzipPool
+//
+
+CBUnzipPool::CBUnzipPool()
+{
+    Threads = 0;
+    Scanner = NULL;
+    InitializeCriticalSection(&QueueLock);
+    QueueFirst = 0;
+    QueueCount = 0;
+    QueueSem = NULL;
+    Terminate = FALSE;
+    ZeroMemory(Jobs, sizeof(Jobs));
+    JobCount = 0;
+    FreeSem = NULL;
+    ScanJob = 0;
+    NextJob = 0;
+    Current = NULL;
+    CurrentPos = 0;
+    EndReached = FALSE;
+    File = INVALID_HANDLE_VALUE;
+    Level = 0;
+    InitData = NULL;
+    InitSize = 0;
+    CombinedCrc = 0;
+}
+
+CBUnzipPool::~CBUnzipPool()
+{
+    CALL_STACK_MESSAGE1("CBUnzipPool::~CBUnzipPool()");
+    EnterCriticalSection(&QueueLock);
+    Terminate = TRUE;
+    LeaveCriticalSection(&QueueLock);
+    int i;
+    // wake up the scanner waiting for a free job and all the workers
+    if (FreeSem != NULL)
+        ReleaseSemaphore(FreeSem, JobCount, NULL);
+    if (QueueSem != NULL)
+        ReleaseSemaphore(QueueSem, Threads, NULL);
+    if (Scanner != NULL)
+    {
+        WaitForSingleObject(Scanner, INFINITE);
+        CloseHandle(Scanner);
+    }
+    for (i = 0; i < Threads; i++)
+    {
+        if (Workers[i].Thread != NULL)
+        {
+            WaitForSingleObject(Workers[i].Thread, INFINITE);
+            CloseHandle(Workers[i].Thread);
+        }
+    }
+    for (i = 0; i < PBUNZIP_QUEUE_SIZE; i++)
+    {
+        if (Jobs[i].In != NULL)
+            free(Jobs[i].In);
+        if (Jobs[i].Out != NULL)
+            free(Jobs[i].Out);
+        if (Jobs[i].Done != NULL)
+            CloseHandle(Jobs[i].Done);
+    }
+    if (InitData != NULL)
+        free(InitData);
+    if (FreeSem != NULL)
+        CloseHandle(FreeSem);
+    if (QueueSem != NULL)
+        CloseHandle(QueueSem);
+    DeleteCriticalSection(&QueueLock);
+}
+
+BOOL CBUnzipPool::Init(HANDLE file, const unsigned char* data, DWORD size, CQuadWord pos, CQuadWord inputSize)
+{
+    CALL_STACK_MESSAGE2("CBUnzipPool::Init(, , %u, , )", size);
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors < 2)
+        return FALSE;
+    int threads = min((int)si.dwNumberOfProcessors, PBUNZIP_MAX_THREADS);
+
+    // the stream header: "BZh" and the block size
+    if (size < 4 || data[0] != 'B' || data[1] != 'Z' || data[2] != 'h' ||
+        data[3] < '1' || data[3] > '9')
+        return FALSE;
+    Level = data[3] - '0';
+
+    // shifts at which the last 16 bits scanned end with the last byte of a magic
+    int i;
+    for (i = 0; i < 0x10000; i++)
+    {
+        unsigned char shifts = 0;
+        int k;
+        for (k = 0; k < 8; k++)
+        {
+            unsigned b = (i >> k) & 0xFF;
+            if (b == (BZIP_BLOCK_MAGIC & 0xFF) || b == (BZIP_END_MAGIC & 0xFF))
+                shifts |= 1 << k;
+        }
+        MagicShifts[i] = shifts;
+    }
+
+    File = file;
+    InitPos = pos;
+    InitSize = size;
+    InitData = (unsigned char*)malloc(size);
+    if (InitData == NULL)
+        return FALSE;
+    memcpy(InitData, data, size);
+    InPos = pos + CQuadWord(size, 0);
+    InSize = inputSize;
+
+    JobCount = 2 * threads;
+    QueueSem = CreateSemaphore(NULL, 0, PBUNZIP_QUEUE_SIZE + PBUNZIP_MAX_THREADS, NULL);
+    FreeSem = CreateSemaphore(NULL, JobCount, 2 * JobCount, NULL);
+    if (QueueSem == NULL || FreeSem == NULL)
+        return FALSE;
+    for (i = 0; i < JobCount; i++)
+    {
+        Jobs[i].Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (Jobs[i].Done == NULL)
+            return FALSE;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        CWorker* worker = &Workers[i];
+        worker->Pool = this;
+        worker->Thread = NULL;
+        Threads = i + 1; // the destructor cleans up the workers created so far
+        DWORD id;
+        worker->Thread = CreateThread(NULL, 0, ThreadBody, worker, 0, &id);
+        if (worker->Thread == NULL)
+        {
+            TRACE_E("CBUnzipPool::Init(): unable to start worker thread");
+            return FALSE;
+        }
+    }
+    DWORD id;
+    Scanner = CreateThread(NULL, 0, ScannerThreadBody, this, 0, &id);
+    if (Scanner == NULL)
+    {
+        TRACE_E("CBUnzipPool::Init(): unable to start scanner thread");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+unsigned int CBUnzipPool::Read(unsigned char* buffer, DWORD size, DWORD& read, CQuadWord& inPos, DWORD& lastError)
+{
+    read = 0;
+    while (read < size && !EndReached)
+    {
+        if (Current == NULL)
+        {
+            CBUnzipJob* job = WaitJob(NextJob);
+            // a block which does not decode was probably cut by a false magic inside
+            // its data, try it again joined with the following block
+            int joins = 0;
+            while (job->Type == bjtBlock && job->Error == IDS_ERR_CORRUPT && joins < PBUNZIP_MAX_JOINS)
+            {
+                CBUnzipJob* next = WaitJob(NextJob + 1);
+                if (next->Type != bjtBlock)
+                    break;
+                if (!JoinJobs(job, next))
+                {
+                    job->Error = IDS_ERR_MEMORY;
+                    break;
+                }
+                ReleaseJob();
+                job = next;
+                joins++;
+            }
+            if (job->Type == bjtError || job->Error != 0)
+            {
+                lastError = job->LastError;
+                return job->Error;
+            }
+            if (job->Type == bjtEnd)
+            {
+                if (job->StoredCrc != CombinedCrc)
+                    return IDS_ERR_CORRUPT;
+                inPos = job->InEnd;
+                EndReached = TRUE;
+                break;
+            }
+            CombinedCrc = ((CombinedCrc << 1) | (CombinedCrc >> 31)) ^ job->StoredCrc;
+            Current = job;
+            CurrentPos = 0;
+        }
+        DWORD count = min(size - read, Current->OutSize - CurrentPos);
+        memcpy(buffer + read, Current->Out + CurrentPos, count);
+        read += count;
+        CurrentPos += count;
+        if (CurrentPos == Current->OutSize)
+        {
+            inPos = Current->InEnd;
+            Current = NULL;
+            ReleaseJob();
+        }
+    }
+    return 0;
+}
+
+CBUnzipJob* CBUnzipPool::WaitJob(int index)
+{
+    CBUnzipJob* job = &Jobs[index % JobCount];
+    WaitForSingleObject(job->Done, INFINITE);
+    return job;
+}
+
+void CBUnzipPool::ReleaseJob()
+{
+    NextJob++;
+    ReleaseSemaphore(FreeSem, 1, NULL);
+}
+
+CBUnzipJob* CBUnzipPool::NewJob()
+{
+    WaitForSingleObject(FreeSem, INFINITE);
+    EnterCriticalSection(&QueueLock);
+    BOOL terminate = Terminate;
+    LeaveCriticalSection(&QueueLock);
+    if (terminate)
+        return NULL;
+    CBUnzipJob* job = &Jobs[ScanJob % JobCount];
+    ScanJob++;
+    job->Type = bjtBlock;
+    job->StartBit = 0;
+    job->BitLen = 0;
+    job->StoredCrc = 0;
+    job->OutSize = 0;
+    job->Error = 0;
+    job->LastError = 0;
+    return job;
+}
+
+void CBUnzipPool::SubmitJob(CBUnzipJob* job)
+{
+    if (job->Type != bjtBlock || job->Error != 0)
+    {
+        // nothing to decode
+        SetEvent(job->Done);
+        return;
+    }
+    EnterCriticalSection(&QueueLock);
+    Queue[(QueueFirst + QueueCount) % PBUNZIP_QUEUE_SIZE] = job;
+    QueueCount++;
+    LeaveCriticalSection(&QueueLock);
+    ReleaseSemaphore(QueueSem, 1, NULL);
+}
+
+BOOL CBUnzipPool::JoinJobs(CBUnzipJob* first, CBUnzipJob* second)
+{
+    CALL_STACK_MESSAGE1("CBUnzipPool::JoinJobs(, )");
+    DWORD bitLen = first->BitLen + second->BitLen;
+    DWORD alloc = (bitLen + 7) / 8 + 1;
+    unsigned char* in = (unsigned char*)calloc(alloc, 1);
+    if (in == NULL)
+        return FALSE;
+    CopyBits(in, 0, first->In, first->StartBit, first->BitLen);
+    CopyBits(in, first->BitLen, second->In, second->StartBit, second->BitLen);
+    if (second->In != NULL)
+        free(second->In);
+    second->In = in;
+    second->InAlloc = alloc;
+    second->StartBit = 0;
+    second->BitLen = bitLen;
+    if (bitLen < 48 + 32)
+        second->Error = IDS_ERR_CORRUPT;
+    else
+    {
+        second->StoredCrc = GetDWordAt(in, 48);
+        Decode(second);
+    }
+    return TRUE;
+}
+
+// decodes the block as a stream: header, the block, end of stream marker and the
+// combined CRC, which is the CRC of the block for a stream with one block
+void CBUnzipPool::Decode(CBUnzipJob* job)
+{
+    CALL_STACK_MESSAGE2("CBUnzipPool::Decode(%u)", job->BitLen);
+    job->OutSize = 0;
+    job->Error = 0;
+    DWORD streamSize = (32 + job->BitLen + 48 + 32 + 7) / 8;
+    unsigned char* stream = (unsigned char*)calloc(streamSize + 1, 1);
+    if (stream == NULL)
+    {
+        job->Error = IDS_ERR_MEMORY;
+        return;
+    }
+    stream[0] = 'B';
+    stream[1] = 'Z';
+    stream[2] = 'h';
+    stream[3] = (unsigned char)('0' + Level);
+    CopyBits(stream, 32, job->In, job->StartBit, job->BitLen);
+    PutBits(stream, 32 + job->BitLen, BZIP_END_MAGIC, 48);
+    PutBits(stream, 32 + job->BitLen + 48, job->StoredCrc, 32);
+
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int ret = BZ2_bzDecompressInit(&strm, 0, 0);
+    if (ret != BZ_OK)
+    {
+        free(stream);
+        job->Error = ret == BZ_MEM_ERROR ? IDS_ERR_MEMORY : IDS_ERR_INTERNAL;
+        return;
+    }
+    strm.next_in = (char*)stream;
+    strm.avail_in = streamSize;
+    for (;;)
+    {
+        if (job->OutSize == job->OutAlloc)
+        {
+            // a block usually decodes to at most the block size, runs may make it longer
+            DWORD alloc = job->OutAlloc == 0 ? Level * 100000 + 1024 : job->OutAlloc * 2;
+            unsigned char* out = (unsigned char*)realloc(job->Out, alloc);
+            if (out == NULL)
+            {
+                job->Error = IDS_ERR_MEMORY;
+                break;
+            }
+            job->Out = out;
+            job->OutAlloc = alloc;
+        }
+        strm.next_out = (char*)job->Out + job->OutSize;
+        strm.avail_out = job->OutAlloc - job->OutSize;
+        ret = BZ2_bzDecompress(&strm);
+        job->OutSize = job->OutAlloc - strm.avail_out;
+        if (ret == BZ_STREAM_END)
+            break;
+        if (ret != BZ_OK || strm.avail_in == 0 && strm.avail_out != 0)
+        {
+            // a truncated block ends up here too
+            job->Error = ret == BZ_MEM_ERROR ? IDS_ERR_MEMORY : IDS_ERR_CORRUPT;
+            break;
+        }
+    }
+    BZ2_bzDecompressEnd(&strm);
+    free(stream);
+}
+
+// appends the next part of the archive to 'buf'; returns 0, IDS_ERR_EOF at the end
+// of the archive or IDS_ERR_FREAD / IDS_ERR_MEMORY
+unsigned int CBUnzipPool::ReadInput(unsigned char*& buf, DWORD& alloc, DWORD& used, DWORD& lastError)
+{
+    if (InPos >= InSize)
+        return IDS_ERR_EOF;
+    DWORD size = PBUNZIP_READ_SIZE;
+    if (InPos + CQuadWord(size, 0) > InSize)
+        size = (DWORD)(InSize - InPos).Value;
+    if (alloc < used + size + 1)
+    {
+        DWORD newAlloc = max(2 * alloc, used + size + 1);
+        unsigned char* newBuf = (unsigned char*)realloc(buf, newAlloc);
+        if (newBuf == NULL)
+            return IDS_ERR_MEMORY;
+        buf = newBuf;
+        alloc = newAlloc;
+    }
+    DWORD read;
+    if (!ReadFile(File, buf + used, size, &read, NULL))
+    {
+        lastError = GetLastError();
+        return IDS_ERR_FREAD;
+    }
+    if (read == 0)
+        return IDS_ERR_EOF;
+    used += read;
+    InPos += CQuadWord(read, 0);
+    return 0;
+}
+
+// the end of stream magic at 'magicBit' of 'buf' is valid if the combined CRC behind it
+// is followed by zero padding to the byte boundary and then by the end of the archive
+// or the header of the next stream; returns 0 or IDS_ERR_FREAD / IDS_ERR_MEMORY
+unsigned int CBUnzipPool::CheckStreamEnd(unsigned char*& buf, DWORD& alloc, DWORD& used, DWORD magicBit,
+                                         BOOL& valid, DWORD& lastError)
+{
+    valid = FALSE;
+    DWORD crcEnd = magicBit + 48 + 32;
+    DWORD next = (crcEnd + 7) / 8; // the byte behind the stream
+    unsigned int error = 0;
+    while (error == 0 && used < next + 4)
+        error = ReadInput(buf, alloc, used, lastError);
+    if (error == IDS_ERR_EOF)
+        error = 0;
+    if (error != 0 || used < next)
+        return error;
+    if (crcEnd % 8 != 0 && (buf[next - 1] & (0xFF >> (crcEnd % 8))) != 0)
+        return 0; // the padding is not zero
+    if (used == next)
+        valid = TRUE; // end of the archive
+    else if (used >= next + 4 && buf[next] == 'B' && buf[next + 1] == 'Z' && buf[next + 2] == 'h' &&
+             buf[next + 3] >= '1' && buf[next + 3] <= '9')
+        valid = TRUE; // the next stream
+    return 0;
+}
+
+// hands the block from bit 'blockStart' to 'endBit' of 'buf' to the workers; returns
+// FALSE when terminated
+BOOL CBUnzipPool::SubmitBlock(const unsigned char* buf, int blockStart, DWORD endBit, CQuadWord bufPos)
+{
+    CBUnzipJob* job = NewJob();
+    if (job == NULL)
+        return FALSE;
+    job->StartBit = blockStart;
+    job->BitLen = endBit - blockStart;
+    job->InEnd = bufPos + CQuadWord(endBit / 8, 0);
+    DWORD size = (endBit + 7) / 8;
+    if (job->InAlloc < size + 1)
+    {
+        if (job->In != NULL)
+            free(job->In);
+        job->InAlloc = 0;
+        job->In = (unsigned char*)malloc(size + 1);
+        if (job->In != NULL)
+            job->InAlloc = size + 1;
+    }
+    if (job->In == NULL)
+        job->Error = IDS_ERR_MEMORY;
+    else
+    {
+        memcpy(job->In, buf, size);
+        job->In[size] = 0;
+        // the bits of the following magic must not get into the block
+        if (endBit % 8 != 0)
+            job->In[size - 1] &= 0xFF00 >> (endBit % 8);
+        if (job->BitLen < 48 + 32)
+            job->Error = IDS_ERR_CORRUPT; // joined with the next block, see Read()
+        else
+            job->StoredCrc = GetDWordAt(job->In, job->StartBit + 48);
+    }
+    SubmitJob(job);
+    return TRUE;
+}
+
+// hands the end of the stream at 'magicBit' of 'buf' to Read(); returns FALSE when
+// terminated
+BOOL CBUnzipPool::SubmitEnd(unsigned char*& buf, DWORD& alloc, DWORD& used, DWORD magicBit, CQuadWord bufPos,
+                            DWORD& lastError)
+{
+    // the combined CRC follows
+    DWORD crcEnd = magicBit + 48 + 32;
+    unsigned int error = 0;
+    while (error == 0 && used * 8 < crcEnd)
+        error = ReadInput(buf, alloc, used, lastError);
+    CBUnzipJob* job = NewJob();
+    if (job == NULL)
+        return FALSE;
+    if (error != 0)
+    {
+        job->Type = bjtError;
+        job->Error = error;
+        job->LastError = lastError;
+    }
+    else
+    {
+        job->Type = bjtEnd;
+        buf[used] = 0;
+        job->StoredCrc = GetDWordAt(buf, magicBit + 48);
+        job->InEnd = bufPos + CQuadWord((crcEnd + 7) / 8, 0);
+    }
+    SubmitJob(job);
+    return TRUE;
+}
+
+// finds the blocks in the archive and hands them to the workers; returns FALSE
+// when terminated
+BOOL CBUnzipPool::Scan()
+{
+    CALL_STACK_MESSAGE1("CBUnzipPool::Scan()");
+
+    // the part of the archive from the start of the current block; the first
+    // byte of 'buf' is at 'bufPos'
+    DWORD alloc = InitSize + 1;
+    unsigned char* buf = (unsigned char*)malloc(alloc);
+    if (buf == NULL)
+    {
+        CBUnzipJob* job = NewJob();
+        if (job == NULL)
+            return FALSE;
+        job->Type = bjtError;
+        job->Error = IDS_ERR_MEMORY;
+        SubmitJob(job);
+        return TRUE;
+    }
+    memcpy(buf, InitData, InitSize);
+    DWORD used = InitSize;
+    CQuadWord bufPos = InitPos;
+
+    DWORD scanPos = 4;   // the next byte to scan, the stream header is skipped
+    int blockStart = -1; // first bit of the current block in 'buf', -1 = none yet
+    int falseEnd = -1;   // the last rejected end of stream magic in the current block, -1 = none
+    // the last 64 bits scanned
+    unsigned __int64 reg = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    unsigned int error = 0;
+    DWORD lastError = 0;
+    for (;;)
+    {
+        while (scanPos < used)
+        {
+            reg = (reg << 8) | buf[scanPos++];
+            unsigned shifts = MagicShifts[reg & 0xFFFF];
+            if (shifts == 0)
+                continue;
+            // 'k' bits of the last byte follow the magic, try the earlier magic first
+            int k;
+            for (k = 7; k >= 0; k--)
+            {
+                if ((shifts & (1 << k)) == 0 || scanPos * 8 < (DWORD)(48 + k))
+                    continue;
+                unsigned __int64 magic = (reg >> k) & BZIP_MAGIC_MASK;
+                if (magic != BZIP_BLOCK_MAGIC && magic != BZIP_END_MAGIC)
+                    continue;
+
+                DWORD magicBit = scanPos * 8 - k - 48;
+                if (magic == BZIP_END_MAGIC && blockStart >= 0)
+                {
+                    // sqrt(pi) may appear inside the compressed data by chance too, the
+                    // block then must not be cut here
+                    BOOL valid;
+                    error = CheckStreamEnd(buf, alloc, used, magicBit, valid, lastError);
+                    if (error != 0)
+                        break;
+                    if (!valid)
+                    {
+                        falseEnd = magicBit;
+                        continue;
+                    }
+                }
+
+                if (blockStart >= 0)
+                {
+                    // the current block ends here
+                    if (!SubmitBlock(buf, blockStart, magicBit, bufPos))
+                    {
+                        free(buf);
+                        return FALSE;
+                    }
+                }
+                else if (magicBit != 32)
+                {
+                    error = IDS_ERR_CORRUPT; // garbage behind the stream header
+                    break;
+                }
+
+                if (magic == BZIP_END_MAGIC)
+                {
+                    BOOL ret = SubmitEnd(buf, alloc, used, magicBit, bufPos, lastError);
+                    free(buf);
+                    return ret;
+                }
+
+                // a new block starts, drop the data before it
+                DWORD drop = magicBit / 8;
+                memmove(buf, buf + drop, used - drop);
+                used -= drop;
+                scanPos -= drop;
+                bufPos += CQuadWord(drop, 0);
+                blockStart = magicBit % 8;
+                falseEnd = -1;
+            }
+            if (error != 0)
+                break;
+        }
+        // the first block must follow the stream header right away and
+        // a block cannot be this large
+        if (error == 0 && (blockStart < 0 && scanPos >= 4 + 6 || used > PBUNZIP_MAX_BLOCK))
+            error = IDS_ERR_CORRUPT;
+        if (error == 0)
+            error = ReadInput(buf, alloc, used, lastError);
+        if ((error == IDS_ERR_EOF || error == IDS_ERR_CORRUPT) && falseEnd >= 0)
+        {
+            // no valid end found and the block cannot go on: the last rejected end is
+            // followed by garbage the serial decompression would ignore as well
+            BOOL ret = SubmitBlock(buf, blockStart, falseEnd, bufPos) &&
+                       SubmitEnd(buf, alloc, used, falseEnd, bufPos, lastError);
+            free(buf);
+            return ret;
+        }
+        if (error != 0)
+            break;
+    }
+
+    CBUnzipJob* job = NewJob();
+    if (job == NULL)
+    {
+        free(buf);
+        return FALSE;
+    }
+    job->Type = bjtError;
+    job->Error = error;
+    job->LastError = lastError;
+    SubmitJob(job);
+    free(buf);
+    return TRUE;
+}
+
+DWORD WINAPI
+CBUnzipPool::ScannerThreadBody(void* param)
+{
+    return SalamanderDebug->CallWithCallStack(ScannerBody, param);
+}
+
+unsigned WINAPI
+CBUnzipPool::ScannerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CBUnzipPool::ScannerBody()");
+    ((CBUnzipPool*)param)->Scan();
+    return 0;
+}
+
+DWORD WINAPI
+CBUnzipPool::ThreadBody(void* param)
+{
+    return SalamanderDebug->CallWithCallStack(WorkerBody, param);
+}
+
+unsigned WINAPI
+CBUnzipPool::WorkerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CBUnzipPool::WorkerBody()");
+    CWorker* worker = (CWorker*)param;
+    CBUnzipPool* pool = worker->Pool;
+    while (1)
+    {
+        WaitForSingleObject(pool->QueueSem, INFINITE);
+        CBUnzipJob* job = NULL;
+        EnterCriticalSection(&pool->QueueLock);
+        if (!pool->Terminate && pool->QueueCount > 0)
+        {
+            job = pool->Queue[pool->QueueFirst];
+            pool->QueueFirst = (pool->QueueFirst + 1) % PBUNZIP_QUEUE_SIZE;
+            pool->QueueCount--;
+        }
+        LeaveCriticalSection(&pool->QueueLock);
+        if (job == NULL)
+            break; // terminating
+        pool->Decode(job);
+        SetEvent(job->Done);
+    }
+    return 0;
+}
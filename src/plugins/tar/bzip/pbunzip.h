@@ -0,0 +1,133 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// Parallel bzip2 decompression used by CBZip:
+// - a scanner thread reads the archive and looks for the 48-bit block magic, which
+//   is not byte aligned; the bits between two magics form one block
+// - the workers decode every block as a separate bzip2 stream with one block: the
+//   stream header, the block bits and the end of stream marker with the combined CRC
+//   equal to the block CRC, so the bundled library is used unmodified
+// - the caller gets the decoded blocks in order and verifies the combined CRC of
+//   the whole stream
+// The block magic may appear inside compressed data by chance; the block then does
+// not decode and is joined with the following one. The end of stream magic is only
+// accepted when the end of the archive or the next stream follows.
+
+#define PBUNZIP_MAX_THREADS 16
+#define PBUNZIP_MIN_SIZE (1024 * 1024)      // smaller archives are decompressed serially
+#define PBUNZIP_READ_SIZE (256 * 1024)      // the scanner reads the archive by this much
+#define PBUNZIP_MAX_BLOCK (8 * 1024 * 1024) // larger compressed block means corrupted data
+#define PBUNZIP_MAX_JOINS 8                 // how many blocks may be joined because of false magics
+#define PBUNZIP_QUEUE_SIZE (2 * PBUNZIP_MAX_THREADS)
+
+enum CBUnzipJobType
+{
+    bjtBlock, // compressed block
+    bjtEnd,   // end of the stream, StoredCrc holds the combined CRC
+    bjtError, // the scanner failed (Error, LastError)
+};
+
+struct CBUnzipJob
+{
+    CBUnzipJobType Type;
+
+    // compressed block: BitLen bits starting at bit StartBit (0..7) of In
+    unsigned char* In;
+    DWORD InAlloc;
+    DWORD StartBit;
+    DWORD BitLen;
+    CQuadWord InEnd; // position in the archive behind the block (for progress)
+
+    DWORD StoredCrc; // bjtBlock: CRC of the block, bjtEnd: combined CRC of the stream
+
+    // results
+    unsigned char* Out;
+    DWORD OutSize;
+    DWORD OutAlloc;
+    unsigned int Error; // 0 = OK, otherwise IDS_ERR_xxx
+    DWORD LastError;    // IDS_ERR_FREAD: GetLastError()
+
+    HANDLE Done; // signaled when the job is finished
+};
+
+class CBUnzipPool
+{
+protected:
+    struct CWorker
+    {
+        CBUnzipPool* Pool;
+        HANDLE Thread;
+    };
+
+    int Threads;
+    CWorker Workers[PBUNZIP_MAX_THREADS];
+    HANDLE Scanner;
+
+    CRITICAL_SECTION QueueLock; // guards Queue, QueueFirst, QueueCount and Terminate
+    CBUnzipJob* Queue[PBUNZIP_QUEUE_SIZE];
+    int QueueFirst;
+    int QueueCount;
+    HANDLE QueueSem; // number of jobs in Queue
+    BOOL Terminate;
+
+    CBUnzipJob Jobs[PBUNZIP_QUEUE_SIZE];      // ring of jobs in the order of the stream
+    int JobCount;                             // number of used items of Jobs
+    HANDLE FreeSem;                           // number of free items of Jobs (for the scanner)
+    int ScanJob;                              // the next job for the scanner
+    int NextJob;                              // the next job for Read()
+    CBUnzipJob* Current;                      // job Read() copies the data from
+    DWORD CurrentPos;                         // already copied part of Current->Out
+    BOOL EndReached;                          // Read() has returned the whole stream
+    DWORD CombinedCrc;                        // computed from the CRCs of the blocks returned so far
+
+    // scanner state
+    HANDLE File;
+    CQuadWord InPos;         // position in the archive of the next byte to read
+    CQuadWord InSize;        // the archive ends here
+    int Level;               // block size from the stream header (1..9)
+    unsigned char* InitData; // the start of the stream passed to Init()
+    DWORD InitSize;
+    CQuadWord InitPos;       // position of InitData in the archive
+    // for the last 16 bits scanned: bit k is set if the bits shifted right by k end
+    // with the last byte of a magic, only then the full magic is compared
+    unsigned char MagicShifts[0x10000];
+
+public:
+    CBUnzipPool();
+    ~CBUnzipPool(); // stops the threads, unfinished jobs are dropped
+
+    // starts the threads, 'data' ('size' bytes) is the unread start of the stream
+    // at position 'pos' in the archive and must contain its header, the rest is
+    // read from the current position of 'file' up to 'inputSize'; returns FALSE if
+    // it is not worth it (single processor) or there is not enough memory, the pool
+    // then must not be used
+    BOOL Init(HANDLE file, const unsigned char* data, DWORD size, CQuadWord pos, CQuadWord inputSize);
+
+    // returns up to 'size' bytes of the decompressed data in 'buffer', 'read' is
+    // zero at the end of the stream; 'inPos' receives the position in the archive
+    // behind the data returned so far; returns 0 or IDS_ERR_xxx ('lastError' for
+    // IDS_ERR_FREAD)
+    unsigned int Read(unsigned char* buffer, DWORD size, DWORD& read, CQuadWord& inPos, DWORD& lastError);
+
+protected:
+    BOOL Scan();
+    unsigned int ReadInput(unsigned char*& buf, DWORD& alloc, DWORD& used, DWORD& lastError);
+    unsigned int CheckStreamEnd(unsigned char*& buf, DWORD& alloc, DWORD& used, DWORD magicBit,
+                                BOOL& valid, DWORD& lastError);
+    BOOL SubmitBlock(const unsigned char* buf, int blockStart, DWORD endBit, CQuadWord bufPos);
+    BOOL SubmitEnd(unsigned char*& buf, DWORD& alloc, DWORD& used, DWORD magicBit, CQuadWord bufPos,
+                   DWORD& lastError);
+    CBUnzipJob* NewJob();
+    void SubmitJob(CBUnzipJob* job);
+    CBUnzipJob* WaitJob(int index);
+    void ReleaseJob();
+    BOOL JoinJobs(CBUnzipJob* first, CBUnzipJob* second);
+    void Decode(CBUnzipJob* job);
+
+    static DWORD WINAPI ScannerThreadBody(void* param);
+    static unsigned WINAPI ScannerBody(void* param);
+    static DWORD WINAPI ThreadBody(void* param);
+    static unsigned WINAPI WorkerBody(void* param);
+};
@@ -12,6 +12,7 @@
 #include "compress/compress.h"
 #include "rpm/rpm.h"
 #include "lzh/lzh.h"
+#include "xz/xz.h"
 
 #include "tar.rh"
 #include "tar.rh2"
@@ -97,14 +98,20 @@ CDecompressFile::CreateInstance(LPCTSTR fileName, DWORD inputOffset, CQuadWord i
                 archive = new CBZip(fileName, file, buffer, inputOffset, read, inputSize);
                 if (archive != NULL && !archive->IsOk() && archive->GetErrorCode() == 0)
                 {
-                    // not compress, try lzh
+                    // not bzip, try xz
                     delete archive;
-                    archive = new CLZH(fileName, file, buffer, read);
+                    archive = new CXZip(fileName, file, buffer, inputOffset, read, inputSize);
                     if (archive != NULL && !archive->IsOk() && archive->GetErrorCode() == 0)
                     {
-                        // not compressed, fall back to the base class
+                        // not xz, try lzh
                         delete archive;
-                        archive = new CDecompressFile(fileName, file, buffer, inputOffset, read, inputSize);
+                        archive = new CLZH(fileName, file, buffer, read);
+                        if (archive != NULL && !archive->IsOk() && archive->GetErrorCode() == 0)
+                        {
+                            // not compressed, fall back to the base class
+                            delete archive;
+                            archive = new CDecompressFile(fileName, file, buffer, inputOffset, read, inputSize);
+                        }
                     }
                 }
             }
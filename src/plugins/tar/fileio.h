@@ -6,6 +6,9 @@
 // size of file read buffer
 #define BUFSIZE 0x8000 // buffer will be 32 KB
 
+class CSeekIndex;
+struct CSeekPoint;
+
 class CDecompressFile
 {
 public:
@@ -40,6 +43,17 @@ public:
     virtual const unsigned char* GetBlock(unsigned short size, unsigned short* read = NULL);
     virtual void GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr);
 
+    // seek index support (see seekidx.h), only for streams which can restart
+    // decompression from a checkpoint
+    virtual BOOL CanSeek() { return FALSE; }
+    // starts recording checkpoints into 'index' during decompression, NULL stops it
+    virtual void SetSeekIndex(CSeekIndex* index) {}
+    // returns the position in the decompressed data (bytes returned by GetBlock)
+    virtual CQuadWord GetOutPos() { return CQuadWord(0, 0); }
+    // restarts decompression at checkpoint 'point', GetBlock() continues with data
+    // from point->OutPos; on failure the stream is broken (IsOk() returns FALSE)
+    virtual BOOL SeekTo(const CSeekPoint* point) { return FALSE; }
+
 protected:
     // reads a block from the file
     const unsigned char* FReadBlock(unsigned int number);
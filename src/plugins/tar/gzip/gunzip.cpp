@@ -5,6 +5,7 @@
 
 #include "../dlldefs.h"
 #include "../fileio.h"
+#include "../seekidx.h"
 #include "gzip.h"
 
 #include "..\tar.rh"
@@ -853,6 +854,24 @@ int CGZip::InflateStored()
     return StoredLen > 0 ? -1 : 1;
 }
 
+// records a checkpoint; called between deflate blocks, where the decoder
+// state consists only of the window, the bit buffer and the member CRC
+void CGZip::AddSeekPoint()
+{
+    CSeekPoint point;
+    point.Window = (unsigned char*)malloc(BUFSIZE);
+    if (point.Window != NULL)
+        memcpy(point.Window, Window, BUFSIZE);
+    point.WindowPos = (DWORD)(ExtrEnd - Window);
+    point.OutPos = OutTotal;
+    point.InPos = StreamPos;
+    point.BitBuffer = BitBuffer;
+    point.BitCount = BitCount;
+    point.Crc = crc;
+    point.MemberSize = TotalCnt;
+    SeekIndex->AddPoint(point);
+}
+
 // decompress an inflated block
 BOOL CGZip::InflateBlock()
 {
@@ -860,6 +879,9 @@ BOOL CGZip::InflateBlock()
 
     if (!InProgress)
     {
+        if (SeekIndex != NULL && SeekIndex->WantPoint(OutTotal))
+            AddSeekPoint();
+
         unsigned long b; // bit buffer
         unsigned k;      // number of bits in bit buffer
 
@@ -926,6 +948,7 @@ BOOL CGZip::InflateBlock()
     // update crc and extracted size
     unsigned short extracted = (unsigned short)(ExtrEnd - begin);
     TotalCnt += CQuadWord(extracted, 0);
+    OutTotal += CQuadWord(extracted, 0);
     crc = UpdateCRC(crc, begin, extracted);
 
     if (ret != -1)
@@ -972,7 +995,8 @@ BOOL CGZip::InflateBlock()
 CGZip::CGZip(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize) : CZippedFile(filename, file, buffer, start, read, inputSize), CopyInProgress(FALSE), LastBlock(FALSE), CopyCount(0),
                                                                                                                                        CopyDistance(0), BlockType(0), LiteralTable(NULL), LiteralBits(0), DistanceTable(NULL),
                                                                                                                                        DistanceBits(0), FixedLiteralTable(NULL), FixedLiteralBits(0), FixedDistanceTable(NULL),
-                                                                                                                                       FixedDistanceBits(0), StoredLen(0), BitBuffer(0), BitCount(0), InProgress(FALSE)
+                                                                                                                                       FixedDistanceBits(0), StoredLen(0), BitBuffer(0), BitCount(0), InProgress(FALSE),
+                                                                                                                                       OutTotal(0, 0), SeekIndex(NULL)
 {
     CALL_STACK_MESSAGE2("CGZip::CGZip(%s, , , )", filename);
 
@@ -1248,6 +1272,53 @@ BOOL CGZip::CompactBuffer()
     return TRUE;
 }
 
+BOOL CGZip::SeekTo(const CSeekPoint* point)
+{
+    CALL_STACK_MESSAGE1("CGZip::SeekTo()");
+
+    if (!Ok)
+        return FALSE;
+
+    LARGE_INTEGER pos;
+    pos.QuadPart = point->InPos.Value;
+    if (!SetFilePointerEx(File, pos, NULL, FILE_BEGIN))
+    {
+        Ok = FALSE;
+        ErrorCode = IDS_GZERR_SEEK;
+        LastError = GetLastError();
+        return FALSE;
+    }
+    // drop the buffered input
+    DataStart = Buffer;
+    DataEnd = Buffer;
+    StreamPos = point->InPos;
+
+    // the checkpoint lies between two blocks, nothing of the current block is needed
+    HufTableFree(LiteralTable);
+    LiteralTable = NULL;
+    HufTableFree(DistanceTable);
+    DistanceTable = NULL;
+    HufTableFree(FixedLiteralTable);
+    FixedLiteralTable = NULL;
+    HufTableFree(FixedDistanceTable);
+    FixedDistanceTable = NULL;
+    InProgress = FALSE;
+    CopyInProgress = FALSE;
+    LastBlock = FALSE;
+
+    BitBuffer = point->BitBuffer;
+    BitCount = point->BitCount;
+    crc = point->Crc;
+    TotalCnt = point->MemberSize;
+    OutTotal = point->OutPos;
+
+    // restore the history for back references, there is no unread data
+    memcpy(Window, point->Window, BUFSIZE);
+    ExtrStart = Window + point->WindowPos;
+    ExtrEnd = ExtrStart;
+    return TRUE;
+}
+
 BOOL CGZip::DecompressBlock(unsigned short needed)
 {
     unsigned char* begin = ExtrEnd;
@@ -65,8 +65,16 @@ public:
 
     virtual void GetFileInfo(FILETIME& lastWrite, CQuadWord& fileSize, DWORD& fileAttr);
 
+    virtual BOOL CanSeek() { return TRUE; }
+    virtual void SetSeekIndex(CSeekIndex* index) { SeekIndex = index; }
+    virtual CQuadWord GetOutPos() { return OutTotal - CQuadWord((DWORD)(ExtrEnd - ExtrStart), 0); }
+    virtual BOOL SeekTo(const CSeekPoint* point);
+
 protected:
     CQuadWord TotalCnt; // total number of bytes extracted from archive
+    CQuadWord OutTotal; // number of bytes extracted from all gzip members of the archive
+
+    CSeekIndex* SeekIndex; // if not NULL, checkpoints are recorded into it at block boundaries
 
     BOOL InProgress;     // current block is not finished yet
     BOOL CopyInProgress; // current operation is copy
@@ -89,6 +97,7 @@ protected:
     unsigned long crc;
 
     // internal, private functions
+    void AddSeekPoint();
     BOOL InflateBlock();
     BOOL InflateStoredInit();
     int InflateStored();
@@ -0,0 +1,480 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "dlldefs.h"
+#include "fileio.h"
+#include "names.h"
+#include "seekidx.h"
+
+#define SEEKIDX_SIGNATURE 0x58444954 // "TIDX"
+#define SEEKIDX_VERSION 1
+#define SEEKIDX_MAX_FILE 0x40000000 // larger index files are considered damaged
+
+// these structures map directly to on-disk data; do not change their size
+#pragma pack(push, 1)
+struct SSeekIndexHeader
+{
+    DWORD Signature;
+    DWORD Version;
+    CQuadWord ArchiveSize; // size of the archive the index belongs to
+    FILETIME LastWrite;    // last write time of the archive
+    DWORD NameLen;         // length of the archive name following the header
+    DWORD PointCount;      // number of checkpoints following the name
+    DWORD MemberCount;     // number of members following the checkpoints
+};
+
+struct SSeekPointRecord
+{
+    CQuadWord OutPos;
+    CQuadWord InPos;
+    DWORD BitBuffer;
+    DWORD BitCount;
+    DWORD Crc;
+    CQuadWord MemberSize;
+    DWORD WindowPos;
+    // followed by BUFSIZE bytes of the window
+};
+
+struct SSeekMemberRecord
+{
+    CQuadWord HeaderPos;
+    WORD NameLen;
+    // followed by NameLen bytes of the name (without the terminating null)
+};
+#pragma pack(pop)
+
+#define SEEKIDX_WRITE_BUFFER 0x10000
+
+// buffered writing of the index file; the first failure is remembered and
+// reported by Close()
+class CSeekIndexWriter
+{
+public:
+    CSeekIndexWriter()
+    {
+        File = INVALID_HANDLE_VALUE;
+        Used = 0;
+        Ok = FALSE;
+    }
+    ~CSeekIndexWriter() { Close(); }
+
+    BOOL Create(const char* fileName)
+    {
+        File = CreateFileUtf8Local(fileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        Ok = File != INVALID_HANDLE_VALUE;
+        return Ok;
+    }
+
+    void Write(const void* data, DWORD size)
+    {
+        if (Used + size > SEEKIDX_WRITE_BUFFER)
+            Flush();
+        if (size >= SEEKIDX_WRITE_BUFFER)
+            WriteDirect(data, size);
+        else
+        {
+            memcpy(Buffer + Used, data, size);
+            Used += size;
+        }
+    }
+
+    BOOL Close()
+    {
+        if (File != INVALID_HANDLE_VALUE)
+        {
+            Flush();
+            CloseHandle(File);
+            File = INVALID_HANDLE_VALUE;
+        }
+        return Ok;
+    }
+
+protected:
+    HANDLE File;
+    unsigned char Buffer[SEEKIDX_WRITE_BUFFER];
+    DWORD Used;
+    BOOL Ok;
+
+    void Flush()
+    {
+        WriteDirect(Buffer, Used);
+        Used = 0;
+    }
+
+    void WriteDirect(const void* data, DWORD size)
+    {
+        DWORD written;
+        if (Ok && size > 0 && (!WriteFile(File, data, size, &written, NULL) || written != size))
+            Ok = FALSE;
+    }
+};
+
+CSeekIndex::CSeekIndex() : Points(64, 64), Members(256, 1024)
+{
+    Recording = FALSE;
+    Broken = FALSE;
+    NextPointPos.Set(0, 0);
+    PointSpacing.Set(SEEK_POINT_SPACING, 0);
+}
+
+CSeekIndex::~CSeekIndex()
+{
+    Clear();
+}
+
+void CSeekIndex::Clear()
+{
+    int i;
+    for (i = 0; i < Points.Count; i++)
+        free(Points[i].Window);
+    for (i = 0; i < Members.Count; i++)
+        free(Members[i].Name);
+    Points.DestroyMembers();
+    Members.DestroyMembers();
+    if (!Points.IsGood())
+        Points.ResetState();
+    if (!Members.IsGood())
+        Members.ResetState();
+    Recording = FALSE;
+    Broken = FALSE;
+}
+
+void CSeekIndex::StartRecording(CQuadWord archiveSize)
+{
+    CALL_STACK_MESSAGE1("CSeekIndex::StartRecording()");
+
+    Clear();
+    // the decompressed size is not known yet, the compressed one must do for the estimate
+    PointSpacing.Set(SEEK_POINT_SPACING, 0);
+    if (archiveSize.Value / SEEK_MAX_POINTS > PointSpacing.Value)
+        PointSpacing.Value = archiveSize.Value / SEEK_MAX_POINTS;
+    NextPointPos = PointSpacing;
+    Recording = TRUE;
+}
+
+void CSeekIndex::AddPoint(CSeekPoint& point)
+{
+    if (point.Window == NULL)
+        Broken = TRUE;
+    if (!Recording || Broken)
+    {
+        free(point.Window);
+        return;
+    }
+    Points.Add(point);
+    if (!Points.IsGood())
+    {
+        free(point.Window);
+        Broken = TRUE;
+        return;
+    }
+    if (Points.Count >= SEEK_MAX_POINTS)
+    {
+        // the archive decompresses to much more than estimated: keep every other
+        // checkpoint and record the next ones twice as far apart
+        int i, j = 0;
+        for (i = 0; i < Points.Count; i++)
+        {
+            if (i % 2 == 0)
+                Points[j++] = Points[i];
+            else
+                free(Points[i].Window);
+        }
+        Points.Delete(j, Points.Count - j);
+        PointSpacing.Value *= 2;
+    }
+    NextPointPos = Points[Points.Count - 1].OutPos + PointSpacing;
+}
+
+void CSeekIndex::AddMember(const char* name, CQuadWord headerPos)
+{
+    if (!Recording || Broken)
+        return;
+    CSeekMember member;
+    member.HeaderPos = headerPos;
+    member.Name = _strdup(name);
+    if (member.Name == NULL || strlen(name) > 0xFFFF)
+    {
+        free(member.Name);
+        Broken = TRUE;
+        return;
+    }
+    Members.Add(member);
+    if (!Members.IsGood())
+    {
+        free(member.Name);
+        Broken = TRUE;
+    }
+}
+
+const CSeekMember*
+CSeekIndex::FindMember(const char* name)
+{
+    int i;
+    for (i = 0; i < Members.Count; i++)
+        if (strcmp(Members[i].Name, name) == 0)
+            return &Members[i];
+    return NULL;
+}
+
+const CSeekMember*
+CSeekIndex::FindFirstMember(CNames& names)
+{
+    int i;
+    for (i = 0; i < Members.Count; i++)
+        if (names.IsNamePresent(Members[i].Name))
+            return &Members[i];
+    return NULL;
+}
+
+const CSeekPoint*
+CSeekIndex::FindPoint(CQuadWord outPos)
+{
+    // checkpoints are sorted by OutPos, find the last one not behind 'outPos'
+    int l = 0, r = Points.Count - 1;
+    const CSeekPoint* found = NULL;
+    while (l <= r)
+    {
+        int m = (l + r) / 2;
+        if (Points[m].OutPos <= outPos)
+        {
+            found = &Points[m];
+            l = m + 1;
+        }
+        else
+            r = m - 1;
+    }
+    return found;
+}
+
+// the index of an archive is stored in %TEMP%\SalTarIndex under a name derived from
+// the full archive name; the name itself is stored in the index to detect collisions
+BOOL CSeekIndex::GetCacheName(const char* archiveName, char* cacheName, BOOL create)
+{
+    char path[MAX_PATH];
+    DWORD len = GetTempPath(MAX_PATH, path);
+    if (len == 0 || len + 32 > MAX_PATH)
+        return FALSE;
+    SalamanderGeneral->SalPathAppend(path, "SalTarIndex", MAX_PATH);
+    if (create && GetFileAttributesUtf8Local(path) == INVALID_FILE_ATTRIBUTES &&
+        !CreateDirectoryUtf8Local(path, NULL))
+    {
+        return FALSE;
+    }
+
+    // FNV-1a of the case-insensitive name
+    DWORD hash = 2166136261U;
+    const char* s;
+    for (s = archiveName; *s != 0; s++)
+    {
+        unsigned char c = *s;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        hash = (hash ^ c) * 16777619U;
+    }
+    sprintf(cacheName, "%s\\%08X.idx", path, hash);
+    return TRUE;
+}
+
+BOOL CSeekIndex::Load(const char* archiveName, CQuadWord archiveSize, const FILETIME& lastWrite)
+{
+    CALL_STACK_MESSAGE2("CSeekIndex::Load(%s, , )", archiveName);
+
+    Clear();
+    char cacheName[MAX_PATH];
+    if (!GetCacheName(archiveName, cacheName, FALSE))
+        return FALSE;
+    HANDLE file = CreateFileUtf8Local(cacheName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                      FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    // the index is read at once, it is small compared to the archive
+    DWORD sizeHigh;
+    DWORD size = GetFileSize(file, &sizeHigh);
+    unsigned char* data = NULL;
+    DWORD read = 0;
+    if (size != INVALID_FILE_SIZE && sizeHigh == 0 && size >= sizeof(SSeekIndexHeader) && size <= SEEKIDX_MAX_FILE)
+    {
+        data = (unsigned char*)malloc(size);
+        if (data != NULL && (!ReadFile(file, data, size, &read, NULL) || read != size))
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    CloseHandle(file);
+    if (data == NULL)
+        return FALSE;
+
+    BOOL ok = FALSE;
+    const unsigned char* ptr = data;
+    const unsigned char* end = data + size;
+    const SSeekIndexHeader* header = (const SSeekIndexHeader*)ptr;
+    ptr += sizeof(SSeekIndexHeader);
+    if (header->Signature == SEEKIDX_SIGNATURE && header->Version == SEEKIDX_VERSION &&
+        header->ArchiveSize == archiveSize && CompareFileTime(&header->LastWrite, &lastWrite) == 0 &&
+        header->NameLen == strlen(archiveName) && (DWORD)(end - ptr) >= header->NameLen &&
+        _strnicmp((const char*)ptr, archiveName, header->NameLen) == 0)
+    {
+        ptr += header->NameLen;
+        ok = TRUE;
+        DWORD i;
+        for (i = 0; ok && i < header->PointCount; i++)
+        {
+            if ((DWORD)(end - ptr) < sizeof(SSeekPointRecord) + BUFSIZE)
+            {
+                ok = FALSE;
+                break;
+            }
+            const SSeekPointRecord* rec = (const SSeekPointRecord*)ptr;
+            CSeekPoint point;
+            point.OutPos = rec->OutPos;
+            point.InPos = rec->InPos;
+            point.BitBuffer = rec->BitBuffer;
+            point.BitCount = rec->BitCount;
+            point.Crc = rec->Crc;
+            point.MemberSize = rec->MemberSize;
+            point.WindowPos = rec->WindowPos;
+            point.Window = (unsigned char*)malloc(BUFSIZE);
+            if (point.Window == NULL || point.WindowPos >= BUFSIZE || point.BitCount > 32)
+            {
+                free(point.Window);
+                ok = FALSE;
+                break;
+            }
+            memcpy(point.Window, ptr + sizeof(SSeekPointRecord), BUFSIZE);
+            Points.Add(point);
+            if (!Points.IsGood())
+            {
+                free(point.Window);
+                ok = FALSE;
+            }
+            ptr += sizeof(SSeekPointRecord) + BUFSIZE;
+        }
+        for (i = 0; ok && i < header->MemberCount; i++)
+        {
+            const SSeekMemberRecord* rec = (const SSeekMemberRecord*)ptr;
+            if ((DWORD)(end - ptr) < sizeof(SSeekMemberRecord) ||
+                (DWORD)(end - ptr) < sizeof(SSeekMemberRecord) + rec->NameLen)
+            {
+                ok = FALSE;
+                break;
+            }
+            CSeekMember member;
+            member.HeaderPos = rec->HeaderPos;
+            member.Name = (char*)malloc(rec->NameLen + 1);
+            if (member.Name == NULL)
+            {
+                ok = FALSE;
+                break;
+            }
+            memcpy(member.Name, ptr + sizeof(SSeekMemberRecord), rec->NameLen);
+            member.Name[rec->NameLen] = 0;
+            Members.Add(member);
+            if (!Members.IsGood())
+            {
+                free(member.Name);
+                ok = FALSE;
+            }
+            ptr += sizeof(SSeekMemberRecord) + rec->NameLen;
+        }
+    }
+    free(data);
+    if (!ok)
+    {
+        TRACE_I("CSeekIndex::Load(): no valid index for " << archiveName);
+        Clear();
+    }
+    return ok;
+}
+
+BOOL CSeekIndex::Save(const char* archiveName, CQuadWord archiveSize, const FILETIME& lastWrite)
+{
+    CALL_STACK_MESSAGE2("CSeekIndex::Save(%s, , )", archiveName);
+
+    Recording = FALSE;
+    if (Broken || Points.Count == 0)
+        return FALSE;
+    char cacheName[MAX_PATH];
+    if (!GetCacheName(archiveName, cacheName, TRUE))
+        return FALSE;
+
+    // Load() rejects larger files
+    unsigned __int64 size = sizeof(SSeekIndexHeader) + strlen(archiveName) +
+                            (unsigned __int64)Points.Count * (sizeof(SSeekPointRecord) + BUFSIZE);
+    int i;
+    for (i = 0; i < Members.Count; i++)
+        size += sizeof(SSeekMemberRecord) + strlen(Members[i].Name);
+    if (size > SEEKIDX_MAX_FILE)
+        return FALSE;
+
+    // the file is streamed through a small buffer instead of being built in memory
+    CSeekIndexWriter writer;
+    if (!writer.Create(cacheName))
+        return FALSE;
+    SSeekIndexHeader header;
+    header.Signature = SEEKIDX_SIGNATURE;
+    header.Version = SEEKIDX_VERSION;
+    header.ArchiveSize = archiveSize;
+    header.LastWrite = lastWrite;
+    header.NameLen = (DWORD)strlen(archiveName);
+    header.PointCount = Points.Count;
+    header.MemberCount = Members.Count;
+    writer.Write(&header, sizeof(header));
+    writer.Write(archiveName, header.NameLen);
+    for (i = 0; i < Points.Count; i++)
+    {
+        SSeekPointRecord rec;
+        CSeekPoint* point = &Points[i];
+        rec.OutPos = point->OutPos;
+        rec.InPos = point->InPos;
+        rec.BitBuffer = point->BitBuffer;
+        rec.BitCount = point->BitCount;
+        rec.Crc = point->Crc;
+        rec.MemberSize = point->MemberSize;
+        rec.WindowPos = point->WindowPos;
+        writer.Write(&rec, sizeof(rec));
+        writer.Write(point->Window, BUFSIZE);
+    }
+    for (i = 0; i < Members.Count; i++)
+    {
+        SSeekMemberRecord rec;
+        rec.HeaderPos = Members[i].HeaderPos;
+        rec.NameLen = (WORD)strlen(Members[i].Name);
+        writer.Write(&rec, sizeof(rec));
+        writer.Write(Members[i].Name, rec.NameLen);
+    }
+    BOOL ok = writer.Close();
+    if (!ok)
+        DeleteFileUtf8Local(cacheName); // a partial index would only be rejected by Load()
+
+    // drop indexes of archives which were not listed for a long time
+    char mask[MAX_PATH];
+    strcpy(mask, cacheName);
+    char* name = strrchr(mask, '\\') + 1;
+    strcpy(name, "*.idx");
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    CQuadWord limit(now.dwLowDateTime, now.dwHighDateTime);
+    limit.Value -= (unsigned __int64)SEEK_CACHE_MAX_AGE * 24 * 3600 * 10000000;
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileUtf8Local(mask, &findData);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            CQuadWord fileTime(findData.ftLastWriteTime.dwLowDateTime, findData.ftLastWriteTime.dwHighDateTime);
+            if (fileTime < limit && lstrlen(findData.cFileName) < MAX_PATH - (name - mask))
+            {
+                strcpy(name, findData.cFileName);
+                DeleteFileUtf8Local(mask);
+            }
+        } while (FindNextFileUtf8Local(find, &findData));
+        FindClose(find);
+    }
+    return ok;
+}
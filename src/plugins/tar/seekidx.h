@@ -0,0 +1,85 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// Seek index of a compressed tar archive: decompressor checkpoints recorded
+// during the first listing together with the positions of member headers in
+// the decompressed data. Extraction of a single member can then restart the
+// decompressor at the nearest checkpoint instead of at the start of the archive.
+
+// distance between checkpoints in the decompressed data; it starts at the larger
+// of SEEK_POINT_SPACING and the compressed size / SEEK_MAX_POINTS (the decompressed
+// size is not known during the listing) and doubles, dropping every other checkpoint,
+// whenever SEEK_MAX_POINTS checkpoints are recorded, so their windows never take more
+// than SEEK_MAX_POINTS * BUFSIZE bytes
+#define SEEK_POINT_SPACING 0x1000000 // 16 MB
+#define SEEK_MAX_POINTS 1024
+// smaller archives are decompressed quickly enough without an index
+#define SEEK_MIN_ARCHIVE_SIZE 0x2000000 // 32 MB
+
+// index files in the cache which were not written for this many days are deleted
+#define SEEK_CACHE_MAX_AGE 30
+
+class CNames;
+
+// decompressor checkpoint
+struct CSeekPoint
+{
+    CQuadWord OutPos;      // position in the decompressed data
+    CQuadWord InPos;       // position of the next unread byte of the archive file
+    DWORD BitBuffer;       // bits read from the archive file but not used yet
+    DWORD BitCount;        // number of bits in BitBuffer
+    DWORD Crc;             // CRC of the current compressed member up to OutPos
+    CQuadWord MemberSize;  // number of bytes decompressed from the current member
+    DWORD WindowPos;       // position in Window where decompression continues
+    unsigned char* Window; // BUFSIZE bytes of the decompressed data preceding OutPos (circular)
+};
+
+// position of an archive member in the decompressed data
+struct CSeekMember
+{
+    CQuadWord HeaderPos; // start of the member headers (including long name headers)
+    char* Name;          // name of the member, as in SCommonHeader::Name
+};
+
+class CSeekIndex
+{
+public:
+    CSeekIndex();
+    ~CSeekIndex();
+
+    // prepares recording of a new index for an archive of size 'archiveSize'
+    void StartRecording(CQuadWord archiveSize);
+    // returns TRUE if a checkpoint should be recorded at position 'outPos'
+    BOOL WantPoint(CQuadWord outPos) { return Recording && outPos >= NextPointPos; }
+    // adds a checkpoint, takes over 'point.Window' (also on failure, NULL means out of memory);
+    // thins out the checkpoints when there are SEEK_MAX_POINTS of them
+    void AddPoint(CSeekPoint& point);
+    // adds a member header position
+    void AddMember(const char* name, CQuadWord headerPos);
+
+    // returns the first member with name 'name' or NULL
+    const CSeekMember* FindMember(const char* name);
+    // returns the first member for which 'names' contains its name or NULL
+    const CSeekMember* FindFirstMember(CNames& names);
+    // returns the last checkpoint before position 'outPos' or NULL
+    const CSeekPoint* FindPoint(CQuadWord outPos);
+
+    // loads the index of archive 'archiveName' from the cache, 'archiveSize' and
+    // 'lastWrite' must match the values the index was saved with
+    BOOL Load(const char* archiveName, CQuadWord archiveSize, const FILETIME& lastWrite);
+    // saves the recorded index to the cache (only when it contains some checkpoint)
+    BOOL Save(const char* archiveName, CQuadWord archiveSize, const FILETIME& lastWrite);
+
+protected:
+    TDirectArray<CSeekPoint> Points;
+    TDirectArray<CSeekMember> Members;
+    BOOL Recording;          // TRUE while the index is being recorded
+    BOOL Broken;             // out of memory while recording, the index must not be saved
+    CQuadWord NextPointPos;  // the next checkpoint will be recorded behind this position
+    CQuadWord PointSpacing;  // distance between checkpoints
+
+    void Clear();
+    BOOL GetCacheName(const char* archiveName, char* cacheName, BOOL create);
+};
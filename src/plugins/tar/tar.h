@@ -277,6 +277,8 @@ public:
     virtual BOOL IsOk() = 0;
 };
 
+class CSeekIndex;
+
 class CArchive : public CArchiveAbstract
 {
 private:
@@ -285,6 +287,8 @@ private:
     BOOL Ok;
     CQuadWord Offset;
     DWORD Silent;
+    CSeekIndex* SeekIndex;  // seek index recorded by ListArchive or loaded by SeekToMember
+    BOOL SeekIndexAllowed;  // the archive is a standalone file (not a part of a deb package)
 
     BOOL ListStream(CSalamanderDirectoryAbstract* dir);
     BOOL UnpackStream(const char* targetPath, BOOL doProgress,
@@ -292,6 +296,9 @@ private:
     BOOL GetStreamHeader(SCommonHeader& header);
 
     int ReadArchiveHeader(SCommonHeader& header, BOOL probe);
+    void StartSeekIndex(CQuadWord firstHeaderPos, const char* firstName);
+    void SaveSeekIndex();
+    int SeekToMember(const char* nameInArchive, CNames* names);
     int WriteOutData(const SCommonHeader& header, const char* targetPath,
                      const char* nameInArchive, BOOL simulate, BOOL doProgress);
 
@@ -40,9 +40,10 @@
 //                3 - work-in-progress version before Servant Salamander 2.5 beta 1, removed the *.CPIO viewer
 //                4 - work-in-progress version before Servant Salamander 2.5 beta 1, added .z archives
 //                5 - work-in-progress version before Servant Salamander 2.52 beta 2, added .DEB archives
+//                6 - added TXZ and XZ archives
 
 int ConfigVersion = 0;
-#define CURRENT_CONFIG_VERSION 5
+#define CURRENT_CONFIG_VERSION 6
 const char* CONFIG_VERSION = "Version";
 
 // plugin interface object, its methods are called from Salamander
@@ -158,7 +159,7 @@ CPluginInterfaceAbstract* WINAPI SalamanderPluginEntry(CSalamanderPluginEntryAbs
                                    VERSINFO_VERSION_NO_PLATFORM,
                                    VERSINFO_COPYRIGHT,
                                    LoadStr(IDS_PLUGIN_DESCRIPTION),
-                                   "TAR" /* neprekladat! */, "tar;tgz;taz;tbz;gz;bz;bz2;z;rpm;cpio;deb");
+                                   "TAR" /* neprekladat! */, "tar;tgz;taz;tbz;txz;gz;bz;bz2;xz;z;rpm;cpio;deb");
 
     salamander->SetPluginHomePageURL("www.altap.cz");
 
@@ -169,7 +170,8 @@ void CPluginInterface::About(HWND parent)
 {
     char buf[1000];
     _snprintf_s(buf, _TRUNCATE,
-                "%s " VERSINFO_VERSION "\n\n" VERSINFO_COPYRIGHT "\nbzip2 library Copyright © 1996-2010 Julian R Seward\n\n"
+                "%s " VERSINFO_VERSION "\n\n" VERSINFO_COPYRIGHT "\nbzip2 library Copyright © 1996-2010 Julian R Seward\n"
+                "LZMA SDK by Igor Pavlov (public domain)\n\n"
                 "%s",
                 LoadStr(IDS_PLUGINNAME),
                 LoadStr(IDS_PLUGIN_DESCRIPTION));
@@ -206,16 +208,16 @@ void CPluginInterface::Connect(HWND parent, CSalamanderConnectAbstract* salamand
 
     // base part:
     salamander->AddCustomUnpacker("TAR (Plugin)",
-                                  "*.tar;*.tgz;*.tbz;*.taz;"
-                                  "*.tar.gz;*.tar.bz;*.tar.bz2;*.tar.z;"
-                                  "*_tar.gz;*_tar.bz;*_tar.bz2;*_tar.z;"
-                                  "*_tar_gz;*_tar_bz;*_tar_bz2;*_tar_z;"
-                                  "*.tar_gz;*.tar_bz;*.tar_bz2;*.tar_z;"
-                                  "*.gz;*.bz;*.bz2;*.z;"
+                                  "*.tar;*.tgz;*.tbz;*.taz;*.txz;"
+                                  "*.tar.gz;*.tar.bz;*.tar.bz2;*.tar.z;*.tar.xz;"
+                                  "*_tar.gz;*_tar.bz;*_tar.bz2;*_tar.z;*_tar.xz;"
+                                  "*_tar_gz;*_tar_bz;*_tar_bz2;*_tar_z;*_tar_xz;"
+                                  "*.tar_gz;*.tar_bz;*.tar_bz2;*.tar_z;*.tar_xz;"
+                                  "*.gz;*.bz;*.bz2;*.z;*.xz;"
                                   "*.rpm;*.cpio;*.deb",
-                                  ConfigVersion < 5);                                       // ignored during upgrades except when upgrading to version 4 - required update because of "*.z" and others
-    salamander->AddPanelArchiver("tgz;tbz;taz;tar;gz;bz;bz2;z;rpm;cpio;deb", FALSE, FALSE); // ignored when upgrading the plugin
-    salamander->AddViewer("*.rpm", FALSE);                                                  // ignored when upgrading the plugin except when upgrading from a version without the viewer (the version shipped with SS 2.0)
+                                  ConfigVersion < 6);                                              // ignored during upgrades except when upgrading to version 6 - required update because of "*.xz" and others
+    salamander->AddPanelArchiver("tgz;tbz;taz;txz;tar;gz;bz;bz2;xz;z;rpm;cpio;deb", FALSE, FALSE); // ignored when upgrading the plugin
+    salamander->AddViewer("*.rpm", FALSE);                                                         // ignored when upgrading the plugin except when upgrading from a version without the viewer (the version shipped with SS 2.0)
 
     // section for upgrades:
     if (ConfigVersion < 1) // 1 - work-in-progress version before Servant Salamander 2.5 beta 1, added tbz, bz, bz2, and rpm
@@ -246,6 +248,10 @@ void CPluginInterface::Connect(HWND parent, CSalamanderConnectAbstract* salamand
     {
         salamander->AddPanelArchiver("deb", FALSE, TRUE);
     }
+    if (ConfigVersion < 6) // 6 - added .txz and .xz archives
+    {
+        salamander->AddPanelArchiver("txz;xz", FALSE, TRUE);
+    }
 }
 
 CPluginInterfaceForArchiverAbstract*
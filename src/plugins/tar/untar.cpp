@@ -6,6 +6,7 @@
 #include "dlldefs.h"
 #include "fileio.h"
 #include "tar.h"
+#include "seekidx.h"
 #include "deb/deb.h"
 
 #include "tar.rh"
@@ -176,6 +177,9 @@ CArchive::CArchive(const char* fileName, CSalamanderForOperationsAbstract* salam
     Silent = 0;
     Ok = TRUE;
     Stream = NULL;
+    SeekIndex = NULL;
+    // the cached index is keyed by the archive file, so it cannot describe an embedded stream
+    SeekIndexAllowed = offset == 0 && inputSize == CQuadWord(0, 0);
     SalamanderIf = salamander;
     if (fileName == NULL || salamander == NULL)
     {
@@ -198,6 +202,8 @@ CArchive::~CArchive()
     // we can now close the archive
     if (Stream != NULL)
         delete Stream;
+    if (SeekIndex != NULL)
+        delete SeekIndex;
 }
 
 BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir)
@@ -211,6 +217,7 @@ BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir
     Silent = 0;
     Offset.Set(0, 0);
     SCommonHeader header;
+    CQuadWord headerPos = Stream->GetOutPos();
     int ret = ReadArchiveHeader(header, TRUE);
 
     // if this is not a supported format, unpack only the outer compression when present
@@ -232,6 +239,9 @@ BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir
         return FALSE;
     }
 
+    // record a seek index for later extraction of single files
+    StartSeekIndex(headerPos, header.Name);
+
     // we have an archive, so proceed - decode all files from the archive
     for (;;)
     {
@@ -280,17 +290,24 @@ BOOL CArchive::ListArchive(const char* prefix, CSalamanderDirectoryAbstract* dir
         {
             // Patera 2004.03.02: Return TRUE if TAR file ended exactly at the end
             // of last stream
-            return (ret == TAR_EOF) ? TRUE : FALSE;
+            if (ret != TAR_EOF)
+                return FALSE;
+            break;
         }
 
         // prepare a new header for the next iteration
+        headerPos = Stream->GetOutPos();
         if (ReadArchiveHeader(header, FALSE) != TAR_OK)
             return FALSE;
 
         // reached the end of the archive; finish appropriately
         if (header.Finished)
-            return TRUE;
+            break;
+        if (SeekIndex != NULL && header.Name != NULL)
+            SeekIndex->AddMember(header.Name, headerPos);
     }
+    SaveSeekIndex();
+    return TRUE;
 }
 
 BOOL CArchive::UnpackOneFile(const char* nameInArchive, const CFileData* fileData,
@@ -305,7 +322,12 @@ BOOL CArchive::UnpackOneFile(const char* nameInArchive, const CFileData* fileDat
     Silent = 0;
     Offset.Set(0, 0);
     SCommonHeader header;
-    int ret = ReadArchiveHeader(header, TRUE);
+    // jump close to the file when the archive has a seek index
+    int ret = SeekToMember(nameInArchive, NULL);
+    if (ret == TAR_OK)
+        ret = ReadArchiveHeader(header, FALSE);
+    else if (ret == TAR_NOTAR)
+        ret = ReadArchiveHeader(header, TRUE);
     // if this is not a supported format, unpack only the outer compression when present
     if (ret == TAR_NOTAR && Stream->IsCompressed())
         return UnpackStream(targetPath, FALSE, nameInArchive, NULL, newFileName);
@@ -452,12 +474,17 @@ BOOL CArchive::DoUnpackArchive(const char* targetPath, const char* archiveRoot,
         return FALSE;
 
     CQuadWord filePos, sizeDelta;
-    filePos = Stream->GetStreamPos();
     // first try to detect the archive and read the first header
     Silent = 0;
     Offset.Set(0, 0);
     SCommonHeader header;
-    int ret = ReadArchiveHeader(header, TRUE);
+    // jump close to the first selected file when the archive has a seek index
+    int ret = SeekToMember(NULL, &names);
+    if (ret == TAR_ERROR)
+        return FALSE;
+    BOOL seeked = ret == TAR_OK;
+    filePos = Stream->GetStreamPos();
+    ret = ReadArchiveHeader(header, !seeked);
     // if this is not a supported format, unpack only the outer compression when present
     if (ret == TAR_NOTAR && Stream->IsCompressed())
         return UnpackStream(targetPath, TRUE, NULL, &names, NULL);
@@ -471,6 +498,13 @@ BOOL CArchive::DoUnpackArchive(const char* targetPath, const char* archiveRoot,
     // open the progress dialog
     SalamanderIf->OpenProgressDialog(LoadStr(IDS_UNPACKPROGRESS_TITLE), FALSE, NULL, FALSE);
     SalamanderIf->ProgressSetTotalSize(Stream->GetStreamSize(), CQuadWord(-1, -1));
+    // the skipped part of the archive counts as done
+    if (seeked && !SalamanderIf->ProgressSetSize(filePos, CQuadWord(-1, -1), TRUE))
+    {
+        // handle cancel
+        SalamanderIf->CloseProgressDialog();
+        return FALSE;
+    }
     // update the progress after reading the header
     sizeDelta = filePos;
     filePos = Stream->GetStreamPos();
@@ -871,6 +905,110 @@ int CArchive::SkipBlockPadding(const SCommonHeader& header)
     return TAR_OK;
 } /* CArchive::SkipBlockPadding */
 
+// starts recording the seek index while the archive is being listed
+void CArchive::StartSeekIndex(CQuadWord firstHeaderPos, const char* firstName)
+{
+    CALL_STACK_MESSAGE1("CArchive::StartSeekIndex(, )");
+
+    if (SeekIndex != NULL)
+    {
+        delete SeekIndex;
+        SeekIndex = NULL;
+    }
+    if (!SeekIndexAllowed || !Stream->CanSeek() ||
+        Stream->GetStreamSize() < CQuadWord(SEEK_MIN_ARCHIVE_SIZE, 0))
+        return;
+
+    SeekIndex = new CSeekIndex;
+    if (SeekIndex == NULL)
+        return; // the index is only an optimization
+    SeekIndex->StartRecording(Stream->GetStreamSize());
+    Stream->SetSeekIndex(SeekIndex);
+    if (firstName != NULL)
+        SeekIndex->AddMember(firstName, firstHeaderPos);
+}
+
+// stores the seek index recorded by ListArchive to the cache
+void CArchive::SaveSeekIndex()
+{
+    CALL_STACK_MESSAGE1("CArchive::SaveSeekIndex()");
+
+    if (SeekIndex == NULL)
+        return;
+    Stream->SetSeekIndex(NULL);
+
+    FILETIME lastWrite;
+    CQuadWord fileSize;
+    DWORD fileAttr;
+    Stream->GetFileInfo(lastWrite, fileSize, fileAttr);
+    SeekIndex->Save(Stream->GetArchiveName(), fileSize, lastWrite);
+    delete SeekIndex;
+    SeekIndex = NULL;
+}
+
+// uses the cached seek index to restart decompression close to the header of member
+// 'nameInArchive' (or of the first member contained in 'names'); returns TAR_OK when
+// the stream now continues with the member headers, TAR_NOTAR when there is no usable
+// index (the stream was not touched) and TAR_ERROR on error (already reported)
+int CArchive::SeekToMember(const char* nameInArchive, CNames* names)
+{
+    CALL_STACK_MESSAGE2("CArchive::SeekToMember(%s, )", nameInArchive);
+
+    if (!SeekIndexAllowed || !Stream->CanSeek() ||
+        Stream->GetStreamSize() < CQuadWord(SEEK_MIN_ARCHIVE_SIZE, 0))
+        return TAR_NOTAR;
+
+    if (SeekIndex == NULL)
+    {
+        FILETIME lastWrite;
+        CQuadWord fileSize;
+        DWORD fileAttr;
+        Stream->GetFileInfo(lastWrite, fileSize, fileAttr);
+        SeekIndex = new CSeekIndex;
+        if (SeekIndex == NULL)
+            return TAR_NOTAR;
+        if (!SeekIndex->Load(Stream->GetArchiveName(), fileSize, lastWrite))
+        {
+            delete SeekIndex;
+            SeekIndex = NULL;
+            return TAR_NOTAR;
+        }
+    }
+
+    const CSeekMember* member = names != NULL ? SeekIndex->FindFirstMember(*names) : SeekIndex->FindMember(nameInArchive);
+    if (member == NULL)
+        return TAR_NOTAR;
+    const CSeekPoint* point = SeekIndex->FindPoint(member->HeaderPos);
+    if (point == NULL)
+        return TAR_NOTAR;
+
+    if (!Stream->SeekTo(point))
+    {
+        SalamanderGeneral->ShowMessageBox(LoadErr(Stream->GetErrorCode(), Stream->GetLastErr()),
+                                          LoadStr(IDS_TARERR_TITLE), MSGBOX_ERROR);
+        return TAR_ERROR;
+    }
+    // decompress the rest up to the member headers
+    CQuadWord skip = member->HeaderPos - point->OutPos;
+    while (skip > CQuadWord(0, 0))
+    {
+        unsigned short size = skip > CQuadWord(BUFSIZE, 0) ? BUFSIZE : (unsigned short)skip.Value;
+        if (Stream->GetBlock(size) == NULL)
+        {
+            if (!Stream->IsOk())
+                SalamanderGeneral->ShowMessageBox(LoadErr(Stream->GetErrorCode(), Stream->GetLastErr()),
+                                                  LoadStr(IDS_TARERR_TITLE), MSGBOX_ERROR);
+            else
+                SalamanderGeneral->ShowMessageBox(LoadStr(IDS_ERR_EOF),
+                                                  LoadStr(IDS_TARERR_TITLE), MSGBOX_ERROR);
+            return TAR_ERROR;
+        }
+        skip -= CQuadWord(size, 0);
+    }
+    Offset = member->HeaderPos;
+    return TAR_OK;
+}
+
 // reads a block header in the archive (with type auto-detection)
 int CArchive::ReadArchiveHeader(SCommonHeader& header, BOOL probe)
 {
@@ -0,0 +1,158 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "../dlldefs.h"
+#include "../fileio.h"
+#include "xz.h"
+
+#include "../../7zip/7za/c/7zCrc.h"
+#include "../../7zip/7za/c/XzCrc64.h"
+#include "../../7zip/7za/c/Xz.h"
+
+#include "..\tar.rh"
+#include "..\tar.rh2"
+#include "..\lang\lang.rh"
+
+struct CXzState
+{
+    CXzUnpacker Unpacker;
+};
+
+static void* XzAlloc(void* p, size_t size) { return malloc(size); }
+static void XzFree(void* p, void* address) { free(address); }
+static ISzAlloc XzAllocator = {XzAlloc, XzFree};
+
+static BOOL XzTablesReady = FALSE;
+
+CXZip::CXZip(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize) : CZippedFile(filename, file, buffer, start, read, inputSize), EndReached(FALSE), State(NULL), InBuf(NULL)
+{
+    CALL_STACK_MESSAGE2("CXZip::CXZip(%s, , , )", filename);
+
+    // if the parent constructor failed, bail out immediately
+    if (!Ok)
+        return;
+
+    // if the stream header signature is not at the start, it is not an xz stream
+    if (DataEnd - DataStart < XZ_SIG_SIZE || memcmp(DataStart, XZ_SIG, XZ_SIG_SIZE) != 0)
+    {
+        Ok = FALSE;
+        FreeBufAndFile = FALSE;
+        return;
+    }
+    // the rest of the header (flags and its CRC) is verified by the decoder
+
+    State = (CXzState*)malloc(sizeof(CXzState));
+    InBuf = (unsigned char*)malloc(XZ_INBUF_SIZE);
+    if (State == NULL || InBuf == NULL)
+    {
+        if (State != NULL)
+            free(State);
+        State = NULL;
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_MEMORY;
+        FreeBufAndFile = FALSE;
+        return;
+    }
+    if (!XzTablesReady)
+    {
+        CrcGenerateTable();
+        Crc64GenerateTable();
+        XzTablesReady = TRUE;
+    }
+    XzUnpacker_Construct(&State->Unpacker, &XzAllocator);
+    // done
+}
+
+CXZip::~CXZip()
+{
+    CALL_STACK_MESSAGE1("CXZip::~CXZip()");
+    if (State != NULL)
+    {
+        XzUnpacker_Free(&State->Unpacker);
+        free(State);
+    }
+    if (InBuf != NULL)
+        free(InBuf);
+}
+
+// the detection buffer is consumed, reads the next part of the archive into InBuf
+BOOL CXZip::FillInput()
+{
+    if (StreamPos >= InputSize)
+    {
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_EOF;
+        return FALSE;
+    }
+    DWORD read = XZ_INBUF_SIZE;
+    if (StreamPos + CQuadWord(read, 0) > InputSize)
+        read = (DWORD)(InputSize - StreamPos).Value;
+    if (!ReadFile(File, InBuf, read, &read, NULL))
+    {
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_FREAD;
+        LastError = GetLastError();
+        return FALSE;
+    }
+    if (read == 0)
+    {
+        Ok = FALSE;
+        ErrorCode = IDS_ERR_EOF;
+        return FALSE;
+    }
+    DataStart = InBuf;
+    DataEnd = InBuf + read;
+    return TRUE;
+}
+
+BOOL CXZip::DecompressBlock(unsigned short needed)
+{
+    if (EndReached)
+        return TRUE;
+    while (ExtrEnd < Window + BUFSIZE)
+    {
+        if (DataStart == DataEnd)
+        {
+            // concatenated streams may follow, so the end is known only at the end of the archive
+            if (StreamPos >= InputSize && XzUnpacker_IsStreamWasFinished(&State->Unpacker))
+            {
+                EndReached = TRUE;
+                break;
+            }
+            if (!FillInput())
+                return FALSE;
+        }
+        SizeT srcLen = DataEnd - DataStart;
+        SizeT destLen = Window + BUFSIZE - ExtrEnd;
+        ECoderStatus status;
+        SRes ret = XzUnpacker_Code(&State->Unpacker, ExtrEnd, &destLen, DataStart, &srcLen,
+                                   CODER_FINISH_ANY, &status);
+        if (ret != SZ_OK)
+        {
+            Ok = FALSE;
+            switch (ret)
+            {
+            case SZ_ERROR_DATA:
+            case SZ_ERROR_CRC:
+            case SZ_ERROR_UNSUPPORTED:
+            case SZ_ERROR_NO_ARCHIVE:
+            case SZ_ERROR_ARCHIVE:
+                ErrorCode = IDS_ERR_CORRUPT;
+                break;
+            case SZ_ERROR_MEM:
+                ErrorCode = IDS_ERR_MEMORY;
+                break;
+            default:
+                ErrorCode = IDS_ERR_INTERNAL;
+                break;
+            }
+            return FALSE;
+        }
+        DataStart += srcLen;
+        StreamPos += CQuadWord((DWORD)srcLen, 0);
+        ExtrEnd += destLen;
+    }
+    return TRUE;
+}
@@ -0,0 +1,29 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// xz streams are decoded by the LZMA SDK shipped with the 7-Zip plugin (7zip/7za/c)
+
+#define XZ_INBUF_SIZE (1024 * 1024) // read-ahead, the archive is read by this much
+
+struct CXzState;
+
+class CXZip : public CZippedFile
+{
+public:
+    CXZip(const char* filename, HANDLE file, unsigned char* buffer, unsigned long start, unsigned long read, CQuadWord inputSize);
+    virtual ~CXZip();
+
+    // the unpacked size is stored only in the index at the end of the stream
+    virtual BOOL BuggySize() { return TRUE; }
+
+protected:
+    BOOL EndReached;      // set, when all data was extracted
+    CXzState* State;      // decoder state (unxz.cpp)
+    unsigned char* InBuf; // read-ahead buffer, DataStart and DataEnd point into it once
+                          // the data from the detection buffer is consumed
+
+    virtual BOOL DecompressBlock(unsigned short needed);
+    BOOL FillInput();
+};
@@ -41,3 +41,149 @@ const wchar_t* const CMFTSnapshot<wchar_t>::STRING_EFS = L"$EFS";
 
 const char* const CMFTSnapshot<char>::STRING_BITMAP = "$Bitmap";
 const wchar_t* const CMFTSnapshot<wchar_t>::STRING_BITMAP = L"$Bitmap";
+
+// **************************************************************************************
+//
+//   CMFTArena
+//
+
+CMFTArena::CMFTArena()
+{
+    Block = NULL;
+    BlockSize = 0;
+    Used = 0;
+}
+
+void* CMFTArena::Alloc(DWORD size)
+{
+    size = (size + 7) & ~7;
+    if (Block == NULL || Used + size > BlockSize)
+    {
+        DWORD blockSize = max(MFT_ARENA_BLOCK, size + 8);
+        BYTE* block = new BYTE[blockSize];
+        if (block == NULL)
+            return NULL;
+        *(BYTE**)block = Block;
+        Block = block;
+        BlockSize = blockSize;
+        Used = 8;
+    }
+    void* ret = Block + Used;
+    Used += size;
+    memset(ret, 0, size);
+    return ret;
+}
+
+void CMFTArena::Free()
+{
+    while (Block != NULL)
+    {
+        BYTE* prev = *(BYTE**)Block;
+        delete[] Block;
+        Block = prev;
+    }
+    BlockSize = 0;
+    Used = 0;
+}
+
+// **************************************************************************************
+//
+//   CMFTParsePool
+//
+
+CMFTParsePool::CMFTParsePool()
+{
+    Threads = 0;
+    ZeroMemory(Workers, sizeof(Workers));
+    Func = NULL;
+    Param = NULL;
+    Terminate = FALSE;
+}
+
+CMFTParsePool::~CMFTParsePool()
+{
+    CALL_STACK_MESSAGE1("CMFTParsePool::~CMFTParsePool()");
+    Terminate = TRUE;
+    int i;
+    for (i = 0; i < Threads; i++)
+    {
+        if (Workers[i].Thread != NULL)
+        {
+            SetEvent(Workers[i].Start); // wake up the worker, it ends
+            WaitForSingleObject(Workers[i].Thread, INFINITE);
+            CloseHandle(Workers[i].Thread);
+        }
+    }
+    for (i = 0; i < MFT_MAX_THREADS - 1; i++)
+    {
+        if (Workers[i].Start != NULL)
+            CloseHandle(Workers[i].Start);
+        if (Workers[i].Done != NULL)
+            CloseHandle(Workers[i].Done);
+    }
+}
+
+BOOL CMFTParsePool::Init()
+{
+    CALL_STACK_MESSAGE1("CMFTParsePool::Init()");
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors < 2)
+        return FALSE;
+    int threads = min((int)si.dwNumberOfProcessors, MFT_MAX_THREADS) - 1; // the calling thread parses too
+
+    for (int i = 0; i < threads; i++)
+    {
+        CWorker* worker = &Workers[i];
+        worker->Pool = this;
+        worker->Slice = i;
+        worker->Start = CreateEvent(NULL, FALSE, FALSE, NULL);
+        worker->Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (worker->Start == NULL || worker->Done == NULL)
+            return FALSE;
+        DoneEvents[i] = worker->Done;
+        Threads = i + 1; // the destructor cleans up the threads created so far
+        DWORD id;
+        worker->Thread = CreateThread(NULL, 0, ThreadBody, worker, 0, &id);
+        if (worker->Thread == NULL)
+        {
+            TRACE_E("CMFTParsePool::Init(): unable to start worker thread");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void CMFTParsePool::Run(FMFTParseSlice func, void* param)
+{
+    Func = func;
+    Param = param;
+    int i;
+    for (i = 0; i < Threads; i++)
+        SetEvent(Workers[i].Start);
+    func(param, Threads, Threads + 1);
+    WaitForMultipleObjects(Threads, DoneEvents, TRUE, INFINITE);
+}
+
+DWORD WINAPI
+CMFTParsePool::ThreadBody(void* param)
+{
+    return SalamanderDebug->CallWithCallStack(WorkerBody, param);
+}
+
+unsigned WINAPI
+CMFTParsePool::WorkerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CMFTParsePool::WorkerBody()");
+    CWorker* worker = (CWorker*)param;
+    CMFTParsePool* pool = worker->Pool;
+    while (1)
+    {
+        WaitForSingleObject(worker->Start, INFINITE);
+        if (pool->Terminate)
+            break;
+        pool->Func(pool->Param, worker->Slice, pool->Threads + 1);
+        SetEvent(worker->Done);
+    }
+    return 0;
+}
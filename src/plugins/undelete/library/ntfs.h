@@ -110,6 +110,71 @@ struct ATTRIBUTE_VOLUME_INFORMATION
 
 #pragma pack(pop, ntfs_h)
 
+#define MFT_READ_SIZE (1024 * 1024) // how much of MFT we read in one time (in bytes)
+#define MFT_MAX_THREADS 16          // max. number of threads parsing MFT records (incl. the calling one)
+#define MFT_ARENA_BLOCK (64 * 1024) // size of memory blocks of CMFTArena
+
+// CMFTArena - allocates MFT records and their names in large blocks, the memory is
+// zeroed and it is released all at once by Free(); not thread safe, each thread
+// parsing MFT records has its own arena
+
+class CMFTArena
+{
+public:
+    CMFTArena();
+    ~CMFTArena() { Free(); }
+
+    void* Alloc(DWORD size); // returns NULL if out of memory
+    void Free();
+
+protected:
+    BYTE* Block; // current block, it starts with the pointer to the previous block
+    DWORD BlockSize;
+    DWORD Used;
+};
+
+// CMFTParsePool - threads parsing MFT records of one read chunk, the chunk is
+// split into slices and each slice is parsed on one thread
+
+typedef void (*FMFTParseSlice)(void* param, int slice, int slices);
+
+class CMFTParsePool
+{
+public:
+    CMFTParsePool();
+    ~CMFTParsePool(); // stops the threads
+
+    // starts the threads; returns FALSE if it is not worth it (single processor)
+    // or the threads cannot be started, the pool then must not be used
+    BOOL Init();
+
+    int GetSlices() { return Threads + 1; }
+
+    // calls 'func' for all slices at once, the last slice is processed on the calling
+    // thread; returns when all slices are done
+    void Run(FMFTParseSlice func, void* param);
+
+protected:
+    struct CWorker
+    {
+        CMFTParsePool* Pool;
+        int Slice;
+        HANDLE Thread;
+        HANDLE Start; // signaled when the worker should process its slice
+        HANDLE Done;  // signaled when the slice is done
+    };
+
+    int Threads;
+    CWorker Workers[MFT_MAX_THREADS - 1];
+    HANDLE DoneEvents[MFT_MAX_THREADS - 1];
+    FMFTParseSlice Func;
+    void* Param;
+    BOOL Terminate;
+
+    static DWORD WINAPI ThreadBody(void* param);
+    static unsigned WINAPI WorkerBody(void* param);
+};
+
 template <typename CHAR>
 class CMFTSnapshot : public CSnapshot<CHAR>
 {
@@ -123,7 +188,11 @@ public:
     QWORD MFTItems;
 
 private:
-    BOOL ParseRecord(BYTE* data, QWORD index);
+    int ParseRecord(BYTE* data, QWORD index, CMFTArena* arena, BOOL& errorsFound);
+    CHAR* NewName(CMFTArena* arena, const WCHAR* src, DWORD srclen);
+    void FreeMFTRecord(FILE_RECORD_I<CHAR>* record);
+    void ClassifyChunk();
+    static void ParseSlice(void* param, int slice, int slices);
     BOOL BuildDirectoryTree();
     BOOL IsValidRef(QWORD fileref);
     void Mark(FILE_RECORD_I<CHAR>* r, DWORD depth);
@@ -155,6 +224,24 @@ private:
     QWORD ClustersProcessed; // current progress in clusters
     QWORD ClustersTotal;     // total progress in clusters
 
+    // MFT records are allocated in arenas, one for each slice (the serial parsing uses the first one)
+    CMFTArena Arenas[MFT_MAX_THREADS];
+
+    // chunk of MFT being parsed: records with ChunkSerial[k] == FALSE are parsed in
+    // slices (possibly in parallel), the rest afterwards in the order of MFT
+    BYTE* ChunkData;
+    QWORD ChunkFirst;  // index of the first record of the chunk
+    DWORD ChunkCount;  // number of records in the chunk
+    BYTE* ChunkSerial; // see above
+
+    struct CSliceResult
+    {
+        int Error;        // 0 = OK, otherwise IDS_xxx of the first failed record
+        QWORD ErrorIndex; // index of the first failed record
+        BOOL ErrorsFound; // see ErrorsFound
+    };
+    CSliceResult SliceResults[MFT_MAX_THREADS];
+
     static const CHAR* const STRING_EMPTY;
     static const CHAR* const STRING_DOT;
     static const CHAR* const STRING_MFT;
@@ -176,6 +263,10 @@ CMFTSnapshot<CHAR>::CMFTSnapshot(CVolume<CHAR>* volume)
 {
     MFT = NULL;
     RootAllocated = FALSE;
+    ChunkData = NULL;
+    ChunkFirst = 0;
+    ChunkCount = 0;
+    ChunkSerial = NULL;
 }
 
 #ifdef TRACE_ENABLE
@@ -213,7 +304,23 @@ void CMFTSnapshot<CHAR>::DumpHexData(BYTE* data, DWORD len)
 #endif
 
 template <typename CHAR>
-BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
+CHAR* CMFTSnapshot<CHAR>::NewName(CMFTArena* arena, const WCHAR* src, DWORD srclen)
+{
+    CALL_STACK_MESSAGE_NONE
+    // the same as String<CHAR>::NewFromUnicode, just allocated in 'arena'
+    DWORD destlen = srclen;
+    if (sizeof(CHAR) == 1)
+        destlen = WideCharToMultiByte(CP_ACP, 0, src, srclen, NULL, 0, NULL, NULL);
+    CHAR* dest = (CHAR*)arena->Alloc((destlen + 1) * sizeof(CHAR));
+    if (dest == NULL)
+        return NULL;
+    return String<CHAR>::CopyFromUnicode(dest, src, srclen, destlen + 1);
+}
+
+// parses one MFT record; it may run on several threads at once (see Update()), so
+// it does not report errors, it returns 0 or IDS_xxx of the error instead
+template <typename CHAR>
+int CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index, CMFTArena* arena, BOOL& errorsFound)
 {
     CALL_STACK_MESSAGE_NONE
     //CALL_STACK_MESSAGE2("CMFTSnapshot::ParseRecord(, %d)", index);
@@ -231,7 +338,7 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
       return Error(IDS_UNDELETE, IDS_ERRORMETADAMAGED); // metafiles must be OK
     else*/
         // fixme // update: on NT4 are records 16-24 unused and doesn't have header, we can skip this check
-        return TRUE; // looks like one of 'BAAD' records, skip it
+        return 0; // looks like one of 'BAAD' records, skip it
     }
 
     if (!meta && !(this->UdFlags & UF_SHOWEXISTING))
@@ -239,7 +346,7 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
         // if it isn't directory and record is used, skip it
         // don't take rheader->BaseRecord into account here, we want to hide (existing) files with BaseRecord != 0
         if (!(rheader->FRHFlags & FRHFLAG_RECORD_IS_DIRECTORY) && (rheader->FRHFlags & FRHFLAG_RECORD_IS_IN_USE))
-            return TRUE;
+            return 0;
     }
 
     WORD* update = (WORD*)(data + rheader->UpdateOffset);
@@ -249,14 +356,14 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
     {
         if (*lastw != seqnum)
         {
-            ErrorsFound = TRUE;
+            errorsFound = TRUE;
             TRACE_E("MFT entry index " << index << " is corrupted "
                                        << "(i = " << i << ")");
             DumpHexData(data, BytesPerMFTRecord);
             if (index == 0)
-                return String<CHAR>::Error(IDS_UNDELETE, IDS_MFTRECORDDAMAGED); // we cannot skip MFT
+                return IDS_MFTRECORDDAMAGED; // we cannot skip MFT
             else
-                return TRUE;
+                return 0;
         }
         *lastw = *update++;
         lastw += this->Volume->NTFSBoot.BytesPerSector / 2;
@@ -266,7 +373,7 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
     if (rheader->BaseRecord != 0)
     {
         if (index == 0)
-            return String<CHAR>::Error(IDS_UNDELETE, IDS_MFTRECORDDAMAGED);
+            return IDS_MFTRECORDDAMAGED;
 
         QWORD oldindex = index;
         index = LODWORD(rheader->BaseRecord);
@@ -282,9 +389,9 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
     FILE_RECORD_I<CHAR>*& mftr = MFT[index];
     if (mftr == NULL)
     {
-        mftr = new FILE_RECORD_I<CHAR>;
+        mftr = (FILE_RECORD_I<CHAR>*)arena->Alloc(sizeof(FILE_RECORD_I<CHAR>));
         if (mftr == NULL)
-            return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+            return IDS_LOWMEM;
     }
     FILE_RECORD_I<CHAR>* record = mftr;
 
@@ -355,19 +462,17 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
             // do we need record?
             if (fname == NULL)
             {
-                fname = new FILE_NAME_I<CHAR>;
+                fname = (FILE_NAME_I<CHAR>*)arena->Alloc(sizeof(FILE_NAME_I<CHAR>));
                 if (fname == NULL)
-                    return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                    return IDS_LOWMEM;
                 fname->FNNext = record->FileNames;
                 record->FileNames = fname;
             }
 
-            // store name
-            if (fname->FNName != NULL)
-                delete[] fname->FNName;
-            fname->FNName = String<CHAR>::NewFromUnicode(attr->FileName, attr->FileNameLength);
+            // store name (the overwritten one stays in the arena)
+            fname->FNName = NewName(arena, attr->FileName, attr->FileNameLength);
             if (fname->FNName == NULL)
-                return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                return IDS_LOWMEM;
             fname->ParentRecord = attr->ParentDir;
             break;
         }
@@ -380,7 +485,7 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
             // do we have already stream with same name?
             CHAR streamname[MAX_PATH];
             if (!String<CHAR>::CopyFromUnicode(streamname, (WCHAR*)(data + offset + aheader->NameOffset), aheader->NameLength, MAX_PATH))
-                return String<CHAR>::Error(IDS_UNDELETE, IDS_READINGMFT);
+                return IDS_READINGMFT;
 
             // for attribute $LOGGED_UTILITY_STREAM we are interested only in these related to EFS
             if (aheader->Type == $LOGGED_UTILITY_STREAM && String<CHAR>::StrICmp(streamname, STRING_EFS))
@@ -400,12 +505,12 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
             {
                 stream = new DATA_STREAM_I<CHAR>;
                 if (stream == NULL)
-                    return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                    return IDS_LOWMEM;
                 if (aheader->NameLength)
                 {
                     stream->DSName = String<CHAR>::NewStr(streamname);
                     if (stream->DSName == NULL)
-                        return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                        return IDS_LOWMEM;
                 }
                 stream->DSNext = NULL;
                 *lastptr = stream;
@@ -416,14 +521,14 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
             {
                 DATA_POINTERS* ptrs = new DATA_POINTERS;
                 if (ptrs == NULL)
-                    return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                    return IDS_LOWMEM;
                 ptrs->DPFlags = aheader->SAHFlags;
                 ptrs->StartVCN = aheader->StartVCN;
                 ptrs->LastVCN = aheader->LastVCN;
                 ptrs->RunsSize = aheader->Length - aheader->DataRunsOffset;
                 ptrs->Runs = new BYTE[ptrs->RunsSize];
                 if (ptrs->Runs == NULL)
-                    return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                    return IDS_LOWMEM;
                 memcpy(ptrs->Runs, data + offset + aheader->DataRunsOffset, ptrs->RunsSize);
                 ptrs->CompUnit = aheader->CompressionUnit;
 
@@ -456,7 +561,7 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
                     delete[] stream->ResidentData;
                 stream->ResidentData = new BYTE[aheader->AttrLength];
                 if (stream->ResidentData == NULL)
-                    return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
+                    return IDS_LOWMEM;
                 memcpy(stream->ResidentData, data + offset + aheader->AttrOffset, aheader->AttrLength);
                 stream->DSSize = aheader->AttrLength;
                 stream->DSValidSize = stream->DSSize; // for resident data is valid data same as DSSize
@@ -524,10 +629,62 @@ BOOL CMFTSnapshot<CHAR>::ParseRecord(BYTE* data, QWORD index)
     }
 #endif
 
-    return TRUE;
+    return 0;
+}
+
+template <typename CHAR>
+void CMFTSnapshot<CHAR>::ClassifyChunk()
+{
+    CALL_STACK_MESSAGE_NONE
+    // CALL_STACK_MESSAGE1("CMFTSnapshot::ClassifyChunk()");
+
+    // extension records change the record of their base record, so they are parsed
+    // serially in the order of MFT; the same applies to base records changed by some
+    // extension record preceding them in the chunk or in an earlier chunk (their item
+    // of MFT exists already); the rest (almost all records) creates just its own item
+    // of MFT and can be parsed in parallel
+    // (the header is not touched by the fixup, it can be read before ParseRecord())
+    memset(ChunkSerial, 0, ChunkCount);
+    for (DWORD k = 0; k < ChunkCount; k++)
+    {
+        if (MFT[ChunkFirst + k] != NULL)
+            ChunkSerial[k] = TRUE;
+        FILE_RECORD_HEADER* rheader = (FILE_RECORD_HEADER*)(ChunkData + k * BytesPerMFTRecord);
+        if (rheader->Signature == FILE_RECORD_SIGNATURE && rheader->BaseRecord != 0)
+        {
+            ChunkSerial[k] = TRUE;
+            QWORD base = LODWORD(rheader->BaseRecord);
+            if (base > ChunkFirst + k && base < ChunkFirst + ChunkCount)
+                ChunkSerial[base - ChunkFirst] = TRUE;
+        }
+    }
+}
+
+template <typename CHAR>
+void CMFTSnapshot<CHAR>::ParseSlice(void* param, int slice, int slices)
+{
+    CALL_STACK_MESSAGE_NONE
+    // CALL_STACK_MESSAGE3("CMFTSnapshot::ParseSlice(, %d, %d)", slice, slices);
+    CMFTSnapshot<CHAR>* snapshot = (CMFTSnapshot<CHAR>*)param;
+    CSliceResult* result = &snapshot->SliceResults[slice];
+    DWORD first = (DWORD)((QWORD)snapshot->ChunkCount * slice / slices);
+    DWORD last = (DWORD)((QWORD)snapshot->ChunkCount * (slice + 1) / slices);
+    for (DWORD k = first; k < last; k++)
+    {
+        QWORD index = snapshot->ChunkFirst + k;
+        if (index == 0 || snapshot->ChunkSerial[k])
+            continue; // first record is parsed already, serial ones are parsed later
+        int err = snapshot->ParseRecord(snapshot->ChunkData + k * snapshot->BytesPerMFTRecord, index,
+                                        &snapshot->Arenas[slice], result->ErrorsFound);
+        if (err != 0)
+        {
+            result->Error = err;
+            result->ErrorIndex = index;
+            break;
+        }
+    }
 }
 
-#define BUFSIZE 16 // how much MFT clusters we read in one time
 #define DIVROUNDUP(a, b) (((a) + (b) - 1) / (b))
 
 template <typename CHAR>
@@ -579,7 +736,7 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
     //DumpHexData(firstrec, BytesPerMFTRecord);
 
     // get info from first record
-    FILE_RECORD_I<CHAR>* mft = new FILE_RECORD_I<CHAR>;
+    FILE_RECORD_I<CHAR>* mft = (FILE_RECORD_I<CHAR>*)Arenas[0].Alloc(sizeof(FILE_RECORD_I<CHAR>));
     if (mft == NULL)
     {
         delete[] firstrec;
@@ -587,11 +744,13 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
     }
     MFT = &mft;
     MFTItems = 1;
-    if (!ParseRecord(firstrec, 0))
+    int err = ParseRecord(firstrec, 0, &Arenas[0], ErrorsFound);
+    if (err != 0)
     {
+        String<CHAR>::Error(IDS_UNDELETE, err);
         TRACE_I("CMFTSnapshot::Update: ParseRecord failed on first record");
         delete[] firstrec;
-        this->FreeRecord(mft);
+        FreeMFTRecord(mft);
         MFT = NULL;
         return FALSE;
     }
@@ -604,7 +763,7 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
         String<CHAR>::StrICmp(mft->FileNames->FNName, STRING_MFT))  // name: $MFT
     {
         TRACE_I("MFT looks corrupted");
-        this->FreeRecord(mft);
+        FreeMFTRecord(mft);
         MFT = NULL;
         return String<CHAR>::Error(IDS_UNDELETE, IDS_MFTRECORDDAMAGED);
     }
@@ -613,12 +772,17 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
     MFTItems = mft->Streams->DSSize / BytesPerMFTRecord;
     TRACE_I("MFTItems=" << MFTItems);
     MFT = new FILE_RECORD_I<CHAR>*[(size_t)MFTItems];
-    BYTE* buffer = new BYTE[BUFSIZE * this->Volume->BytesPerCluster];
-    if (MFT == NULL || buffer == NULL)
+    DWORD readClusters = max(MFT_READ_SIZE / this->Volume->BytesPerCluster, clustersPerMFTRecord);
+    readClusters -= readClusters % clustersPerMFTRecord; // read whole records only
+    BYTE* buffer = new BYTE[readClusters * this->Volume->BytesPerCluster];
+    ChunkSerial = new BYTE[DIVROUNDUP(readClusters * this->Volume->BytesPerCluster, BytesPerMFTRecord)];
+    if (MFT == NULL || buffer == NULL || ChunkSerial == NULL)
     {
         delete[] MFT;
         delete[] buffer;
-        this->FreeRecord(mft);
+        delete[] ChunkSerial;
+        ChunkSerial = NULL;
+        FreeMFTRecord(mft);
         MFT = NULL;
         return String<CHAR>::Error(IDS_UNDELETE, IDS_LOWMEM);
     }
@@ -643,13 +807,27 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
     BOOL ret = TRUE;
     BOOL canceled = FALSE;
 
+    // records of each read chunk are parsed on all processors (see ClassifyChunk())
+    CMFTParsePool pool;
+    BOOL parallel = pool.Init();
+    int slices = parallel ? pool.GetSlices() : 1;
+    memset(SliceResults, 0, sizeof(SliceResults));
+    DWORD startTime = GetTickCount();
+
     while (clustleft && i < MFTItems)
     {
-        QWORD n = min(clustleft, BUFSIZE);
+        QWORD n = min(clustleft, readClusters);
         if (!reader.IsSafeChunk(n))
-            n = clustersPerMFTRecord; // if we are nearing end of fragment, we need to read
-        // with minimized blocks because there could come extension record for $MFT, which we would not process
-        // and stream reader would go out of runs
+        {
+            // if we are nearing end of fragment, we need to read just to its end because
+            // there could come extension record for $MFT, which we would not process
+            // and stream reader would go out of runs; the next fragment starts with
+            // one record read in a minimized block
+            n = reader.GetRunLeft();
+            n -= n % clustersPerMFTRecord;
+            if (n == 0)
+                n = clustersPerMFTRecord;
+        }
 
         if (!reader.GetClusters(buffer, n))
         {
@@ -659,15 +837,65 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
             break;
         }
 
-        for (QWORD j = 0; j < (n * this->Volume->BytesPerCluster) && i < MFTItems; i++)
+        ChunkData = buffer;
+        ChunkFirst = i;
+        ChunkCount = (DWORD)min(DIVROUNDUP(n * this->Volume->BytesPerCluster, BytesPerMFTRecord), MFTItems - i);
+        if (parallel)
+        {
+            ClassifyChunk();
+            pool.Run(ParseSlice, this);
+        }
+        else
+        {
+            memset(ChunkSerial, 0, ChunkCount);
+            ParseSlice(this, 0, 1);
+        }
+
+        // find the first failed record, the serial ones behind it are not parsed
+        QWORD failed = i + ChunkCount;
+        err = 0;
+        for (int s = 0; s < slices; s++)
         {
-            if (i && !ParseRecord(buffer + j, i))
+            if (SliceResults[s].Error != 0 && SliceResults[s].ErrorIndex < failed)
             {
-                TRACE_I("CMFTSnapshot::Update: ParseRecord failed");
-                ret = FALSE;
-                break;
+                failed = SliceResults[s].ErrorIndex;
+                err = SliceResults[s].Error;
             }
-            j += BytesPerMFTRecord;
+        }
+        for (DWORD k = 0; k < ChunkCount && i + k < failed; k++)
+        {
+            if (ChunkSerial[k] && i + k != 0)
+            {
+                int e = ParseRecord(buffer + k * BytesPerMFTRecord, i + k, &Arenas[0], ErrorsFound);
+                if (e != 0)
+                {
+                    failed = i + k;
+                    err = e;
+                    break;
+                }
+            }
+        }
+        if (err != 0 && parallel)
+        {
+            // slices have parsed records behind the failed one too, but not the serial
+            // (extension) records among them; drop the items of MFT the slices have
+            // created there, the result is the same as if the records were parsed one
+            // by one
+            for (QWORD j = failed + 1; j < i + ChunkCount; j++)
+            {
+                if (!ChunkSerial[j - i] && MFT[j] != NULL)
+                {
+                    FreeMFTRecord(MFT[j]);
+                    MFT[j] = NULL;
+                }
+            }
+        }
+        i = failed;
+        if (err != 0)
+        {
+            String<CHAR>::Error(IDS_UNDELETE, err);
+            TRACE_I("CMFTSnapshot::Update: ParseRecord failed");
+            ret = FALSE;
         }
 
         if ((i - lastprogress >= 512) || i == MFTItems)
@@ -688,6 +916,15 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
     }
 
     delete[] buffer;
+    delete[] ChunkSerial;
+    ChunkData = NULL;
+    ChunkSerial = NULL;
+    for (int s = 0; s < slices; s++)
+    {
+        if (SliceResults[s].ErrorsFound)
+            ErrorsFound = TRUE;
+    }
+    TRACE_I("MFT parsed in " << GetTickCount() - startTime << " ms (" << slices << " slices, " << i << " records)");
 
     // we ended with error but if we have something, don't throw it away
     if (!ret && !canceled && i > MAX_METAFILES && i < MFTItems)
@@ -706,7 +943,9 @@ BOOL CMFTSnapshot<CHAR>::Update(CSnapshotProgressDlg* progress, DWORD udFlags, C
     if (ret)
     {
         progress->SetProgressText(IDS_ANALYZINGDIRS);
+        startTime = GetTickCount();
         ret = BuildDirectoryTree();
+        TRACE_I("Directory tree built in " << GetTickCount() - startTime << " ms");
         if (ret)
         {
             if (this->UdFlags & UF_ESTIMATEDAMAGE)
@@ -736,13 +975,15 @@ void CMFTSnapshot<CHAR>::Free()
         for (QWORD i = 0; i < MFTItems; i++)
         {
             if (MFT[i] != NULL)
-                delete this->FreeRecord(MFT[i]);
+                FreeMFTRecord(MFT[i]);
         }
 
         delete[] MFT;
         MFT = NULL;
         MFTItems = 0;
     }
+    for (int i = 0; i < MFT_MAX_THREADS; i++)
+        Arenas[i].Free();
 
     // release Root if it was allocated
     if (RootAllocated)
@@ -758,6 +999,16 @@ void CMFTSnapshot<CHAR>::Free()
     VirtualDirs.DestroyMembers();
 }
 
+// records of MFT, their names and hardlinks are in Arenas, only the rest is released here
+template <typename CHAR>
+void CMFTSnapshot<CHAR>::FreeMFTRecord(FILE_RECORD_I<CHAR>* record)
+{
+    CALL_STACK_MESSAGE_NONE
+    // CALL_STACK_MESSAGE1("CMFTSnapshot::FreeMFTRecord()");
+    record->FileNames = NULL;
+    this->FreeRecord(record);
+}
+
 template <typename CHAR>
 inline BOOL CMFTSnapshot<CHAR>::IsValidRef(QWORD fileref)
 {
@@ -897,7 +1148,7 @@ BOOL CMFTSnapshot<CHAR>::BuildDirectoryTree()
     {
         if (MFT[i] != NULL && MFT[i]->FileNames == NULL)
         {
-            delete this->FreeRecord(MFT[i]);
+            FreeMFTRecord(MFT[i]);
             MFT[i] = NULL;
         }
         NOTIFY; // let know about us
@@ -914,7 +1165,7 @@ BOOL CMFTSnapshot<CHAR>::BuildDirectoryTree()
                 r->Streams != NULL && r->Streams->DSNext == NULL && r->Streams->DSSize == 0)
             {
                 // TRACE_I("Removing zero file "<<r->FileNames->Name);
-                delete this->FreeRecord(MFT[i]);
+                FreeMFTRecord(MFT[i]);
                 MFT[i] = NULL;
             }
             NOTIFY;
@@ -961,7 +1212,7 @@ BOOL CMFTSnapshot<CHAR>::BuildDirectoryTree()
                 r->DirItems = NULL;
                 if (r->IsDir && r != this->Root && mark == NULL)
                 {
-                    delete this->FreeRecord(r);
+                    FreeMFTRecord(r);
                     MFT[i] = NULL;
                 }
             }
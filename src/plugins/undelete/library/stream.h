@@ -120,6 +120,7 @@ public:
     // when 'numRead' is not NULL, it will return number of read clusters or -1 when special error occurred
     BOOL GetClusters(BYTE* buffer, QWORD num, QWORD* numRead = NULL);
     BOOL IsSafeChunk(QWORD n) { return RunLength >= n; }
+    QWORD GetRunLeft() { return RunLength; } // clusters left in current run, 0 when the next read starts a new run
     void Release();
 
 private:
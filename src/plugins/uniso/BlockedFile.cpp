@@ -14,6 +14,9 @@
 CBlockedFile::CCachedBlock::CCachedBlock()
 {
     PosInBuf = 0;
+    Index = -1;
+    PrevUsed = NULL;
+    NextUsed = NULL;
 }
 
 CBlockedFile::CZeroBlock::CZeroBlock(BlockInfo* blockInfo)
@@ -32,155 +35,157 @@ DWORD CBlockedFile::CZeroBlock::Read(char* buf, DWORD BytesToRead)
     return BytesToRead;
 }
 
-CBlockedFile::CZLIBBlock::CZLIBBlock(BlockInfo* blockInfo, HANDLE hFile)
+CBlockedFile::CDecodedBlock::CDecodedBlock(BlockInfo* blockInfo, char* buffer)
+{
+    pBlockInfo = blockInfo;
+    Buffer = buffer;
+}
+
+CBlockedFile::CDecodedBlock::~CDecodedBlock()
+{
+    if (Buffer)
+        free(Buffer);
+}
+
+DWORD CBlockedFile::CDecodedBlock::Read(char* buf, DWORD BytesToRead)
+{
+    if (!Buffer)
+        return 0;
+
+    memcpy(buf, Buffer + PosInBuf, BytesToRead);
+    PosInBuf += BytesToRead;
+    return BytesToRead;
+}
+
+BYTE* CBlockedFile::ReadBlockData(const BlockInfo* blockInfo, HANDLE hFile, int& err)
 {
-    CALL_STACK_MESSAGE3("CZLIBBlock::CZLIBBlock(%p, %p)", blockInfo, hFile);
-    CSalZLIB zi;
     BYTE* inBuf;
     LONG posHi;
     DWORD dwBytesRead;
-    int err;
-
-    pBlockInfo = blockInfo;
 
-    Buffer = (char*)malloc((size_t)blockInfo->outSize);
-    if (!Buffer)
-    {
-        Error(IDS_INSUFFICIENT_MEMORY, FALSE);
-        return;
-    }
     inBuf = (BYTE*)malloc((size_t)blockInfo->inSize);
     if (!inBuf)
     {
-        free(Buffer);
-        Buffer = NULL;
-        Error(IDS_INSUFFICIENT_MEMORY, FALSE);
-        return;
+        err = IDS_INSUFFICIENT_MEMORY;
+        return NULL;
     }
     posHi = (LONG)(blockInfo->inPos >> 32);
     if ((0xFFFFFFFF == SetFilePointer(hFile, (DWORD)(blockInfo->inPos & 0xFFFFFFFF), &posHi, FILE_BEGIN)) || !ReadFile(hFile, inBuf, (DWORD)blockInfo->inSize, &dwBytesRead, NULL) || (blockInfo->inSize != dwBytesRead))
     {
         free(inBuf);
-        free(Buffer);
-        Buffer = NULL;
-        Error(IDS_ERR_BF_READ, FALSE, blockInfo->inPos);
-        return;
+        err = IDS_ERR_BF_READ;
+        return NULL;
     }
-    if (SAL_Z_OK != SalZLIB->InflateInit(&zi))
+    err = 0;
+    return inBuf;
+}
+
+int CBlockedFile::DecodeBlock(const BlockInfo* blockInfo, BYTE* in, char* out)
+{
+    switch (blockInfo->blockType)
+    {
+    case BF_BLOCKTYPE_ZLIB:
+        return CZLIBBlock::Decode(blockInfo, in, out);
+    case BF_BLOCKTYPE_BZIP2:
+        return CBZIP2Block::Decode(blockInfo, in, out);
+    case BF_BLOCKTYPE_ADC:
+        return CDMGFile::CADCBlock::Decode(blockInfo, in, out);
+    default:
+        return IDS_ERR_BF_BLOCK_UNK_TYPE;
+    }
+}
+
+CBlockedFile::CZLIBBlock::CZLIBBlock(BlockInfo* blockInfo, HANDLE hFile) : CDecodedBlock(blockInfo)
+{
+    CALL_STACK_MESSAGE3("CZLIBBlock::CZLIBBlock(%p, %p)", blockInfo, hFile);
+    BYTE* inBuf;
+    int err;
+
+    Buffer = (char*)malloc((size_t)blockInfo->outSize);
+    if (!Buffer)
     {
-        free(inBuf);
-        free(Buffer);
-        Buffer = NULL;
         Error(IDS_INSUFFICIENT_MEMORY, FALSE);
         return;
     }
-    zi.avail_in = (UINT)blockInfo->inSize;
-    zi.next_in = inBuf;
-    zi.next_out = (BYTE*)Buffer;
-    zi.avail_out = (UINT)blockInfo->outSize;
-    err = SalZLIB->Inflate(&zi, SAL_Z_FINISH);
-    SalZLIB->InflateEnd(&zi);
-    free(inBuf);
-    if ((err != SAL_Z_STREAM_END) || (zi.avail_out != 0))
+    inBuf = ReadBlockData(blockInfo, hFile, err);
+    if (inBuf)
+    {
+        err = Decode(blockInfo, inBuf, Buffer);
+        free(inBuf);
+    }
+    if (err)
     {
         free(Buffer);
         Buffer = NULL;
-        Error(IDS_ERR_BF_ZLIB, FALSE);
+        Error(err, FALSE, blockInfo->inPos);
     }
 }
 
-CBlockedFile::CZLIBBlock::~CZLIBBlock()
+int CBlockedFile::CZLIBBlock::Decode(const BlockInfo* blockInfo, BYTE* in, char* out)
 {
-    if (Buffer)
-        free(Buffer);
-}
-
-DWORD CBlockedFile::CZLIBBlock::Read(char* buf, DWORD BytesToRead)
-{
-    if (!Buffer)
-        return 0;
+    CSalZLIB zi;
+    int err;
 
-    memcpy(buf, Buffer + PosInBuf, BytesToRead);
-    PosInBuf += BytesToRead;
-    return BytesToRead;
+    if (SAL_Z_OK != SalZLIB->InflateInit(&zi))
+        return IDS_INSUFFICIENT_MEMORY;
+    zi.avail_in = (UINT)blockInfo->inSize;
+    zi.next_in = in;
+    zi.next_out = (BYTE*)out;
+    zi.avail_out = (UINT)blockInfo->outSize;
+    err = SalZLIB->Inflate(&zi, SAL_Z_FINISH);
+    SalZLIB->InflateEnd(&zi);
+    if ((err != SAL_Z_STREAM_END) || (zi.avail_out != 0))
+        return IDS_ERR_BF_ZLIB;
+    return 0;
 }
 
-CBlockedFile::CBZIP2Block::CBZIP2Block(BlockInfo* blockInfo, HANDLE hFile)
+CBlockedFile::CBZIP2Block::CBZIP2Block(BlockInfo* blockInfo, HANDLE hFile) : CDecodedBlock(blockInfo)
 {
     CALL_STACK_MESSAGE3("CBZIP2Block::CBZIP2Block(%p, %p)", blockInfo, hFile);
-    CSalBZIP2 bzi;
     BYTE* inBuf;
-    LONG posHi;
-    DWORD dwBytesRead;
     int err;
 
-    pBlockInfo = blockInfo;
-
     Buffer = (char*)malloc((size_t)blockInfo->outSize);
     if (!Buffer)
     {
         Error(IDS_INSUFFICIENT_MEMORY, FALSE);
         return;
     }
-    inBuf = (BYTE*)malloc((size_t)blockInfo->inSize);
-    if (!inBuf)
+    inBuf = ReadBlockData(blockInfo, hFile, err);
+    if (inBuf)
     {
-        free(Buffer);
-        Buffer = NULL;
-        Error(IDS_INSUFFICIENT_MEMORY, FALSE);
-        return;
+        err = Decode(blockInfo, inBuf, Buffer);
+        free(inBuf);
     }
-    posHi = (LONG)(blockInfo->inPos >> 32);
-    if ((0xFFFFFFFF == SetFilePointer(hFile, (DWORD)(blockInfo->inPos & 0xFFFFFFFF), &posHi, FILE_BEGIN)) || !ReadFile(hFile, inBuf, (DWORD)blockInfo->inSize, &dwBytesRead, NULL) || (blockInfo->inSize != dwBytesRead))
+    if (err)
     {
-        free(inBuf);
         free(Buffer);
         Buffer = NULL;
-        Error(IDS_ERR_BF_READ, FALSE, blockInfo->inPos);
-        return;
+        Error(err, FALSE, blockInfo->inPos);
     }
-    if ((dwBytesRead > 3) && !memcmp(inBuf, "ISz", 3))
+}
+
+int CBlockedFile::CBZIP2Block::Decode(const BlockInfo* blockInfo, BYTE* in, char* out)
+{
+    CSalBZIP2 bzi;
+    int err;
+
+    if ((blockInfo->inSize > 3) && !memcmp(in, "ISz", 3))
     {
         // ISZ files use proprietary magic instead of the default one :-(
-        memcpy(inBuf, "BZh", 3);
+        memcpy(in, "BZh", 3);
     }
     if (SAL_BZ_OK != SalBZIP2->DecompressInit(&bzi, false))
-    {
-        free(inBuf);
-        free(Buffer);
-        Buffer = NULL;
-        Error(IDS_INSUFFICIENT_MEMORY, FALSE);
-        return;
-    }
+        return IDS_INSUFFICIENT_MEMORY;
     bzi.avail_in = (UINT)blockInfo->inSize;
-    bzi.next_in = inBuf;
-    bzi.next_out = (BYTE*)Buffer;
+    bzi.next_in = in;
+    bzi.next_out = (BYTE*)out;
     bzi.avail_out = (UINT)blockInfo->outSize;
     err = SalBZIP2->Decompress(&bzi);
     SalBZIP2->DecompressEnd(&bzi);
-    free(inBuf);
     if ((err != SAL_BZ_STREAM_END) || (bzi.avail_out != 0))
-    {
-        free(Buffer);
-        Buffer = NULL;
-        Error(IDS_ERR_BF_BZIP2, FALSE);
-    }
-}
-
-CBlockedFile::CBZIP2Block::~CBZIP2Block()
-{
-    if (Buffer)
-        free(Buffer);
-}
-
-DWORD CBlockedFile::CBZIP2Block::Read(char* buf, DWORD BytesToRead)
-{
-    if (!Buffer)
-        return 0;
-
-    memcpy(buf, Buffer + PosInBuf, BytesToRead);
-    PosInBuf += BytesToRead;
-    return BytesToRead;
+        return IDS_ERR_BF_BZIP2;
+    return 0;
 }
 
 CBlockedFile::CCopyBlock::CCopyBlock(BlockInfo* blockInfo, HANDLE hFile) : File(hFile)
@@ -218,7 +223,16 @@ CBlockedFile::CBlockedFile()
     pBlocks = NULL;
     nBlocks = 0;
 
-    MRUCachedBlock = 0;
+    CacheIndex = NULL;
+    CacheFirst = NULL;
+    CacheLast = NULL;
+    CacheSize = 0;
+
+    LastLoaded = -1;
+    SequentialLoads = 0;
+    DecodePool = NULL;
+    bDecodePoolTried = false;
+
     pCurBlock = NULL;
 
     bUnknownBlockErrShown = false;
@@ -226,12 +240,18 @@ CBlockedFile::CBlockedFile()
 
 CBlockedFile::~CBlockedFile()
 {
-    if (pBlocks)
-        free(pBlocks);
-    for (int i = 0; i < SizeOf(BlockCache); i++)
+    if (DecodePool)
+        delete DecodePool;
+    while (CacheFirst)
     {
-        delete BlockCache[i];
+        CCachedBlock* block = CacheFirst;
+        CacheFirst = block->NextUsed;
+        delete block;
     }
+    if (CacheIndex)
+        free(CacheIndex);
+    if (pBlocks)
+        free(pBlocks);
 }
 
 BOOL CBlockedFile::IsOK()
@@ -313,89 +333,252 @@ __int64 CBlockedFile::Seek(__int64 lDistanceToMove, DWORD dwMoveMethod)
     return CurrentPos;
 }
 
-CBlockedFile::CCachedBlock* CBlockedFile::LoadBlock(UInt64 pos)
+// returns the index of the block containing 'pos' or -1
+int CBlockedFile::FindBlock(UInt64 pos)
 {
-    CALL_STACK_MESSAGE2("CBlockedFile::LoadBlock(%I64u)", pos);
-    for (int i = MRUCachedBlock - 1; i >= 0; i--)
+    // sequential reading continues with the following block
+    int next = LastLoaded + 1;
+    if ((next > 0) && (next < nBlocks) && (pos >= pBlocks[next].outPos) && (pos < pBlocks[next].outPos + pBlocks[next].outSize))
+        return next;
+
+    // the blocks are ordered by their position in the image
+    int lo = 0;
+    int hi = nBlocks - 1;
+    while (lo <= hi)
     {
-        if ((pos >= BlockCache[i]->pBlockInfo->outPos) && (pos < BlockCache[i]->pBlockInfo->outPos + BlockCache[i]->pBlockInfo->outSize))
-        {
-            // Found -> put to the end of the list
-            CBlockedFile::CCachedBlock* pCachedBlock = BlockCache[i];
-            memmove(&BlockCache[i], &BlockCache[i + 1], sizeof(void*) * (MRUCachedBlock - i - 1));
-            BlockCache[MRUCachedBlock - 1] = pCachedBlock;
-            return pCachedBlock;
-        }
+        int mid = (lo + hi) / 2;
+        if (pos < pBlocks[mid].outPos)
+            hi = mid - 1;
+        else if (pos >= pBlocks[mid].outPos + pBlocks[mid].outSize)
+            lo = mid + 1;
+        else
+            return mid;
     }
+    // just in case some image does not keep the order
     for (int j = 0; j < nBlocks; j++)
     {
-        // TODO: better search algorithm
         if ((pos >= pBlocks[j].outPos) && (pos < pBlocks[j].outPos + pBlocks[j].outSize))
-        {
-            CBlockedFile::CCachedBlock* pCachedBlock;
-            CBlockedFile::BlockInfo* pBlock = &pBlocks[j];
-
-            switch (pBlock->blockType)
-            {
-            case BF_BLOCKTYPE_ZLIB:
-            {
-                CBlockedFile::CZLIBBlock* pZLIBBlock = new CBlockedFile::CZLIBBlock(pBlock, File);
-
-                if (pZLIBBlock && !pZLIBBlock->IsOK())
-                {
-                    delete pZLIBBlock;
-                    return NULL; // Error reported in CZLIBBlock::CZLIBBlock()
-                }
-                pCachedBlock = pZLIBBlock;
-                break;
-            }
+            return j;
+    }
+    return -1;
+}
 
-            case BF_BLOCKTYPE_BZIP2:
-            {
-                CBlockedFile::CBZIP2Block* pBZIP2Block = new CBlockedFile::CBZIP2Block(pBlock, File);
-
-                if (pBZIP2Block && !pBZIP2Block->IsOK())
-                {
-                    delete pBZIP2Block;
-                    return NULL; // Error reported in CBZIP2Block::CBZIP2Block()
-                }
-                pCachedBlock = pBZIP2Block;
-                break;
-            }
+CBlockedFile::CCachedBlock* CBlockedFile::LoadBlock(UInt64 pos)
+{
+    CALL_STACK_MESSAGE2("CBlockedFile::LoadBlock(%I64u)", pos);
+    int index = FindBlock(pos);
+    if (index < 0)
+    {
+        Error(IDS_ERR_DMG_BLOCK_UNDEFINED, FALSE, pos);
+        return NULL;
+    }
+    if (!CacheIndex)
+    {
+        CacheIndex = (CCachedBlock**)calloc(nBlocks, sizeof(CCachedBlock*));
+        if (!CacheIndex)
+        {
+            Error(IDS_INSUFFICIENT_MEMORY, FALSE);
+            return NULL;
+        }
+    }
 
-            case BF_BLOCKTYPE_COPY:
-                pCachedBlock = new CBlockedFile::CCopyBlock(pBlock, File);
-                break;
+    if (index == LastLoaded + 1)
+        SequentialLoads++;
+    else
+        SequentialLoads = 0;
+    LastLoaded = index;
 
-            case BF_BLOCKTYPE_ADC:
-                pCachedBlock = new CDMGFile::CADCBlock(pBlock, File);
-                break;
+    CCachedBlock* pCachedBlock = CacheIndex[index];
+    if (pCachedBlock)
+    {
+        MarkUsed(pCachedBlock);
+    }
+    else
+    {
+        pCachedBlock = CreateBlock(index);
+        if (!pCachedBlock)
+            return NULL;
+        AddToCache(pCachedBlock);
+    }
+    if (SequentialLoads >= BF_SEQUENTIAL_LOADS)
+        ReadAhead(index);
+    return pCachedBlock;
+}
 
-            case BF_BLOCKTYPE_ZERO:
-                pCachedBlock = new CBlockedFile::CZeroBlock(pBlock);
-                break;
+// creates the block with index 'index' into pBlocks, reports errors
+CBlockedFile::CCachedBlock* CBlockedFile::CreateBlock(int index)
+{
+    CBlockedFile::CCachedBlock* pCachedBlock;
+    CBlockedFile::BlockInfo* pBlock = &pBlocks[index];
 
-            default: // Should not happen
-                Error(IDS_ERR_BF_BLOCK_UNK_TYPE, bUnknownBlockErrShown);
-                bUnknownBlockErrShown = true; // Don't show the same error multiple times
-                return NULL;
-            }
+    // the block may have been decoded ahead
+    CBlockDecodeJob* job = DecodePool ? DecodePool->FindJob(index) : NULL;
+    if (job)
+    {
+        char* buffer = DecodePool->Collect(job);
+        if (buffer)
+        {
+            pCachedBlock = new CBlockedFile::CDecodedBlock(pBlock, buffer);
             if (!pCachedBlock)
             {
+                free(buffer);
                 Error(IDS_INSUFFICIENT_MEMORY, FALSE);
                 return NULL;
             }
-            if (MRUCachedBlock >= SizeOf(BlockCache))
-            {
-                delete BlockCache[0];
-                memmove(BlockCache, &BlockCache[1], sizeof(void*) * --MRUCachedBlock);
-            }
-            BlockCache[MRUCachedBlock++] = pCachedBlock;
+            pCachedBlock->Index = index;
             return pCachedBlock;
         }
+        // decoding failed, decode it again below to report the error
+    }
+
+    switch (pBlock->blockType)
+    {
+    case BF_BLOCKTYPE_ZLIB:
+    {
+        CBlockedFile::CZLIBBlock* pZLIBBlock = new CBlockedFile::CZLIBBlock(pBlock, File);
+
+        if (pZLIBBlock && !pZLIBBlock->IsOK())
+        {
+            delete pZLIBBlock;
+            return NULL; // Error reported in CZLIBBlock::CZLIBBlock()
+        }
+        pCachedBlock = pZLIBBlock;
+        break;
+    }
+
+    case BF_BLOCKTYPE_BZIP2:
+    {
+        CBlockedFile::CBZIP2Block* pBZIP2Block = new CBlockedFile::CBZIP2Block(pBlock, File);
+
+        if (pBZIP2Block && !pBZIP2Block->IsOK())
+        {
+            delete pBZIP2Block;
+            return NULL; // Error reported in CBZIP2Block::CBZIP2Block()
+        }
+        pCachedBlock = pBZIP2Block;
+        break;
+    }
+
+    case BF_BLOCKTYPE_COPY:
+        pCachedBlock = new CBlockedFile::CCopyBlock(pBlock, File);
+        break;
+
+    case BF_BLOCKTYPE_ADC:
+    {
+        CDMGFile::CADCBlock* pADCBlock = new CDMGFile::CADCBlock(pBlock, File);
+
+        if (pADCBlock && !pADCBlock->IsOK())
+        {
+            delete pADCBlock;
+            return NULL; // Error reported in CADCBlock::CADCBlock()
+        }
+        pCachedBlock = pADCBlock;
+        break;
+    }
+
+    case BF_BLOCKTYPE_ZERO:
+        pCachedBlock = new CBlockedFile::CZeroBlock(pBlock);
+        break;
+
+    default: // Should not happen
+        Error(IDS_ERR_BF_BLOCK_UNK_TYPE, bUnknownBlockErrShown);
+        bUnknownBlockErrShown = true; // Don't show the same error multiple times
+        return NULL;
+    }
+    if (!pCachedBlock)
+    {
+        Error(IDS_INSUFFICIENT_MEMORY, FALSE);
+        return NULL;
+    }
+    pCachedBlock->Index = index;
+    return pCachedBlock;
+}
+
+// inserts 'block' as the most recently used one and releases the least recently used
+// blocks over the budget
+void CBlockedFile::AddToCache(CCachedBlock* block)
+{
+    block->PrevUsed = NULL;
+    block->NextUsed = CacheFirst;
+    if (CacheFirst)
+        CacheFirst->PrevUsed = block;
+    else
+        CacheLast = block;
+    CacheFirst = block;
+    CacheIndex[block->Index] = block;
+    CacheSize += block->GetMemSize();
+
+    size_t budget = (size_t)Options.BlockCacheSize * 1024 * 1024;
+    while (CacheSize > budget && CacheLast != block)
+    {
+        CCachedBlock* old = CacheLast;
+        CacheLast = old->PrevUsed;
+        CacheLast->NextUsed = NULL;
+        CacheIndex[old->Index] = NULL;
+        CacheSize -= old->GetMemSize();
+        if (old == pCurBlock)
+            pCurBlock = NULL;
+        delete old;
+    }
+}
+
+// moves 'block' to the start of the list of cached blocks
+void CBlockedFile::MarkUsed(CCachedBlock* block)
+{
+    if (block == CacheFirst)
+        return;
+    block->PrevUsed->NextUsed = block->NextUsed;
+    if (block->NextUsed)
+        block->NextUsed->PrevUsed = block->PrevUsed;
+    else
+        CacheLast = block->PrevUsed;
+    block->PrevUsed = NULL;
+    block->NextUsed = CacheFirst;
+    CacheFirst->PrevUsed = block;
+    CacheFirst = block;
+}
+
+// the reader goes through the image sequentially and has just loaded block 'index',
+// starts decoding the following compressed blocks on the pool threads
+void CBlockedFile::ReadAhead(int index)
+{
+    CALL_STACK_MESSAGE2("CBlockedFile::ReadAhead(%d)", index);
+    if (!DecodePool)
+    {
+        if (bDecodePoolTried)
+            return;
+        bDecodePoolTried = true;
+        DecodePool = new CBlockDecodePool;
+        if (!DecodePool)
+            return;
+        if (!DecodePool->Init())
+        {
+            delete DecodePool;
+            DecodePool = NULL;
+            return;
+        }
+    }
+
+    int last = min(index + DecodePool->GetAhead(), nBlocks - 1);
+    DecodePool->DropOutside(index + 1, last);
+    // the decoded blocks wait outside the cache, they may take a quarter of its budget
+    UInt64 budget = (UInt64)Options.BlockCacheSize * 1024 * 1024 / 4;
+    for (int j = index + 1; j <= last; j++)
+    {
+        BlockInfo* pBlock = &pBlocks[j];
+        if ((pBlock->blockType != BF_BLOCKTYPE_ZLIB) && (pBlock->blockType != BF_BLOCKTYPE_BZIP2) && (pBlock->blockType != BF_BLOCKTYPE_ADC))
+            continue; // nothing to decode
+        if (CacheIndex[j] || DecodePool->FindJob(j))
+            continue;
+        if (DecodePool->GetAheadSize() + pBlock->outSize > budget)
+            break;
+        int err;
+        BYTE* inBuf = ReadBlockData(pBlock, File, err);
+        if (!inBuf)
+            break; // LoadBlock() reports the error when the reader gets there
+        if (!DecodePool->Submit(pBlock, j, inBuf))
+            break;
     }
-    Error(IDS_ERR_DMG_BLOCK_UNDEFINED, FALSE, pos);
-    return NULL;
 }
 
 BOOL CBlockedFile::Close(LPCTSTR fileName, HWND parent)
@@ -416,3 +599,188 @@ DWORD CBlockedFile::GetFileSize(LPDWORD lpFileSizeHigh)
         *lpFileSizeHigh = (DWORD)((FileSize >> 32) & 0xffffffff);
     return (DWORD)(FileSize & 0xffffffff);
 }
+
+//****************************************************************************
+//
+// CBlockDecodePool
+//
+
+CBlockDecodePool::CBlockDecodePool()
+{
+    Threads = 0;
+    InitializeCriticalSection(&QueueLock);
+    QueueFirst = 0;
+    QueueCount = 0;
+    QueueSem = NULL;
+    Terminate = FALSE;
+    ZeroMemory(Jobs, sizeof(Jobs));
+    AheadSize = 0;
+}
+
+CBlockDecodePool::~CBlockDecodePool()
+{
+    CALL_STACK_MESSAGE1("CBlockDecodePool::~CBlockDecodePool()");
+    EnterCriticalSection(&QueueLock);
+    Terminate = TRUE;
+    LeaveCriticalSection(&QueueLock);
+    int i;
+    if (QueueSem != NULL)
+        ReleaseSemaphore(QueueSem, Threads, NULL); // wake up all the workers
+    for (i = 0; i < Threads; i++)
+    {
+        if (ThreadHandles[i] != NULL)
+        {
+            WaitForSingleObject(ThreadHandles[i], INFINITE);
+            CloseHandle(ThreadHandles[i]);
+        }
+    }
+    // the workers are gone, the queued jobs were not started
+    for (i = 0; i < SizeOf(Jobs); i++)
+    {
+        if (Jobs[i].In != NULL)
+            free(Jobs[i].In);
+        if (Jobs[i].Out != NULL)
+            free(Jobs[i].Out);
+        if (Jobs[i].Done != NULL)
+            CloseHandle(Jobs[i].Done);
+    }
+    if (QueueSem != NULL)
+        CloseHandle(QueueSem);
+    DeleteCriticalSection(&QueueLock);
+}
+
+BOOL CBlockDecodePool::Init()
+{
+    CALL_STACK_MESSAGE1("CBlockDecodePool::Init()");
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors < 2)
+        return FALSE;
+    int threads = min((int)si.dwNumberOfProcessors, BF_MAX_THREADS);
+
+    QueueSem = CreateSemaphore(NULL, 0, SizeOf(Queue) + BF_MAX_THREADS, NULL);
+    if (QueueSem == NULL)
+        return FALSE;
+    int i;
+    for (i = 0; i < SizeOf(Jobs); i++)
+    {
+        Jobs[i].Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (Jobs[i].Done == NULL)
+            return FALSE;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        Threads = i + 1; // the destructor cleans up the threads created so far
+        DWORD id;
+        ThreadHandles[i] = CreateThread(NULL, 0, ThreadBody, this, 0, &id);
+        if (ThreadHandles[i] == NULL)
+        {
+            TRACE_E("CBlockDecodePool::Init(): unable to start worker thread");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+CBlockDecodeJob* CBlockDecodePool::FindJob(int index)
+{
+    for (int i = 0; i < SizeOf(Jobs); i++)
+    {
+        if (Jobs[i].pBlockInfo != NULL && Jobs[i].Index == index)
+            return &Jobs[i];
+    }
+    return NULL;
+}
+
+BOOL CBlockDecodePool::Submit(CBlockedFile::BlockInfo* blockInfo, int index, BYTE* in)
+{
+    CBlockDecodeJob* job = NULL;
+    for (int i = 0; i < SizeOf(Jobs); i++)
+    {
+        if (Jobs[i].pBlockInfo == NULL)
+        {
+            job = &Jobs[i];
+            break;
+        }
+    }
+    if (job == NULL)
+    {
+        free(in);
+        return FALSE;
+    }
+    job->pBlockInfo = blockInfo;
+    job->Index = index;
+    job->In = in;
+    job->Out = NULL;
+    job->Ok = FALSE;
+    AheadSize += blockInfo->outSize;
+
+    EnterCriticalSection(&QueueLock);
+    Queue[(QueueFirst + QueueCount) % SizeOf(Queue)] = job;
+    QueueCount++;
+    LeaveCriticalSection(&QueueLock);
+    ReleaseSemaphore(QueueSem, 1, NULL);
+    return TRUE;
+}
+
+char* CBlockDecodePool::Collect(CBlockDecodeJob* job)
+{
+    WaitForSingleObject(job->Done, INFINITE);
+    char* out = job->Ok ? job->Out : NULL;
+    if (!job->Ok && job->Out != NULL)
+        free(job->Out);
+    AheadSize -= job->pBlockInfo->outSize;
+    job->pBlockInfo = NULL;
+    job->Out = NULL;
+    return out;
+}
+
+void CBlockDecodePool::DropOutside(int first, int last)
+{
+    for (int i = 0; i < SizeOf(Jobs); i++)
+    {
+        if (Jobs[i].pBlockInfo != NULL && (Jobs[i].Index < first || Jobs[i].Index > last))
+        {
+            char* out = Collect(&Jobs[i]);
+            if (out != NULL)
+                free(out);
+        }
+    }
+}
+
+DWORD WINAPI
+CBlockDecodePool::ThreadBody(void* param)
+{
+    return SalamanderDebug->CallWithCallStack(WorkerBody, param);
+}
+
+unsigned WINAPI
+CBlockDecodePool::WorkerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CBlockDecodePool::WorkerBody()");
+    CBlockDecodePool* pool = (CBlockDecodePool*)param;
+    while (1)
+    {
+        WaitForSingleObject(pool->QueueSem, INFINITE);
+        CBlockDecodeJob* job = NULL;
+        EnterCriticalSection(&pool->QueueLock);
+        if (!pool->Terminate && pool->QueueCount > 0)
+        {
+            job = pool->Queue[pool->QueueFirst];
+            pool->QueueFirst = (pool->QueueFirst + 1) % SizeOf(pool->Queue);
+            pool->QueueCount--;
+        }
+        LeaveCriticalSection(&pool->QueueLock);
+        if (job == NULL)
+            break; // terminating
+
+        // errors are not reported here, the block is decoded again by the reader
+        job->Out = (char*)malloc((size_t)job->pBlockInfo->outSize);
+        if (job->Out != NULL)
+            job->Ok = CBlockedFile::DecodeBlock(job->pBlockInfo, job->In, job->Out) == 0;
+        free(job->In);
+        job->In = NULL;
+        SetEvent(job->Done);
+    }
+    return 0;
+}
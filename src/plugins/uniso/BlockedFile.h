@@ -13,6 +13,12 @@
 #define BF_BLOCKTYPE_ADC 4
 #define BF_BLOCKTYPE_UNKNOWN 255
 
+#define BF_MAX_THREADS 16     // max. number of threads decoding blocks ahead of the reader
+#define BF_MAX_AHEAD 32       // max. number of blocks decoded ahead of the reader
+#define BF_SEQUENTIAL_LOADS 2 // after this many blocks loaded in a row the reading is sequential
+
+class CBlockDecodePool;
+
 class CBlockedFile : public CFile
 {
 
@@ -33,9 +39,31 @@ public:
         BlockInfo* pBlockInfo;
         size_t PosInBuf; // must remain unsigned!
 
+        int Index;              // index into pBlocks
+        CCachedBlock* PrevUsed; // more recently used block in the cache
+        CCachedBlock* NextUsed; // less recently used block in the cache
+
         CCachedBlock();
         virtual ~CCachedBlock() {};
         virtual DWORD Read(char* buf, DWORD BytesToRead) = 0;
+
+        // memory taken by the block, counted against Options.BlockCacheSize
+        virtual size_t GetMemSize() { return sizeof(*this); }
+    };
+
+    // block decompressed into memory
+    class CDecodedBlock : public CCachedBlock
+    {
+    public:
+        CDecodedBlock(BlockInfo* blockInfo, char* buffer = NULL); // takes over 'buffer'
+        virtual ~CDecodedBlock();
+        virtual DWORD Read(char* buf, DWORD BytesToRead);
+        virtual size_t GetMemSize() { return sizeof(*this) + (Buffer ? (size_t)pBlockInfo->outSize : 0); }
+
+        bool IsOK() { return Buffer ? true : false; };
+
+    protected:
+        char* Buffer;
     };
 
     class CZeroBlock : public CCachedBlock
@@ -46,30 +74,23 @@ public:
         virtual DWORD Read(char* buf, DWORD BytesToRead);
     };
 
-    class CZLIBBlock : public CCachedBlock
+    class CZLIBBlock : public CDecodedBlock
     {
     public:
         CZLIBBlock(BlockInfo* blockInfo, HANDLE hFile);
-        virtual ~CZLIBBlock();
-        virtual DWORD Read(char* buf, DWORD BytesToRead);
-
-        bool IsOK() { return Buffer ? true : false; };
 
-    private:
-        char* Buffer;
+        // decodes the block from 'in' (inSize bytes) to 'out' (outSize bytes), may modify 'in';
+        // returns 0 or the ID of the error message; called also from CBlockDecodePool threads
+        static int Decode(const BlockInfo* blockInfo, BYTE* in, char* out);
     };
 
-    class CBZIP2Block : public CCachedBlock
+    class CBZIP2Block : public CDecodedBlock
     {
     public:
         CBZIP2Block(BlockInfo* blockInfo, HANDLE hFile);
-        virtual ~CBZIP2Block();
-        virtual DWORD Read(char* buf, DWORD BytesToRead);
-
-        bool IsOK() { return Buffer ? true : false; };
 
-    private:
-        char* Buffer;
+        // see CZLIBBlock::Decode()
+        static int Decode(const BlockInfo* blockInfo, BYTE* in, char* out);
     };
 
     class CCopyBlock : public CCachedBlock
@@ -97,6 +118,12 @@ public:
 
     virtual BOOL IsOK();
 
+    // reads the compressed data of the block; returns an allocated buffer or NULL and the
+    // ID of the error message in 'err'
+    static BYTE* ReadBlockData(const BlockInfo* blockInfo, HANDLE hFile, int& err);
+    // decodes a ZLIB, BZIP2 or ADC block in memory, see CZLIBBlock::Decode()
+    static int DecodeBlock(const BlockInfo* blockInfo, BYTE* in, char* out);
+
 protected:
     BlockInfo* pBlocks;
     int nBlocks;
@@ -104,10 +131,87 @@ protected:
     UInt64 CurrentPos;
     UInt64 FileSize;
 
-    CCachedBlock* BlockCache[32]; // 32 MRU blocks
-    int MRUCachedBlock;           // index into MRUCachedBlock
+    // cache of loaded blocks: CacheIndex has an item for each block in pBlocks (NULL if
+    // it is not cached), the blocks are also in a list ordered from the most recently used;
+    // the least recently used ones are released when CacheSize exceeds Options.BlockCacheSize
+    CCachedBlock** CacheIndex;
+    CCachedBlock* CacheFirst; // the most recently used block
+    CCachedBlock* CacheLast;  // the least recently used block
+    size_t CacheSize;         // sum of GetMemSize() of the cached blocks
+
+    int LastLoaded;               // index of the block returned by the last LoadBlock() or -1
+    int SequentialLoads;          // number of LoadBlock() calls in a row for the following block
+    CBlockDecodePool* DecodePool; // decodes blocks ahead of a sequential reader, NULL = not started
+    bool bDecodePoolTried;        // DecodePool was already attempted to start
+
     CCachedBlock* pCurBlock;
     bool bUnknownBlockErrShown;
 
     virtual CCachedBlock* LoadBlock(UInt64 pos);
+
+    int FindBlock(UInt64 pos);
+    CCachedBlock* CreateBlock(int index);
+    void AddToCache(CCachedBlock* block);
+    void MarkUsed(CCachedBlock* block);
+    void ReadAhead(int index);
+};
+
+//****************************************************************************
+//
+// CBlockDecodePool - Decodes compressed blocks on worker threads ahead of
+//                    a sequential reader (see CBlockedFile::ReadAhead())
+//
+
+struct CBlockDecodeJob
+{
+    CBlockedFile::BlockInfo* pBlockInfo; // NULL = free item
+    int Index;                           // index of the block in CBlockedFile::pBlocks
+    BYTE* In;                            // compressed data, released by the worker
+    char* Out;                           // decoded data
+    BOOL Ok;                             // Out contains the whole block
+    HANDLE Done;                         // signaled when the worker is finished with the job
+};
+
+class CBlockDecodePool
+{
+protected:
+    int Threads;
+    HANDLE ThreadHandles[BF_MAX_THREADS];
+
+    CRITICAL_SECTION QueueLock; // guards Queue, QueueFirst, QueueCount and Terminate
+    CBlockDecodeJob* Queue[BF_MAX_AHEAD];
+    int QueueFirst;
+    int QueueCount;
+    HANDLE QueueSem; // number of jobs in Queue
+    BOOL Terminate;
+
+    CBlockDecodeJob Jobs[BF_MAX_AHEAD];
+    UInt64 AheadSize; // sum of outSize of the used Jobs
+
+public:
+    CBlockDecodePool();
+    ~CBlockDecodePool(); // waits for the running jobs, the decoded data is dropped
+
+    // starts the threads; returns FALSE if it is not worth it (single processor) or
+    // the threads cannot be started, the pool then must not be used
+    BOOL Init();
+
+    // how many blocks to decode ahead of the reader
+    int GetAhead() { return min(2 * Threads, BF_MAX_AHEAD); }
+    UInt64 GetAheadSize() { return AheadSize; }
+
+    // returns the job of block 'index' or NULL
+    CBlockDecodeJob* FindJob(int index);
+    // starts decoding block 'index' from 'in' (taken over); returns FALSE if there
+    // is no free job, 'in' is then released
+    BOOL Submit(CBlockedFile::BlockInfo* blockInfo, int index, BYTE* in);
+    // waits for 'job' and frees it; returns the decoded data (the caller releases it)
+    // or NULL if the decoding failed
+    char* Collect(CBlockDecodeJob* job);
+    // frees the jobs of the blocks outside 'first'..'last' (the reader moved elsewhere)
+    void DropOutside(int first, int last);
+
+protected:
+    static DWORD WINAPI ThreadBody(void* param);
+    static unsigned WINAPI WorkerBody(void* param);
 };
@@ -55,6 +55,20 @@ void CConfigurationDialog::Transfer(CTransferInfo& ti)
     ti.CheckBox(IDC_CFG_READONLY, Options.ClearReadOnly);
     ti.CheckBox(IDC_CFG_SESSIONASDIR, Options.SessionAsDirectory);
     ti.CheckBox(IDC_CFG_BOOTIMAGEASFILE, Options.BootImageAsFile);
+    int cacheSize = Options.BlockCacheSize;
+    ti.EditLine(IDC_CFG_BLOCKCACHE, cacheSize);
+    if (ti.Type == ttDataFromWindow && ti.IsGood())
+    {
+        if (cacheSize < BLOCK_CACHE_SIZE_MIN || cacheSize > BLOCK_CACHE_SIZE_MAX)
+        {
+            char buf[200];
+            _snprintf_s(buf, _TRUNCATE, LoadStr(IDS_CFG_BLOCKCACHE_RANGE), BLOCK_CACHE_SIZE_MIN, BLOCK_CACHE_SIZE_MAX);
+            SalamanderGeneral->SalMessageBox(HWindow, buf, LoadStr(IDS_ERROR), MB_OK | MB_ICONEXCLAMATION);
+            ti.ErrorOn(IDC_CFG_BLOCKCACHE);
+            return;
+        }
+        Options.BlockCacheSize = cacheSize;
+    }
 }
 
 INT_PTR
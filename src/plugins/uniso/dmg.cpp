@@ -304,15 +304,11 @@ CDMGFile::~CDMGFile()
 }
 
 // Apple Data Compression, see http://www.macdisk.com/dmgen.php
-CDMGFile::CADCBlock::CADCBlock(BlockInfo* blockInfo, HANDLE hFile)
+CDMGFile::CADCBlock::CADCBlock(BlockInfo* blockInfo, HANDLE hFile) : CDecodedBlock(blockInfo)
 {
     CALL_STACK_MESSAGE3("CADCBlock::CADCBlock(%p, %p)", blockInfo, hFile);
-    BYTE *inBuf, *in, *out;
-    LONG posHi;
-    DWORD dwBytesRead;
-    int size;
-
-    pBlockInfo = blockInfo;
+    BYTE* inBuf;
+    int err;
 
     Buffer = (char*)malloc((size_t)blockInfo->outSize);
     if (!Buffer)
@@ -320,25 +316,26 @@ CDMGFile::CADCBlock::CADCBlock(BlockInfo* blockInfo, HANDLE hFile)
         Error(IDS_INSUFFICIENT_MEMORY, FALSE);
         return;
     }
-    in = inBuf = (BYTE*)malloc((size_t)blockInfo->inSize);
+    inBuf = ReadBlockData(blockInfo, hFile, err);
     if (!inBuf)
     {
         free(Buffer);
         Buffer = NULL;
-        Error(IDS_INSUFFICIENT_MEMORY, FALSE);
+        Error(err, FALSE, blockInfo->inPos);
         return;
     }
+    Decode(blockInfo, inBuf, Buffer);
+    free(inBuf);
+}
+
+int CDMGFile::CADCBlock::Decode(const BlockInfo* blockInfo, BYTE* inBuf, char* outBuf)
+{
+    BYTE *in, *out;
+    int size;
+
+    in = inBuf;
+    out = (BYTE*)outBuf;
     size = (int)blockInfo->inSize;
-    posHi = (LONG)(blockInfo->inPos >> 32);
-    if ((0xFFFFFFFF == SetFilePointer(hFile, (DWORD)(blockInfo->inPos & 0xFFFFFFFF), &posHi, FILE_BEGIN)) || !ReadFile(hFile, inBuf, size, &dwBytesRead, NULL) || (blockInfo->inSize != dwBytesRead))
-    {
-        free(inBuf);
-        free(Buffer);
-        Buffer = NULL;
-        Error(IDS_ERR_BF_READ, FALSE, blockInfo->inPos);
-        return;
-    }
-    out = (BYTE*)Buffer;
     while (size > 0)
     {
         if (*in & 0x80)
@@ -391,21 +388,5 @@ CDMGFile::CADCBlock::CADCBlock(BlockInfo* blockInfo, HANDLE hFile)
         }
     }
 
-    free(inBuf);
-}
-
-CDMGFile::CADCBlock::~CADCBlock()
-{
-    if (Buffer)
-        free(Buffer);
-}
-
-DWORD CDMGFile::CADCBlock::Read(char* buf, DWORD BytesToRead)
-{
-    if (!Buffer)
-        return 0;
-
-    memcpy(buf, Buffer + PosInBuf, BytesToRead);
-    PosInBuf += BytesToRead;
-    return BytesToRead;
+    return 0;
 }
@@ -52,17 +52,13 @@ private:
 
 #pragma pack(pop)
 
-    class CADCBlock : public CBlockedFile::CCachedBlock
+    class CADCBlock : public CBlockedFile::CDecodedBlock
     { // Apple Data Compression
     public:
         CADCBlock(BlockInfo* blockInfo, HANDLE hFile);
-        virtual ~CADCBlock();
-        virtual DWORD Read(char* buf, DWORD BytesToRead);
 
-        bool IsOK() { return Buffer ? true : false; };
-
-    private:
-        char* Buffer;
+        // see CBlockedFile::CZLIBBlock::Decode()
+        static int Decode(const BlockInfo* blockInfo, BYTE* in, char* out);
     };
 
 public:
@@ -63,6 +63,7 @@ int SortByExtDirsAsFiles = FALSE; // current value of Salamander's configuration
 const char* CONFIG_CLEAR_READONLY = "Clear Read Only";
 const char* CONFIG_SESSION_AS_DIR = "Show Session As Directory";
 const char* CONFIG_BOOTIMAGE_AS_FILE = "Show Boot Image As File";
+const char* CONFIG_BLOCK_CACHE_SIZE = "Block Cache Size";
 
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 {
@@ -267,12 +268,16 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     Options.ClearReadOnly = TRUE;
     Options.SessionAsDirectory = TRUE; // by default we show how good we are (they can turn it off if they want)
     Options.BootImageAsFile = TRUE;    // by default we show the boot image (they can turn it off if they want)
+    Options.BlockCacheSize = BLOCK_CACHE_SIZE_DEFAULT;
 
     if (regKey != NULL) // load from the registry
     {
         registry->GetValue(regKey, CONFIG_CLEAR_READONLY, REG_DWORD, &Options.ClearReadOnly, sizeof(DWORD));
         registry->GetValue(regKey, CONFIG_SESSION_AS_DIR, REG_DWORD, &Options.SessionAsDirectory, sizeof(DWORD));
         registry->GetValue(regKey, CONFIG_BOOTIMAGE_AS_FILE, REG_DWORD, &Options.BootImageAsFile, sizeof(DWORD));
+        registry->GetValue(regKey, CONFIG_BLOCK_CACHE_SIZE, REG_DWORD, &Options.BlockCacheSize, sizeof(DWORD));
+        if (Options.BlockCacheSize < BLOCK_CACHE_SIZE_MIN || Options.BlockCacheSize > BLOCK_CACHE_SIZE_MAX)
+            Options.BlockCacheSize = BLOCK_CACHE_SIZE_DEFAULT;
     }
 }
 
@@ -286,6 +291,7 @@ void CPluginInterface::SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     registry->SetValue(regKey, CONFIG_CLEAR_READONLY, REG_DWORD, &Options.ClearReadOnly, sizeof(DWORD));
     registry->SetValue(regKey, CONFIG_SESSION_AS_DIR, REG_DWORD, &Options.SessionAsDirectory, sizeof(DWORD));
     registry->SetValue(regKey, CONFIG_BOOTIMAGE_AS_FILE, REG_DWORD, &Options.BootImageAsFile, sizeof(DWORD));
+    registry->SetValue(regKey, CONFIG_BLOCK_CACHE_SIZE, REG_DWORD, &Options.BlockCacheSize, sizeof(DWORD));
 }
 
 void CPluginInterface::Configuration(HWND parent)
@@ -148,8 +148,13 @@ struct COptions
     BOOL ClearReadOnly;      // Clear read-only attribute when copying from archive
     BOOL SessionAsDirectory; // Show session as directory (allow access to all sessions)
     BOOL BootImageAsFile;    // Show boot image disk as file
+    int BlockCacheSize;      // Memory for decompressed blocks of DMG and ISZ images (in MB)
 };
 
+#define BLOCK_CACHE_SIZE_MIN 1
+#define BLOCK_CACHE_SIZE_MAX 1024
+#define BLOCK_CACHE_SIZE_DEFAULT 64
+
 extern COptions Options; // configuration
 
 char* LoadStr(int resID);
@@ -24,6 +24,7 @@
 #include "common.h"
 #include "add_del.h"
 #include "deflate.h"
+#include "pdeflate.h"
 #include "crypt.h"
 #include "iosfxset.h"
 #include "sfxmake/sfxmake.h"
@@ -62,6 +63,10 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
 {
     CALL_STACK_MESSAGE1("CZipPack::PackNormal( , )");
 
+    // finish rolling back an interrupted in place update first
+    ErrorID = CheckJournal();
+    if (ErrorID)
+        return ErrorID;
     int ret = CreateCFile(&ZipFile, ZipName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, PE_NOSKIP, NULL,
                           true, false);
@@ -87,6 +92,9 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
         EOCentrDir.CommentLen = 0;
         Config.BackupZip = false;
     }
+    InPlace = Config.UpdateInPlace && !ZeroZip;
+    if (InPlace)
+        Config.BackupZip = false;
     if (!ErrorID && EOCentrDir.DiskNum == 0xFFFF)
         ErrorID = IDS_MODIFICATION_NOT_SUPPORTED;
     if (!ErrorID)
@@ -116,7 +124,17 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                     }
                     if (!ErrorID && !NothingToDo)
                     {
-                        if (DelFiles.Count)
+                        if (InPlace)
+                        {
+                            // replaced files are only dropped from the central directory,
+                            // their data stay in the archive until it is compacted
+                            for (int i = 0; i < DelFiles.Count; i++)
+                                UpdateCentrDir(DelFiles[i], NULL, 0);
+                            DelFiles.Destroy();
+                            ProgressTotalSize = CQuadWord(0, 0);
+                            ErrorID = WriteJournal();
+                        }
+                        else if (DelFiles.Count)
                         {
                             QuickSortHeaders(0, DelFiles.Count - 1, DelFiles);
                             ProgressTotalSize = CQuadWord().SetUI64(ZipFile->Size) -
@@ -147,7 +165,7 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                         if (!ErrorID && !UserBreak)
                         {
                             ErrorID = PackFiles();
-                            if (ErrorID && !Config.BackupZip && !ZeroZip)
+                            if (ErrorID && !Config.BackupZip && !ZeroZip && !InPlace)
                                 Recover();
                         }
                         if (!ErrorID && (!UserBreak || UserBreak && !Config.BackupZip && !ZeroZip))
@@ -157,6 +175,19 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                 if (NewCentrDir)
                     free(NewCentrDir);
             }
+            if (*JournalName)
+            {
+                if (!ErrorID)
+                    ErrorID = DeleteJournal();
+                if (ErrorID)
+                {
+                    // return the archive to its state before the update (before its time
+                    // is changed below, the journal checks it)
+                    CloseCFile(ZipFile);
+                    ZipFile = NULL;
+                    CheckJournal(TRUE);
+                }
+            }
             if (Config.BackupZip)
             {
                 if (ErrorID || UserBreak || NothingToDo)
@@ -194,7 +225,7 @@ int CZipPack::PackNormal(SalEnumSelection2 next, void* param)
                     ZipFile = NULL;
                     DeleteFile(ZipName);
                 }
-                else
+                else if (ZipFile != NULL) // closed if the in place update was rolled back
                 {
                     if (Config.TimeToNewestFile &&
                         NewestFileTime.dwLowDateTime != 0 && NewestFileTime.dwHighDateTime != 0)
@@ -1299,12 +1330,10 @@ int CZipPack::BackupZip()
     return ret;
 }
 
-int ReadInput(char* buffer, unsigned size, int* error, void* user)
+static int ReadInputAux(char* buffer, unsigned size, int* error, CZipPack* pack, BOOL updateCrc)
 {
-    CALL_STACK_MESSAGE2("ReadInput( , %u, , )", size);
     unsigned read;
     int ret;
-    CZipPack* pack = (CZipPack*)user;
 
     if (!pack->Salamander->ProgressAddSize(pack->SizeToAdd, TRUE))
     {
@@ -1318,7 +1347,8 @@ int ReadInput(char* buffer, unsigned size, int* error, void* user)
     case ERR_NOERROR:
         if (read)
         {
-            pack->Crc = SalamanderGeneral->UpdateCrc32(buffer, read, pack->Crc);
+            if (updateCrc)
+                pack->Crc = SalamanderGeneral->UpdateCrc32(buffer, read, pack->Crc);
             return read;
         }
         else
@@ -1336,6 +1366,19 @@ int ReadInput(char* buffer, unsigned size, int* error, void* user)
     return 0;
 }
 
+int ReadInput(char* buffer, unsigned size, int* error, void* user)
+{
+    CALL_STACK_MESSAGE2("ReadInput( , %u, , )", size);
+    return ReadInputAux(buffer, size, error, (CZipPack*)user, TRUE);
+}
+
+// for CDeflatePool::DeflateStream(), which computes CRC on the worker threads
+int ReadInputNoCrc(char* buffer, unsigned size, int* error, void* user)
+{
+    CALL_STACK_MESSAGE2("ReadInputNoCrc( , %u, , )", size);
+    return ReadInputAux(buffer, size, error, (CZipPack*)user, FALSE);
+}
+
 int WriteOutput(char* buffer, unsigned size, void* user)
 {
     CALL_STACK_MESSAGE2("WriteOutput( , %u, )", size);
@@ -1392,6 +1435,9 @@ int CZipPack::PackFiles()
     int ret;
     __UINT64 writePos;
     CDeflate* defObj = new CDeflate();
+    CDeflatePool* pool = NULL;
+    int ahead = 0; // next file to be compressed ahead by 'pool'
+    ush aheadFlag; // general purpose flag of the files compressed ahead (see below)
     int errorID = 0;
     char progrTextBuf[MAX_PATH + 32];
     char* progrText;
@@ -1422,6 +1468,22 @@ int CZipPack::PackFiles()
             delete defObj;
         return IDS_LOWMEM;
     }
+    // with more processors, large files are compressed in blocks in parallel and
+    // small files are compressed ahead on the worker threads, see pdeflate.h
+    if (Config.Level > 0)
+    {
+        pool = new CDeflatePool;
+        if (pool != NULL && !pool->Init(Config.Level))
+        {
+            delete pool;
+            pool = NULL;
+        }
+    }
+    // only GPF_DATADESCR matters for the workers (files with a data descriptor
+    // are never turned into stored files), it is set as below
+    aheadFlag = (Options.Action & PA_MULTIVOL || Removable) ? GPF_DATADESCR : 0;
+    if (Options.Encrypt && Config.EncryptMethod == EM_ZIP20)
+        aheadFlag |= GPF_DATADESCR;
     sour = LoadStr(IDS_ADDING);
     progrText = progrTextBuf;
     while (*sour)
@@ -1437,6 +1499,23 @@ int CZipPack::PackFiles()
         next = AddFiles[i];
         if (next->Action != AF_ADD && next->Action != AF_OVERWRITE)
             continue;
+        if (pool != NULL)
+        {
+            // let the workers compress the following small files meanwhile
+            if (ahead < i)
+                ahead = i;
+            for (; ahead < AddFiles.Count; ahead++)
+            {
+                CAddInfo* a = AddFiles[ahead];
+                if ((a->Action != AF_ADD && a->Action != AF_OVERWRITE) || a->IsDir ||
+                    a->Size.Value == 0 || a->Size.Value > PDEFLATE_SMALL_FILE_SIZE)
+                {
+                    continue;
+                }
+                if (!pool->QueueFile(ahead, a->Name, aheadFlag))
+                    break; // no free slot, try it again with the next file
+            }
+        }
         //TRACE_I("Packing file: " << next->Name);
         lstrcpyn(progrText, next->Name + SourceLen + 1, MAX_PATH + 32 - progrPrefixLen);
         Salamander->ProgressDialogAddText(progrTextBuf, TRUE);
@@ -1710,8 +1789,40 @@ int CZipPack::PackFiles()
             {
                 ullg size = 0;
                 int method = next->Method;
-                errorID = defObj->Deflate(&next->InterAttr, &method, Config.Level, &next->Flag,
-                                          &size, WriteOutput, ReadInput, this);
+                CDeflateJob* job = pool != NULL ? pool->GetFile(i) : NULL;
+                if (job != NULL && job->Error == 0 && job->Size == file.Size &&
+                    CompareFileTime(&job->LastWrite, &file.LastWrite) == 0 &&
+                    (job->Flag & GPF_DATADESCR) == (next->Flag & GPF_DATADESCR))
+                {
+                    // compressed ahead by a worker (and not changed since), just write it
+                    if (Salamander->ProgressAddSize((int)job->Size, TRUE))
+                    {
+                        next->InterAttr = job->InterAttr;
+                        next->Flag |= job->Flag & (FAST | SLOW);
+                        if (job->Method == STORE)
+                            method = CM_STORED;
+                        Crc = job->Crc;
+                        size = job->OutSize;
+                        errorID = WriteOutput(job->Out, job->OutSize, this);
+                    }
+                    else
+                        errorID = IDS_USERBREAK;
+                }
+                else
+                {
+                    if (pool != NULL && file.Size >= PDEFLATE_MIN_SIZE)
+                    {
+                        errorID = pool->DeflateStream(&next->InterAttr, &next->Flag, &size, &Crc,
+                                                      WriteOutput, ReadInputNoCrc, this);
+                    }
+                    else
+                    {
+                        errorID = defObj->Deflate(&next->InterAttr, &method, Config.Level, &next->Flag,
+                                                  &size, WriteOutput, ReadInput, this);
+                    }
+                }
+                if (job != NULL)
+                    pool->ReleaseFile(job);
                 file.CompSize = size;
                 switch (errorID)
                 {
@@ -1794,6 +1905,8 @@ int CZipPack::PackFiles()
         /*EONewCentrDir.*/ NewCentrDirOffs = writePos;
     free(buffer);
     delete defObj;
+    if (pool != NULL)
+        delete pool;
     return errorID;
 }
 
@@ -131,6 +131,9 @@ int CZipPack::DeleteFromArchive(SalEnumSelection next, void* param)
 
     //  if (ErrorID = LoadConfig())
     //    return ErrorID;
+    ErrorID = CheckJournal();
+    if (ErrorID)
+        return ErrorID;
     Pack = false;
     ZipAttr = SalamanderGeneral->SalGetFileAttributes(ZipName);
     if (ZipAttr == 0xFFFFFFFF)
@@ -309,6 +312,119 @@ int CZipPack::DeleteFromArchive(SalEnumSelection next, void* param)
     return ErrorID;
 }
 
+int CZipPack::CompactArchive()
+{
+    CALL_STACK_MESSAGE1("CZipPack::CompactArchive()");
+
+    ErrorID = CheckJournal();
+    if (ErrorID)
+        return ErrorID;
+    Pack = false;
+    ZipAttr = SalamanderGeneral->SalGetFileAttributes(ZipName);
+    if (ZipAttr == 0xFFFFFFFF)
+    {
+        ProcessError(IDS_ERRACCESS, GetLastError(), ZipName, PE_NORETRY | PE_NOSKIP, NULL);
+        return ErrorID = IDS_NODISPLAY;
+    }
+    if (ZipAttr & FILE_ATTRIBUTE_READONLY)
+    {
+        return ErrorID = IDS_READONLY;
+    }
+    int ret = CreateCFile(&ZipFile, ZipName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, PE_NOSKIP, NULL, true, false);
+    if (ret)
+    {
+        if (ret == ERR_LOWMEM)
+            return ErrorID = IDS_LOWMEM;
+        else
+            return ErrorID = IDS_NODISPLAY;
+    }
+    Options.Action = PA_NORMAL;
+    Options.Encrypt = false;
+    NothingToDo = false;
+    TCHAR title[1024];
+    _stprintf(title, LoadStr(IDS_COMPACTPROGTITLE), SalamanderGeneral->SalPathFindFileName(ZipName));
+    Salamander->OpenProgressDialog(title, TRUE, NULL, FALSE);
+    Salamander->ProgressDialogAddText(LoadStr(IDS_PREPAREDATA), FALSE);
+    ErrorID = CheckZip();
+    if (!ErrorID && ZeroZip)
+        NothingToDo = true;
+    if (!ErrorID && !NothingToDo && EOCentrDir.DiskNum == 0xFFFF)
+        ErrorID = IDS_MODIFICATION_NOT_SUPPORTED;
+    if (!ErrorID && !NothingToDo)
+    {
+        if (Config.BackupZip)
+            ErrorID = CreateTempFile();
+        else
+            TempFile = ZipFile;
+        if (!ErrorID)
+        {
+            if (EOCentrDir.DiskNum)
+            {
+                ErrorID = IDS_MULDISK;
+                Fatal = true;
+            }
+            else
+            {
+                ErrorID = LoadCentralDirectory();
+                if (!ErrorID)
+                {
+                    ErrorID = CompactFiles();
+                    if (!NothingToDo)
+                    {
+                        if (ErrorID && !Config.BackupZip)
+                            Recover();
+                        if (!ErrorID && (!UserBreak || UserBreak && !Config.BackupZip))
+                        {
+                            ErrorID = WriteCentrDir();
+                            if (!ErrorID)
+                                ErrorID = WriteEOCentrDirRecord();
+                            if (!ErrorID)
+                            {
+                                if (!Flush(TempFile, TempFile->OutputBuffer, TempFile->BufferPosition, NULL))
+                                {
+                                    SetEndOfFile(TempFile->File);
+                                }
+                                else
+                                    ErrorID = IDS_NODISPLAY;
+                            }
+                        }
+                    }
+                    free(NewCentrDir);
+                }
+            }
+            if (Config.BackupZip)
+            {
+                if (ErrorID || UserBreak || NothingToDo)
+                {
+                    CloseCFile(TempFile);
+                    DeleteFile(TempName);
+                }
+                else
+                {
+                    CloseCFile(ZipFile);
+                    ZipFile = NULL;
+                    if (ZipAttr & FILE_ATTRIBUTE_COMPRESSED)
+                    {
+                        NTFSCompressFile(TempFile->File);
+                        ZipAttr &= ~FILE_ATTRIBUTE_COMPRESSED;
+                    }
+                    CloseCFile(TempFile);
+                    SalamanderGeneral->ClearReadOnlyAttr(ZipName);
+                    if (!DeleteFile(ZipName) ||
+                        !MoveFile(TempName, ZipName))
+                        ErrorID = IDS_ERRRESTORE;
+                    SetFileAttributes(ZipName, ZipAttr | FILE_ATTRIBUTE_ARCHIVE);
+                }
+            }
+        }
+    }
+    Salamander->CloseProgressDialog();
+    if (!ErrorID && NothingToDo)
+        SalamanderGeneral->ShowMessageBox(LoadStr(IDS_COMPACTNOTHING), LoadStr(IDS_PLUGINNAME), MSGBOX_INFO);
+    return ErrorID;
+}
+
 BOOL CZipPack::LoadDefaults()
 {
     CALL_STACK_MESSAGE1("CZipPack::LoadDefaults()");
@@ -511,6 +627,9 @@ int CZipPack::CommentArchive()
 {
     CALL_STACK_MESSAGE1("CZipPack::CommentArchive()");
 
+    ErrorID = CheckJournal();
+    if (ErrorID)
+        return ErrorID;
     int ret = CreateCFile(&ZipFile, ZipName, GENERIC_READ, FILE_SHARE_READ,
                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, PE_NOSKIP, NULL,
                           true, false);
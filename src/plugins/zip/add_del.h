@@ -103,6 +103,10 @@ public:
     bool RecoverOK;
     FILETIME NewestFileTime;
 
+    //in place update
+    bool InPlace;                   //new files are appended, replaced files stay in zip
+    char JournalName[MAX_PATH + 1]; //empty if no journal was written
+
     //multi-volume archives
     bool OverwriteAll;
     bool IgnoreAllFreeSp;
@@ -126,6 +130,8 @@ public:
         NewestFileTime.dwLowDateTime = 0;
         NewestFileTime.dwHighDateTime = 0;
         SeccondPass = FALSE;
+        InPlace = false;
+        JournalName[0] = 0;
     }
 
     ~CZipPack()
@@ -166,6 +172,13 @@ public:
     int CleanUpSource();
     int LoadExPackOptions(unsigned flags);
     void Recover();
+    int CheckJournal(BOOL quiet = FALSE);
+    int WriteJournal();
+    int DeleteJournal();
+    int RestoreJournal(CFile* journal, BOOL quiet);
+    int GetJournalIdentity(CFile* file, QWORD tailOffs, CJournalHeader* header);
+    int CompactArchive();
+    int CompactFiles();
     int Store(__UINT64* size);
     int CreateNextFile(bool firstSfxDisk = false);
     int NextDisk();
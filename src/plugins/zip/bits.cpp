@@ -99,6 +99,10 @@ CDeflate::CDeflate()
         configuration_table[i] = _configuration_table[i];
 
     static_dtree[0].Len = 0; //ct_init not called
+
+    dictionary = NULL;
+    dict_len = 0;
+    stream_block = 0;
 }
 
 #define GPF_ENCRYPTED 0x01
@@ -117,6 +121,9 @@ int CDeflate::Deflate(ush* internAttr, int* compMethod, int compLevel,
         ReadData = readFunc;
         Flag = *flag;
         level = compLevel;
+        dictionary = NULL;
+        dict_len = 0;
+        stream_block = 0;
         //encrypted = *flag & GPF_ENCRYPTED ? true  : false;
         bi_init();
         ct_init(internAttr, compMethod);
@@ -130,6 +137,48 @@ int CDeflate::Deflate(ush* internAttr, int* compMethod, int compLevel,
     }
 }
 
+int CDeflate::DeflateBlock(const char* dict, unsigned dictLen, ush* internAttr,
+                           int compLevel, ullg* compLen, FWriteData writeFunc,
+                           FReadData readFunc, void* userData)
+{
+#ifdef ZIP_DLL
+    CALL_STACK_MESSAGE3("CDeflate::DeflateBlock( , %u, , %d, , , , )", dictLen, compLevel);
+#endif //ZIP_DLL
+    try
+    {
+        int method = DEFLATE;
+        ush flag = 0;
+
+        UserData = userData;
+        WriteData = writeFunc;
+        ReadData = readFunc;
+        Flag = 0;
+        level = compLevel;
+        dictionary = dict;
+        dict_len = dict != NULL ? min(dictLen, (unsigned)WSIZE) : 0;
+        stream_block = 1;
+        bi_init();
+        ct_init(internAttr, &method);
+        lm_init(level, &flag);
+        deflate();
+
+        /* Align the output on a byte boundary with an empty stored block, as
+         * zlib does for Z_SYNC_FLUSH, so that the next block can follow.
+         */
+        send_bits(STORED_BLOCK << 1, 3);
+        bi_windup();
+        PUTSHORT(0);
+        PUTSHORT(0xffff);
+        flush_outbuf(0, 0);
+        *compLen = cmpr_bytelen + ((cmpr_len_bits + 3 + 7) >> 3) + 4;
+        return 0;
+    }
+    catch (int errorID)
+    {
+        return errorID;
+    }
+}
+
 void CDeflate::bi_init() /* output zip file, NULL for in-memory compression */
 {
     bi_buf = 0;
@@ -43,6 +43,7 @@ const CConfiguration DefConfig =
         EM_ZIP20,                     // Encryption Method
         false,                        //don't add empty directories to zip
         true,                         //create temporary backup of zip
+        false,                        //append to zip in place
         true,                         //display exteded pack options dialog
         false,                        //set zip file time to the newest file time
         {"1423", {0}, {0}, {0}, {0}}, //volume sizes
@@ -2027,30 +2028,30 @@ struct CInflateBufferData
     char* OutputEnd;
 };
 
-void InflateBufferRefill(CDecompressionObject* decompress)
+static void InflateBufferRefill(CDecompressionObject* decompress)
 {
     CALL_STACK_MESSAGE1("InflateBufferRefill()");
 
+    // the whole compressed data is in the input buffer, the stream is corrupted
     decompress->Input->Error = 1;
 }
 
-int InflateBufferFlush(unsigned bytes, CDecompressionObject* decompress)
+static int InflateBufferFlush(unsigned bytes, CDecompressionObject* decompress)
 {
     CALL_STACK_MESSAGE2("InflateBufferFlush(0x%X, )", bytes);
     CInflateBufferData* data = (CInflateBufferData*)decompress->UserData;
 
-    if (data->Output + bytes > data->OutputEnd)
+    if (bytes > (unsigned)(data->OutputEnd - data->Output))
         return 1;
     memcpy(data->Output, decompress->Output->SlideWin, bytes);
     data->Output += bytes;
     return 0;
 }
 
-int InflateBuffer(char* sour, int sourSize, char* dest, int* destSize)
+int InflateMemory(CDecompressionObject* decompress, uch* slideWin, const char* sour, unsigned sourSize,
+                  char* dest, unsigned destSize, unsigned* outSize, int deflate64)
 {
-    CALL_STACK_MESSAGE1("CZipUnpack::InflateBuffer(, )");
-    int ret = 0;
-    CDecompressionObject decompress;
+    CALL_STACK_MESSAGE3("InflateMemory(, , , 0x%X, , 0x%X, , )", sourSize, destSize);
     COutputManager output;
     CInputManager input;
     CInflateBufferData data;
@@ -2058,16 +2059,28 @@ int InflateBuffer(char* sour, int sourSize, char* dest, int* destSize)
     input.BytesLeft = sourSize;
     input.Error = 0;
     input.Refill = InflateBufferRefill;
-    output.SlideWin = (__UINT8*)malloc(SLIDE_WINDOW_SIZE);
-    if (!output.SlideWin)
-        return IDS_LOWMEM;
+    output.SlideWin = slideWin;
     output.WinSize = SLIDE_WINDOW_SIZE;
     output.Flush = InflateBufferFlush;
     data.Output = dest;
-    data.OutputEnd = dest + *destSize;
-    decompress.Input = &input;
-    decompress.Output = &output;
-    decompress.UserData = &data;
+    data.OutputEnd = dest + destSize;
+    decompress->Input = &input;
+    decompress->Output = &output;
+    decompress->UserData = &data;
+    int ret = Inflate(decompress, deflate64);
+    *outSize = (unsigned)(data.Output - dest);
+    return ret;
+}
+
+int InflateBuffer(char* sour, int sourSize, char* dest, int* destSize)
+{
+    CALL_STACK_MESSAGE1("CZipUnpack::InflateBuffer(, )");
+    int ret = 0;
+    CDecompressionObject decompress;
+    unsigned outSize = 0;
+    uch* slideWin = (uch*)malloc(SLIDE_WINDOW_SIZE);
+    if (!slideWin)
+        return IDS_LOWMEM;
     decompress.fixed_tl64 = (huft*)NULL;
     decompress.fixed_td64 = (huft*)NULL;
     decompress.fixed_bl64 = 0;
@@ -2082,7 +2095,7 @@ int InflateBuffer(char* sour, int sourSize, char* dest, int* destSize)
         ret = IDS_LOWMEM;
         goto FAIL;
     }
-    switch (Inflate(&decompress, 0))
+    switch (InflateMemory(&decompress, slideWin, sour, sourSize, dest, *destSize, &outSize, 0))
     {
     case 1:;
     case 2:;
@@ -2096,9 +2109,9 @@ int InflateBuffer(char* sour, int sourSize, char* dest, int* destSize)
         ret = IDS_LOWMEM;
         break;
     }
-    *destSize = (int)(data.Output - dest);
+    *destSize = (int)outSize;
 FAIL:
-    free(output.SlideWin);
+    free(slideWin);
     FreeFixedHufman(&decompress);
     if (decompress.HeapInfo)
         HeapDestroy(decompress.HeapInfo);
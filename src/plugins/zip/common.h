@@ -64,6 +64,8 @@ struct CConfiguration
     bool NoEmptyDirs;                  //don't add empty directories to zip
     bool BackupZip;                    //create temporary backup of zip before
                                        //any modification of it
+    bool UpdateInPlace;                //append to zip in place, replaced files
+                                       //are left in it until it is compacted
     bool ShowExOptions;                //display exteded pack options dialog
     bool TimeToNewestFile;             //set zip file time to the newest file time
     char VolSizeCache[5][MAX_VOL_STR]; //volume sizes
@@ -86,12 +86,22 @@ void CDeflate::lm_init(int pack_level, /* 0: store, 1: best speed, 9: best compr
     strstart = 0;
     block_start = 0L;
 
+    /* Put the dictionary (DeflateBlock) at the beginning of the window, the
+     * input follows it as if the dictionary had just been compressed.
+     */
+    if (dict_len > 0)
+    {
+        memcpy((char*)window, dictionary, dict_len);
+        strstart = dict_len;
+        block_start = (long)dict_len;
+    }
+
     j = WSIZE;
 #ifndef MAXSEG_64K
     if (sizeof(int) > 2)
         j <<= 1; /* Can read 64K in one step */
 #endif
-    lookahead = ReadData((char*)window, j, &errorID, UserData);
+    lookahead = ReadData((char*)window + strstart, j - strstart, &errorID, UserData);
     if (errorID)
         Error(errorID);
 
@@ -113,6 +123,15 @@ void CDeflate::lm_init(int pack_level, /* 0: store, 1: best speed, 9: best compr
     /* If lookahead < MIN_MATCH, ins_h is garbage, but this is
      * not important since only literal bytes will be emitted.
      */
+
+    /* Insert all strings of the dictionary, the last ones already reach
+     * into the input. ins_h is then ready for the string at strstart.
+     */
+    for (j = 0; j < dict_len; j++)
+    {
+        IPos hash_head;
+        INSERT_STRING(j, hash_head);
+    }
 }
 
 /* ===========================================================================
@@ -473,7 +492,7 @@ ullg CDeflate::deflate_fast()
         if (lookahead < MIN_LOOKAHEAD)
             fill_window();
     }
-    return FLUSH_BLOCK(1); /* eof */
+    return FLUSH_BLOCK(!stream_block); /* eof */
 }
 
 /* ===========================================================================
@@ -602,5 +621,5 @@ ullg CDeflate::deflate()
     if (match_available)
         ct_tally(0, window[strstart - 1]);
 
-    return FLUSH_BLOCK(1); /* eof */
+    return FLUSH_BLOCK(!stream_block); /* eof */
 }
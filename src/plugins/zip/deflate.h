@@ -984,6 +984,18 @@ class CDeflate
     //bool        encrypted;
     ush Flag;
 
+    const char* dictionary;
+    unsigned dict_len;
+    /* End of the data preceding the block compressed by DeflateBlock(), its
+     * strings are put into the hash table before the block is compressed.
+     */
+
+    int stream_block;
+    /* Set by DeflateBlock(): the block is a part of a longer stream, so its
+     * last block must not be flagged as the last one and the output must not
+     * be turned into a stored file.
+     */
+
 public:
     CDeflate();
 
@@ -996,4 +1008,13 @@ public:
     int Deflate(ush* internAttr, int* compMethod, int compLevel,
                 ush* flag, ullg* compLen, FWriteData writeFunc,
                 FReadData readFunc, void* userData);
+
+    // compresses one block of a stream made of independently compressed blocks
+    // (see CDeflatePool): 'dict' is the end of the preceding data (up to WSIZE
+    // bytes, may be NULL) used as a dictionary; the output is never flagged as
+    // the last block and ends with an empty stored block (on a byte boundary),
+    // so the outputs of consecutive blocks can simply be concatenated
+    int DeflateBlock(const char* dict, unsigned dictLen, ush* internAttr,
+                     int compLevel, ullg* compLen, FWriteData writeFunc,
+                     FReadData readFunc, void* userData);
 };
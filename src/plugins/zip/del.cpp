@@ -23,6 +23,33 @@
 #include "common.h"
 #include "add_del.h"
 
+// returns position of the zip64 copy of the local header offset in the extra field
+// of 'centrHeader', NULL if the offset is stored in the header itself
+static char* FindZip64LocHeaderOffs(CFileHeader* centrHeader)
+{
+    if (centrHeader->LocHeaderOffs != 0xFFFFFFFF)
+        return NULL;
+    char* extra = (char*)centrHeader + sizeof(CFileHeader) + centrHeader->NameLen;
+    char* extraEnd = extra + centrHeader->ExtraLen;
+    while (extra + 2 + 2 <= extraEnd)
+    {
+        char* data = extra + 2 + 2; // HeaderID & DataSize
+        char* dataEnd = data + *(__UINT16*)(extra + 2);
+        if (*(__UINT16*)extra == ZIP64_HEADER_ID)
+        {
+            if (0xFFFFFFFF == centrHeader->Size)
+                data += 8;
+            if (0xFFFFFFFF == centrHeader->CompSize)
+                data += 8;
+            if (data + 8 > dataEnd || data + 8 > extraEnd)
+                return NULL;
+            return data;
+        }
+        extra = dataEnd;
+    }
+    return NULL;
+}
+
 int CZipPack::CountFilesInRoot(int* filesInRoot, bool* rootExist)
 {
     CALL_STACK_MESSAGE1("CZipPack::CountFilesInRoot(, )");
@@ -268,20 +295,8 @@ void CZipPack::UpdateCentrDir(CFileInfo* curFile, CFileInfo* nextFile, QWORD del
     centrHeader = (CFileHeader*)NewCentrDir;
     for (i = 0; (char*)centrHeader < NewCentrDir + /*EONewCentrDir.*/ NewCentrDirSize;)
     {
-        QWORD locHeaderOffs = centrHeader->LocHeaderOffs;
-        char* locHeaderOffsOffs = NULL;
-
-        if ((0xFFFFFFFF == locHeaderOffs) && (centrHeader->ExtraLen >= 2 + 2 + 8))
-        {
-            locHeaderOffsOffs = (char*)(centrHeader) + sizeof(CFileHeader) + centrHeader->NameLen;
-
-            locHeaderOffsOffs += 2 + 2; // HeaderID & DataSize
-            if (0xFFFFFFFF == centrHeader->CompSize)
-                locHeaderOffsOffs += 8;
-            if (0xFFFFFFFF == centrHeader->Size)
-                locHeaderOffsOffs += 8;
-            locHeaderOffs = *(QWORD*)locHeaderOffsOffs;
-        }
+        char* locHeaderOffsOffs = FindZip64LocHeaderOffs(centrHeader);
+        QWORD locHeaderOffs = locHeaderOffsOffs ? *(QWORD*)locHeaderOffsOffs : centrHeader->LocHeaderOffs;
 
         if (locHeaderOffs == curFile->LocHeaderOffs)
         {
@@ -342,3 +357,222 @@ void CZipPack::Recover()
         RecoverOK = true;
     }
 }
+
+struct CCompactEntry
+{
+    QWORD LocHeaderOffs; //offset of local header before compaction
+    QWORD NewOffs;       //offset of local header after compaction
+    QWORD Size;          //size of whole entry, zero for duplicate entries
+    QWORD CompSize;      //compressed size
+    QWORD FileSize;      //uncompressed size
+    unsigned Flag;       //general purpose bit flag
+};
+
+static int CompareCompactEntries(const void* entry1, const void* entry2)
+{
+    QWORD offs1 = ((const CCompactEntry*)entry1)->LocHeaderOffs;
+    QWORD offs2 = ((const CCompactEntry*)entry2)->LocHeaderOffs;
+    if (offs1 < offs2)
+        return -1;
+    return offs1 > offs2 ? 1 : 0;
+}
+
+int CZipPack::CompactFiles()
+{
+    CALL_STACK_MESSAGE1("CZipPack::CompactFiles()");
+    char* centrDirEnd = NewCentrDir + NewCentrDirSize;
+    CFileHeader* centrHeader;
+    CFileInfo fileInfo;
+    CCompactEntry* entries;
+    CCompactEntry* entry;
+    CCompactEntry key;
+    CLocalFileHeader localHeader;
+    char* buffer;
+    char* locHeaderOffsOffs;
+    unsigned bytesRead;
+    __UINT32 sig;
+    QWORD writePos;
+    QWORD liveSize;
+    QWORD next;
+    int count = 0;
+    int errorID = 0;
+    int ret;
+    int i;
+
+    for (centrHeader = (CFileHeader*)NewCentrDir; (char*)centrHeader < centrDirEnd;
+         centrHeader = (CFileHeader*)((char*)centrHeader +
+                                      sizeof(CFileHeader) +
+                                      centrHeader->NameLen +
+                                      centrHeader->ExtraLen +
+                                      centrHeader->CommentLen))
+    {
+        if ((char*)centrHeader + sizeof(CFileHeader) > centrDirEnd ||
+            (char*)centrHeader + sizeof(CFileHeader) + centrHeader->NameLen +
+                    centrHeader->ExtraLen + centrHeader->CommentLen >
+                centrDirEnd)
+        {
+            Fatal = true;
+            return IDS_ERRFORMAT;
+        }
+        count++;
+    }
+    entries = (CCompactEntry*)malloc((count + 1) * sizeof(CCompactEntry));
+    buffer = (char*)malloc(DECOMPRESS_INBUFFER_SIZE);
+    if (!entries || !buffer)
+    {
+        if (entries)
+            free(entries);
+        if (buffer)
+            free(buffer);
+        return IDS_LOWMEM;
+    }
+    centrHeader = (CFileHeader*)NewCentrDir;
+    for (i = 0; i < count; i++)
+    {
+        ProcessHeader(centrHeader, &fileInfo);
+        entries[i].LocHeaderOffs = entries[i].NewOffs = fileInfo.LocHeaderOffs;
+        entries[i].CompSize = fileInfo.CompSize;
+        entries[i].FileSize = fileInfo.Size;
+        entries[i].Flag = fileInfo.Flag;
+        centrHeader = (CFileHeader*)((char*)centrHeader +
+                                     sizeof(CFileHeader) +
+                                     centrHeader->NameLen +
+                                     centrHeader->ExtraLen +
+                                     centrHeader->CommentLen);
+    }
+    qsort(entries, count, sizeof(CCompactEntry), CompareCompactEntries);
+
+    // find out the size of each entry, it is limited by the next one in the archive
+    liveSize = 0;
+    for (i = 0; i < count && !errorID; i++)
+    {
+        entry = entries + i;
+        if (i > 0 && entry->LocHeaderOffs == entry[-1].LocHeaderOffs)
+        {
+            entry->Size = 0; // more central headers point to the same data
+            continue;
+        }
+        next = i + 1 < count ? entries[i + 1].LocHeaderOffs : CentrDirOffs;
+        ZipFile->FilePointer = entry->LocHeaderOffs;
+        ret = Read(ZipFile, &localHeader, sizeof(CLocalFileHeader), &bytesRead, NULL);
+        if (ret || bytesRead != sizeof(CLocalFileHeader) || localHeader.Signature != SIG_LOCALFH ||
+            next < entry->LocHeaderOffs)
+        {
+            if (ret)
+                errorID = IDS_NODISPLAY;
+            else
+            {
+                Fatal = true;
+                errorID = IDS_ERRFORMAT;
+            }
+            break;
+        }
+        entry->Size = sizeof(CLocalFileHeader) + localHeader.NameLen + localHeader.ExtraLen + entry->CompSize;
+        if ((entry->Flag & GPF_DATADESCR) && entry->LocHeaderOffs + entry->Size + 4 <= next)
+        {
+            // the signature of the data descriptor is optional
+            ZipFile->FilePointer = entry->LocHeaderOffs + entry->Size;
+            if (Read(ZipFile, &sig, 4, &bytesRead, NULL))
+            {
+                errorID = IDS_NODISPLAY;
+                break;
+            }
+            if ((entry->FileSize >= 0xFFFFFFFF) || (entry->CompSize >= 0xFFFFFFFF) || (entry->LocHeaderOffs >= 0xFFFFFFFF))
+                entry->Size += sizeof(CZip64DataDescriptor);
+            else
+                entry->Size += sizeof(CDataDescriptor);
+            if (sig != SIG_DATADESCR)
+                entry->Size -= 4;
+        }
+        if (entry->LocHeaderOffs + entry->Size > next)
+        {
+            TRACE_E("CZipPack::CompactFiles(): entry at " << entry->LocHeaderOffs << " overlaps the next one");
+            entry->Size = next - entry->LocHeaderOffs;
+        }
+        liveSize += entry->Size;
+    }
+
+    // data in front of the first entry (self-extractor) are kept, unless the archive
+    // starts with a local header, then the removed entries there are dropped as well
+    writePos = count ? entries[0].LocHeaderOffs : CentrDirOffs;
+    if (!errorID && writePos >= 4)
+    {
+        ZipFile->FilePointer = 0;
+        if (Read(ZipFile, &sig, 4, &bytesRead, NULL))
+            errorID = IDS_NODISPLAY;
+        else if (sig == SIG_LOCALFH)
+            writePos = 0;
+    }
+    if (!errorID && writePos + liveSize >= CentrDirOffs)
+        NothingToDo = true;
+    if (!errorID && !NothingToDo)
+    {
+        // entries in front of the first gap stay in place
+        next = writePos;
+        ProgressTotalSize = CQuadWord(0, 0);
+        for (i = 0; i < count; i++)
+        {
+            if (entries[i].LocHeaderOffs != next || Config.BackupZip)
+                ProgressTotalSize += CQuadWord().SetUI64(entries[i].Size);
+            next += entries[i].Size;
+        }
+        if (Config.BackupZip)
+        {
+            ProgressTotalSize += CQuadWord().SetUI64(writePos);
+            Salamander->ProgressDialogAddText(LoadStr(IDS_BACKUPING), TRUE);
+            Salamander->ProgressSetTotalSize(CQuadWord().SetUI64(writePos), ProgressTotalSize);
+            errorID = MoveData(0, 0, writePos, buffer);
+        }
+        Salamander->ProgressDialogAddText(LoadStr(IDS_COMPACTFILES), TRUE);
+        for (i = 0; i < count && !errorID && !UserBreak; i++)
+        {
+            entry = entries + i;
+            if (!entry->Size)
+            {
+                entry->NewOffs = entry[-1].NewOffs;
+                continue;
+            }
+            if (entry->LocHeaderOffs != writePos || Config.BackupZip)
+            {
+                Salamander->ProgressSetTotalSize(CQuadWord().SetUI64(entry->Size), ProgressTotalSize);
+                errorID = MoveData(writePos, entry->LocHeaderOffs, entry->Size, buffer);
+                if (errorID)
+                    break;
+            }
+            entry->NewOffs = writePos;
+            writePos += entry->Size;
+        }
+
+        // entries which were not moved (error or cancel) stay where they were
+        for (; i < count; i++)
+        {
+            if (!entries[i].Size)
+                entries[i].NewOffs = entries[i - 1].NewOffs;
+            if (entries[i].LocHeaderOffs + entries[i].Size > writePos)
+                writePos = entries[i].LocHeaderOffs + entries[i].Size;
+        }
+        NewCentrDirOffs = writePos;
+
+        for (centrHeader = (CFileHeader*)NewCentrDir; (char*)centrHeader < centrDirEnd;
+             centrHeader = (CFileHeader*)((char*)centrHeader +
+                                          sizeof(CFileHeader) +
+                                          centrHeader->NameLen +
+                                          centrHeader->ExtraLen +
+                                          centrHeader->CommentLen))
+        {
+            locHeaderOffsOffs = FindZip64LocHeaderOffs(centrHeader);
+            key.LocHeaderOffs = locHeaderOffsOffs ? *(QWORD*)locHeaderOffsOffs : centrHeader->LocHeaderOffs;
+            entry = (CCompactEntry*)bsearch(&key, entries, count, sizeof(CCompactEntry), CompareCompactEntries);
+            if (entry && entry->NewOffs != key.LocHeaderOffs)
+            {
+                if (!locHeaderOffsOffs)
+                    centrHeader->LocHeaderOffs = (__UINT32)entry->NewOffs;
+                else
+                    *(QWORD*)locHeaderOffsOffs = entry->NewOffs;
+            }
+        }
+    }
+    free(buffer);
+    free(entries);
+    return errorID;
+}
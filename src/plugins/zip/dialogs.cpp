@@ -822,6 +822,11 @@ BOOL CConfigDialog::OnInit(WPARAM wParam, LPARAM lParam)
     else
         SendDlgItemMessage(Dlg, IDC_BACKUP, BM_SETCHECK, (WPARAM)BST_UNCHECKED, 0);
 
+    if (Config->UpdateInPlace)
+        SendDlgItemMessage(Dlg, IDC_INPLACE, BM_SETCHECK, (WPARAM)BST_CHECKED, 0);
+    else
+        SendDlgItemMessage(Dlg, IDC_INPLACE, BM_SETCHECK, (WPARAM)BST_UNCHECKED, 0);
+
     if (Config->NoEmptyDirs)
         SendDlgItemMessage(Dlg, IDC_NOEMPTYDIRS, BM_SETCHECK, (WPARAM)BST_CHECKED, 0);
     else
@@ -883,6 +888,11 @@ BOOL CConfigDialog::OnOK(WORD wNotifyCode, WORD wID, HWND hwndCtl)
         else
             Config->BackupZip = false;
 
+        if (SendDlgItemMessage(Dlg, IDC_INPLACE, BM_GETCHECK, 0, 0) == BST_CHECKED)
+            Config->UpdateInPlace = true;
+        else
+            Config->UpdateInPlace = false;
+
         if (SendDlgItemMessage(Dlg, IDC_NOEMPTYDIRS, BM_GETCHECK, 0, 0) == BST_CHECKED)
             Config->NoEmptyDirs = true;
         else
@@ -955,6 +965,11 @@ BOOL CConfigDialog::OnDefault(WORD wNotifyCode, WORD wID, HWND hwndCtl)
     else
         SendDlgItemMessage(Dlg, IDC_BACKUP, BM_SETCHECK, (WPARAM)BST_UNCHECKED, 0);
 
+    if (DefConfig.UpdateInPlace)
+        SendDlgItemMessage(Dlg, IDC_INPLACE, BM_SETCHECK, (WPARAM)BST_CHECKED, 0);
+    else
+        SendDlgItemMessage(Dlg, IDC_INPLACE, BM_SETCHECK, (WPARAM)BST_UNCHECKED, 0);
+
     if (DefConfig.NoEmptyDirs)
         SendDlgItemMessage(Dlg, IDC_NOEMPTYDIRS, BM_SETCHECK, (WPARAM)BST_CHECKED, 0);
     else
@@ -23,6 +23,7 @@
 #include "lang\lang.rh"
 #include "extract.h"
 #include "inflate.h"
+#include "pinflate.h"
 #include "explode.h"
 #include "unshrink.h"
 #include "unreduce.h"
@@ -44,6 +45,7 @@ CZipUnpack::CZipUnpack(const char* zipName, const char* zipRoot, CSalamanderForO
         ErrorID = IDS_LOWMEM;
 
     OutputBuffer = NULL;
+    InflatedFile = NULL;
     Extract = true;
     Unshrinking = false;
     Test = false;
@@ -820,6 +822,34 @@ int CZipUnpack::UnStoreFile(CFileInfo* fileInfo, int* errorID)
     return exitCode;
 }
 
+int CZipUnpack::WriteInflatedFile(CInflateJob* job, int* errorID)
+{
+    CALL_STACK_MESSAGE1("CZipUnpack::WriteInflatedFile(, )");
+    int result;
+
+    Crc = job->Crc;
+    if (!Test)
+    {
+        result = Write(OutputFile, job->Out, job->Size, &SkipAllIOErrors);
+        if (result)
+        {
+            switch (result)
+            {
+            case ERR_SKIP:
+                return DEC_SKIP;
+            case ERR_CANCEL:
+                *errorID = IDS_NODISPLAY;
+                return DEC_CANCEL;
+            }
+        }
+    }
+    else
+        ExtractedBytes += job->Size;
+    if (!Salamander->ProgressAddSize(job->Size, TRUE))
+        UserBreak = true;
+    return DEC_NOERROR;
+}
+
 int CZipUnpack::ExplodeFile(CFileInfo* fileInfo, int* errorID)
 {
     CALL_STACK_MESSAGE1("CZipUnpack::ExplodeFile(, )");
@@ -1515,46 +1545,54 @@ int CZipUnpack::ExtractSingleFile(char* targetDir, int targetDirLen,
                         }
                         else
                         {
-                            switch (fileInfo->Method)
+                            if (InflatedFile != NULL && !Encrypted)
                             {
-                            case CM_DEFLATE64:
-                                result = InflateFile(fileInfo, TRUE, &errorID);
-                                break;
-                            case CM_DEFLATED:
-                                result = InflateFile(fileInfo, FALSE, &errorID);
-                                break;
-                            case CM_STORED:
-                                result = UnStoreFile(fileInfo, &errorID);
-                                break;
-                            case CM_IMPLODED:
-                                result = ExplodeFile(fileInfo, &errorID);
-                                break;
-                            case CM_SHRINKED:
-                                result = UnShrinkFile(fileInfo, &errorID);
-                                break;
-                            case CM_REDUCED1:
-                            case CM_REDUCED2:
-                            case CM_REDUCED3:
-                            case CM_REDUCED4:
-                                result = UnReduceFile(fileInfo, &errorID);
-                                break;
-                            case CM_BZIP2:
-                                result = UnBZIP2File(fileInfo, &errorID);
-                                break;
-                            default:
+                                // already decompressed by a worker thread
+                                result = WriteInflatedFile(InflatedFile, &errorID);
+                            }
+                            else
                             {
-                                switch (ProcessError(IDS_BADMETHOD, 0, FileNameDisp,
-                                                     PE_NORETRY | DialogFlags, &SkipAllBadMathods))
+                                switch (fileInfo->Method)
                                 {
-                                case ERR_SKIP:
-                                    result = DEC_SKIP;
+                                case CM_DEFLATE64:
+                                    result = InflateFile(fileInfo, TRUE, &errorID);
                                     break;
-                                case ERR_CANCEL:
-                                    result = DEC_CANCEL;
-                                    errorID = IDS_NODISPLAY;
+                                case CM_DEFLATED:
+                                    result = InflateFile(fileInfo, FALSE, &errorID);
+                                    break;
+                                case CM_STORED:
+                                    result = UnStoreFile(fileInfo, &errorID);
+                                    break;
+                                case CM_IMPLODED:
+                                    result = ExplodeFile(fileInfo, &errorID);
+                                    break;
+                                case CM_SHRINKED:
+                                    result = UnShrinkFile(fileInfo, &errorID);
+                                    break;
+                                case CM_REDUCED1:
+                                case CM_REDUCED2:
+                                case CM_REDUCED3:
+                                case CM_REDUCED4:
+                                    result = UnReduceFile(fileInfo, &errorID);
+                                    break;
+                                case CM_BZIP2:
+                                    result = UnBZIP2File(fileInfo, &errorID);
+                                    break;
+                                default:
+                                {
+                                    switch (ProcessError(IDS_BADMETHOD, 0, FileNameDisp,
+                                                         PE_NORETRY | DialogFlags, &SkipAllBadMathods))
+                                    {
+                                    case ERR_SKIP:
+                                        result = DEC_SKIP;
+                                        break;
+                                    case ERR_CANCEL:
+                                        result = DEC_CANCEL;
+                                        errorID = IDS_NODISPLAY;
+                                    }
                                 }
+                                } //switch (fileHeader->Method)
                             }
-                            } //switch (fileHeader->Method)
                             QWORD remain;
                             if (!Test)
                             {
@@ -1655,6 +1693,8 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
     LPTSTR progrText;
     const char* sour;
     //int                 rootLen = lstrlen(ZipRoot);
+    CInflatePool* pool = NULL;
+    int ahead = 0; // next file to be decompressed ahead by 'pool'
     int errorID = 0;
     int i;
 
@@ -1714,9 +1754,34 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
         Silent = 0;
         ProgressTotalSize += CQuadWord(ExtrFiles->Count, 0);
         Salamander->ProgressDialogAddText(LoadStr(Test ? IDS_TESTFILES : IDS_EXTRACTFILES), FALSE);
+        // with more processors, small files are read and decompressed ahead on the
+        // worker threads, see pinflate.h (not for multi-volume archives, the workers
+        // read the archive file directly)
+        if (!MultiVol && ExtrFiles->Count > 1)
+        {
+            pool = new CInflatePool;
+            if (pool != NULL && !pool->Init(ZipName))
+            {
+                delete pool;
+                pool = NULL;
+            }
+        }
         for (i = 0; i < ExtrFiles->Count && !errorID && !UserBreak; i++)
         {
             fileInfo = (*ExtrFiles)[i];
+            if (pool != NULL)
+            {
+                // let the workers decompress the following small files meanwhile
+                if (ahead < i)
+                    ahead = i;
+                for (; ahead < ExtrFiles->Count; ahead++)
+                {
+                    if (!CInflatePool::CanExtract((*ExtrFiles)[ahead]))
+                        continue;
+                    if (!pool->QueueFile(ahead, (*ExtrFiles)[ahead]))
+                        break; // no free slot, try it again with the next file
+                }
+            }
             if (tempDirLen + 1 + fileInfo->NameLen - RootLen - (RootLen ? 1 : 0) >=
                 (DWORD)(Test ? ZIP_MAX_PATH : MAX_PATH - (fileInfo->IsDir ? 12 : 0)))
             {
@@ -1737,7 +1802,12 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
             {
                 Salamander->ProgressSetTotalSize(CQuadWord().SetUI64(fileInfo->Size), ProgressTotalSize);
                 BOOL ok;
+                CInflateJob* job = pool != NULL ? pool->GetFile(i) : NULL;
+                InflatedFile = job != NULL && !job->Error ? job : NULL;
                 errorID = ExtractSingleFile(tempDir, tempDirLen, fileInfo, &ok);
+                InflatedFile = NULL;
+                if (job != NULL)
+                    pool->ReleaseFile(job);
                 if (!ok)
                     AllFilesOK = FALSE; // for archive testing
                 UserBreak = !Salamander->ProgressAddSize(1, TRUE);
@@ -1745,6 +1815,8 @@ int CZipUnpack::ExtractFiles(const char* targetDir)
             else
                 UserBreak = true;
         }
+        if (pool != NULL)
+            delete pool;
         InflateFreeFixedHufman();
     }
     /*
@@ -14,6 +14,8 @@ int ExtractFiles(const char *targetDir, CExtractInfo *info);
 int ExtractSingleFile(char * targetDir, int targetDirLen,
                       CFileInfo * fileInfo, CExtractInfo * info);
 */
+struct CInflateJob;
+
 class CZipUnpack : public CZipCommon
 {
 public:
@@ -64,6 +66,9 @@ public:
     unsigned OutBufSize;
     bool Unshrinking;
 
+    //file decompressed ahead by CInflatePool (see ExtractFiles), NULL if none
+    CInflateJob* InflatedFile;
+
     CZipUnpack(const char* zipName, const char* zipRoot, CSalamanderForOperationsAbstract* salamander,
                TIndirectArray2<char>* archiveVolumes);
 
@@ -91,6 +96,7 @@ public:
     int UnShrinkFile(CFileInfo* fileInfo, int* errorID);
     int UnReduceFile(CFileInfo* fileInfo, int* errorID);
     int UnBZIP2File(CFileInfo* fileInfo, int* errorID);
+    int WriteInflatedFile(CInflateJob* job, int* errorID);
     int ExtractFiles(const char* targetDir);
     int ExtractSingleFile(char* targetDir, int targetDirLen,
                           CFileInfo* fileInfo, BOOL* success, const char* newFileName = NULL);
@@ -338,6 +338,217 @@ static const int dbits = 6; /* bits in base distance lookup table */
 
 #ifndef ASM_INFLATECODES
 
+/* copy n bytes from distance d (already subtracted from w) in the sliding window,
+   flushing the window whenever it gets full */
+static int copy_match(CDecompressionObject* decompress, uch* redirSlide, unsigned wsize,
+                      unsigned* pw, unsigned d, unsigned n)
+{
+    unsigned e;
+    unsigned w = *pw;
+
+    do
+    {
+        e = wsize - ((d &= (wsize - 1)) > w ? d : w);
+        if (e > n)
+            e = n;
+        n -= e;
+#ifndef NOMEMCPY
+        if (w - d >= e)
+        /* (this test assumes unsigned comparison) */
+        {
+            memmove(redirSlide + w, redirSlide + d, e);
+            w += e;
+            d += e;
+        }
+        else /* do it slowly to avoid memcpy() overlap */
+#endif       /* !NOMEMCPY */
+            do
+            {
+                redirSlide[w++] = redirSlide[d++];
+            } while (--e);
+        if (w == wsize)
+        {
+            if (decompress->Output->Flush(w, decompress))
+            {
+                TRACE_I("inflate_codes: flush returned error");
+                return 5;
+            }
+            w = 0;
+        }
+    } while (n);
+    *pw = w;
+    return 0;
+}
+
+/* Fast decoding loop, used while the input buffer holds at least FAST_INPUT_MIN
+   bytes. It keeps 56 to 63 bits in a 64-bit bit buffer, refilled by a single
+   unaligned load without any per-byte checks, and copies matches which do not
+   cross the end of the sliding window in 8-byte chunks. Bit buffer layout:
+   the bits above k are the following input bits, so loading the same bytes
+   again in the next refill does not change them. */
+
+typedef unsigned __int64 ulg64;
+
+#define FAST_INPUT_MIN 32 /* input bytes needed to enter the fast loop */
+#define FAST_EOB (-1)     /* inflate_codes_fast(): end of block reached */
+
+#ifdef _DEBUG
+BOOL InflateFastLoop = TRUE;
+#define FAST_LOOP_ENABLED InflateFastLoop
+#else // _DEBUG
+#define FAST_LOOP_ENABLED TRUE
+#endif // _DEBUG
+
+#define FASTREFILL() \
+    { \
+        ulg64 v; \
+        memcpy(&v, in, sizeof(v)); \
+        bb |= v << kk; \
+        in += (63 - kk) >> 3; \
+        kk |= 56; \
+    }
+
+#define FASTMASK(n) ((unsigned)bb & ((1U << (n)) - 1))
+
+/* returns 0 when the input is nearly exhausted, FAST_EOB at the end of block
+   or an error code */
+static int inflate_codes_fast(CDecompressionObject* decompress,
+                              struct huft* tl, struct huft* td, int bl, int bd,
+                              ulg* pb, unsigned* pk, unsigned* pw)
+{
+    const uch* inStart = decompress->Input->NextByte;
+    const uch* in = inStart;
+    const uch* inLast = inStart + decompress->Input->BytesLeft - 16;
+    uch* redirSlide = decompress->Output->SlideWin;
+    unsigned wsize = decompress->Output->WinSize;
+    unsigned w = *pw;
+    ulg64 bb = *pb;    /* bit buffer */
+    unsigned kk = *pk; /* number of bits in bit buffer, never more than 32 on entry */
+    unsigned ml = (1U << bl) - 1;
+    unsigned md = (1U << bd) - 1;
+    unsigned e, n, d;
+    struct huft* t;
+    int ret = 0;
+
+    while (in < inLast)
+    {
+        FASTREFILL()
+        t = tl + ((unsigned)bb & ml);
+        while (1)
+        {
+            bb >>= t->b;
+            kk -= t->b;
+            if ((e = t->e) == 32) /* literal */
+            {
+                redirSlide[w++] = (uch)t->v.n;
+                if (w == wsize)
+                {
+                    if (decompress->Output->Flush(w, decompress))
+                    {
+                        TRACE_I("inflate_codes: flush returned error");
+                        ret = 5;
+                        goto restore;
+                    }
+                    w = 0;
+                }
+                break;
+            }
+            if (e < 31) /* length, at most 15 + 16 bits were needed so far */
+            {
+                n = t->v.n + FASTMASK(e);
+                bb >>= e;
+                kk -= e;
+                FASTREFILL()
+                t = td + ((unsigned)bb & md);
+                while (1)
+                {
+                    bb >>= t->b;
+                    kk -= t->b;
+                    if ((e = t->e) < 32)
+                        break;
+                    if (IS_INVALID_CODE(e))
+                    {
+                        TRACE_E("inflate_codes: invalid code");
+                        ret = 1;
+                        goto restore;
+                    }
+                    e &= 31;
+                    t = t->v.t + FASTMASK(e);
+                }
+                d = t->v.n + FASTMASK(e); /* distance */
+                bb >>= e;
+                kk -= e;
+                if (d <= w && w + n < wsize) /* the window is flushed by copy_match() or a literal */
+                {
+                    uch* out = redirSlide + w;
+                    const uch* from = out - d;
+                    w += n;
+                    if (d >= 8)
+                    {
+                        /* whole chunks, the rest exactly: the bytes behind the match are
+                           still history for Deflate64 (distances up to the window size) */
+                        for (; n >= 8; n -= 8)
+                        {
+                            ulg64 v;
+                            memcpy(&v, from, sizeof(v));
+                            memcpy(out, &v, sizeof(v));
+                            out += 8;
+                            from += 8;
+                        }
+                        while (n--)
+                            *out++ = *from++;
+                    }
+                    else
+                    {
+                        if (d == 1)
+                            memset(out, *from, n);
+                        else
+                        {
+                            do
+                            {
+                                *out++ = *from++;
+                            } while (--n);
+                        }
+                    }
+                }
+                else
+                {
+                    if ((ret = copy_match(decompress, redirSlide, wsize, &w, w - d, n)) != 0)
+                        goto restore;
+                }
+                break;
+            }
+            if (e == 31) /* end of block */
+            {
+                ret = FAST_EOB;
+                goto restore;
+            }
+            if (IS_INVALID_CODE(e))
+            {
+                TRACE_E("inflate_codes: invalid code");
+                ret = 1;
+                goto restore;
+            }
+            e &= 31;
+            t = t->v.t + FASTMASK(e);
+        }
+    }
+
+restore:
+    /* give back the whole bytes loaded here, so that at most 32 bits stay in the bit buffer */
+    n = (unsigned)(in - inStart);
+    if (n > (kk >> 3))
+        n = kk >> 3;
+    in -= n;
+    kk -= n << 3;
+    decompress->Input->BytesLeft -= (unsigned)(in - inStart);
+    decompress->Input->NextByte = (uch*)in;
+    *pb = (ulg)(bb & (((ulg64)1 << kk) - 1));
+    *pk = kk;
+    *pw = w;
+    return ret;
+}
+
 /* inflate (decompress) the codes in a deflated (compressed) block.
    Return an error code or zero if it all goes ok. */
 int inflate_codes(CDecompressionObject* decompress,
@@ -368,6 +579,15 @@ int inflate_codes(CDecompressionObject* decompress,
     md = mask_bits[bd];
     while (1) /* do until end of block */
     {
+        if (FAST_LOOP_ENABLED && decompress->Input->BytesLeft >= FAST_INPUT_MIN)
+        {
+            int ret = inflate_codes_fast(decompress, tl, td, bl, bd, &b, &k, &w);
+            if (ret == FAST_EOB)
+                goto cleanup_decode;
+            if (ret)
+                return ret;
+            continue;
+        }
         NEEDBITS((unsigned)bl, decompress)
         t = tl + ((unsigned)b & ml);
         while (1)
@@ -418,36 +638,8 @@ int inflate_codes(CDecompressionObject* decompress,
                 DUMPBITS(e)
 
                 /* do the copy */
-                do
-                {
-                    e = wsize - ((d &= (wsize - 1)) > w ? d : w);
-                    if (e > n)
-                        e = n;
-                    n -= e;
-#ifndef NOMEMCPY
-                    if (w - d >= e)
-                    /* (this test assumes unsigned comparison) */
-                    {
-                        memmove(redirSlide + w, redirSlide + d, e);
-                        w += e;
-                        d += e;
-                    }
-                    else /* do it slowly to avoid memcpy() overlap */
-#endif                   /* !NOMEMCPY */
-                        do
-                        {
-                            redirSlide[w++] = redirSlide[d++];
-                        } while (--e);
-                    if (w == wsize)
-                    {
-                        if (decompress->Output->Flush(w, decompress))
-                        {
-                            TRACE_I("inflate_codes: flush returned error");
-                            return 5;
-                        }
-                        w = 0;
-                    }
-                } while (n);
+                if (copy_match(decompress, redirSlide, wsize, &w, d, n))
+                    return 5;
                 break;
             }
 
@@ -116,6 +116,19 @@ struct tagCDecompressionObject
 };
 
 int Inflate(CDecompressionObject* decompress, int deflate64);
+
+#ifdef _DEBUG
+// FALSE leaves all decoding to the bit-by-bit loop of inflate_codes(), RunInflateBenchmark()
+// compares it with the fast loop
+extern BOOL InflateFastLoop;
+#endif // _DEBUG
+
+// inflates the whole stream from 'sour' to 'dest' (at most 'destSize' bytes, the number of
+// written bytes is returned in 'outSize'); 'decompress' must have HeapInfo and the fixed_*
+// tables initialized, the tables built by Inflate() are left there for the next call;
+// 'slideWin' has SLIDE_WINDOW_SIZE bytes; returns the result of Inflate()
+int InflateMemory(CDecompressionObject* decompress, uch* slideWin, const char* sour, unsigned sourSize,
+                  char* dest, unsigned destSize, unsigned* outSize, int deflate64);
 int FreeFixedHufman(CDecompressionObject* decompress);
 
 //used in explode
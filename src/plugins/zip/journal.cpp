@@ -0,0 +1,341 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+#include <crtdbg.h>
+#include <ostream>
+#include <commctrl.h>
+
+#include "spl_com.h"
+#include "spl_base.h"
+#include "spl_gen.h"
+#include "spl_arc.h"
+#include "spl_menu.h"
+#include "dbg.h"
+
+#include "array2.h"
+
+#include "selfextr/comdefs.h"
+#include "config.h"
+#include "typecons.h"
+#include "zip.rh2"
+#include "chicon.h"
+#include "common.h"
+#include "add_del.h"
+
+// The in place update (see CConfiguration::UpdateInPlace) writes new files over
+// the central directory of the archive. Before that, the original tail of the archive
+// (central directory, end of central directory records and comment) is saved to
+// "<archive>.journal". The journal is deleted once the updated archive is flushed
+// to the disk. When it is found later, the update was interrupted and writing
+// the saved tail back returns the archive to its state before the update.
+// The journal also identifies the archive (file index, last write time and a crc
+// of the data the update does not touch). If the archive was deleted or does not
+// match, the journal is discarded and nothing is written.
+
+#define JOURNAL_WINDOW 0x10000 // bytes checked at the start of the archive and before its tail
+
+static BOOL GetJournalName(char* journalName, const char* zipName)
+{
+    if (lstrlen(zipName) + 8 > MAX_PATH)
+        return FALSE;
+    lstrcpy(journalName, zipName);
+    lstrcat(journalName, ".journal");
+    return TRUE;
+}
+
+int CZipPack::CheckJournal(BOOL quiet)
+{
+    CALL_STACK_MESSAGE2("CZipPack::CheckJournal(%d)", quiet);
+    char journalName[MAX_PATH + 1];
+    CFile* journal;
+
+    if (!GetJournalName(journalName, ZipName) ||
+        SalamanderGeneral->SalGetFileAttributes(journalName) == 0xFFFFFFFF)
+    {
+        return 0; // no journal, the last update was completed
+    }
+    int ret = CreateCFile(&journal, journalName, GENERIC_READ, FILE_SHARE_READ,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, PE_NOSKIP, NULL,
+                          true, false);
+    if (ret)
+    {
+        if (ret == ERR_LOWMEM)
+            return IDS_LOWMEM;
+        else
+            return IDS_NODISPLAY;
+    }
+    int errorID = RestoreJournal(journal, quiet);
+    CloseCFile(journal);
+    if (!errorID)
+        DeleteFile(journalName);
+    return errorID;
+}
+
+int CZipPack::RestoreJournal(CFile* journal, BOOL quiet)
+{
+    CALL_STACK_MESSAGE2("CZipPack::RestoreJournal(, %d)", quiet);
+    CJournalHeader header;
+    CFile* zipFile;
+    char* tail;
+    unsigned tailSize;
+    unsigned bytesRead;
+    int errorID = 0;
+    int ret;
+
+    if (journal->Size <= sizeof(CJournalHeader))
+        return 0;
+    if (Read(journal, &header, sizeof(CJournalHeader), &bytesRead, NULL))
+        return IDS_NODISPLAY;
+    tailSize = (unsigned)(journal->Size - sizeof(CJournalHeader));
+    // the signature is written as the last one, without it the journal was not
+    // completed and the archive was not touched yet
+    if (bytesRead != sizeof(CJournalHeader) || header.Signature != SIG_JOURNAL ||
+        header.TailOffs + tailSize != header.ArchiveSize)
+    {
+        TRACE_I("Incomplete journal of " << ZipName << " was dropped");
+        return 0;
+    }
+    tail = (char*)malloc(tailSize);
+    if (!tail)
+        return IDS_LOWMEM;
+    if (Read(journal, tail, tailSize, &bytesRead, NULL))
+        errorID = IDS_NODISPLAY;
+    else
+    {
+        DWORD err;
+        if (bytesRead != tailSize || SalamanderGeneral->UpdateCrc32(tail, tailSize, 0) != header.Crc)
+            TRACE_E("Corrupted journal of " << ZipName << " was dropped");
+        else if (SalamanderGeneral->SalGetFileAttributes(ZipName) == 0xFFFFFFFF &&
+                 ((err = GetLastError()) == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND))
+        {
+            // the archive was deleted, the journal would block every later update
+            TRACE_I("Journal of missing archive " << ZipName << " was dropped");
+            if (!quiet)
+                SalamanderGeneral->ShowMessageBox(LoadStr(IDS_JOURNALDROPPED), LoadStr(IDS_PLUGINNAME), MSGBOX_WARNING);
+        }
+        else
+        {
+            ret = CreateCFile(&zipFile, ZipName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, PE_NOSKIP, NULL,
+                              true, false);
+            if (ret)
+            {
+                if (ret == ERR_LOWMEM)
+                    errorID = IDS_LOWMEM;
+                else
+                    errorID = IDS_NODISPLAY;
+            }
+            else
+            {
+                // the journal must belong to this very archive: the same file whose data
+                // in front of the saved tail were not changed (the update writes only
+                // behind TailOffs), otherwise writing the tail would corrupt the archive
+                CJournalHeader current;
+                BOOL stale = zipFile->Size < header.TailOffs;
+                if (!stale)
+                {
+                    errorID = GetJournalIdentity(zipFile, header.TailOffs, &current);
+                    stale = !errorID &&
+                            (current.FileIndex != header.FileIndex || current.VolumeSerial != header.VolumeSerial ||
+                             current.LastWrite < header.LastWrite || current.WindowCrc != header.WindowCrc);
+                }
+                if (stale)
+                {
+                    TRACE_E("Journal of " << ZipName << " does not match the archive, it was dropped");
+                    if (!quiet)
+                        SalamanderGeneral->ShowMessageBox(LoadStr(IDS_JOURNALDROPPED), LoadStr(IDS_PLUGINNAME), MSGBOX_WARNING);
+                }
+                else if (!errorID)
+                {
+                    zipFile->FilePointer = header.TailOffs;
+                    if (Write(zipFile, tail, tailSize, NULL) ||
+                        Flush(zipFile, zipFile->OutputBuffer, zipFile->BufferPosition, NULL))
+                    {
+                        errorID = IDS_NODISPLAY;
+                    }
+                    else
+                    {
+                        zipFile->BufferPosition = 0;
+                        if (!SetEndOfFile(zipFile->File) || !FlushFileBuffers(zipFile->File))
+                        {
+                            ProcessError(IDS_ERRWRITE, GetLastError(), ZipName, PE_NORETRY | PE_NOSKIP, NULL);
+                            errorID = IDS_NODISPLAY;
+                        }
+                    }
+                    if (!errorID && !quiet)
+                        SalamanderGeneral->ShowMessageBox(LoadStr(IDS_JOURNALRESTORED), LoadStr(IDS_PLUGINNAME), MSGBOX_INFO);
+                }
+                CloseCFile(zipFile);
+            }
+        }
+    }
+    free(tail);
+    return errorID;
+}
+
+// fills the fields of 'header' identifying the archive: the file itself and the data
+// the in place update does not overwrite (the start of the archive and the data just
+// in front of its tail at 'tailOffs')
+int CZipPack::GetJournalIdentity(CFile* file, QWORD tailOffs, CJournalHeader* header)
+{
+    CALL_STACK_MESSAGE1("CZipPack::GetJournalIdentity(, , )");
+    BY_HANDLE_FILE_INFORMATION fi;
+    char* window;
+    unsigned windowSize;
+    unsigned bytesRead;
+    DWORD crc = 0;
+
+    if (!GetFileInformationByHandle(file->File, &fi))
+    {
+        ProcessError(IDS_ERRREAD, GetLastError(), ZipName, PE_NORETRY | PE_NOSKIP, NULL);
+        return IDS_NODISPLAY;
+    }
+    header->LastWrite = MAKEQWORD(fi.ftLastWriteTime.dwLowDateTime, fi.ftLastWriteTime.dwHighDateTime);
+    header->FileIndex = MAKEQWORD(fi.nFileIndexLow, fi.nFileIndexHigh);
+    header->VolumeSerial = fi.dwVolumeSerialNumber;
+
+    windowSize = (unsigned)min(tailOffs, (QWORD)JOURNAL_WINDOW);
+    window = (char*)malloc(JOURNAL_WINDOW);
+    if (!window)
+        return IDS_LOWMEM;
+    file->FilePointer = 0;
+    if (Read(file, window, windowSize, &bytesRead, NULL))
+    {
+        free(window);
+        return IDS_NODISPLAY;
+    }
+    crc = SalamanderGeneral->UpdateCrc32(window, bytesRead, crc);
+    file->FilePointer = tailOffs - windowSize;
+    if (Read(file, window, windowSize, &bytesRead, NULL))
+    {
+        free(window);
+        return IDS_NODISPLAY;
+    }
+    header->WindowCrc = SalamanderGeneral->UpdateCrc32(window, bytesRead, crc);
+    free(window);
+    return 0;
+}
+
+int CZipPack::WriteJournal()
+{
+    CALL_STACK_MESSAGE1("CZipPack::WriteJournal()");
+    CJournalHeader header;
+    CFile* journal;
+    char* tail;
+    unsigned tailSize;
+    unsigned bytesRead;
+    int errorID = 0;
+    int ret;
+
+    if (!GetJournalName(JournalName, ZipName))
+    {
+        *JournalName = 0;
+        return IDS_TOOLONGZIPNAME;
+    }
+    tailSize = (unsigned)(ZipFile->Size - CentrDirOffs);
+    tail = (char*)malloc(tailSize);
+    if (!tail)
+    {
+        *JournalName = 0;
+        return IDS_LOWMEM;
+    }
+    ZipFile->FilePointer = CentrDirOffs;
+    ret = Read(ZipFile, tail, tailSize, &bytesRead, NULL);
+    if (ret || bytesRead != tailSize)
+    {
+        free(tail);
+        *JournalName = 0;
+        if (ret)
+            return IDS_NODISPLAY;
+        Fatal = true;
+        return IDS_ERRFORMAT;
+    }
+    memset(&header, 0, sizeof(CJournalHeader));
+    errorID = GetJournalIdentity(ZipFile, CentrDirOffs, &header);
+    if (errorID)
+    {
+        free(tail);
+        *JournalName = 0;
+        return errorID;
+    }
+    ret = CreateCFile(&journal, JournalName, GENERIC_WRITE, 0, CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, PE_NOSKIP, NULL, true, false);
+    if (ret)
+    {
+        free(tail);
+        *JournalName = 0;
+        if (ret == ERR_LOWMEM)
+            return IDS_LOWMEM;
+        else
+            return IDS_NODISPLAY;
+    }
+    header.Crc = SalamanderGeneral->UpdateCrc32(tail, tailSize, 0);
+    header.TailOffs = CentrDirOffs;
+    header.ArchiveSize = ZipFile->Size;
+    if (Write(journal, &header, sizeof(CJournalHeader), NULL) ||
+        Write(journal, tail, tailSize, NULL) ||
+        Flush(journal, journal->OutputBuffer, journal->BufferPosition, NULL))
+    {
+        errorID = IDS_NODISPLAY;
+    }
+    else
+    {
+        // the journal becomes valid only after the saved tail is on the disk
+        journal->BufferPosition = 0;
+        if (FlushFileBuffers(journal->File))
+        {
+            header.Signature = SIG_JOURNAL;
+            journal->FilePointer = 0;
+            if (Write(journal, &header, sizeof(CJournalHeader), NULL) ||
+                Flush(journal, journal->OutputBuffer, journal->BufferPosition, NULL))
+            {
+                errorID = IDS_NODISPLAY;
+            }
+            else
+            {
+                journal->BufferPosition = 0;
+                if (!FlushFileBuffers(journal->File))
+                    errorID = IDS_ERRJOURNAL;
+            }
+        }
+        else
+            errorID = IDS_ERRJOURNAL;
+        if (errorID == IDS_ERRJOURNAL)
+        {
+            ProcessError(IDS_ERRJOURNAL, GetLastError(), JournalName, PE_NORETRY | PE_NOSKIP, NULL);
+            errorID = IDS_NODISPLAY;
+        }
+    }
+    CloseCFile(journal);
+    free(tail);
+    if (errorID)
+    {
+        DeleteFile(JournalName);
+        *JournalName = 0;
+    }
+    return errorID;
+}
+
+int CZipPack::DeleteJournal()
+{
+    CALL_STACK_MESSAGE1("CZipPack::DeleteJournal()");
+    if (*JournalName)
+    {
+        // the updated archive has to reach the disk before its journal is dropped;
+        // if it does not, the update fails and the caller rolls it back, a journal
+        // must never survive an update reported as successful
+        if (!FlushFileBuffers(ZipFile->File))
+        {
+            ProcessError(IDS_ERRWRITE, GetLastError(), ZipName, PE_NORETRY | PE_NOSKIP, NULL);
+            return IDS_NODISPLAY;
+        }
+        if (!DeleteFile(JournalName))
+        {
+            ProcessError(IDS_ERRDELJOURNAL, GetLastError(), JournalName, PE_NORETRY | PE_NOSKIP, NULL);
+            return IDS_NODISPLAY;
+        }
+        *JournalName = 0;
+    }
+    return 0;
+}
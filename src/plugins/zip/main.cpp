@@ -27,6 +27,7 @@
 #include "common.h"
 #include "list.h"
 #include "extract.h"
+#include "pinflate.h"
 #include "add_del.h"
 #include "zipdll.h"
 #include "dialogs.h"
@@ -64,6 +65,7 @@ const char* CONFIG_LEVEL = "Level";
 const char* CONFIG_ENCRYPTMETHOD = "Encryption Method";
 const char* CONFIG_NOEMPTYDIRS = "No Empty Dirs";
 const char* CONFIG_BACKUPZIP = "Backup ZIP";
+const char* CONFIG_UPDATEINPLACE = "Update In Place";
 const char* CONFIG_SHOWEXOPT = "Show Extended Options";
 const char* CONFIG_TIMETONEWESTFILE = "Time To Newest File";
 const char* CONFIG_VOLSIZECACHE = "Volume Size %d";
@@ -103,6 +105,7 @@ const char* CONFIG_COL_PACKEDSIZE_WIDTH = "Column PackedSize Width";
 #define MID_REPAIR 2
 #define MID_TEST 3
 #define MID_COMMENT 4
+#define MID_COMPACT 5
 
 //
 // ****************************************************************************
@@ -177,6 +180,10 @@ CPluginInterfaceAbstract* WINAPI SalamanderPluginEntry(CSalamanderPluginEntryAbs
     // register the plugin home page URL
     salamander->SetPluginHomePageURL("www.altap.cz");
 
+#ifdef _DEBUG
+    RunInflateBenchmark(); // only if requested by OPENSAL_BENCHMARK
+#endif // _DEBUG
+
     return &PluginInterface;
 }
 
@@ -260,6 +267,10 @@ void CPluginInterface::LoadConfiguration(HWND parent, HKEY regKey, CSalamanderRe
         {
             Config.BackupZip = (v != 0);
         }
+        if (registry->GetValue(regKey, CONFIG_UPDATEINPLACE, REG_DWORD, &v, sizeof(DWORD)))
+        {
+            Config.UpdateInPlace = (v != 0);
+        }
         if (registry->GetValue(regKey, CONFIG_SHOWEXOPT, REG_DWORD, &v, sizeof(DWORD)))
         {
             Config.ShowExOptions = (v != 0);
@@ -403,6 +414,8 @@ void CPluginInterface::SaveConfiguration(HWND parent, HKEY regKey, CSalamanderRe
     registry->SetValue(regKey, CONFIG_NOEMPTYDIRS, REG_DWORD, &v, sizeof(DWORD));
     v = Config.BackupZip;
     registry->SetValue(regKey, CONFIG_BACKUPZIP, REG_DWORD, &v, sizeof(DWORD));
+    v = Config.UpdateInPlace;
+    registry->SetValue(regKey, CONFIG_UPDATEINPLACE, REG_DWORD, &v, sizeof(DWORD));
     v = Config.ShowExOptions;
     registry->SetValue(regKey, CONFIG_SHOWEXOPT, REG_DWORD, &v, sizeof(DWORD));
     v = Config.TimeToNewestFile;
@@ -526,6 +539,7 @@ MENU_TEMPLATE_ITEM PluginMenu[] =
 	{MNTT_IT, IDS_MENUCREATESFX
 //	{MNTT_IT, IDS_MENUREPAIR
 	{MNTT_IT, IDS_MENUTEST
+	{MNTT_IT, IDS_MENUCOMPACT
 	{MNTT_PE, 0
 };
 */
@@ -536,6 +550,8 @@ MENU_TEMPLATE_ITEM PluginMenu[] =
                             MENU_SKILLLEVEL_ALL);
     //salamander->AddMenuItem(LoadStr(IDS_MENUREPAIR), 0, MID_REPAIR, TRUE, 0, 0);
     salamander->AddMenuItem(-1, LoadStr(IDS_MENUTEST), 0, MID_TEST, TRUE, 0, 0, MENU_SKILLLEVEL_ALL);
+    salamander->AddMenuItem(-1, LoadStr(IDS_MENUCOMPACT), 0, MID_COMPACT, TRUE, 0, 0,
+                            MENU_SKILLLEVEL_INTERMEDIATE | MENU_SKILLLEVEL_ADVANCED);
 
     if (Config.Version < 2) // before SS 1.6 beta 4
     {
@@ -704,6 +720,24 @@ BOOL CPluginInterfaceForMenuExt::ExecuteMenuItem(CSalamanderForOperationsAbstrac
             break;
         }
 
+        case MID_COMPACT:
+        {
+            SalamanderGeneral->SetUserWorkedOnPanelPath(PANEL_SOURCE); // treat this command as work on the path (shows up in Alt+F12)
+
+            CZipPack pack(zipFile, "", salamander);
+
+            if (pack.ErrorID || pack.CompactArchive())
+            {
+                if (pack.ErrorID != IDS_NODISPLAY)
+                    SalamanderGeneral->ShowMessageBox(LoadStr(pack.ErrorID),
+                                                      LoadStr(IDS_PLUGINNAME), MSGBOX_ERROR);
+                ok = FALSE;
+            }
+            if (pack.UserBreak)
+                ok = FALSE;
+            break;
+        }
+
             //case MID_REPAIR:break;
 
         case MID_TEST:
@@ -733,7 +767,7 @@ BOOL CPluginInterfaceForMenuExt::ExecuteMenuItem(CSalamanderForOperationsAbstrac
         }
         }
 
-        if (id == MID_COMMENT || id == MID_CREATESFX || id == MID_REPAIR) // when the operation may have modified the path
+        if (id == MID_COMMENT || id == MID_CREATESFX || id == MID_REPAIR || id == MID_COMPACT) // when the operation may have modified the path
         {
             if (!changesReported) // path changed and has not been reported yet -> report it
             {
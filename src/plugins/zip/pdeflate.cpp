@@ -0,0 +1,460 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "spl_com.h"
+#include "spl_base.h"
+#include "spl_gen.h"
+#include "dbg.h"
+
+#include "config.h"
+#include "common.h"
+#include "deflate.h"
+#include "pdeflate.h"
+
+#ifndef SSZIP
+#include "lang\lang.rh"
+#endif //SSZIP
+
+//
+// ****************************************************************************
+// CombineCrc32
+//
+
+static __UINT32 GF2MatrixTimes(const __UINT32* mat, __UINT32 vec)
+{
+    __UINT32 sum = 0;
+    while (vec)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void GF2MatrixSquare(__UINT32* square, const __UINT32* mat)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = GF2MatrixTimes(mat, mat[n]);
+}
+
+__UINT32 CombineCrc32(__UINT32 crc1, __UINT32 crc2, QWORD len2)
+{
+    __UINT32 even[32]; // even-power-of-two zeros operator
+    __UINT32 odd[32];  // odd-power-of-two zeros operator
+
+    if (len2 == 0)
+        return crc1;
+
+    // operator for one zero bit in 'odd'
+    odd[0] = 0xEDB88320; // CRC-32 polynomial
+    __UINT32 row = 1;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    GF2MatrixSquare(even, odd); // two zero bits
+    GF2MatrixSquare(odd, even); // four zero bits
+
+    // apply len2 zeros to crc1 (the first square puts the operator for one zero
+    // byte, eight zero bits, in 'even')
+    do
+    {
+        GF2MatrixSquare(even, odd);
+        if (len2 & 1)
+            crc1 = GF2MatrixTimes(even, crc1);
+        len2 >>= 1;
+        if (len2 == 0)
+            break;
+
+        GF2MatrixSquare(odd, even);
+        if (len2 & 1)
+            crc1 = GF2MatrixTimes(odd, crc1);
+        len2 >>= 1;
+    } while (len2 != 0);
+
+    return crc1 ^ crc2;
+}
+
+//
+// ****************************************************************************
+// CDeflatePool
+//
+
+static int ReadJobInput(char* buffer, unsigned size, int* error, void* user)
+{
+    CDeflateJob* job = (CDeflateJob*)user;
+    unsigned left = job->InSize - job->InPos;
+    if (size > left)
+        size = left;
+    memcpy(buffer, job->In + job->DictLen + job->InPos, size);
+    job->InPos += size;
+    return size;
+}
+
+static int WriteJobOutput(char* buffer, unsigned size, void* user)
+{
+    CDeflateJob* job = (CDeflateJob*)user;
+    if (job->OutSize + size > job->OutAlloc)
+    {
+        unsigned alloc = max(job->OutAlloc * 2, job->OutSize + size);
+        char* out = (char*)realloc(job->Out, alloc);
+        if (out == NULL)
+            return IDS_LOWMEM;
+        job->Out = out;
+        job->OutAlloc = alloc;
+    }
+    memcpy(job->Out + job->OutSize, buffer, size);
+    job->OutSize += size;
+    return 0;
+}
+
+CDeflatePool::CDeflatePool()
+{
+    Level = 0;
+    Threads = 0;
+    InitializeCriticalSection(&QueueLock);
+    QueueFirst = 0;
+    QueueCount = 0;
+    QueueSem = NULL;
+    Terminate = FALSE;
+    ZeroMemory(Blocks, sizeof(Blocks));
+    ZeroMemory(Files, sizeof(Files));
+    FilesFirst = 0;
+    FilesCount = 0;
+}
+
+CDeflatePool::~CDeflatePool()
+{
+    CALL_STACK_MESSAGE1("CDeflatePool::~CDeflatePool()");
+    EnterCriticalSection(&QueueLock);
+    Terminate = TRUE;
+    LeaveCriticalSection(&QueueLock);
+    int i;
+    if (QueueSem != NULL)
+        ReleaseSemaphore(QueueSem, Threads, NULL); // wake up all the workers
+    for (i = 0; i < Threads; i++)
+    {
+        if (Workers[i].Thread != NULL)
+        {
+            WaitForSingleObject(Workers[i].Thread, INFINITE);
+            CloseHandle(Workers[i].Thread);
+        }
+        if (Workers[i].Deflate != NULL)
+            delete Workers[i].Deflate;
+    }
+    for (i = 0; i < 2 * PDEFLATE_MAX_THREADS; i++)
+    {
+        if (Blocks[i].In != NULL)
+            free(Blocks[i].In);
+        if (Blocks[i].Out != NULL)
+            free(Blocks[i].Out);
+        if (Blocks[i].Done != NULL)
+            CloseHandle(Blocks[i].Done);
+        if (Files[i].In != NULL)
+            free(Files[i].In);
+        if (Files[i].Name != NULL)
+            free(Files[i].Name);
+        if (Files[i].Out != NULL)
+            free(Files[i].Out);
+        if (Files[i].Done != NULL)
+            CloseHandle(Files[i].Done);
+    }
+    if (QueueSem != NULL)
+        CloseHandle(QueueSem);
+    DeleteCriticalSection(&QueueLock);
+}
+
+BOOL CDeflatePool::Init(int level)
+{
+    CALL_STACK_MESSAGE2("CDeflatePool::Init(%d)", level);
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors < 2)
+        return FALSE;
+    int threads = min((int)si.dwNumberOfProcessors, PDEFLATE_MAX_THREADS);
+
+    Level = level;
+    QueueSem = CreateSemaphore(NULL, 0, SizeOf(Queue) + PDEFLATE_MAX_THREADS, NULL);
+    if (QueueSem == NULL)
+        return FALSE;
+    int i;
+    for (i = 0; i < 2 * threads; i++)
+    {
+        Blocks[i].Type = djtBlock;
+        Blocks[i].In = (char*)malloc(WSIZE + PDEFLATE_BLOCK_SIZE);
+        Blocks[i].OutAlloc = PDEFLATE_BLOCK_SIZE + PDEFLATE_BLOCK_SIZE / 8;
+        Blocks[i].Out = (char*)malloc(Blocks[i].OutAlloc);
+        Blocks[i].Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        Files[i].Type = djtFile;
+        Files[i].Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (Blocks[i].In == NULL || Blocks[i].Out == NULL || Blocks[i].Done == NULL ||
+            Files[i].Done == NULL)
+        {
+            TRACE_E("CDeflatePool::Init(): low memory");
+            return FALSE;
+        }
+    }
+    for (i = 0; i < threads; i++)
+    {
+        CWorker* worker = &Workers[i];
+        worker->Pool = this;
+        worker->Thread = NULL;
+        worker->Deflate = new CDeflate;
+        Threads = i + 1; // the destructor cleans up the workers created so far
+        if (worker->Deflate == NULL)
+            return FALSE;
+        DWORD id;
+        worker->Thread = CreateThread(NULL, 0, ThreadBody, worker, 0, &id);
+        if (worker->Thread == NULL)
+        {
+            TRACE_E("CDeflatePool::Init(): unable to start worker thread");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void CDeflatePool::Submit(CDeflateJob* job)
+{
+    EnterCriticalSection(&QueueLock);
+    Queue[(QueueFirst + QueueCount) % SizeOf(Queue)] = job;
+    QueueCount++;
+    LeaveCriticalSection(&QueueLock);
+    ReleaseSemaphore(QueueSem, 1, NULL);
+}
+
+DWORD WINAPI
+CDeflatePool::ThreadBody(void* param)
+{
+    return SalamanderDebug->CallWithCallStack(WorkerBody, param);
+}
+
+unsigned WINAPI
+CDeflatePool::WorkerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CDeflatePool::WorkerBody()");
+    CWorker* worker = (CWorker*)param;
+    CDeflatePool* pool = worker->Pool;
+    while (1)
+    {
+        WaitForSingleObject(pool->QueueSem, INFINITE);
+        CDeflateJob* job = NULL;
+        EnterCriticalSection(&pool->QueueLock);
+        if (!pool->Terminate && pool->QueueCount > 0)
+        {
+            job = pool->Queue[pool->QueueFirst];
+            pool->QueueFirst = (pool->QueueFirst + 1) % SizeOf(pool->Queue);
+            pool->QueueCount--;
+        }
+        LeaveCriticalSection(&pool->QueueLock);
+        if (job == NULL)
+            break; // terminating
+        pool->Process(worker, job);
+        SetEvent(job->Done);
+    }
+    return 0;
+}
+
+void CDeflatePool::Process(CWorker* worker, CDeflateJob* job)
+{
+    ullg compLen;
+
+    job->InPos = 0;
+    job->OutSize = 0;
+    job->InterAttr = (ush)UNKNOWN;
+    if (job->Type == djtBlock)
+    {
+        job->Crc = SalamanderGeneral->UpdateCrc32(job->In + job->DictLen, job->InSize, INIT_CRC);
+        job->Error = worker->Deflate->DeflateBlock(job->DictLen > 0 ? job->In : NULL, job->DictLen,
+                                                   &job->InterAttr, job->Level, &compLen,
+                                                   WriteJobOutput, ReadJobInput, job);
+        return;
+    }
+
+    // djtFile: read the whole file, on any problem leave it to PackFiles, which
+    // reports errors to the user
+    job->Error = PDEFLATE_ERR_READ;
+    HANDLE file = CreateFile(job->Name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(file, &info) && info.nFileSizeHigh == 0 &&
+        info.nFileSizeLow <= PDEFLATE_SMALL_FILE_SIZE)
+    {
+        job->Size = info.nFileSizeLow;
+        job->LastWrite = info.ftLastWriteTime;
+        job->In = (char*)malloc(max(info.nFileSizeLow, (DWORD)1));
+        DWORD read;
+        if (job->In != NULL && ReadFile(file, job->In, info.nFileSizeLow, &read, NULL) &&
+            read == info.nFileSizeLow)
+        {
+            job->InSize = read;
+            job->Error = 0;
+        }
+    }
+    CloseHandle(file);
+    if (job->Error == 0)
+    {
+        job->Crc = SalamanderGeneral->UpdateCrc32(job->In, job->InSize, INIT_CRC);
+        job->Method = DEFLATE;
+        job->OutAlloc = job->InSize / 2 + 1024;
+        job->Out = (char*)malloc(job->OutAlloc);
+        if (job->Out != NULL)
+        {
+            job->Error = worker->Deflate->Deflate(&job->InterAttr, &job->Method, job->Level,
+                                                  &job->Flag, &compLen, WriteJobOutput,
+                                                  ReadJobInput, job);
+        }
+        else
+        {
+            job->OutAlloc = 0;
+            job->Error = PDEFLATE_ERR_READ;
+        }
+    }
+    if (job->In != NULL)
+    {
+        free(job->In);
+        job->In = NULL;
+    }
+}
+
+int CDeflatePool::DeflateStream(ush* internAttr, ush* flag, ullg* compLen, __UINT32* crc,
+                                FWriteData writeFunc, FReadData readFunc, void* userData)
+{
+    CALL_STACK_MESSAGE1("CDeflatePool::DeflateStream(, , , , , , )");
+    int count = 2 * Threads; // number of blocks in the ring
+    int submitted = 0;       // blocks read and given to the workers
+    int written = 0;         // blocks written
+    BOOL eof = FALSE;
+    int errorID = 0;
+
+    if (Level <= 2)
+        *flag |= FAST;
+    else if (Level >= 8)
+        *flag |= SLOW;
+    *compLen = 0;
+    *crc = INIT_CRC;
+    while (!errorID)
+    {
+        // read blocks while there is a free place in the ring
+        while (!eof && submitted - written < count)
+        {
+            CDeflateJob* job = &Blocks[submitted % count];
+            job->DictLen = 0;
+            if (submitted > 0)
+            {
+                // the dictionary is the end of the previous block (its buffer is
+                // only read by the worker, so it can be shared)
+                CDeflateJob* prev = &Blocks[(submitted - 1) % count];
+                unsigned avail = prev->DictLen + prev->InSize;
+                job->DictLen = min(avail, (unsigned)WSIZE);
+                memcpy(job->In, prev->In + avail - job->DictLen, job->DictLen);
+            }
+            unsigned size = 0;
+            while (size < PDEFLATE_BLOCK_SIZE)
+            {
+                int error = 0;
+                unsigned read = readFunc(job->In + job->DictLen + size, PDEFLATE_BLOCK_SIZE - size,
+                                         &error, userData);
+                if (error)
+                {
+                    errorID = error;
+                    break;
+                }
+                if (read == 0 || read == (unsigned)EOF)
+                {
+                    eof = TRUE;
+                    break;
+                }
+                size += read;
+            }
+            if (errorID || size == 0)
+                break;
+            job->InSize = size;
+            job->Level = Level;
+            Submit(job);
+            submitted++;
+        }
+        if (errorID || written == submitted)
+            break; // error or everything written
+
+        // write the oldest block
+        CDeflateJob* job = &Blocks[written % count];
+        WaitForSingleObject(job->Done, INFINITE);
+        written++;
+        errorID = job->Error;
+        if (!errorID)
+        {
+            if (written == 1)
+                *internAttr = job->InterAttr;
+            *crc = CombineCrc32(*crc, job->Crc, job->InSize);
+            *compLen += job->OutSize;
+            errorID = writeFunc(job->Out, job->OutSize, userData);
+        }
+    }
+    // on error wait for the blocks still being compressed
+    while (written < submitted)
+        WaitForSingleObject(Blocks[written++ % count].Done, INFINITE);
+
+    if (!errorID)
+    {
+        // all blocks end with an empty stored block, finish the stream with an
+        // empty last block with static trees
+        char end[2] = {0x03, 0x00};
+        *compLen += 2;
+        errorID = writeFunc(end, 2, userData);
+    }
+    return errorID;
+}
+
+BOOL CDeflatePool::QueueFile(int index, const char* name, ush flag)
+{
+    if (FilesCount == 2 * Threads)
+        return FALSE;
+    CDeflateJob* job = &Files[(FilesFirst + FilesCount) % (2 * Threads)];
+    job->Name = _strdup(name);
+    if (job->Name == NULL)
+        return FALSE;
+    job->Index = index;
+    job->Flag = flag;
+    job->Level = Level;
+    job->DictLen = 0;
+    FilesCount++;
+    Submit(job);
+    return TRUE;
+}
+
+CDeflateJob* CDeflatePool::GetFile(int index)
+{
+    while (FilesCount > 0)
+    {
+        CDeflateJob* job = &Files[FilesFirst];
+        if (job->Index > index)
+            break;
+        WaitForSingleObject(job->Done, INFINITE);
+        if (job->Index == index)
+            return job;
+        ReleaseFile(job); // PackFiles did not get to this file (skipped, not compressed)
+    }
+    return NULL;
+}
+
+void CDeflatePool::ReleaseFile(CDeflateJob* job)
+{
+    free(job->Name);
+    job->Name = NULL;
+    if (job->Out != NULL)
+    {
+        free(job->Out);
+        job->Out = NULL;
+    }
+    job->OutAlloc = 0;
+    FilesFirst = (FilesFirst + 1) % (2 * Threads);
+    FilesCount--;
+}
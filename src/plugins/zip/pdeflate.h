@@ -0,0 +1,120 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// Parallel deflate (the way pigz does it) used by CZipPack::PackFiles:
+// - large files are cut into blocks compressed on the worker threads, every block
+//   gets the last WSIZE bytes of the preceding data as a dictionary and ends on
+//   a byte boundary (CDeflate::DeflateBlock), so the compressed blocks written
+//   one after another form one ordinary deflate stream; the CRC of the file is
+//   combined from the CRCs of the blocks
+// - small files are read and compressed whole by the workers ahead of PackFiles,
+//   which then only writes the results (or packs the file itself if the worker
+//   failed or the file has changed meanwhile)
+
+#define PDEFLATE_MAX_THREADS 32
+#define PDEFLATE_BLOCK_SIZE (128 * 1024)       // input size of one block of a large file
+#define PDEFLATE_MIN_SIZE (1024 * 1024)        // smaller files are not cut into blocks
+#define PDEFLATE_SMALL_FILE_SIZE (1024 * 1024) // files up to this size are compressed ahead
+
+enum CDeflateJobType
+{
+    djtBlock, // one block of a large file
+    djtFile,  // whole small file
+};
+
+struct CDeflateJob
+{
+    CDeflateJobType Type;
+    int Level;
+
+    // djtBlock: dictionary (DictLen bytes) followed by the data (InSize bytes);
+    // djtFile: the file contents (read by the worker)
+    char* In;
+    unsigned DictLen;
+    unsigned InSize;
+    unsigned InPos; // how much of the data CDeflate has already read
+
+    // djtFile
+    int Index;          // index of the file in CZipPack::AddFiles
+    char* Name;         // name of the file
+    ush Flag;           // general purpose flag the file is packed with (GPF_DATADESCR matters)
+    QWORD Size;         // size and time of the file when it was read, PackFiles uses
+    FILETIME LastWrite; // the result only if the file has not changed since
+
+    // results
+    char* Out; // compressed data
+    unsigned OutSize;
+    unsigned OutAlloc;
+    __UINT32 Crc;
+    ush InterAttr; // ASCII / BINARY
+    int Method;    // djtFile: DEFLATE or STORE (CDeflate decided to store the file)
+    int Error;     // 0 = OK, CDeflate error or IDS_xxx; djtFile: PDEFLATE_ERR_READ = read it yourself
+
+    HANDLE Done; // signaled when the job is finished
+};
+
+#define PDEFLATE_ERR_READ -1
+
+class CDeflatePool
+{
+protected:
+    struct CWorker
+    {
+        CDeflatePool* Pool;
+        CDeflate* Deflate;
+        HANDLE Thread;
+    };
+
+    int Level;
+    int Threads;
+    CWorker Workers[PDEFLATE_MAX_THREADS];
+
+    CRITICAL_SECTION QueueLock; // guards Queue, QueueFirst, QueueCount and Terminate
+    CDeflateJob* Queue[4 * PDEFLATE_MAX_THREADS];
+    int QueueFirst;
+    int QueueCount;
+    HANDLE QueueSem; // number of jobs in Queue
+    BOOL Terminate;
+
+    CDeflateJob Blocks[2 * PDEFLATE_MAX_THREADS]; // ring of blocks of the large file being packed
+    CDeflateJob Files[2 * PDEFLATE_MAX_THREADS];  // ring of small files compressed ahead
+    int FilesFirst;
+    int FilesCount;
+
+public:
+    CDeflatePool();
+    ~CDeflatePool(); // stops the workers, jobs not started yet are dropped
+
+    // starts the workers, returns FALSE if it is not worth it (single processor)
+    // or there is not enough memory; the pool then must not be used
+    BOOL Init(int level);
+
+    // compresses a file read by 'readFunc' and writes it by 'writeFunc' (called from
+    // this thread only, in order); sets FAST/SLOW in 'flag' the same way CDeflate does,
+    // the CRC is computed here (so 'readFunc' need not compute it), the file is never
+    // stored; returns 0, a CDeflate error, an error of the callbacks or IDS_LOWMEM
+    int DeflateStream(ush* internAttr, ush* flag, ullg* compLen, __UINT32* crc,
+                      FWriteData writeFunc, FReadData readFunc, void* userData);
+
+    // starts compressing small file 'name' (file 'index' of CZipPack::AddFiles, indexes
+    // must grow), returns FALSE if there is no free slot (try it again later)
+    BOOL QueueFile(int index, const char* name, ush flag);
+
+    // waits for the result for file 'index' and returns it (call ReleaseFile() then),
+    // NULL if the file was not queued; results for files before 'index' are dropped
+    CDeflateJob* GetFile(int index);
+    void ReleaseFile(CDeflateJob* job);
+
+protected:
+    void Submit(CDeflateJob* job);
+    void Process(CWorker* worker, CDeflateJob* job);
+
+    static DWORD WINAPI ThreadBody(void* param);
+    static unsigned WINAPI WorkerBody(void* param);
+};
+
+// returns CRC of the concatenation of two blocks given their CRCs and the length
+// of the second block (crc32_combine from zlib)
+__UINT32 CombineCrc32(__UINT32 crc1, __UINT32 crc2, QWORD len2);
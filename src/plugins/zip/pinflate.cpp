@@ -0,0 +1,634 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "precomp.h"
+
+#include "spl_com.h"
+#include "spl_base.h"
+#include "spl_gen.h"
+#include "dbg.h"
+
+#include "config.h"
+#include "common.h"
+#include "inflate.h"
+#include "pinflate.h"
+#include "deflate.h"
+#include "benchsel.h"
+
+//
+// ****************************************************************************
+// CInflatePool
+//
+
+// reads 'size' bytes from 'offset' of 'file' (does not use the file pointer)
+static BOOL ReadAt(HANDLE file, QWORD offset, void* buffer, DWORD size)
+{
+    OVERLAPPED ov;
+    ZeroMemory(&ov, sizeof(ov));
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD read;
+    return ReadFile(file, buffer, size, &read, &ov) && read == size;
+}
+
+CInflatePool::CInflatePool()
+{
+    Threads = 0;
+    InitializeCriticalSection(&QueueLock);
+    QueueFirst = 0;
+    QueueCount = 0;
+    QueueSem = NULL;
+    Terminate = FALSE;
+    ZeroMemory(Files, sizeof(Files));
+    FilesFirst = 0;
+    FilesCount = 0;
+    FilesSize = 0;
+}
+
+CInflatePool::~CInflatePool()
+{
+    CALL_STACK_MESSAGE1("CInflatePool::~CInflatePool()");
+    EnterCriticalSection(&QueueLock);
+    Terminate = TRUE;
+    LeaveCriticalSection(&QueueLock);
+    int i;
+    if (QueueSem != NULL)
+        ReleaseSemaphore(QueueSem, Threads, NULL); // wake up all the workers
+    for (i = 0; i < Threads; i++)
+        FreeWorker(&Workers[i]);
+    for (i = 0; i < SizeOf(Files); i++)
+    {
+        if (Files[i].Out != NULL)
+            free(Files[i].Out);
+        if (Files[i].Done != NULL)
+            CloseHandle(Files[i].Done);
+    }
+    if (QueueSem != NULL)
+        CloseHandle(QueueSem);
+    DeleteCriticalSection(&QueueLock);
+}
+
+void CInflatePool::FreeWorker(CWorker* worker)
+{
+    if (worker->Thread != NULL)
+    {
+        WaitForSingleObject(worker->Thread, INFINITE);
+        CloseHandle(worker->Thread);
+    }
+    if (worker->Heap != NULL)
+    {
+        CDecompressionObject decompress;
+        decompress.HeapInfo = worker->Heap;
+        decompress.fixed_tl64 = (huft*)worker->fixed_tl64;
+        decompress.fixed_td64 = (huft*)worker->fixed_td64;
+        decompress.fixed_tl32 = (huft*)worker->fixed_tl32;
+        decompress.fixed_td32 = (huft*)worker->fixed_td32;
+        FreeFixedHufman(&decompress);
+        HeapDestroy(worker->Heap);
+    }
+    if (worker->SlideWindow != NULL)
+        free(worker->SlideWindow);
+    if (worker->ZipFile != INVALID_HANDLE_VALUE)
+        CloseHandle(worker->ZipFile);
+}
+
+BOOL CInflatePool::Init(const char* zipName)
+{
+    CALL_STACK_MESSAGE2("CInflatePool::Init(%s)", zipName);
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    if (si.dwNumberOfProcessors < 2)
+        return FALSE;
+    int threads = min((int)si.dwNumberOfProcessors, PINFLATE_MAX_THREADS);
+
+    QueueSem = CreateSemaphore(NULL, 0, SizeOf(Queue) + PINFLATE_MAX_THREADS, NULL);
+    if (QueueSem == NULL)
+        return FALSE;
+    int i;
+    for (i = 0; i < 4 * threads; i++)
+    {
+        Files[i].Done = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (Files[i].Done == NULL)
+            return FALSE;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        CWorker* worker = &Workers[i];
+        ZeroMemory(worker, sizeof(CWorker));
+        worker->Pool = this;
+        worker->ZipFile = INVALID_HANDLE_VALUE;
+        Threads = i + 1; // the destructor cleans up the workers created so far
+        worker->ZipFile = CreateFile(zipName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                     FILE_ATTRIBUTE_NORMAL, NULL);
+        worker->Heap = HeapCreate(HEAP_NO_SERIALIZE, INITIAL_HEAP_SIZE, MAXIMUM_HEAP_SIZE);
+        worker->SlideWindow = (char*)malloc(SLIDE_WINDOW_SIZE);
+        if (worker->ZipFile == INVALID_HANDLE_VALUE || worker->Heap == NULL ||
+            worker->SlideWindow == NULL)
+        {
+            TRACE_E("CInflatePool::Init(): unable to prepare worker");
+            return FALSE;
+        }
+        DWORD id;
+        worker->Thread = CreateThread(NULL, 0, ThreadBody, worker, 0, &id);
+        if (worker->Thread == NULL)
+        {
+            TRACE_E("CInflatePool::Init(): unable to start worker thread");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+BOOL CInflatePool::CanExtract(const CFileInfo* file)
+{
+    return !file->IsDir && !(file->Flag & GPF_ENCRYPTED) &&
+           (file->Method == CM_STORED || file->Method == CM_DEFLATED || file->Method == CM_DEFLATE64) &&
+           file->Size <= PINFLATE_MAX_SIZE && file->CompSize <= PINFLATE_MAX_SIZE;
+}
+
+void CInflatePool::Submit(CInflateJob* job)
+{
+    EnterCriticalSection(&QueueLock);
+    Queue[(QueueFirst + QueueCount) % SizeOf(Queue)] = job;
+    QueueCount++;
+    LeaveCriticalSection(&QueueLock);
+    ReleaseSemaphore(QueueSem, 1, NULL);
+}
+
+DWORD WINAPI
+CInflatePool::ThreadBody(void* param)
+{
+    return SalamanderDebug->CallWithCallStack(WorkerBody, param);
+}
+
+unsigned WINAPI
+CInflatePool::WorkerBody(void* param)
+{
+    CALL_STACK_MESSAGE1("CInflatePool::WorkerBody()");
+    CWorker* worker = (CWorker*)param;
+    CInflatePool* pool = worker->Pool;
+    while (1)
+    {
+        WaitForSingleObject(pool->QueueSem, INFINITE);
+        CInflateJob* job = NULL;
+        EnterCriticalSection(&pool->QueueLock);
+        if (!pool->Terminate && pool->QueueCount > 0)
+        {
+            job = pool->Queue[pool->QueueFirst];
+            pool->QueueFirst = (pool->QueueFirst + 1) % SizeOf(pool->Queue);
+            pool->QueueCount--;
+        }
+        LeaveCriticalSection(&pool->QueueLock);
+        if (job == NULL)
+            break; // terminating
+        pool->Process(worker, job);
+        SetEvent(job->Done);
+    }
+    return 0;
+}
+
+void CInflatePool::Process(CWorker* worker, CInflateJob* job)
+{
+    // on any problem leave the file to ExtractFiles, which reports errors to the user
+    job->Error = TRUE;
+    job->Crc = INIT_CRC;
+
+    CLocalFileHeader header;
+    if (!ReadAt(worker->ZipFile, job->LocHeaderOffs, &header, sizeof(header)) ||
+        header.Signature != SIG_LOCALFH || (header.Flag & GPF_ENCRYPTED) ||
+        header.Method != job->Method)
+    {
+        return;
+    }
+    QWORD dataOffset = job->LocHeaderOffs + sizeof(CLocalFileHeader) + header.NameLen + header.ExtraLen;
+
+    job->Out = (char*)malloc(max(job->Size, (unsigned)1));
+    if (job->Out == NULL)
+        return;
+    if (job->Method == CM_STORED)
+    {
+        // read straight to the output buffer
+        if (job->CompSize == job->Size && ReadAt(worker->ZipFile, dataOffset, job->Out, job->Size))
+            job->Error = FALSE;
+    }
+    else
+    {
+        char* in = (char*)malloc(max(job->CompSize, (unsigned)1));
+        if (in != NULL && ReadAt(worker->ZipFile, dataOffset, in, job->CompSize))
+        {
+            CDecompressionObject decompress;
+            decompress.HeapInfo = worker->Heap;
+            decompress.fixed_tl64 = (huft*)worker->fixed_tl64;
+            decompress.fixed_td64 = (huft*)worker->fixed_td64;
+            decompress.fixed_bl64 = worker->fixed_bl64;
+            decompress.fixed_bd64 = worker->fixed_bd64;
+            decompress.fixed_tl32 = (huft*)worker->fixed_tl32;
+            decompress.fixed_td32 = (huft*)worker->fixed_td32;
+            decompress.fixed_bl32 = worker->fixed_bl32;
+            decompress.fixed_bd32 = worker->fixed_bd32;
+            unsigned outSize;
+            if (InflateMemory(&decompress, (uch*)worker->SlideWindow, in, job->CompSize, job->Out, job->Size,
+                              &outSize, job->Method == CM_DEFLATE64) == 0 &&
+                outSize == job->Size)
+            {
+                job->Error = FALSE; // the flush fails on more data than the central directory says
+            }
+            worker->fixed_tl64 = decompress.fixed_tl64;
+            worker->fixed_td64 = decompress.fixed_td64;
+            worker->fixed_bl64 = decompress.fixed_bl64;
+            worker->fixed_bd64 = decompress.fixed_bd64;
+            worker->fixed_tl32 = decompress.fixed_tl32;
+            worker->fixed_td32 = decompress.fixed_td32;
+            worker->fixed_bl32 = decompress.fixed_bl32;
+            worker->fixed_bd32 = decompress.fixed_bd32;
+        }
+        if (in != NULL)
+            free(in);
+    }
+    if (!job->Error)
+        job->Crc = SalamanderGeneral->UpdateCrc32(job->Out, job->Size, INIT_CRC);
+    else
+    {
+        free(job->Out);
+        job->Out = NULL;
+    }
+}
+
+BOOL CInflatePool::QueueFile(int index, const CFileInfo* file)
+{
+    if (FilesCount == 4 * Threads ||
+        (FilesCount > 0 && FilesSize + file->Size + file->CompSize > PINFLATE_AHEAD_SIZE))
+    {
+        return FALSE;
+    }
+    CInflateJob* job = &Files[(FilesFirst + FilesCount) % (4 * Threads)];
+    job->Index = index;
+    job->File = file;
+    job->LocHeaderOffs = file->LocHeaderOffs;
+    job->CompSize = (unsigned)file->CompSize;
+    job->Size = (unsigned)file->Size;
+    job->Method = file->Method;
+    FilesCount++;
+    FilesSize += job->Size + job->CompSize;
+    Submit(job);
+    return TRUE;
+}
+
+CInflateJob* CInflatePool::GetFile(int index)
+{
+    while (FilesCount > 0)
+    {
+        CInflateJob* job = &Files[FilesFirst];
+        if (job->Index > index)
+            break;
+        WaitForSingleObject(job->Done, INFINITE);
+        if (job->Index == index)
+            return job;
+        ReleaseFile(job); // ExtractFiles did not get to this file (skipped)
+    }
+    return NULL;
+}
+
+void CInflatePool::ReleaseFile(CInflateJob* job)
+{
+    if (job->Out != NULL)
+    {
+        free(job->Out);
+        job->Out = NULL;
+    }
+    FilesSize -= job->Size + job->CompSize;
+    FilesFirst = (FilesFirst + 1) % (4 * Threads);
+    FilesCount--;
+}
+
+#ifdef _DEBUG
+
+//
+// ****************************************************************************
+// RunInflateBenchmark
+//
+// The corpus consists of synthetic data compressed by CDeflate (text, binary records
+// and long runs of bytes) and of the deflated and Deflate64 entries of all *.zip
+// archives in the benchmark directory. Each stream is decompressed from memory to
+// memory by InflateMemory(), as CInflatePool does, once with the fast loop and once
+// with the bit-by-bit loop only (the decoder before the fast loop was added).
+
+#define INFLATEBENCH_SYNTH_SIZE (8 * 1024 * 1024)        // size of each synthetic stream
+#define INFLATEBENCH_MIN_OUTPUT (256 * 1024 * 1024)      // data decompressed by each measurement
+#define INFLATEBENCH_MAX_ARCHIVE ((QWORD)1024 * 1024 * 1024) // larger archives are skipped
+#define INFLATEBENCH_MAX_ENTRY (256 * 1024 * 1024)       // larger entries of the archives are skipped
+
+struct CInflateBenchStream
+{
+    const char* Comp; // compressed data
+    unsigned CompSize;
+    unsigned Size;
+    __UINT32 Crc;
+    BOOL Deflate64;
+};
+
+// CDeflate input and output in memory
+struct CInflateBenchData
+{
+    const char* In;
+    unsigned InSize;
+    unsigned InPos;
+    char* Out;
+    unsigned OutSize;
+    unsigned OutAlloc;
+};
+
+static int InflateBenchRead(char* buffer, unsigned size, int* error, void* user)
+{
+    CInflateBenchData* data = (CInflateBenchData*)user;
+    if (size > data->InSize - data->InPos)
+        size = data->InSize - data->InPos;
+    memcpy(buffer, data->In + data->InPos, size);
+    data->InPos += size;
+    return size;
+}
+
+static int InflateBenchWrite(char* buffer, unsigned size, void* user)
+{
+    CInflateBenchData* data = (CInflateBenchData*)user;
+    if (size > data->OutAlloc - data->OutSize)
+        return IDS_LOWMEM; // synthetic data always compress well
+    memcpy(data->Out + data->OutSize, buffer, size);
+    data->OutSize += size;
+    return 0;
+}
+
+// fills 'data' with synthetic content: 0 - text, 1 - binary records, 2 - runs of bytes
+static void FillInflateBenchData(char* data, unsigned size, int kind)
+{
+    static const char* words[] = {"the", "archive", "of", "file", "and", "directory", "to",
+                                  "compressed", "in", "Salamander", "is", "plugin", "data", "a"};
+    DWORD seed = 12345;
+    unsigned i = 0;
+    while (i < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        DWORD r = (seed >> 16) & 0x7FFF;
+        unsigned char record[16];
+        unsigned len;
+        switch (kind)
+        {
+        case 0:
+        {
+            const char* w = words[r % _countof(words)];
+            len = (unsigned)strlen(w);
+            memcpy(record, w, len);
+            record[len++] = r % 11 == 0 ? '\n' : ' ';
+            break;
+        }
+
+        case 1:
+        {
+            // counter, small number, zeros and noise, like tables in executables
+            DWORD counter = i / 16;
+            memcpy(record, &counter, 4);
+            record[4] = (unsigned char)(r % 100);
+            memset(record + 5, 0, 7);
+            memcpy(record + 12, &seed, 4);
+            len = 16;
+            break;
+        }
+
+        default:
+        {
+            len = min(1 + r % 300, size - i);
+            memset(data + i, (unsigned char)(r >> 7), len);
+            i += len;
+            continue;
+        }
+        }
+        len = min(len, size - i);
+        memcpy(data + i, record, len);
+        i += len;
+    }
+}
+
+// decompresses all 'streams' by InflateMemory() until INFLATEBENCH_MIN_OUTPUT bytes
+// are produced, returns MB/s of the output or -1 if a stream is corrupted
+static double InflateBenchmarkStreams(TDirectArray2<CInflateBenchStream>& streams)
+{
+    CDecompressionObject decompress;
+    ZeroMemory(&decompress, sizeof(decompress)); // the fixed tables are built by the first stream
+    decompress.HeapInfo = (void*)HeapCreate(HEAP_NO_SERIALIZE, INITIAL_HEAP_SIZE, MAXIMUM_HEAP_SIZE);
+    uch* slideWin = (uch*)malloc(SLIDE_WINDOW_SIZE);
+    QWORD total = 0;
+    unsigned maxSize = 1;
+    int i;
+    for (i = 0; i < streams.Count; i++)
+    {
+        total += streams[i].Size;
+        maxSize = max(maxSize, streams[i].Size);
+    }
+    char* out = (char*)malloc(maxSize);
+    double result = -1;
+    if (decompress.HeapInfo != NULL && slideWin != NULL && out != NULL)
+    {
+        // check the output first, outside of the measured time
+        BOOL ok = TRUE;
+        unsigned outSize;
+        for (i = 0; ok && i < streams.Count; i++)
+        {
+            CInflateBenchStream* s = &streams[i];
+            ok = InflateMemory(&decompress, slideWin, s->Comp, s->CompSize, out, s->Size, &outSize, s->Deflate64) == 0 &&
+                 outSize == s->Size && SalamanderGeneral->UpdateCrc32(out, s->Size, INIT_CRC) == s->Crc;
+        }
+        if (ok)
+        {
+            int rounds = (int)max((QWORD)1, INFLATEBENCH_MIN_OUTPUT / max(total, (QWORD)1));
+            LARGE_INTEGER freq, start;
+            QueryPerformanceFrequency(&freq);
+            QueryPerformanceCounter(&start);
+            int round;
+            for (round = 0; round < rounds; round++)
+            {
+                for (i = 0; i < streams.Count; i++)
+                {
+                    CInflateBenchStream* s = &streams[i];
+                    InflateMemory(&decompress, slideWin, s->Comp, s->CompSize, out, s->Size, &outSize, s->Deflate64);
+                }
+            }
+            result = (double)total * rounds / 1048576.0 / BenchSeconds(start, freq);
+        }
+    }
+    else
+        TRACE_E("RunInflateBenchmark(): low memory");
+    if (out != NULL)
+        free(out);
+    if (slideWin != NULL)
+        free(slideWin);
+    if (decompress.HeapInfo != NULL)
+    {
+        FreeFixedHufman(&decompress);
+        HeapDestroy(decompress.HeapInfo);
+    }
+    return result;
+}
+
+// measures 'streams' with both decoding loops and reports the result
+static void InflateBenchmarkReport(const char* name, TDirectArray2<CInflateBenchStream>& streams)
+{
+    QWORD size = 0, compSize = 0;
+    int deflate64 = 0;
+    int i;
+    for (i = 0; i < streams.Count; i++)
+    {
+        size += streams[i].Size;
+        compSize += streams[i].CompSize;
+        if (streams[i].Deflate64)
+            deflate64++;
+    }
+    if (streams.Count == 0 || size == 0)
+        return;
+    double fast = InflateBenchmarkStreams(streams);
+    InflateFastLoop = FALSE;
+    double bitwise = InflateBenchmarkStreams(streams);
+    InflateFastLoop = TRUE;
+    if (fast < 0 || bitwise < 0)
+    {
+        TRACE_E("RunInflateBenchmark(): " << name << ": corrupted stream or CRC mismatch!");
+        return;
+    }
+    TRACE_I("RunInflateBenchmark(): " << name << ": " << streams.Count << " streams (" << deflate64 << " Deflate64), "
+                                      << (int)(size / 1024) << " KB, ratio " << (int)(compSize * 100 / size) << "%: fast loop "
+                                      << (int)fast << " MB/s, bit-by-bit loop " << (int)bitwise << " MB/s");
+}
+
+// adds the deflated and Deflate64 entries of archive 'data' to 'streams'; the local
+// headers are walked from the start of the archive, the walk stops at the central
+// directory and at entries with a data descriptor or in Zip64 format (their sizes
+// are not in the local header)
+static void AddInflateBenchArchive(const char* data, QWORD size, TDirectArray2<CInflateBenchStream>& streams)
+{
+    QWORD offs = 0;
+    while (offs + sizeof(CLocalFileHeader) <= size)
+    {
+        const CLocalFileHeader* header = (const CLocalFileHeader*)(data + offs);
+        if (header->Signature != SIG_LOCALFH || (header->Flag & GPF_DATADESCR) ||
+            header->CompSize == 0xFFFFFFFF || header->Size == 0xFFFFFFFF)
+        {
+            break;
+        }
+        QWORD dataOffs = offs + sizeof(CLocalFileHeader) + header->NameLen + header->ExtraLen;
+        if (dataOffs + header->CompSize > size)
+            break;
+        if (!(header->Flag & GPF_ENCRYPTED) && header->Size <= INFLATEBENCH_MAX_ENTRY &&
+            (header->Method == CM_DEFLATED || header->Method == CM_DEFLATE64))
+        {
+            CInflateBenchStream stream;
+            stream.Comp = data + dataOffs;
+            stream.CompSize = header->CompSize;
+            stream.Size = header->Size;
+            stream.Crc = header->Crc;
+            stream.Deflate64 = header->Method == CM_DEFLATE64;
+            if (!streams.Add(stream))
+                break;
+        }
+        offs = dataOffs + header->CompSize;
+    }
+}
+
+void RunInflateBenchmark()
+{
+    if (!IsBenchmarkSelected("inflate"))
+        return;
+
+    CALL_STACK_MESSAGE1("RunInflateBenchmark()");
+    char dir[MAX_PATH];
+    if (!GetBenchmarkDir(dir))
+    {
+        TRACE_E("RunInflateBenchmark(): unable to get directory for benchmark data.");
+        return;
+    }
+    TRACE_I("Benchmark \"inflate\": begin");
+
+    // synthetic data
+    static const char* kinds[] = {"text", "binary records", "runs of bytes"};
+    CDeflate* deflate = new CDeflate;
+    char* data = (char*)malloc(INFLATEBENCH_SYNTH_SIZE);
+    CInflateBenchData io;
+    io.In = data;
+    io.InSize = INFLATEBENCH_SYNTH_SIZE;
+    io.OutAlloc = INFLATEBENCH_SYNTH_SIZE;
+    io.Out = (char*)malloc(io.OutAlloc);
+    if (deflate != NULL && data != NULL && io.Out != NULL)
+    {
+        int kind;
+        for (kind = 0; kind < _countof(kinds); kind++)
+        {
+            FillInflateBenchData(data, INFLATEBENCH_SYNTH_SIZE, kind);
+            io.InPos = 0;
+            io.OutSize = 0;
+            ush internAttr = (ush)UNKNOWN;
+            ush flag = 0;
+            int method = DEFLATE;
+            ullg compLen;
+            if (deflate->Deflate(&internAttr, &method, 6, &flag, &compLen, InflateBenchWrite,
+                                 InflateBenchRead, &io) != 0 ||
+                method != DEFLATE)
+            {
+                TRACE_E("RunInflateBenchmark(): unable to compress " << kinds[kind]);
+                continue;
+            }
+            CInflateBenchStream stream;
+            stream.Comp = io.Out;
+            stream.CompSize = io.OutSize;
+            stream.Size = INFLATEBENCH_SYNTH_SIZE;
+            stream.Crc = SalamanderGeneral->UpdateCrc32(data, INFLATEBENCH_SYNTH_SIZE, INIT_CRC);
+            stream.Deflate64 = FALSE;
+            TDirectArray2<CInflateBenchStream> streams(1);
+            if (streams.Add(stream))
+                InflateBenchmarkReport(kinds[kind], streams);
+        }
+    }
+    else
+        TRACE_E("RunInflateBenchmark(): low memory");
+    if (io.Out != NULL)
+        free(io.Out);
+    if (data != NULL)
+        free(data);
+    if (deflate != NULL)
+        delete deflate;
+
+    // archives from the benchmark directory, e.g. made by 7-Zip with -mm=Deflate64
+    char mask[MAX_PATH];
+    lstrcpyn(mask, dir, MAX_PATH);
+    SalamanderGeneral->SalPathAppend(mask, "*.zip", MAX_PATH);
+    WIN32_FIND_DATA find;
+    HANDLE search = FindFirstFile(mask, &find);
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            QWORD size = ((QWORD)find.nFileSizeHigh << 32) | find.nFileSizeLow;
+            if ((find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || size == 0 || size > INFLATEBENCH_MAX_ARCHIVE)
+                continue;
+            char name[MAX_PATH];
+            lstrcpyn(name, dir, MAX_PATH);
+            SalamanderGeneral->SalPathAppend(name, find.cFileName, MAX_PATH);
+            HANDLE file = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                     FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            char* archive = (char*)malloc((size_t)size);
+            if (file != INVALID_HANDLE_VALUE && archive != NULL && ReadAt(file, 0, archive, (DWORD)size))
+            {
+                TDirectArray2<CInflateBenchStream> streams(1024);
+                AddInflateBenchArchive(archive, size, streams);
+                InflateBenchmarkReport(find.cFileName, streams);
+            }
+            else
+                TRACE_E("RunInflateBenchmark(): unable to read " << name);
+            if (archive != NULL)
+                free(archive);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+        } while (FindNextFile(search, &find));
+        FindClose(search);
+    }
+    TRACE_I("Benchmark \"inflate\": end");
+}
+
+#endif // _DEBUG
@@ -0,0 +1,105 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+// Concurrent extraction used by CZipUnpack::ExtractFiles: small stored and deflated
+// files are read (through their own handle of the archive, by positional reads) and
+// decompressed into memory by the worker threads ahead of ExtractFiles, which then
+// only writes the results; creating of the files, all dialogs and the CRC check stay
+// on the thread calling ExtractFiles (if the worker failed, the file is extracted
+// the usual way, which reports the error)
+
+#define PINFLATE_MAX_THREADS 32
+#define PINFLATE_MAX_SIZE (1024 * 1024)        // bigger files are not decompressed ahead
+#define PINFLATE_AHEAD_SIZE (64 * 1024 * 1024) // limit of memory taken by the queued files
+
+struct CInflateJob
+{
+    int Index;             // index of the file in CZipUnpack::ExtrFiles
+    const CFileInfo* File; // the file (from the central directory)
+    QWORD LocHeaderOffs;   // offset of the local header in the archive
+    unsigned CompSize;
+    unsigned Size;
+    int Method; // CM_STORED, CM_DEFLATED or CM_DEFLATE64
+
+    // results
+    char* Out; // decompressed data (Size bytes)
+    __UINT32 Crc;
+    BOOL Error; // read error, bad data or low memory, ExtractFiles extracts the file itself
+
+    HANDLE Done; // signaled when the job is finished
+};
+
+class CInflatePool
+{
+protected:
+    struct CWorker
+    {
+        CInflatePool* Pool;
+        HANDLE Thread;
+        HANDLE ZipFile; // own handle of the archive
+        HANDLE Heap;    // for inflate.cpp
+        char* SlideWindow;
+        // fixed Huffman trees of inflate, NULL before the first use
+        void* fixed_tl64;
+        void* fixed_td64;
+        int fixed_bl64,
+            fixed_bd64;
+        void* fixed_tl32;
+        void* fixed_td32;
+        int fixed_bl32,
+            fixed_bd32;
+    };
+
+    int Threads;
+    CWorker Workers[PINFLATE_MAX_THREADS];
+
+    CRITICAL_SECTION QueueLock; // guards Queue, QueueFirst, QueueCount and Terminate
+    CInflateJob* Queue[4 * PINFLATE_MAX_THREADS];
+    int QueueFirst;
+    int QueueCount;
+    HANDLE QueueSem; // number of jobs in Queue
+    BOOL Terminate;
+
+    CInflateJob Files[4 * PINFLATE_MAX_THREADS]; // ring of files decompressed ahead
+    int FilesFirst;
+    int FilesCount;
+    QWORD FilesSize; // memory taken by the files in the ring
+
+public:
+    CInflatePool();
+    ~CInflatePool(); // stops the workers, jobs not started yet are dropped
+
+    // starts the workers reading archive 'zipName', returns FALSE if it is not worth
+    // it (single processor) or it failed; the pool then must not be used
+    BOOL Init(const char* zipName);
+
+    // returns TRUE if the workers can decompress 'file'
+    static BOOL CanExtract(const CFileInfo* file);
+
+    // starts decompressing 'file' (file 'index' of CZipUnpack::ExtrFiles, indexes must
+    // grow), returns FALSE if there is no free slot (try it again later)
+    BOOL QueueFile(int index, const CFileInfo* file);
+
+    // waits for the result for file 'index' and returns it (call ReleaseFile() then),
+    // NULL if the file was not queued; results for files before 'index' are dropped
+    CInflateJob* GetFile(int index);
+    void ReleaseFile(CInflateJob* job);
+
+protected:
+    void Submit(CInflateJob* job);
+    void Process(CWorker* worker, CInflateJob* job);
+    void FreeWorker(CWorker* worker);
+
+    static DWORD WINAPI ThreadBody(void* param);
+    static unsigned WINAPI WorkerBody(void* param);
+};
+
+#ifdef _DEBUG
+// speed of InflateMemory() with the fast and with the bit-by-bit decoding loop on
+// synthetic data and on the *.zip archives in the benchmark directory, started when
+// loading the plugin if the environment variable OPENSAL_BENCHMARK contains "inflate"
+// (or is "all"); results are reported as TRACE_I messages
+void RunInflateBenchmark();
+#endif // _DEBUG
@@ -651,7 +651,7 @@ ullg CDeflate::flush_block(char* buf,      /* input block, or NULL if too old */
         cmpr_bytelen == 0L && cmpr_len_bits == 0L)
     { /* force stored file */
 #else
-    if (stored_len <= opt_lenb && eof &&
+    if (stored_len <= opt_lenb && eof && !stream_block &&
         cmpr_bytelen == 0L && cmpr_len_bits == 0L &&
         seekable() && !(Flag & 0x08))
     { //0x08 == GPF_DATADESCR
@@ -197,6 +197,20 @@ typedef struct
     __UINT32 StartDisk;     // Disk Start Number
 } CZip64ExtraField;
 
+// header of the journal written next to the archive before it is updated in place,
+// followed by the original tail of the archive (central directory and end records)
+typedef struct
+{
+    __UINT32 Signature;    // 0x4c4e524a, written last, when the journal is complete
+    __UINT32 Crc;          // crc-32 of the saved tail
+    __UINT64 TailOffs;     // offset of the saved tail in the archive
+    __UINT64 ArchiveSize;  // original size of the archive
+    __UINT64 LastWrite;    // original last write time of the archive (FILETIME)
+    __UINT64 FileIndex;    // file index of the archive on its volume
+    __UINT32 VolumeSerial; // serial number of the volume with the archive
+    __UINT32 WindowCrc;    // crc-32 of the data around the archive start and before TailOffs
+} CJournalHeader;
+
 #pragma pack(pop)
 
 #define IF_STORED_AES 1 // File is stored and AES-encrypted
@@ -353,6 +367,7 @@ extern const SYSTEMTIME MinZipTime;
 #define SIG_EOCENTRDIR 0x06054b50      //end of central dir signature
 #define SIG_ZIP64EOCENTRDIR 0x06064b50 //zip64 end of central dir
 #define SIG_ZIP64LOCATOR 0x07064b50    //zip64 end of central dir locator
+#define SIG_JOURNAL 0x4c4e524a         //journal of in place update ("JRNL")
 
 #define ZIP64_HEADER_ID 0x0001 //zip64 extra header id
 
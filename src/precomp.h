@@ -88,6 +88,7 @@
 #include "callstk.h"
 #include "moore.h"
 #include "regexp.h"
+#include "regdfa.h"
 #include "filter.h"
 #include "regwork.h"
 
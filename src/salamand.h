@@ -160,11 +160,17 @@ public:
 //
 // ****************************************************************************
 
+class CFileSortKeys;
+
+// releases keys built for sorting of CFilesArray (see sort.cpp)
+void DeleteFileSortKeys(CFileSortKeys* keys);
+
 class CFilesArray : public TDirectArray<CFileData>
 {
 protected:
     BOOL DeleteData;          // should destructors of removed elements be called?
     CStringArena* Arena;      // optional arena for string allocations (NULL = use malloc/free)
+    CFileSortKeys* SortKeys;  // keys of names from the last sorting (NULL = none), see SortNameExt()
 
 public:
     // j.r. is increasing the delta to 800 because when entering larger directories (several thousand files)
@@ -173,6 +179,7 @@ public:
     {
         DeleteData = TRUE;
         Arena = NULL;
+        SortKeys = NULL;
     }
     ~CFilesArray() { Destroy(); }
 
@@ -184,8 +191,19 @@ public:
     void SetArena(CStringArena* arena) { Arena = arena; }
     CStringArena* GetArena() const { return Arena; }
 
+    // Sort keys are owned by the array; they are checked against names before reuse, so
+    // changes of the array only cause them to be rebuilt
+    CFileSortKeys* GetSortKeys() const { return SortKeys; }
+    void SetSortKeys(CFileSortKeys* keys)
+    {
+        if (SortKeys != NULL && SortKeys != keys)
+            DeleteFileSortKeys(SortKeys);
+        SortKeys = keys;
+    }
+
     void DestroyMembers()
     {
+        SetSortKeys(NULL);
         if (DeleteData)
             TDirectArray<CFileData>::DestroyMembers();
         else
@@ -195,6 +213,7 @@ public:
 
     void Destroy()
     {
+        SetSortKeys(NULL);
         if (!DeleteData)
             DetachMembers();
         TDirectArray<CFileData>::Destroy();
@@ -16,6 +16,8 @@
 #include "shellib.h"
 #include "worker.h"
 #include "iconpool.h"
+#include "bench.h"
+#include "crc32.h"
 #include "snooper.h"
 #include "viewer.h"
 #include "editwnd.h"
@@ -684,37 +686,6 @@ COLORREF CustomColors[NUMBER_OF_CUSTOMCOLORS] =
 // CRC32
 //
 
-static DWORD Crc32Tab[256];
-static BOOL Crc32TabInitialized = FALSE;
-
-void MakeCrc32Table(DWORD* crcTab)
-{
-    DWORD c;
-    DWORD poly = 0xedb88320L; //polynomial exclusive-or pattern
-
-    /*
-  // generate crc polonomial, using precomputed poly should be faster
-  // terms of polynomial defining this crc (except x^32):
-  static const Byte p[] = {0,1,2,4,5,7,8,10,11,12,16,22,23,26};
-
-  // make exclusive-or pattern from polynomial (0xedb88320L)
-  poly = 0L;
-  for (n = 0; n < sizeof(p)/sizeof(Byte); n++)
-    poly |= 1L << (31 - p[n]);
-*/
-    int n;
-    for (n = 0; n < 256; n++)
-    {
-        c = (UINT32)n;
-
-        int k;
-        for (k = 0; k < 8; k++)
-            c = c & 1 ? poly ^ (c >> 1) : c >> 1;
-
-        crcTab[n] = c;
-    }
-}
-
 DWORD UpdateCrc32(const void* buffer, DWORD count, DWORD crcVal)
 {
     CALL_STACK_MESSAGE_NONE
@@ -722,70 +693,8 @@ DWORD UpdateCrc32(const void* buffer, DWORD count, DWORD crcVal)
     if (buffer == NULL)
         return 0;
 
-    if (!Crc32TabInitialized)
-    {
-        MakeCrc32Table(Crc32Tab);
-        Crc32TabInitialized = TRUE;
-    }
-
-    BYTE* p = (BYTE*)buffer;
-    DWORD c = crcVal ^ 0xFFFFFFFF;
-
-    if (count)
-        do
-        {
-            c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-        } while (--count);
-
-    // Honza: meril jsem nasledujici optimalizace a nemaji zadny vyznam;
-    // jedina sance by bylo prepsani do ASM a cteni pameti po DWORDech,
-    // ze kterych by pak bylo mozne vyzobavat jednotlive bajty;
-    // pri soucasnem nastaveni release verze neni prekladac schopen tuto
-    // optimalizaci provest za nas.
-    /*
-  int remain = count % 8;
-  count -= remain;
-  while (remain)
-  {
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    remain--;
-  }
-  while (count)
-  {
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    count -= 8;
-  }
-*/
-    /*
-  int remain = count % 4;
-  count -= remain;
-  while (remain > 0)
-  {
-    c = Crc32Tab[((int)c ^ (*p++)) & 0xff] ^ (c >> 8);
-    remain--;
-  }
-
-
-  DWORD *pdw = (DWORD*)p;
-  DWORD dw;
-  while (count > 0)
-  {
-    dw = *pdw++;
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw))) & 0xFF] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw >> 8))) & 0xFF] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw >> 16))) & 0xFF] ^ (c >> 8);
-    c = Crc32Tab[((int)c ^ ((BYTE)(dw >> 24))) & 0xFF] ^ (c >> 8);
-    count -= 4;
-  }
-*/
-    return c ^ 0xFFFFFFFF; /* (instead of ~c for 64-bit machines) */
+    // the kernel (PCLMULQDQ or slice-by-16) is selected by the CPU, see common\crc32.cpp
+    return UpdateCrc((char*)buffer, count, crcVal, NULL);
 }
 
 BOOL IsRemoteSession(void)
@@ -4093,6 +4002,11 @@ FIND_NEW_SLG_FILE:
     // inicializace funkci pro prochazeni pres next/prev soubor v panelu/Findu z vieweru
     InitFileNamesEnumForViewers();
 
+#ifdef _DEBUG
+    // benchmarks of the engines selected by OPENSAL_BENCHMARK (see bench.h)
+    RunBenchmarks();
+#endif // _DEBUG
+
     // nacteme seznam sharovanych adresaru
     IfExistSetSplashScreenText(LoadStr(IDS_STARTUP_SHARES));
     Shares.Refresh();
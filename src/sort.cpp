@@ -257,6 +257,12 @@ int RegSetStrCmpEx(const char* s1, int l1, const char* s2, int l2, BOOL* numeric
     }
 }
 
+#define SORT_KEYS_MIN_ITEMS 256 // smaller arrays are sorted by quick sort with Less* functions
+
+// sorting using keys of names (parallel merge sort), see CFileSortKeys at the end of the file;
+// returns FALSE on lack of memory (the array is not changed then)
+static BOOL SortFilesByKeys(CFilesArray& files, int left, int right, CSortType sortType, BOOL reverse);
+
 //
 //*****************************************************************************
 // QuickSort   1.klic Name, 2.klic Ext
@@ -398,7 +404,8 @@ LABEL_SortNameExtAux:
 
 void SortNameExt(CFilesArray& files, int left, int right, BOOL reverse)
 {
-    SortNameExtAux(files, left, right, reverse);
+    if (right - left + 1 < SORT_KEYS_MIN_ITEMS || !SortFilesByKeys(files, left, right, stName, reverse))
+        SortNameExtAux(files, left, right, reverse);
 }
 
 //
@@ -506,7 +513,8 @@ LABEL_SortExtNameAux:
 
 void SortExtName(CFilesArray& files, int left, int right, BOOL reverse)
 {
-    SortExtNameAux(files, left, right, reverse);
+    if (right - left + 1 < SORT_KEYS_MIN_ITEMS || !SortFilesByKeys(files, left, right, stExtension, reverse))
+        SortExtNameAux(files, left, right, reverse);
 }
 
 //
@@ -589,7 +597,8 @@ LABEL_SortTimeNameExtAux:
 
 void SortTimeNameExt(CFilesArray& files, int left, int right, BOOL reverse)
 {
-    SortTimeNameExtAux(files, left, right, reverse);
+    if (right - left + 1 < SORT_KEYS_MIN_ITEMS || !SortFilesByKeys(files, left, right, stTime, reverse))
+        SortTimeNameExtAux(files, left, right, reverse);
 }
 
 //
@@ -671,7 +680,8 @@ LABEL_SortSizeNameExtAux:
 
 void SortSizeNameExt(CFilesArray& files, int left, int right, BOOL reverse)
 {
-    SortSizeNameExtAux(files, left, right, reverse);
+    if (right - left + 1 < SORT_KEYS_MIN_ITEMS || !SortFilesByKeys(files, left, right, stSize, reverse))
+        SortSizeNameExtAux(files, left, right, reverse);
 }
 
 //
@@ -679,49 +689,38 @@ void SortSizeNameExt(CFilesArray& files, int left, int right, BOOL reverse)
 // QuickSort   1.klic Attr 2.klic Name, 3.klic Ext
 //
 
-BOOL LessAttrNameExt(const CFileData& f1, const CFileData& f2, BOOL reverse)
+// poradi atributu pro razeni
+static DWORD GetAttrSortKey(DWORD attr)
 {
     // okopcim FILE_ATTRIBUTE_READONLY na nejvyznamejsi bit
-    //  DWORD f1Attr = f1.Attr;
-    //  DWORD f2Attr = f2.Attr;
-    //  if (f1.Attr & FILE_ATTRIBUTE_READONLY) f1Attr |= 0x80000000;
-    //  if (f2.Attr & FILE_ATTRIBUTE_READONLY) f2Attr |= 0x80000000;
+    //  if (attr & FILE_ATTRIBUTE_READONLY) key |= 0x80000000;
 
     // pokud podporime zobrazovani dalsiho atributu,
     // je treba rozsirit masku DISPLAYED_ATTRIBUTES
 
     // prejdeme na abecedni razeni, jako ma explorer a speed commander
-    DWORD f1Attr = 0;
-    DWORD f2Attr = 0;
-    if (f1.Attr & FILE_ATTRIBUTE_ARCHIVE)
-        f1Attr |= 0x00000001;
-    if (f1.Attr & FILE_ATTRIBUTE_COMPRESSED)
-        f1Attr |= 0x00000002;
-    if (f1.Attr & FILE_ATTRIBUTE_ENCRYPTED)
-        f1Attr |= 0x00000004;
-    if (f1.Attr & FILE_ATTRIBUTE_HIDDEN)
-        f1Attr |= 0x00000008;
-    if (f1.Attr & FILE_ATTRIBUTE_READONLY)
-        f1Attr |= 0x00000010;
-    if (f1.Attr & FILE_ATTRIBUTE_SYSTEM)
-        f1Attr |= 0x00000020;
-    if (f1.Attr & FILE_ATTRIBUTE_TEMPORARY)
-        f1Attr |= 0x00000040;
-
-    if (f2.Attr & FILE_ATTRIBUTE_ARCHIVE)
-        f2Attr |= 0x00000001;
-    if (f2.Attr & FILE_ATTRIBUTE_COMPRESSED)
-        f2Attr |= 0x00000002;
-    if (f2.Attr & FILE_ATTRIBUTE_ENCRYPTED)
-        f2Attr |= 0x00000004;
-    if (f2.Attr & FILE_ATTRIBUTE_HIDDEN)
-        f2Attr |= 0x00000008;
-    if (f2.Attr & FILE_ATTRIBUTE_READONLY)
-        f2Attr |= 0x00000010;
-    if (f2.Attr & FILE_ATTRIBUTE_SYSTEM)
-        f2Attr |= 0x00000020;
-    if (f2.Attr & FILE_ATTRIBUTE_TEMPORARY)
-        f2Attr |= 0x00000040;
+    DWORD key = 0;
+    if (attr & FILE_ATTRIBUTE_ARCHIVE)
+        key |= 0x00000001;
+    if (attr & FILE_ATTRIBUTE_COMPRESSED)
+        key |= 0x00000002;
+    if (attr & FILE_ATTRIBUTE_ENCRYPTED)
+        key |= 0x00000004;
+    if (attr & FILE_ATTRIBUTE_HIDDEN)
+        key |= 0x00000008;
+    if (attr & FILE_ATTRIBUTE_READONLY)
+        key |= 0x00000010;
+    if (attr & FILE_ATTRIBUTE_SYSTEM)
+        key |= 0x00000020;
+    if (attr & FILE_ATTRIBUTE_TEMPORARY)
+        key |= 0x00000040;
+    return key;
+}
+
+BOOL LessAttrNameExt(const CFileData& f1, const CFileData& f2, BOOL reverse)
+{
+    DWORD f1Attr = GetAttrSortKey(f1.Attr);
+    DWORD f2Attr = GetAttrSortKey(f2.Attr);
 
     //--- nejprve podle Attr
     if (f1Attr != f2Attr)
@@ -795,7 +794,8 @@ LABEL_SortAttrNameExtAux:
 
 void SortAttrNameExt(CFilesArray& files, int left, int right, BOOL reverse)
 {
-    SortAttrNameExtAux(files, left, right, reverse);
+    if (right - left + 1 < SORT_KEYS_MIN_ITEMS || !SortFilesByKeys(files, left, right, stAttr, reverse))
+        SortAttrNameExtAux(files, left, right, reverse);
 }
 
 //
@@ -864,3 +864,808 @@ LABEL_IntSort:
         }
     }
 }
+
+//
+//*****************************************************************************
+// CFileSortKeys
+//
+// Keys for sorting of panel listings: names are split into segments (texts, dots and
+// numbers, see StrCmpLogicalEx) once per listing and texts of the segments are converted
+// for comparison (by LowerCase, or to sort keys of LCMapString when sorting by regional
+// settings). Comparison of two keys gives the same result as RegSetStrICmpEx() without
+// rescanning the names and without calls of CompareString. Keys are stored in CFilesArray
+// and reused by the next sorting of the array (e.g. after change of the sort column)
+// while the array contains the same names: items of the array are changed in place and
+// a freed name can be reallocated at the same address, so the pointer, the text and the
+// extension offset of each name are checked before reuse. Other fields of CFileData
+// (time, size, attributes) are read directly from the array by the sorting.
+//
+
+#define SORT_PARALLEL_MIN_ITEMS 16384 // smaller arrays are sorted by one thread
+#define SORT_MAX_THREADS 8            // maximal number of sorting threads
+#define SORT_SEGMENT_TEXT 0xFFFF      // CSortSegment::Digits of texts and dots
+#define SORT_LCMAP_BUFFER 16384       // buffer for sort keys of LCMapString (one name)
+
+struct CSortSegment
+{
+    WORD Start;     // offset of the segment in the string
+    WORD Length;    // length of the segment in the string
+    WORD KeyOffset; // offset of the converted segment in CSortNameKey::Text
+    WORD KeyLength; // length of the converted segment
+    WORD Digits;    // number: count of digits without leading zeros; SORT_SEGMENT_TEXT = text or dot
+};
+
+struct CSortNameKey
+{
+    const char* Source;           // the string (points to CFileData::Name)
+    const BYTE* Text;             // converted segments
+    const CSortSegment* Segments; // segments of the string
+    int Count;                    // number of segments
+};
+
+struct CFileSortKey
+{
+    const char* Name;      // CFileData::Name the key was built for (checked before reuse)
+    int NameLen;           // CFileData::NameLen the key was built for
+    const char* NameCopy;  // copy of the name the key was built for (checked before reuse)
+    int ExtOffset;         // CFileData::Ext - CFileData::Name the key was built for
+    CSortNameKey Full;     // the whole name
+    CSortNameKey* ExtKeys; // [0] = extension, [1] = name without extension; NULL = not built yet
+};
+
+class CFileSortKeys
+{
+public:
+    CFileSortKey* Keys;
+    int Count;
+
+    // configuration the keys were built for (see RegSetStrICmpEx)
+    BOOL UsesLocale;
+    BOOL DetectNumbers;
+    BOOL FindDots;
+    LCID Locale; // user locale of LCMapString (only if UsesLocale)
+
+    CStringArena Arenas[SORT_MAX_THREADS]; // texts and segments, one arena per building thread
+
+public:
+    CFileSortKeys();
+    ~CFileSortKeys();
+
+    // returns TRUE if the keys were built for names in 'files' with the current configuration
+    BOOL IsValidFor(CFilesArray& files);
+
+    // builds keys for all items of 'files' ('ext' is TRUE = keys of extensions and names
+    // without extensions are needed too), uses 'threads' threads; returns FALSE on lack
+    // of memory
+    BOOL Build(CFilesArray& files, BOOL ext, int threads);
+
+    // builds keys of items 'first'..'last' ('full' = also keys of whole names); used by
+    // building threads, each with its own 'arena'
+    BOOL BuildKeys(CFilesArray& files, int first, int last, CStringArena* arena, BOOL full, BOOL ext);
+
+protected:
+    BOOL BuildNameKey(CSortNameKey* key, const char* s, int len, CStringArena* arena);
+};
+
+void DeleteFileSortKeys(CFileSortKeys* keys)
+{
+    delete keys;
+}
+
+CFileSortKeys::CFileSortKeys()
+{
+    Keys = NULL;
+    Count = 0;
+    UsesLocale = FALSE;
+    DetectNumbers = FALSE;
+    FindDots = FALSE;
+    Locale = 0;
+}
+
+CFileSortKeys::~CFileSortKeys()
+{
+    if (Keys != NULL)
+        free(Keys);
+}
+
+BOOL CFileSortKeys::IsValidFor(CFilesArray& files)
+{
+    if (Keys == NULL || Count != files.Count ||
+        UsesLocale != Configuration.SortUsesLocale || DetectNumbers != Configuration.SortDetectNumbers ||
+        FindDots != (WindowsVistaAndLater && !SystemPolicies.GetNoDotBreakInLogicalCompare()) ||
+        (UsesLocale && Locale != GetUserDefaultLCID()))
+    {
+        return FALSE;
+    }
+    int i;
+    for (i = 0; i < Count; i++)
+    {
+        CFileData* f = &files[i];
+        CFileSortKey* key = &Keys[i];
+        if (key->Name != f->Name || key->NameLen != (int)f->NameLen || key->ExtOffset != (int)(f->Ext - f->Name) ||
+            memcmp(key->NameCopy, f->Name, f->NameLen) != 0)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+BOOL CFileSortKeys::BuildNameKey(CSortNameKey* key, const char* s, int len, CStringArena* arena)
+{
+    CSortSegment segments[MAX_PATH + 1]; // names are shorter than MAX_PATH
+    if (len > MAX_PATH)
+    {
+        TRACE_E("CFileSortKeys::BuildNameKey(): unexpected length of name: " << len);
+        return FALSE;
+    }
+
+    // split the string the same way as StrCmpLogicalEx
+    int count = 0;
+    if (DetectNumbers)
+    {
+        const char* end = s + len;
+        const char* p = s;
+        while (p < end)
+        {
+            CSortSegment* seg = &segments[count++];
+            seg->Start = (WORD)(p - s);
+            seg->Digits = SORT_SEGMENT_TEXT;
+            if (*p >= '0' && *p <= '9') // number
+            {
+                const char* numBeg = NULL; // first non-zero digit
+                while (p < end && *p >= '0' && *p <= '9')
+                {
+                    if (numBeg == NULL && *p != '0')
+                        numBeg = p;
+                    p++;
+                }
+                seg->Digits = numBeg != NULL ? (WORD)(p - numBeg) : 0;
+            }
+            else
+            {
+                if (FindDots && *p == '.')
+                    p++; // dots are taken one by one
+                else
+                {
+                    while (p < end && (*p < '0' || *p > '9') && (!FindDots || *p != '.'))
+                        p++;
+                }
+            }
+            seg->Length = (WORD)((p - s) - seg->Start);
+        }
+    }
+    else
+    {
+        if (len > 0) // the whole string is one text
+        {
+            segments[0].Start = 0;
+            segments[0].Length = (WORD)len;
+            segments[0].Digits = SORT_SEGMENT_TEXT;
+            count = 1;
+        }
+    }
+
+    // convert texts of the segments
+    BYTE* text;
+    if (!UsesLocale)
+    {
+        text = (BYTE*)arena->Alloc(len > 0 ? len : 1);
+        if (text == NULL)
+            return FALSE;
+        int i;
+        for (i = 0; i < len; i++)
+            text[i] = LowerCase[(BYTE)s[i]];
+        for (i = 0; i < count; i++)
+        {
+            segments[i].KeyOffset = segments[i].Start;
+            segments[i].KeyLength = segments[i].Length;
+        }
+    }
+    else
+    {
+        BYTE buffer[SORT_LCMAP_BUFFER];
+        int used = 0;
+        int i;
+        for (i = 0; i < count; i++)
+        {
+            int n = LCMapString(LOCALE_USER_DEFAULT, LCMAP_SORTKEY | NORM_IGNORECASE, s + segments[i].Start,
+                                segments[i].Length, (char*)buffer + used, SORT_LCMAP_BUFFER - used);
+            if (n == 0)
+            {
+                DWORD err = GetLastError();
+                TRACE_E("CFileSortKeys::BuildNameKey(): LCMapString failed: " << GetErrorText(err));
+                return FALSE;
+            }
+            segments[i].KeyOffset = (WORD)used;
+            segments[i].KeyLength = (WORD)(n - 1); // without the terminating null byte
+            used += n - 1;
+        }
+        text = (BYTE*)arena->Alloc(used > 0 ? used : 1);
+        if (text == NULL)
+            return FALSE;
+        memcpy(text, buffer, used);
+    }
+
+    CSortSegment* keySegments = NULL;
+    if (count > 0)
+    {
+        keySegments = (CSortSegment*)arena->Alloc(count * sizeof(CSortSegment));
+        if (keySegments == NULL)
+            return FALSE;
+        memcpy(keySegments, segments, count * sizeof(CSortSegment));
+    }
+    key->Source = s;
+    key->Text = text;
+    key->Segments = keySegments;
+    key->Count = count;
+    return TRUE;
+}
+
+BOOL CFileSortKeys::BuildKeys(CFilesArray& files, int first, int last, CStringArena* arena, BOOL full, BOOL ext)
+{
+    int i;
+    for (i = first; i <= last; i++)
+    {
+        CFileData* f = &files[i];
+        CFileSortKey* key = &Keys[i];
+        if (full)
+        {
+            key->Name = f->Name;
+            key->NameLen = f->NameLen;
+            key->ExtOffset = (int)(f->Ext - f->Name);
+            key->ExtKeys = NULL;
+            char* copy = (char*)arena->Alloc(f->NameLen > 0 ? f->NameLen : 1);
+            if (copy == NULL)
+                return FALSE;
+            memcpy(copy, f->Name, f->NameLen);
+            key->NameCopy = copy;
+            if (!BuildNameKey(&key->Full, f->Name, f->NameLen, arena))
+                return FALSE;
+        }
+        if (ext && key->ExtKeys == NULL)
+        {
+            CSortNameKey* extKeys = (CSortNameKey*)arena->Alloc(2 * sizeof(CSortNameKey));
+            if (extKeys == NULL ||
+                !BuildNameKey(&extKeys[0], f->Ext, f->NameLen - (int)(f->Ext - f->Name), arena) ||
+                !BuildNameKey(&extKeys[1], f->Name, (*f->Ext != 0) ? (int)(f->Ext - 1 - f->Name) : f->NameLen, arena))
+            {
+                return FALSE;
+            }
+            key->ExtKeys = extKeys;
+        }
+    }
+    return TRUE;
+}
+
+//
+//*****************************************************************************
+// Parallel merge sort of panel listings
+//
+
+struct CSortContext
+{
+    CFilesArray* Files;
+    CFileSortKey* Keys;
+    CSortType SortType;
+    BOOL Reverse;
+    BOOL NewerOnTop; // Configuration.SortNewerOnTop
+};
+
+enum CSortJobType
+{
+    sjBuildKeys, // CFileSortKeys::BuildKeys() of items First..Last
+    sjSort,      // sorts Count items in Items (Buffer is a work buffer of the same size)
+    sjMerge,     // merges sorted Items[0..Middle-1] and Items[Middle..Count-1] to Buffer
+};
+
+struct CSortJob
+{
+    CSortJobType Type;
+    CSortContext* Context;
+
+    // sjBuildKeys
+    CFileSortKeys* Keys;
+    int First;
+    int Last;
+    CStringArena* Arena;
+    BOOL Full;
+    BOOL Ext;
+    BOOL Result; // FALSE = lack of memory
+
+    // sjSort and sjMerge
+    int* Items;
+    int* Buffer;
+    int Middle;
+    int Count;
+};
+
+// compares texts of segments like StrICmpEx (or CompareString, texts are then sort keys)
+static int CompareSortText(const BYTE* t1, int l1, const BYTE* t2, int l2)
+{
+    int res = memcmp(t1, t2, l1 < l2 ? l1 : l2);
+    if (res != 0)
+        return res < 0 ? -1 : 1;
+    if (l1 != l2)
+        return l1 < l2 ? -1 : 1;
+    return 0;
+}
+
+// equivalent of RegSetStrICmpEx on keys of the strings
+static int CompareNameKeys(const CSortNameKey* k1, const CSortNameKey* k2, BOOL* numericalyEqual)
+{
+    int suggestion = 0; // see StrCmpLogicalEx
+    int i = 0;
+    while (1)
+    {
+        // behind the end of a string there is an empty text
+        const CSortSegment* s1 = i < k1->Count ? &k1->Segments[i] : NULL;
+        const CSortSegment* s2 = i < k2->Count ? &k2->Segments[i] : NULL;
+        if (s1 == NULL || s2 == NULL || s1->Digits == SORT_SEGMENT_TEXT || s2->Digits == SORT_SEGMENT_TEXT)
+        {
+            int ret = CompareSortText(s1 != NULL ? k1->Text + s1->KeyOffset : k1->Text, s1 != NULL ? s1->KeyLength : 0,
+                                      s2 != NULL ? k2->Text + s2->KeyOffset : k2->Text, s2 != NULL ? s2->KeyLength : 0);
+            if (ret != 0)
+            {
+                if (numericalyEqual != NULL)
+                    *numericalyEqual = FALSE;
+                return ret;
+            }
+        }
+        else // two numbers
+        {
+            int ret;
+            if (s1->Digits != s2->Digits)
+                ret = s1->Digits < s2->Digits ? -1 : 1; // "00" < "1", "99" < "100"
+            else
+            {
+                ret = memcmp(k1->Source + s1->Start + s1->Length - s1->Digits,
+                             k2->Source + s2->Start + s2->Length - s2->Digits, s1->Digits);
+                if (ret != 0)
+                    ret = ret < 0 ? -1 : 1;
+            }
+            if (ret != 0)
+            {
+                if (numericalyEqual != NULL)
+                    *numericalyEqual = FALSE;
+                return ret;
+            }
+            if (suggestion == 0 && s1->Length != s2->Length) // only the first "suggestion" matters
+                suggestion = s1->Length > s2->Length ? -1 : 1;  // "0001" < "001"
+        }
+        i++;
+        if (i >= k1->Count && i >= k2->Count)
+            break;
+    }
+    if (numericalyEqual != NULL)
+        *numericalyEqual = TRUE;
+    return suggestion;
+}
+
+// equivalent of CmpNameExt on keys
+static int CompareNameExtKeys(CSortContext* ctx, int i1, int i2)
+{
+    int res = CompareNameKeys(&ctx->Keys[i1].Full, &ctx->Keys[i2].Full, NULL);
+    if (res != 0)
+        return res;
+    // equal names (archives or FS) may differ in case, the rare case goes to the original function
+    return CmpNameExt(ctx->Files->At(i1), ctx->Files->At(i2));
+}
+
+// returns a negative value if item 'i1' should be before item 'i2' (see Less* functions)
+static int CompareSortItems(CSortContext* ctx, int i1, int i2)
+{
+    const CFileData& f1 = ctx->Files->At(i1);
+    const CFileData& f2 = ctx->Files->At(i2);
+    int res;
+    switch (ctx->SortType)
+    {
+    case stExtension:
+    {
+        const CSortNameKey* e1 = ctx->Keys[i1].ExtKeys;
+        const CSortNameKey* e2 = ctx->Keys[i2].ExtKeys;
+        BOOL numericalyEqual1;
+        int res1 = CompareNameKeys(&e1[0], &e2[0], &numericalyEqual1);
+        if (!numericalyEqual1)
+            res = res1; // extensions differ
+        else
+        {
+            BOOL numericalyEqual2;
+            int res2 = CompareNameKeys(&e1[1], &e2[1], &numericalyEqual2);
+            if (numericalyEqual2 && res1 != 0)
+                res = res1; // extensions have priority
+            else
+            {
+                if (res2 == 0 && f1.Name != f2.Name) // equal names (archives or FS), the rare case goes to LessExtName
+                    return LessExtName(f1, f2, ctx->Reverse) ? -1 : (LessExtName(f2, f1, ctx->Reverse) ? 1 : 0);
+                res = res2;
+            }
+        }
+        break;
+    }
+
+    case stTime:
+    {
+        res = CompareFileTime(&f1.LastWrite, &f2.LastWrite);
+        if (res != 0)
+            return (ctx->Reverse ^ ctx->NewerOnTop) ? -res : res;
+        res = CompareNameExtKeys(ctx, i1, i2);
+        break;
+    }
+
+    case stSize:
+    {
+        if (f1.Size != f2.Size)
+            res = f1.Size < f2.Size ? -1 : 1;
+        else
+            res = CompareNameExtKeys(ctx, i1, i2);
+        break;
+    }
+
+    case stAttr:
+    {
+        DWORD attr1 = GetAttrSortKey(f1.Attr);
+        DWORD attr2 = GetAttrSortKey(f2.Attr);
+        if (attr1 != attr2)
+            res = attr1 < attr2 ? -1 : 1;
+        else
+            res = CompareNameExtKeys(ctx, i1, i2);
+        break;
+    }
+
+    default:
+        res = CompareNameExtKeys(ctx, i1, i2);
+        break;
+    }
+    return ctx->Reverse ? -res : res;
+}
+
+// stable merge of two sorted sequences to 'dst'
+static void MergeSortItems(CSortContext* ctx, const int* a, int aCount, const int* b, int bCount, int* dst)
+{
+    const int* aEnd = a + aCount;
+    const int* bEnd = b + bCount;
+    if (aCount > 0 && bCount > 0 && CompareSortItems(ctx, aEnd[-1], *b) <= 0) // already in order
+    {
+        memcpy(dst, a, aCount * sizeof(int));
+        memcpy(dst + aCount, b, bCount * sizeof(int));
+        return;
+    }
+    while (a < aEnd && b < bEnd)
+    {
+        if (CompareSortItems(ctx, *b, *a) < 0)
+            *dst++ = *b++;
+        else
+            *dst++ = *a++;
+    }
+    while (a < aEnd)
+        *dst++ = *a++;
+    while (b < bEnd)
+        *dst++ = *b++;
+}
+
+// stable merge sort of 'count' items, 'buffer' is a work buffer of the same size
+static void SortItems(CSortContext* ctx, int* items, int* buffer, int count)
+{
+    const int run = 16; // runs sorted by insertion sort
+    int i;
+    for (i = 0; i < count; i += run)
+    {
+        int end = i + run < count ? i + run : count;
+        int j;
+        for (j = i + 1; j < end; j++)
+        {
+            int item = items[j];
+            int k = j;
+            while (k > i && CompareSortItems(ctx, item, items[k - 1]) < 0)
+            {
+                items[k] = items[k - 1];
+                k--;
+            }
+            items[k] = item;
+        }
+    }
+    int* src = items;
+    int* dst = buffer;
+    int width;
+    for (width = run; width < count; width *= 2)
+    {
+        for (i = 0; i < count; i += 2 * width)
+        {
+            int aCount = i + width < count ? width : count - i;
+            int bCount = i + 2 * width < count ? width : count - i - aCount;
+            MergeSortItems(ctx, src + i, aCount, src + i + aCount, bCount, dst + i);
+        }
+        int* swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != items)
+        memcpy(items, src, count * sizeof(int));
+}
+
+static void DoSortJob(CSortJob* job)
+{
+    switch (job->Type)
+    {
+    case sjBuildKeys:
+        job->Result = job->Keys->BuildKeys(*job->Context->Files, job->First, job->Last, job->Arena, job->Full, job->Ext);
+        break;
+
+    case sjSort:
+        SortItems(job->Context, job->Items, job->Buffer, job->Count);
+        break;
+
+    case sjMerge:
+        MergeSortItems(job->Context, job->Items, job->Middle, job->Items + job->Middle,
+                       job->Count - job->Middle, job->Buffer);
+        break;
+    }
+}
+
+static unsigned SortThreadEH(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    __try
+    {
+#endif // CALLSTK_DISABLE
+        SetThreadNameInVCAndTrace("Sort");
+        DoSortJob((CSortJob*)param);
+        return 0;
+#ifndef CALLSTK_DISABLE
+    }
+    __except (CCallStack::HandleException(GetExceptionInformation()))
+    {
+        TRACE_I("Thread Sort: calling ExitProcess(1).");
+        //    ExitProcess(1);
+        TerminateProcess(GetCurrentProcess(), 1); // harder exit (this call still performs some operations)
+        return 1;
+    }
+#endif // CALLSTK_DISABLE
+}
+
+static DWORD WINAPI SortThread(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    CCallStack stack;
+#endif // CALLSTK_DISABLE
+    return SortThreadEH(param);
+}
+
+// runs 'count' jobs in parallel: the first one in this thread, the others in new threads
+// (in this thread too if a thread cannot be started); returns after all jobs are done
+static void RunSortJobs(CSortJob* jobs, int count)
+{
+    HANDLE threads[SORT_MAX_THREADS];
+    int started = 0;
+    int i;
+    for (i = 1; i < count; i++)
+    {
+        DWORD threadId;
+        threads[started] = HANDLES(CreateThread(NULL, 0, SortThread, &jobs[i], 0, &threadId));
+        if (threads[started] == NULL)
+        {
+            TRACE_E("RunSortJobs(): unable to start sorting thread");
+            DoSortJob(&jobs[i]);
+        }
+        else
+            started++;
+    }
+    DoSortJob(&jobs[0]);
+    if (started > 0)
+    {
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+        for (i = 0; i < started; i++)
+            HANDLES(CloseHandle(threads[i]));
+    }
+}
+
+BOOL CFileSortKeys::Build(CFilesArray& files, BOOL ext, int threads)
+{
+    BOOL full = !IsValidFor(files);
+    if (full)
+    {
+        int a;
+        for (a = 0; a < SORT_MAX_THREADS; a++)
+            Arenas[a].Release();
+        if (Keys != NULL)
+            free(Keys);
+        Count = 0;
+        Keys = (CFileSortKey*)malloc(files.Count * sizeof(CFileSortKey));
+        if (Keys == NULL)
+        {
+            TRACE_E(LOW_MEMORY);
+            return FALSE;
+        }
+        UsesLocale = Configuration.SortUsesLocale;
+        Locale = GetUserDefaultLCID();
+        DetectNumbers = Configuration.SortDetectNumbers;
+        FindDots = WindowsVistaAndLater && !SystemPolicies.GetNoDotBreakInLogicalCompare();
+    }
+    else
+    {
+        if (!ext)
+            return TRUE; // keys of whole names are enough
+        int i;
+        for (i = 0; i < Count && Keys[i].ExtKeys != NULL; i++)
+            ;
+        if (i == Count)
+            return TRUE; // keys of extensions are ready too
+    }
+
+    CSortContext context;
+    context.Files = &files;
+    CSortJob jobs[SORT_MAX_THREADS];
+    int chunk = (files.Count + threads - 1) / threads;
+    int count = 0;
+    int first;
+    for (first = 0; first < files.Count; first += chunk)
+    {
+        CSortJob* job = &jobs[count];
+        job->Type = sjBuildKeys;
+        job->Context = &context;
+        job->Keys = this;
+        job->First = first;
+        job->Last = first + chunk < files.Count ? first + chunk - 1 : files.Count - 1;
+        job->Arena = &Arenas[count];
+        job->Full = full;
+        job->Ext = ext;
+        job->Result = FALSE;
+        count++;
+    }
+    RunSortJobs(jobs, count);
+
+    BOOL ok = TRUE;
+    int i;
+    for (i = 0; i < count; i++)
+        ok &= jobs[i].Result;
+    if (!ok)
+    {
+        TRACE_E("CFileSortKeys::Build(): unable to build sort keys");
+        free(Keys);
+        Keys = NULL;
+        Count = 0;
+        return FALSE;
+    }
+    Count = files.Count;
+    return TRUE;
+}
+
+// sorts items 'left'..'right' of 'files' using keys of names (built or reused, see
+// CFileSortKeys) by a parallel merge sort; returns FALSE if there is not enough memory,
+// 'files' are not changed then
+static BOOL SortFilesByKeys(CFilesArray& files, int left, int right, CSortType sortType, BOOL reverse)
+{
+    CALL_STACK_MESSAGE5("SortFilesByKeys(, %d, %d, %d, %d)", left, right, sortType, reverse);
+
+    int count = right - left + 1;
+    int threads = 1;
+    if (count >= SORT_PARALLEL_MIN_ITEMS)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        threads = (int)si.dwNumberOfProcessors;
+        if (threads > SORT_MAX_THREADS)
+            threads = SORT_MAX_THREADS;
+        if (threads > count / (SORT_PARALLEL_MIN_ITEMS / 2))
+            threads = count / (SORT_PARALLEL_MIN_ITEMS / 2);
+        if (threads < 1)
+            threads = 1;
+    }
+
+    CFileSortKeys* keys = files.GetSortKeys();
+    if (keys == NULL)
+    {
+        keys = new CFileSortKeys;
+        if (keys == NULL)
+        {
+            TRACE_E(LOW_MEMORY);
+            return FALSE;
+        }
+        files.SetSortKeys(keys);
+    }
+    if (!keys->Build(files, sortType == stExtension, threads))
+    {
+        files.SetSortKeys(NULL);
+        return FALSE;
+    }
+
+    int* items = (int*)malloc(2 * count * sizeof(int));
+    if (items == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return FALSE;
+    }
+    int* buffer = items + count;
+    int i;
+    for (i = 0; i < count; i++)
+        items[i] = left + i;
+
+    CSortContext context;
+    context.Files = &files;
+    context.Keys = keys->Keys;
+    context.SortType = sortType;
+    context.Reverse = reverse;
+    context.NewerOnTop = Configuration.SortNewerOnTop;
+
+    // sort parts of the array in parallel, then merge them in pairs (also in parallel)
+    CSortJob jobs[SORT_MAX_THREADS];
+    int bounds[SORT_MAX_THREADS + 1];
+    int parts = threads;
+    for (i = 0; i <= parts; i++)
+        bounds[i] = (int)((__int64)count * i / parts);
+    for (i = 0; i < parts; i++)
+    {
+        jobs[i].Type = sjSort;
+        jobs[i].Context = &context;
+        jobs[i].Items = items + bounds[i];
+        jobs[i].Buffer = buffer + bounds[i];
+        jobs[i].Count = bounds[i + 1] - bounds[i];
+    }
+    RunSortJobs(jobs, parts);
+
+    int* src = items;
+    int* dst = buffer;
+    while (parts > 1)
+    {
+        int merges = 0;
+        for (i = 0; i < parts; i += 2)
+        {
+            CSortJob* job = &jobs[merges];
+            job->Type = sjMerge;
+            job->Context = &context;
+            job->Items = src + bounds[i];
+            job->Buffer = dst + bounds[i];
+            if (i + 1 < parts)
+            {
+                job->Middle = bounds[i + 1] - bounds[i];
+                job->Count = bounds[i + 2] - bounds[i];
+            }
+            else // odd part is only copied
+            {
+                job->Middle = bounds[i + 1] - bounds[i];
+                job->Count = job->Middle;
+            }
+            bounds[merges] = bounds[i];
+            merges++;
+        }
+        bounds[merges] = count;
+        RunSortJobs(jobs, merges);
+        parts = merges;
+        int* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    // move items and their keys to the sorted order (by cycles of the permutation)
+    CFileSortKey* sortKeys = keys->Keys;
+    for (i = 0; i < count; i++)
+    {
+        if (src[i] < 0)
+            continue;
+        if (src[i] == left + i)
+        {
+            src[i] = -1;
+            continue;
+        }
+        CFileData file = files[left + i];
+        CFileSortKey key = sortKeys[left + i];
+        int j = i;
+        while (1)
+        {
+            int from = src[j] - left;
+            src[j] = -1;
+            if (from == i)
+            {
+                files[left + j] = file;
+                sortKeys[left + j] = key;
+                break;
+            }
+            files[left + j] = files[left + from];
+            sortKeys[left + j] = sortKeys[left + from];
+            j = from;
+        }
+    }
+    free(items);
+    return TRUE;
+}
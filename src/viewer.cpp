@@ -511,16 +511,49 @@ CFindSetDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 void CViewerGoToOffsetDialog::Validate(CTransferInfo& ti)
 {
-    int h;
-    ti.CheckBox(IDC_VGTO_HEX, h);
+    int line = FALSE;
+    if (GoToLine != NULL)
+        ti.CheckBox(IDC_VGTO_LINE, line);
+    int h = FALSE;
+    if (!line) // line numbers are always decimal
+        ti.CheckBox(IDC_VGTO_HEX, h);
     __int64 dummy;
     ti.EditLine(IDE_VGTO_OFFSET, dummy, TRUE, TRUE, h);
 }
 
 void CViewerGoToOffsetDialog::Transfer(CTransferInfo& ti)
 {
-    ti.CheckBox(IDC_VGTO_HEX, Configuration.GoToOffsetIsHex);
-    ti.EditLine(IDE_VGTO_OFFSET, *Offset, TRUE, TRUE, Configuration.GoToOffsetIsHex);
+    int line = GoToLine != NULL && *GoToLine;
+    if (GoToLine != NULL)
+        ti.CheckBox(IDC_VGTO_LINE, line);
+    if (line)
+    {
+        if (ti.Type == ttDataToWindow)
+            CheckDlgButton(HWindow, IDC_VGTO_HEX, BST_UNCHECKED);
+        ti.EditLine(IDE_VGTO_OFFSET, *Line, TRUE, TRUE, FALSE);
+    }
+    else
+    {
+        ti.CheckBox(IDC_VGTO_HEX, Configuration.GoToOffsetIsHex);
+        ti.EditLine(IDE_VGTO_OFFSET, *Offset, TRUE, TRUE, Configuration.GoToOffsetIsHex);
+    }
+    if (ti.Type == ttDataToWindow)
+    {
+        if (GoToLine == NULL) // there are no lines in hex view
+            EnableWindow(GetDlgItem(HWindow, IDC_VGTO_LINE), FALSE);
+        EnableControls();
+    }
+    else
+    {
+        if (GoToLine != NULL)
+            *GoToLine = line;
+    }
+}
+
+void CViewerGoToOffsetDialog::EnableControls()
+{
+    BOOL line = IsDlgButtonChecked(HWindow, IDC_VGTO_LINE) != BST_UNCHECKED;
+    EnableWindow(GetDlgItem(HWindow, IDC_VGTO_HEX), !line);
 }
 
 INT_PTR
@@ -543,6 +576,23 @@ CViewerGoToOffsetDialog::DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
                 ti2.EditLine(IDE_VGTO_OFFSET, off, FALSE, TRUE, h);
             }
         }
+        if (LOWORD(wParam) == IDC_VGTO_LINE && HIWORD(wParam) == BN_CLICKED)
+        { // line numbers are decimal: convert a hex offset to decimal and uncheck HEX
+            if (IsDlgButtonChecked(HWindow, IDC_VGTO_LINE) != BST_UNCHECKED &&
+                IsDlgButtonChecked(HWindow, IDC_VGTO_HEX) != BST_UNCHECKED)
+            {
+                CheckDlgButton(HWindow, IDC_VGTO_HEX, BST_UNCHECKED);
+                CTransferInfo ti(HWindow, ttDataFromWindow);
+                __int64 off;
+                ti.EditLine(IDE_VGTO_OFFSET, off, TRUE, TRUE, TRUE, FALSE, TRUE); // do not show an error; just skip conversion
+                if (ti.IsGood())
+                {
+                    CTransferInfo ti2(HWindow, ttDataToWindow);
+                    ti2.EditLine(IDE_VGTO_OFFSET, off, FALSE, TRUE, FALSE);
+                }
+            }
+            EnableControls();
+        }
         break;
     }
     }
@@ -627,6 +677,10 @@ CViewerWindow::CViewerWindow(const char* fileName, CViewType type, const char* c
     SelectionIsFindResult = FALSE;
     ScrollScaleX = ScrollScaleY = 0;
     EnableSetScroll = TRUE;
+    ScrollByLines = FALSE;
+    Follow = FALSE;
+    FollowIDValid = FALSE;
+    FollowVolume = FollowIndexHigh = FollowIndexLow = 0;
     ScrollToSelection = FALSE;
     ToolTipOffset = -1;
     HToolTip = NULL;
@@ -659,6 +713,7 @@ CViewerWindow::~CViewerWindow()
     if (ViewerFont != NULL)
         HANDLES(DeleteObject(ViewerFont));
     ReleaseViewerBrushs();
+    LineIndex.Stop(); // closes the file, must be done before the disk cache gets it
     if (Lock != NULL)
     {
         SetEvent(Lock);
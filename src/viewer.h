@@ -16,6 +16,8 @@
 
 #define VIEWER_HISTORY_SIZE 30 // number of remembered strings
 
+#define VIEWER_FOLLOW_PERIOD 250 // follow mode: how often [ms] the viewed file is tested for changes
+
 // menu positions - redo when the menu changes!
 #define VIEWER_FILE_MENU_INDEX 0         // in the viewer main menu
 #define VIEWER_FILE_MENU_OTHFILESINDEX 3 // in the File submenu of the viewer main menu
@@ -93,8 +95,16 @@ protected:
 class CViewerGoToOffsetDialog : public CCommonDialog
 {
 public:
-    CViewerGoToOffsetDialog(HWND parent, __int64* offset)
-        : CCommonDialog(HLanguage, IDD_VIEWERGOTOOFFSET, IDD_VIEWERGOTOOFFSET, parent) { Offset = offset; }
+    // 'line' is the line number (one based) offered in line mode; 'goToLine' is the state of
+    // the Line checkbox (in/out), NULL disables it (hex view); if it returns TRUE, 'line'
+    // contains the chosen line instead of 'offset'
+    CViewerGoToOffsetDialog(HWND parent, __int64* offset, __int64* line, BOOL* goToLine)
+        : CCommonDialog(HLanguage, IDD_VIEWERGOTOOFFSET, IDD_VIEWERGOTOOFFSET, parent)
+    {
+        Offset = offset;
+        Line = line;
+        GoToLine = goToLine;
+    }
 
     virtual void Validate(CTransferInfo& ti);
     virtual void Transfer(CTransferInfo& ti);
@@ -103,7 +113,12 @@ protected:
     virtual INT_PTR DialogProc(UINT uMsg, WPARAM wParam, LPARAM lParam);
 
 protected:
+    // enables/disables the HEX checkbox according to the Line checkbox
+    void EnableControls();
+
     __int64* Offset;
+    __int64* Line;
+    BOOL* GoToLine;
 };
 
 // ****************************************************************************
@@ -114,6 +129,119 @@ enum CViewType
     vtHex
 };
 
+// ****************************************************************************
+//
+// CViewerLineIndex
+//
+// index of line beginnings of the viewed file built by a background thread; the thread maps
+// the file into memory by parts and scans it with SSE2; only every VIEWER_LINE_INDEX_STEP-th
+// line beginning is stored, any line is found by reading at most VIEWER_LINE_INDEX_STEP - 1
+// lines behind the nearest stored one; lines are ended by EOLs per Configuration.EOL_XXX
+// (see CViewerWindow::FindNextEOL()), line wrapping is not taken into account
+//
+
+#define VIEWER_LINE_INDEX_STEP 64             // every how many lines a line beginning is stored
+#define VIEWER_LINE_INDEX_VIEW_SIZE 0x1000000 // size of one mapped part of the file (16 MB, must be a multiple of 64 KB)
+#define VIEWER_LINE_INDEX_SCAN_SIZE 0x100000  // the found lines are published after scanning each 1 MB
+
+class CViewerLineIndex
+{
+protected:
+    CRITICAL_SECTION CS; // guards the data shared with the indexing thread (see below)
+    HANDLE Thread;       // indexing thread (NULL = not started)
+    BOOL Running;        // TRUE = the indexing thread has not finished yet
+    BOOL Terminate;      // TRUE = the indexing thread should end as soon as possible
+    HANDLE File;         // indexed file (opened in Update(), read by the indexing thread)
+    char* FileName;      // name of the indexed file (NULL = there is no index)
+
+    // EOL configuration used for the index (copy of Configuration.EOL_XXX)
+    BOOL EolCR, EolLF, EolCRLF, EolNULL;
+
+    // data shared with the indexing thread
+    TDirectArray<__int64> Checkpoints; // offsets of beginnings of lines 0, STEP, 2 * STEP, ...
+    __int64 Lines;                     // number of line beginnings found so far (including line 0)
+    __int64 IndexedSize;               // number of bytes scanned so far
+    __int64 TargetSize;                // file size the index should reach
+    BOOL Failed;                       // TRUE = reading of the file failed, the index is unusable
+
+    // state of the indexing thread (EOLs can be split by a boundary of the mapped part)
+    BOOL LastWasCR;             // the last scanned byte is '\r' which is not an EOL itself
+    BOOL LastWasCREOL;          // the last scanned byte is '\r' which is an EOL (Configuration.EOL_CR)
+    unsigned char Tail[16];     // the last bytes in front of IndexedSize (to detect that the file was rewritten, not appended)
+    int TailLen;                // number of valid bytes in Tail
+
+public:
+    CViewerLineIndex();
+    ~CViewerLineIndex();
+
+    // starts indexing of file 'fileName' with size 'fileSize'; if the index of this file
+    // already exists and the file has only grown, it continues from where it ended
+    void Update(const char* fileName, __int64 fileSize);
+
+    // stops the indexing thread and releases the index (and the file)
+    void Stop();
+
+    // returns TRUE if the index exists and reading of the file has not failed
+    BOOL IsAvailable();
+
+    // returns TRUE if the whole file with size 'fileSize' is indexed
+    BOOL IsComplete(__int64 fileSize);
+
+    // returns in 'lines' the number of lines found so far; returns TRUE if the index is complete
+    BOOL GetLinesCount(__int64* lines);
+
+    // returns TRUE if the index knows line 'line' (zero based); 'lineBegin' and 'firstLine'
+    // return the beginning and the number of the nearest stored line in front of it
+    BOOL GetLineCheckpoint(__int64 line, __int64* lineBegin, __int64* firstLine);
+
+    // returns TRUE if offset 'offset' is already indexed; 'lineBegin' and 'line' return
+    // the beginning and the number of the nearest stored line beginning at or in front of 'offset'
+    BOOL GetOffsetCheckpoint(__int64 offset, __int64* lineBegin, __int64* line);
+
+    // approximation of the line number for offset 'offset' (interpolated between stored lines),
+    // used for the scrollbar; the index must be complete
+    double GetLineFromOffset(__int64 offset);
+
+    // approximation of the offset of line 'line' (interpolated between stored lines), used for
+    // the scrollbar; the index must be complete
+    __int64 GetOffsetFromLine(double line);
+
+    // body of the indexing thread
+    void IndexFile();
+
+protected:
+    // starts the indexing thread (waits for the previous one which has already finished)
+    void StartThread();
+
+    // returns the index of the last stored line beginning at or in front of 'offset'; must be called in CS
+    int FindCheckpoint(__int64 offset);
+
+    // calls Scan() and catches the error of reading the mapped file (EXCEPTION_IN_PAGE_ERROR);
+    // returns FALSE on the error
+    BOOL ScanView(const unsigned char* data, int len, __int64 offset, __int64& lines,
+                  TDirectArray<__int64>& newCheckpoints);
+
+    // returns in 'equal' TRUE if the mapped 'data' starts with Tail (the indexed part of the file
+    // was not changed); returns FALSE on the error of reading the mapped file
+    BOOL CompareTail(const unsigned char* data, BOOL* equal);
+
+    // scans 'len' bytes of 'data' placed at offset 'offset' in the file; adds the beginnings
+    // of found lines to 'lines' and to 'newCheckpoints'
+    void Scan(const unsigned char* data, int len, __int64 offset, __int64& lines,
+              TDirectArray<__int64>& newCheckpoints);
+
+    // a line begins at offset 'lineBegin'
+    void AddLine(__int64 lineBegin, __int64& lines, TDirectArray<__int64>& newCheckpoints)
+    {
+        if (lines % VIEWER_LINE_INDEX_STEP == 0)
+            newCheckpoints.Add(lineBegin);
+        lines++;
+    }
+
+    // the last found line begins at 'lineBegin' (not in front of it): '\r\n' split by EOL_CR
+    void MoveLastLine(__int64 lineBegin, __int64 lines, TDirectArray<__int64>& newCheckpoints);
+};
+
 class CViewerWindow : public CWindow
 {
 public:
@@ -187,6 +315,13 @@ protected:
                      BOOL* calledHeightChanged = NULL);
     // if a read error occurs, fatalErr == TRUE; ExitTextMode is TRUE when switching to hex mode
     void HeightChanged(BOOL& fatalErr);
+
+    // follow mode: turns following of the end of the viewed file on/off
+    void SetFollow(BOOL follow);
+    // follow mode (IDT_FOLLOW timer): tests the size and identity of the viewed file; reads
+    // and paints only the appended part of the file, reloads the file if it was rotated
+    // (replaced by another file) or truncated
+    void FollowFile();
     // if a read error occurs, fatalErr == TRUE; ExitTextMode is TRUE when switching to hex mode
     __int64 ZeroLineSize(BOOL& fatalErr, __int64* firstLineEndOff = NULL, __int64* firstLineCharLen = NULL);
 
@@ -303,6 +438,18 @@ protected:
 
     void FindNewSeekY(__int64 newSeekY, BOOL& fatalErr);
 
+    // returns in 'offset' the beginning of line 'line' (zero based, the last line is used for
+    // a bigger 'line'); waits for the line index if needed (the user can cancel it with ESC);
+    // returns FALSE if the line index is not available or on cancel/error
+    BOOL GetLineBegin(__int64 line, __int64* offset, BOOL& fatalErr);
+
+    // returns in 'line' the number (zero based) of the line containing 'offset'; returns FALSE
+    // if the line index does not contain 'offset' yet
+    BOOL GetLineNumber(__int64 offset, __int64* line, BOOL& fatalErr);
+
+    // TRUE if the vertical scrollbar may work with lines from the line index instead of offsets
+    BOOL CanScrollByLines() { return Type == vtText && !WrapText && LineIndex.IsComplete(FileSize); }
+
     // calls SalMessageBox internally and blocks Paint just for it (only clears the viewer background, does not touch the file)
     int SalMessageBoxViewerPaintBlocked(HWND hParent, LPCTSTR lpText, LPCTSTR lpCaption, UINT uType);
 
@@ -353,6 +500,15 @@ protected:
     double ScrollScaleX,  // horizontal scrollbar coefficient
         ScrollScaleY;     // vertical scrollbar coefficient
     BOOL EnableSetScroll; // do not refresh scrollbar data while dragging
+    BOOL ScrollByLines;   // TRUE = the vertical scrollbar works with lines (see LineIndex), FALSE = with offsets
+
+    CViewerLineIndex LineIndex; // index of line beginnings of the viewed file (text view)
+
+    BOOL Follow;              // TRUE = follow mode: the viewer shows the end of the growing file
+    BOOL FollowIDValid;       // TRUE = FollowVolume and FollowIndexXXX identify the viewed file
+    DWORD FollowVolume;       // serial number of the volume with the viewed file (follow mode)
+    DWORD FollowIndexHigh,    // file index of the viewed file (follow mode), the file was rotated when it changes
+        FollowIndexLow;
 
     __int64 ToolTipOffset; // hex mode: file offset (shown in the tooltip)
     HWND HToolTip;         // tooltip window
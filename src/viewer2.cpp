@@ -340,11 +340,7 @@ CViewerWindow::Prepare(HANDLE* hFile, __int64 offset, __int64 bytes, BOOL& fatal
 void CViewerWindow::CodeCharacters(unsigned char* start, unsigned char* end)
 {
     if (UseCodeTable)
-    {
-        unsigned char* s = start - 1;
-        while (++s < end)
-            *s = CodeTable[*s];
-    }
+        ConvertByTable(CodeTable, IsAsciiPreservingTable(CodeTable), (char*)start, (char*)start, (int)(end - start));
 }
 
 BOOL CViewerWindow::LoadBefore(HANDLE* hFile)
@@ -458,6 +454,7 @@ BOOL CViewerWindow::LoadBefore(HANDLE* hFile)
                 free(Caption);
                 Caption = NULL;
             }
+            LineIndex.Stop();
             if (Lock != NULL)
             {
                 SetEvent(Lock);
@@ -480,6 +477,7 @@ BOOL CViewerWindow::LoadBefore(HANDLE* hFile)
             free(Caption);
             Caption = NULL;
         }
+        LineIndex.Stop();
         if (Lock != NULL)
         {
             SetEvent(Lock);
@@ -612,6 +610,7 @@ BOOL CViewerWindow::LoadBehind(HANDLE* hFile)
                 free(Caption);
                 Caption = NULL;
             }
+            LineIndex.Stop();
             if (Lock != NULL)
             {
                 SetEvent(Lock);
@@ -634,6 +633,7 @@ BOOL CViewerWindow::LoadBehind(HANDLE* hFile)
             free(Caption);
             Caption = NULL;
         }
+        LineIndex.Stop();
         if (Lock != NULL)
         {
             SetEvent(Lock);
@@ -666,6 +666,147 @@ void CViewerWindow::HeightChanged(BOOL& fatalErr)
     }
 }
 
+void CViewerWindow::SetFollow(BOOL follow)
+{
+    CALL_STACK_MESSAGE2("CViewerWindow::SetFollow(%d)", follow);
+    if (follow)
+    {
+        Follow = TRUE;
+        FollowIDValid = FALSE; // FollowFile() reads the file again and shows its end
+        SetTimer(HWindow, IDT_FOLLOW, VIEWER_FOLLOW_PERIOD, NULL);
+        FollowFile();
+    }
+    else
+    {
+        if (Follow)
+            KillTimer(HWindow, IDT_FOLLOW);
+        Follow = FALSE;
+    }
+}
+
+void CViewerWindow::FollowFile()
+{
+    CALL_STACK_MESSAGE1("CViewerWindow::FollowFile()");
+    if (FileName == NULL || MouseDrag || !EnablePaint) // nothing to follow or the viewer is busy (try it next time)
+        return;
+
+    // only attributes are read here, so the test is cheap and it does not block writing/rotating of the file
+    HANDLE file = HANDLES_Q(CreateFileUtf8(FileName, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                           NULL, OPEN_EXISTING, 0, NULL));
+    if (file == INVALID_HANDLE_VALUE)
+        return; // e.g. the file is just being rotated, try it next time
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(file, &info);
+    HANDLES(CloseHandle(file));
+    if (!ok)
+        return;
+    __int64 size = ((__int64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    BOOL sameFile = FollowIDValid && FollowVolume == info.dwVolumeSerialNumber &&
+                    FollowIndexHigh == info.nFileIndexHigh && FollowIndexLow == info.nFileIndexLow;
+    if (sameFile && size == FileSize)
+        return; // nothing has changed (the usual case)
+
+    FollowIDValid = TRUE;
+    FollowVolume = info.dwVolumeSerialNumber;
+    FollowIndexHigh = info.nFileIndexHigh;
+    FollowIndexLow = info.nFileIndexLow;
+
+    BOOL fatalErr = FALSE;
+    if (!sameFile || size < FileSize) // rotated or truncated file: read it again and show its end
+    {
+        EndSelectionRow = -1; // disable the optimization
+        if (!sameFile)
+            LineIndex.Stop(); // the file may have the same size, the index must be built again
+        FileChanged(NULL, FALSE, fatalErr, FALSE);
+        if (!fatalErr && !ExitTextMode)
+        {
+            SeekY = MaxSeekY;
+            __int64 newSeekY = FindBegin(SeekY, fatalErr);
+            if (!fatalErr && !ExitTextMode)
+                SeekY = newSeekY;
+        }
+        if (fatalErr)
+            FatalFileErrorOccured();
+        if (fatalErr || ExitTextMode)
+            return;
+        ResetFindOffsetOnNextPaint = TRUE;
+        InvalidateRect(HWindow, NULL, FALSE);
+        return;
+    }
+
+    // the file has grown: the data in Buffer remain valid (Prepare() loads the appended data
+    // when they are needed), so only the appended rows are painted
+    __int64 oldFileSize = FileSize;
+    __int64 oldSeekY = SeekY;
+    BOOL atEnd = SeekY >= MaxSeekY;
+    BOOL endVisible = oldSeekY + ViewSize >= oldFileSize;
+    int rows = max(1, Height / CharHeight);
+    FileSize = size;
+    if (Type == vtText)
+        LineIndex.Update(FileName, FileSize);
+    HeightChanged(fatalErr);
+    if (!fatalErr && !ExitTextMode && atEnd && MaxSeekY > oldSeekY)
+    {
+        // count rows the view is scrolled by (-1 = unknown, paint the whole view)
+        int scrolled = -1;
+        if (Type == vtHex)
+        {
+            if ((MaxSeekY - oldSeekY) / 16 < rows)
+                scrolled = (int)((MaxSeekY - oldSeekY) / 16);
+        }
+        else
+        {
+            if (!WrapText)
+            {
+                HANDLE hFile = NULL; // let Prepare() open the file just once and close it ourselves at the end
+                __int64 lineBegin = oldSeekY;
+                __int64 lineEnd, nextLineBegin;
+                int lines = 0;
+                while (lineBegin < MaxSeekY && lines < rows &&
+                       FindNextEOL(&hFile, lineBegin, MaxSeekY, lineEnd, nextLineBegin, fatalErr))
+                {
+                    lineBegin = nextLineBegin;
+                    lines++;
+                }
+                if (hFile != NULL)
+                    HANDLES(CloseHandle(hFile));
+                if (!fatalErr && lineBegin == MaxSeekY)
+                    scrolled = lines;
+            }
+        }
+        if (!fatalErr)
+        {
+            SeekY = MaxSeekY;
+            EndSelectionRow = -1; // disable the optimization
+            if (scrolled > 0 && scrolled < rows)
+            {
+                ::ScrollWindow(HWindow, 0, -scrolled * CharHeight, NULL, NULL); // scroll the window
+                // the last rows of the old view (the last line could have been completed) and the uncovered rows
+                RECT r;
+                r.left = 0;
+                r.top = max(0, rows - scrolled - 2) * CharHeight;
+                r.right = Width;
+                r.bottom = Height;
+                InvalidateRect(HWindow, &r, FALSE);
+            }
+            else
+                InvalidateRect(HWindow, NULL, FALSE);
+        }
+    }
+    else
+    {
+        if (!fatalErr && !ExitTextMode)
+        {
+            if (endVisible)
+                InvalidateRect(HWindow, NULL, FALSE); // the appended data are (partially) visible
+            else
+                SetScrollBar(); // only the scrollbar has changed
+        }
+    }
+    if (fatalErr)
+        FatalFileErrorOccured();
+}
+
 void CViewerWindow::OpenFile(const char* file, const char* caption, BOOL wholeCaption)
 {
     CALL_STACK_MESSAGE3("CViewerWindow::OpenFile(%s, %s)", file, caption);
@@ -794,6 +935,7 @@ void CViewerWindow::FileChanged(HANDLE file, BOOL testOnlyFileSize, BOOL& fatalE
                 free(Caption);
                 Caption = NULL;
             }
+            LineIndex.Stop();
             if (Lock != NULL)
             {
                 SetEvent(Lock);
@@ -915,6 +1057,8 @@ void CViewerWindow::FileChanged(HANDLE file, BOOL testOnlyFileSize, BOOL& fatalE
                         FindNewSeekY(SeekY, fatalErr);
                 }
             }
+            if (!fatalErr && Type == vtText) // the line index is built only for the text view
+                LineIndex.Update(FileName, FileSize);
         }
         if (close)
             HANDLES(CloseHandle(file));
@@ -937,6 +1081,7 @@ void CViewerWindow::FileChanged(HANDLE file, BOOL testOnlyFileSize, BOOL& fatalE
             free(Caption);
             Caption = NULL;
         }
+        LineIndex.Stop();
         if (Lock != NULL)
         {
             SetEvent(Lock);
@@ -1073,6 +1218,85 @@ BOOL CViewerWindow::FindNextEOL(HANDLE* hFile, __int64 seek, __int64 maxSeek, __
     return !fatalErr && nextLineBegin != -1;
 }
 
+BOOL CViewerWindow::GetLineBegin(__int64 line, __int64* offset, BOOL& fatalErr)
+{
+    CALL_STACK_MESSAGE2("CViewerWindow::GetLineBegin(%g, ,)", (double)line);
+    fatalErr = FALSE;
+    __int64 lineBegin, curLine;
+    if (!LineIndex.GetLineCheckpoint(line, &lineBegin, &curLine))
+    {
+        if (!LineIndex.IsAvailable())
+            return FALSE;
+
+        // the line is not indexed yet, wait for the indexing thread
+        HCURSOR oldCur = SetCursor(LoadCursor(NULL, IDC_WAIT));
+        CreateSafeWaitWindow(LoadStr(IDS_INDEXINGLINESESC), LoadStr(IDS_VIEWERTITLE), 1000, TRUE, HWindow);
+        GetAsyncKeyState(VK_ESCAPE); // init GetAsyncKeyState - see help
+        BOOL found = FALSE;
+        while (LineIndex.IsAvailable() && !UserWantsToCancelSafeWaitWindow())
+        {
+            if (LineIndex.GetLineCheckpoint(line, &lineBegin, &curLine))
+            {
+                found = TRUE;
+                break;
+            }
+            Sleep(50);
+        }
+        DestroySafeWaitWindow();
+        SetCursor(oldCur);
+        if (!found)
+            return FALSE;
+    }
+
+    // walk at most VIEWER_LINE_INDEX_STEP - 1 lines from the stored line beginning
+    HANDLE hFile = NULL; // let Prepare() open the file just once and close it ourselves at the end
+    __int64 lineEnd, nextLineBegin;
+    while (curLine < line)
+    {
+        if (!FindNextEOL(&hFile, lineBegin, FileSize, lineEnd, nextLineBegin, fatalErr) ||
+            lineEnd >= FileSize) // the last line of the file (it is not ended by EOL)
+        {
+            break;
+        }
+        lineBegin = nextLineBegin;
+        curLine++;
+    }
+    if (hFile != NULL)
+        HANDLES(CloseHandle(hFile));
+    if (fatalErr)
+        return FALSE;
+    *offset = lineBegin;
+    return TRUE;
+}
+
+BOOL CViewerWindow::GetLineNumber(__int64 offset, __int64* line, BOOL& fatalErr)
+{
+    CALL_STACK_MESSAGE2("CViewerWindow::GetLineNumber(%g, ,)", (double)offset);
+    fatalErr = FALSE;
+    __int64 lineBegin, curLine;
+    if (!LineIndex.GetOffsetCheckpoint(offset, &lineBegin, &curLine))
+        return FALSE;
+
+    HANDLE hFile = NULL; // let Prepare() open the file just once and close it ourselves at the end
+    __int64 lineEnd, nextLineBegin;
+    while (lineBegin < offset)
+    {
+        if (!FindNextEOL(&hFile, lineBegin, offset, lineEnd, nextLineBegin, fatalErr) ||
+            lineEnd >= FileSize || nextLineBegin > offset) // 'offset' is inside line 'curLine'
+        {
+            break;
+        }
+        lineBegin = nextLineBegin;
+        curLine++;
+    }
+    if (hFile != NULL)
+        HANDLES(CloseHandle(hFile));
+    if (fatalErr)
+        return FALSE;
+    *line = curLine;
+    return TRUE;
+}
+
 BOOL CViewerWindow::FindPreviousEOL(HANDLE* hFile, __int64 seek, __int64 minSeek, __int64& lineBegin,
                                     __int64& previousLineEnd, BOOL allowWrap, BOOL takeLineBegin,
                                     BOOL& fatalErr, int* lines, __int64* firstLineEndOff,
@@ -1555,23 +1779,39 @@ void CViewerWindow::SetScrollBar()
         si.fMask = SIF_ALL;
         GetScrollInfo(HWindow, SB_VERT, &si);
 
-        __int64 max = ViewSize + MaxSeekY;
-        ScrollScaleY = ((double)max) / 20000.0;
+        // the text view of a file with a complete line index uses line numbers so the thumb
+        // does not jump on files with lines of very different lengths; otherwise offsets are used
+        double viewY, posY, maxY;
+        ScrollByLines = CanScrollByLines();
+        if (ScrollByLines)
+        {
+            viewY = max(1, Height / CharHeight);
+            posY = LineIndex.GetLineFromOffset(SeekY);
+            maxY = LineIndex.GetLineFromOffset(MaxSeekY) + viewY;
+        }
+        else
+        {
+            viewY = (double)ViewSize;
+            posY = (double)SeekY;
+            maxY = (double)(ViewSize + MaxSeekY);
+        }
+        __int64 max = (__int64)maxY;
+        ScrollScaleY = maxY / 20000.0;
         if (ScrollScaleY < 0.00001)
             ScrollScaleY = 0.00001; // against "divide by zero"
-        int page = (int)(ViewSize / ScrollScaleY + 0.5 + 1);
-        if (max == 0 || si.nMin != 0 || si.nMax != max / ScrollScaleY + 0.5 + 1 ||
+        int page = (int)(viewY / ScrollScaleY + 0.5 + 1);
+        if (max == 0 || si.nMin != 0 || si.nMax != maxY / ScrollScaleY + 0.5 + 1 ||
             si.nPage != (DWORD)page ||
-            si.nPos != SeekY / ScrollScaleY + 0.5) // if it needs to be set ...
+            si.nPos != posY / ScrollScaleY + 0.5) // if it needs to be set ...
         {
             si.cbSize = sizeof(si);
             si.fMask = SIF_ALL | SIF_DISABLENOSCROLL;
             si.nMin = 0;
             if (max != 0 && MaxSeekY != 0)
             {
-                si.nMax = (int)(max / ScrollScaleY + 0.5 + 1);
+                si.nMax = (int)(maxY / ScrollScaleY + 0.5 + 1);
                 si.nPage = page;
-                si.nPos = (int)(SeekY / ScrollScaleY + 0.5);
+                si.nPos = (int)(posY / ScrollScaleY + 0.5);
             }
             else
             {
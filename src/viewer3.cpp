@@ -77,7 +77,10 @@ void CViewerWindow::OnVScroll()
         __int64 oldSeekY = SeekY;
         EndSelectionRow = -1; // disable the optimization
         EnableSetScroll = ((int)LOWORD(VScrollWParam) == SB_THUMBPOSITION);
-        SeekY = (__int64)(ScrollScaleY * ((short)HIWORD(VScrollWParam)) + 0.5);
+        if (ScrollByLines) // the scrollbar works with line numbers (see SetScrollBar())
+            SeekY = LineIndex.GetOffsetFromLine(ScrollScaleY * ((short)HIWORD(VScrollWParam)));
+        else
+            SeekY = (__int64)(ScrollScaleY * ((short)HIWORD(VScrollWParam)) + 0.5);
         SeekY = min(SeekY, MaxSeekY);
         BOOL fatalErr = FALSE;
 
@@ -573,6 +576,7 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
             DragQueryFile((HDROP)wParam, 0, path, MAX_PATH);
             if (SalGetFullName(path))
             {
+                LineIndex.Stop();
                 if (Lock != NULL)
                 {
                     SetEvent(Lock);
@@ -863,6 +867,7 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
             {
                 if (SalGetFullName(file))
                 {
+                    LineIndex.Stop();
                     if (Lock != NULL)
                     {
                         SetEvent(Lock);
@@ -926,6 +931,7 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
 
             if (ok) // we have a new name
             {
+                LineIndex.Stop();
                 if (Lock != NULL)
                 {
                     SetEvent(Lock);
@@ -1059,8 +1065,13 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
                                         break;
                                     if (len == lineEnd - lineBegin)
                                     {
-                                        if (RegExp.SetLine((char*)(Buffer + (lineBegin - Seek)),
-                                                           (char*)(Buffer + (lineEnd - Seek))))
+                                        if (RegExp.TestLine((char*)(Buffer + (lineBegin - Seek)),
+                                                            (char*)(Buffer + (lineEnd - Seek))) == rdfaNoMatch)
+                                        {
+                                            // the automaton found no match on the line, regexec is not needed
+                                        }
+                                        else if (RegExp.SetLine((char*)(Buffer + (lineBegin - Seek)),
+                                                                (char*)(Buffer + (lineEnd - Seek))))
                                         {
                                             int start;
                                             if (FindOffset > lineBegin)
@@ -1172,8 +1183,13 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
                                         break;
                                     if (len == lineEnd - lineBegin)
                                     {
-                                        if (RegExp.SetLine((char*)(Buffer + (lineBegin - Seek)),
-                                                           (char*)(Buffer + (lineEnd - Seek))))
+                                        if (RegExp.TestLine((char*)(Buffer + (lineBegin - Seek)),
+                                                            (char*)(Buffer + (lineEnd - Seek))) == rdfaNoMatch)
+                                        {
+                                            // the automaton found no match on the line, regexec is not needed
+                                        }
+                                        else if (RegExp.SetLine((char*)(Buffer + (lineBegin - Seek)),
+                                                                (char*)(Buffer + (lineEnd - Seek))))
                                         {
                                             int length;
                                             if (FindOffset < lineEnd)
@@ -1787,14 +1803,37 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
         {
             if (MouseDrag || FileName == NULL)
                 return 0;
+            static BOOL goToLine = FALSE; // the last state of the Line checkbox in the text view
+
             __int64 offset = SeekY;
-            if (CViewerGoToOffsetDialog(HWindow, &offset).Execute() == IDOK)
+            __int64 line = 0;
+            BOOL fatalErr = FALSE;
+            if (Type == vtText && !GetLineNumber(SeekY, &line, fatalErr))
+                line = 0; // the line index does not know the line yet, offer the first line
+            if (fatalErr)
             {
+                FatalFileErrorOccured();
+                return 0;
+            }
+            line++; // the dialog uses line numbers from one
+            BOOL lineMode = goToLine;
+            if (CViewerGoToOffsetDialog(HWindow, &offset, &line, Type == vtText ? &lineMode : NULL).Execute() == IDOK)
+            {
+                if (Type == vtText)
+                {
+                    goToLine = lineMode;
+                    if (lineMode && !GetLineBegin(max(line, 1) - 1, &offset, fatalErr))
+                    {
+                        if (fatalErr)
+                            FatalFileErrorOccured();
+                        return 0; // the line index is not available or the user has canceled waiting for it
+                    }
+                }
+
                 EndSelectionRow = -1; // disable the optimization
                 SeekY = offset;
                 SeekY = min(SeekY, MaxSeekY);
 
-                BOOL fatalErr = FALSE;
                 __int64 newSeekY = FindBegin(SeekY, fatalErr);
                 if (fatalErr)
                     FatalFileErrorOccured();
@@ -1834,6 +1873,14 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
             return 0;
         }
 
+        case CM_VIEWER_FOLLOW:
+        {
+            if (MouseDrag)
+                return 0;
+            SetFollow(!Follow);
+            return 0;
+        }
+
         case CM_REREADFILE:
         {
             if (MouseDrag)
@@ -2854,6 +2901,12 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
             return 0;
         }
 
+        if (wParam == IDT_FOLLOW)
+        {
+            FollowFile();
+            return 0;
+        }
+
         if (wParam != IDT_AUTOSCROLL)
             break;
         POINT p;
@@ -3140,6 +3193,8 @@ CViewerWindow::WindowProc(UINT uMsg, WPARAM wParam, LPARAM lParam)
                 BOOL zoomed = IsZoomed(HWindow);
                 CheckMenuItem(subMenu, CM_VIEW_FULLSCREEN, MF_BYCOMMAND | (zoomed ? MF_CHECKED : MF_UNCHECKED));
                 EnableMenuItem(subMenu, CM_GOTOOFFSET, MF_BYCOMMAND | (FileName != NULL ? MF_ENABLED : MF_GRAYED));
+                CheckMenuItem(subMenu, CM_VIEWER_FOLLOW, MF_BYCOMMAND | (Follow ? MF_CHECKED : MF_UNCHECKED));
+                EnableMenuItem(subMenu, CM_VIEWER_FOLLOW, MF_BYCOMMAND | (FileName != NULL ? MF_ENABLED : MF_GRAYED));
             }
             subMenu = GetSubMenu(main, VIEWER_EDIT_MENU_INDEX);
             if (subMenu != NULL)
@@ -3400,6 +3455,9 @@ MENU_TEMPLATE_ITEM ViewerCodingMenu[] =
             case 'C':
                 cm = CM_COPYTOCLIP;
                 break;
+            case 'E':
+                cm = CM_VIEWER_FOLLOW;
+                break;
             case 'F':
                 cm = CM_FINDSET;
                 break;
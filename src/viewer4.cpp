@@ -0,0 +1,575 @@
+﻿// SPDX-FileCopyrightText: 2023 Open Salamander Authors
+// SPDX-License-Identifier: GPL-2.0-or-later
+// CommentsTranslationProject: TRANSLATED
+
+#include "precomp.h"
+
+#include <emmintrin.h>
+
+#include "cfgdlg.h"
+#include "viewer.h"
+#include "cpuinfo.h"
+
+//
+// ****************************************************************************
+// CViewerLineIndex
+//
+
+static unsigned ViewerLineIndexThreadEH(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    __try
+    {
+#endif // CALLSTK_DISABLE
+        SetThreadNameInVCAndTrace("ViewerLineIndex");
+        ((CViewerLineIndex*)param)->IndexFile();
+        return 0;
+#ifndef CALLSTK_DISABLE
+    }
+    __except (CCallStack::HandleException(GetExceptionInformation()))
+    {
+        TRACE_I("Thread ViewerLineIndex: calling ExitProcess(1).");
+        //    ExitProcess(1);
+        TerminateProcess(GetCurrentProcess(), 1); // harsher exit (this one still invokes something)
+        return 1;
+    }
+#endif // CALLSTK_DISABLE
+}
+
+static DWORD WINAPI ViewerLineIndexThread(void* param)
+{
+    CCallStack stack;
+    return ViewerLineIndexThreadEH(param);
+}
+
+CViewerLineIndex::CViewerLineIndex() : Checkpoints(1000, 4096)
+{
+    HANDLES(InitializeCriticalSection(&CS));
+    Thread = NULL;
+    Running = FALSE;
+    Terminate = FALSE;
+    File = NULL;
+    FileName = NULL;
+    EolCR = EolLF = EolCRLF = EolNULL = FALSE;
+    Lines = 0;
+    IndexedSize = 0;
+    TargetSize = 0;
+    Failed = FALSE;
+    LastWasCR = FALSE;
+    LastWasCREOL = FALSE;
+    TailLen = 0;
+}
+
+CViewerLineIndex::~CViewerLineIndex()
+{
+    Stop();
+    HANDLES(DeleteCriticalSection(&CS));
+}
+
+void CViewerLineIndex::Update(const char* fileName, __int64 fileSize)
+{
+    CALL_STACK_MESSAGE3("CViewerLineIndex::Update(%s, %g)", fileName, (double)fileSize);
+
+    if (FileName != NULL && strcmp(FileName, fileName) == 0 &&
+        EolCR == (Configuration.EOL_CR != 0) && EolLF == (Configuration.EOL_LF != 0) &&
+        EolCRLF == (Configuration.EOL_CRLF != 0) && EolNULL == (Configuration.EOL_NULL != 0))
+    {
+        HANDLES(EnterCriticalSection(&CS));
+        if (!Failed && fileSize >= TargetSize) // the file has not changed or it has only grown
+        {
+            BOOL start = fileSize > TargetSize && !Running;
+            TargetSize = fileSize;
+            if (start)
+                Running = TRUE;
+            HANDLES(LeaveCriticalSection(&CS));
+            if (start)
+                StartThread(); // the thread has already finished, continue with the grown part
+            return;
+        }
+        HANDLES(LeaveCriticalSection(&CS));
+    }
+
+    Stop(); // the file or the EOL configuration has changed, the file has shrunk or its reading failed
+
+    File = HANDLES_Q(CreateFileUtf8(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        TRACE_I("CViewerLineIndex::Update(): unable to open file " << fileName);
+        File = NULL;
+        return;
+    }
+    FileName = DupStr(fileName);
+    if (FileName == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        HANDLES(CloseHandle(File));
+        File = NULL;
+        return;
+    }
+    EolCR = Configuration.EOL_CR != 0;
+    EolLF = Configuration.EOL_LF != 0;
+    EolCRLF = Configuration.EOL_CRLF != 0;
+    EolNULL = Configuration.EOL_NULL != 0;
+    Checkpoints.Add(0); // line 0 always begins at the start of the file
+    if (!Checkpoints.IsGood())
+    {
+        Checkpoints.ResetState();
+        Stop();
+        return;
+    }
+    Lines = 1;
+    IndexedSize = 0;
+    TargetSize = fileSize;
+    Running = fileSize > 0;
+    if (Running)
+        StartThread();
+}
+
+void CViewerLineIndex::StartThread()
+{
+    CALL_STACK_MESSAGE1("CViewerLineIndex::StartThread()");
+    if (Thread != NULL) // the previous thread has already finished (Running was FALSE), just release it
+    {
+        WaitForSingleObject(Thread, INFINITE);
+        HANDLES(CloseHandle(Thread));
+        Thread = NULL;
+    }
+    DWORD threadID;
+    Thread = HANDLES(CreateThread(NULL, 0, ViewerLineIndexThread, this, 0, &threadID));
+    if (Thread == NULL)
+    {
+        TRACE_E("Unable to start ViewerLineIndex thread.");
+        HANDLES(EnterCriticalSection(&CS));
+        Running = FALSE;
+        Failed = TRUE;
+        HANDLES(LeaveCriticalSection(&CS));
+        return;
+    }
+    SetThreadPriority(Thread, THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+void CViewerLineIndex::Stop()
+{
+    CALL_STACK_MESSAGE1("CViewerLineIndex::Stop()");
+    if (Thread != NULL)
+    {
+        HANDLES(EnterCriticalSection(&CS));
+        Terminate = TRUE;
+        HANDLES(LeaveCriticalSection(&CS));
+        WaitForSingleObject(Thread, INFINITE);
+        HANDLES(CloseHandle(Thread));
+        Thread = NULL;
+    }
+    if (File != NULL)
+    {
+        HANDLES(CloseHandle(File));
+        File = NULL;
+    }
+    if (FileName != NULL)
+    {
+        free(FileName);
+        FileName = NULL;
+    }
+    Checkpoints.DestroyMembers();
+    Running = FALSE;
+    Terminate = FALSE;
+    Lines = 0;
+    IndexedSize = 0;
+    TargetSize = 0;
+    Failed = FALSE;
+    LastWasCR = FALSE;
+    LastWasCREOL = FALSE;
+    TailLen = 0;
+}
+
+BOOL CViewerLineIndex::IsAvailable()
+{
+    HANDLES(EnterCriticalSection(&CS));
+    BOOL ret = FileName != NULL && !Failed;
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+BOOL CViewerLineIndex::IsComplete(__int64 fileSize)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    BOOL ret = FileName != NULL && !Failed && TargetSize == fileSize && IndexedSize >= fileSize;
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+BOOL CViewerLineIndex::GetLinesCount(__int64* lines)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    *lines = Lines;
+    BOOL ret = FileName != NULL && !Failed && IndexedSize >= TargetSize;
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+int CViewerLineIndex::FindCheckpoint(__int64 offset)
+{
+    int l = 0, r = Checkpoints.Count - 1;
+    while (l < r) // looking for the last checkpoint <= 'offset' (Checkpoints[0] == 0)
+    {
+        int m = (l + r + 1) / 2;
+        if (Checkpoints[m] <= offset)
+            l = m;
+        else
+            r = m - 1;
+    }
+    return l;
+}
+
+BOOL CViewerLineIndex::GetLineCheckpoint(__int64 line, __int64* lineBegin, __int64* firstLine)
+{
+    BOOL ret = FALSE;
+    HANDLES(EnterCriticalSection(&CS));
+    if (FileName != NULL && !Failed && line >= 0)
+    {
+        if (line >= Lines && IndexedSize >= TargetSize) // the whole file is indexed: use the last line
+            line = Lines - 1;
+        if (line < Lines)
+        {
+            int c = (int)(line / VIEWER_LINE_INDEX_STEP);
+            *lineBegin = Checkpoints[c];
+            *firstLine = (__int64)c * VIEWER_LINE_INDEX_STEP;
+            ret = TRUE;
+        }
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+BOOL CViewerLineIndex::GetOffsetCheckpoint(__int64 offset, __int64* lineBegin, __int64* line)
+{
+    BOOL ret = FALSE;
+    HANDLES(EnterCriticalSection(&CS));
+    if (FileName != NULL && !Failed && offset >= 0 &&
+        (offset < IndexedSize || IndexedSize >= TargetSize))
+    {
+        int c = FindCheckpoint(offset);
+        *lineBegin = Checkpoints[c];
+        *line = (__int64)c * VIEWER_LINE_INDEX_STEP;
+        ret = TRUE;
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+double CViewerLineIndex::GetLineFromOffset(__int64 offset)
+{
+    double ret = 0;
+    HANDLES(EnterCriticalSection(&CS));
+    if (Checkpoints.Count > 0)
+    {
+        int c = FindCheckpoint(offset);
+        __int64 begin = Checkpoints[c];
+        __int64 end;
+        __int64 lines;
+        if (c + 1 < Checkpoints.Count)
+        {
+            end = Checkpoints[c + 1];
+            lines = VIEWER_LINE_INDEX_STEP;
+        }
+        else
+        {
+            end = IndexedSize;
+            lines = Lines - (__int64)c * VIEWER_LINE_INDEX_STEP;
+        }
+        ret = (double)c * VIEWER_LINE_INDEX_STEP;
+        if (end > begin && offset > begin)
+            ret += (double)min(offset - begin, end - begin) / (end - begin) * lines;
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+__int64 CViewerLineIndex::GetOffsetFromLine(double line)
+{
+    __int64 ret = 0;
+    HANDLES(EnterCriticalSection(&CS));
+    if (Checkpoints.Count > 0 && line > 0)
+    {
+        int c = (int)min(line / VIEWER_LINE_INDEX_STEP, (double)(Checkpoints.Count - 1));
+        __int64 begin = Checkpoints[c];
+        __int64 end;
+        __int64 lines;
+        if (c + 1 < Checkpoints.Count)
+        {
+            end = Checkpoints[c + 1];
+            lines = VIEWER_LINE_INDEX_STEP;
+        }
+        else
+        {
+            end = IndexedSize;
+            lines = Lines - (__int64)c * VIEWER_LINE_INDEX_STEP;
+        }
+        double part = lines > 0 ? (line - (double)c * VIEWER_LINE_INDEX_STEP) / lines : 0;
+        if (part > 1)
+            part = 1;
+        ret = begin + (__int64)(part * (end - begin));
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return ret;
+}
+
+void CViewerLineIndex::MoveLastLine(__int64 lineBegin, __int64 lines, TDirectArray<__int64>& newCheckpoints)
+{
+    if ((lines - 1) % VIEWER_LINE_INDEX_STEP == 0) // the moved line is stored
+    {
+        if (newCheckpoints.Count > 0)
+            newCheckpoints[newCheckpoints.Count - 1] = lineBegin;
+        else // it was published already (the '\r' was at the end of the previous scanned part)
+        {
+            HANDLES(EnterCriticalSection(&CS));
+            Checkpoints[Checkpoints.Count - 1] = lineBegin;
+            HANDLES(LeaveCriticalSection(&CS));
+        }
+    }
+}
+
+void CViewerLineIndex::Scan(const unsigned char* data, int len, __int64 offset, __int64& lines,
+                            TDirectArray<__int64>& newCheckpoints)
+{
+    // flags afterCR and afterCREOL describe the byte at index 'lastCand' (it is always
+    // the last byte <= '\r' which was processed), they are valid only for the next byte
+    BOOL afterCR = LastWasCR;
+    BOOL afterCREOL = LastWasCREOL;
+    int lastCand = (afterCR || afterCREOL) ? -1 : -2;
+
+    BOOL sse2 = (GetCpuFeatures() & CPU_FEATURE_SSE2) != 0;
+    __m128i cr = _mm_set1_epi8('\r');
+    __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    while (i < len)
+    {
+        if (sse2 && i + 16 <= len)
+        {
+            // bytes <= '\r' (candidates for EOL) give zero after the saturated subtraction of '\r'
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, cr), zero));
+            if (mask == 0)
+            {
+                i += 16;
+                continue;
+            }
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            i += bit;
+        }
+        else
+        {
+            if (data[i] > '\r')
+            {
+                i++;
+                continue;
+            }
+        }
+
+        // data[i] <= '\r'
+        BOOL prevCR = afterCR && lastCand == i - 1;
+        BOOL prevCREOL = afterCREOL && lastCand == i - 1;
+        afterCR = afterCREOL = FALSE;
+        switch (data[i])
+        {
+        case '\r':
+        {
+            if (EolCR)
+            {
+                AddLine(offset + i + 1, lines, newCheckpoints);
+                afterCREOL = TRUE;
+            }
+            else
+                afterCR = TRUE;
+            break;
+        }
+
+        case '\n':
+        {
+            if (prevCREOL && EolCRLF) // '\r\n' is one EOL, the line begins behind '\n'
+                MoveLastLine(offset + i + 1, lines, newCheckpoints);
+            else
+            {
+                if (prevCR && EolCRLF || EolLF)
+                    AddLine(offset + i + 1, lines, newCheckpoints);
+            }
+            break;
+        }
+
+        case 0:
+        {
+            if (EolNULL)
+                AddLine(offset + i + 1, lines, newCheckpoints);
+            break;
+        }
+        }
+        lastCand = i;
+        i++;
+    }
+    LastWasCR = afterCR && lastCand == len - 1;
+    LastWasCREOL = afterCREOL && lastCand == len - 1;
+
+    // remember the end of the scanned data (see CompareTail())
+    if (len >= (int)sizeof(Tail))
+    {
+        memcpy(Tail, data + len - sizeof(Tail), sizeof(Tail));
+        TailLen = sizeof(Tail);
+    }
+    else
+    {
+        int keep = min(TailLen, (int)sizeof(Tail) - len);
+        memmove(Tail, Tail + TailLen - keep, keep);
+        memcpy(Tail + keep, data, len);
+        TailLen = keep + len;
+    }
+}
+
+BOOL CViewerLineIndex::ScanView(const unsigned char* data, int len, __int64 offset, __int64& lines,
+                                TDirectArray<__int64>& newCheckpoints)
+{
+    __try
+    {
+        Scan(data, len, offset, lines, newCheckpoints);
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL CViewerLineIndex::CompareTail(const unsigned char* data, BOOL* equal)
+{
+    __try
+    {
+        *equal = memcmp(data, Tail, TailLen) == 0;
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void CViewerLineIndex::IndexFile()
+{
+    CALL_STACK_MESSAGE1("CViewerLineIndex::IndexFile()");
+
+    TDirectArray<__int64> newCheckpoints(100, 1000);
+    HANDLE mapping = NULL;
+    __int64 mappingSize = 0;
+    BOOL checkTail = TRUE; // the thread continues after the file has grown: test that the indexed part is the same
+    while (1)
+    {
+        HANDLES(EnterCriticalSection(&CS));
+        __int64 offset = IndexedSize;
+        __int64 target = TargetSize;
+        __int64 lines = Lines;
+        if (Terminate || Failed || offset >= target)
+        {
+            Running = FALSE; // from now on Update() may start a new thread
+            HANDLES(LeaveCriticalSection(&CS));
+            break;
+        }
+        HANDLES(LeaveCriticalSection(&CS));
+
+        BOOL err = FALSE;
+        if (mappingSize < target) // the file has grown, the mapping must be created again
+        {
+            if (mapping != NULL)
+                HANDLES(CloseHandle(mapping));
+            mapping = NULL;
+            mappingSize = 0;
+            CQuadWord size;
+            DWORD dummy;
+            if (SalGetFileSize(File, size, dummy) && (__int64)size.Value > offset)
+            {
+                mapping = HANDLES(CreateFileMapping(File, NULL, PAGE_READONLY, 0, 0, NULL));
+                if (mapping != NULL)
+                    mappingSize = (__int64)size.Value;
+            }
+            if (mapping == NULL)
+                err = TRUE; // the file has shrunk or it cannot be mapped
+        }
+
+        const unsigned char* view = NULL;
+        __int64 from = checkTail ? offset - TailLen : offset;
+        __int64 base = from & ~(__int64)0xFFFF; // must be aligned to the allocation granularity (64 KB)
+        __int64 end = min(min(base + VIEWER_LINE_INDEX_VIEW_SIZE, target), mappingSize);
+        if (!err)
+        {
+            view = (const unsigned char*)HANDLES(MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(base >> 32),
+                                                               (DWORD)(base & 0xFFFFFFFF), (SIZE_T)(end - base)));
+            if (view == NULL)
+                err = TRUE;
+        }
+
+        if (!err && checkTail)
+        {
+            checkTail = FALSE;
+            BOOL equal;
+            if (!CompareTail(view + (from - base), &equal))
+                err = TRUE;
+            else
+            {
+                if (!equal) // the file was rewritten, not appended: index it again from the beginning
+                {
+                    HANDLES(EnterCriticalSection(&CS));
+                    Checkpoints.DestroyMembers();
+                    Checkpoints.Add(0);
+                    Lines = 1;
+                    IndexedSize = 0;
+                    HANDLES(LeaveCriticalSection(&CS));
+                    LastWasCR = FALSE;
+                    LastWasCREOL = FALSE;
+                    TailLen = 0;
+                    HANDLES(UnmapViewOfFile(view));
+                    continue;
+                }
+            }
+        }
+
+        while (!err && offset < end)
+        {
+            int len = (int)min(end - offset, (__int64)VIEWER_LINE_INDEX_SCAN_SIZE);
+            newCheckpoints.DestroyMembers();
+            if (!ScanView(view + (offset - base), len, offset, lines, newCheckpoints))
+            {
+                TRACE_I("CViewerLineIndex::IndexFile(): unable to read file " << FileName);
+                err = TRUE;
+                break;
+            }
+            offset += len;
+
+            HANDLES(EnterCriticalSection(&CS));
+            if (newCheckpoints.Count > 0)
+                Checkpoints.Add(newCheckpoints.GetData(), newCheckpoints.Count);
+            if (!newCheckpoints.IsGood() || !Checkpoints.IsGood())
+            {
+                newCheckpoints.ResetState();
+                Checkpoints.ResetState();
+                err = TRUE;
+            }
+            Lines = lines;
+            IndexedSize = offset;
+            BOOL terminate = Terminate;
+            HANDLES(LeaveCriticalSection(&CS));
+            if (terminate)
+                break;
+        }
+
+        if (view != NULL)
+            HANDLES(UnmapViewOfFile(view));
+        if (err)
+        {
+            HANDLES(EnterCriticalSection(&CS));
+            Failed = TRUE;
+            HANDLES(LeaveCriticalSection(&CS));
+        }
+    }
+    if (mapping != NULL)
+        HANDLES(CloseHandle(mapping));
+}
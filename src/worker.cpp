@@ -7,9 +7,12 @@
 #include "cfgdlg.h"
 #include "worker.h"
 #include "execlog.h"
+#include "codetbl.h"
+#include "cpuinfo.h"
 
 #include <Aclapi.h>
 #include <Ntsecapi.h>
+#include <emmintrin.h>
 
 // these functions have no header, we must load them dynamically
 NTQUERYINFORMATIONFILE DynNtQueryInformationFile = NULL;
@@ -1196,6 +1199,365 @@ void SetProgressWithoutSuspend(HWND hProgressDlg, int operation, int summary, CP
     }
 }
 
+//
+// ****************************************************************************
+// CCopyPrefetcher
+//
+// Copying of many small files is dominated by the latency of opening, reading and
+// closing of the source files. The prefetcher keeps up to COPY_PREFETCH_MAX_FILES
+// small source files "in flight": its threads open them, read them completely into
+// memory, get their time of the last write and close them, while the worker thread
+// creates, writes, sets the time and closes the targets of preceding files. The worker
+// still goes through the script in order, so all dialogs (overwrite, errors) and the
+// order of the directory time fixups stay unchanged. If reading ahead fails, the file
+// is simply copied the usual way (and the usual error dialog is shown).
+
+#define COPY_PREFETCH_MAX_FILE_SIZE (256 * 1024)   // only files up to this size are read ahead
+#define COPY_PREFETCH_MAX_BYTES (16 * 1024 * 1024) // limit of memory for files read ahead
+#define COPY_PREFETCH_MAX_FILES 64                 // maximal number of files in flight
+#define COPY_PREFETCH_THREADS 4                    // number of reading threads
+#define COPY_PREFETCH_MIN_FILES 16                 // fewer small files are not worth starting the threads
+
+enum CCopyPrefetchState
+{
+    cpsFree,    // the slot is not used
+    cpsReading, // a reading thread is reading the file
+    cpsReady,   // reading has finished (successfully or not, see CCopyPrefetchedFile::Ok)
+};
+
+struct CCopyPrefetchedFile
+{
+    CCopyPrefetchState State;
+    int Index;          // index of the operation (ocCopyFile) in the script
+    BOOL Ok;            // TRUE = the whole file was read, Data, Size and LastWrite are valid
+    void* Data;         // contents of the file (allocated for op->FileSize + 1 bytes)
+    DWORD Size;         // number of bytes in Data
+    DWORD Reserved;     // number of bytes counted for this file in CCopyPrefetcher::BytesInFlight
+    FILETIME LastWrite; // time of the last write of the source file
+};
+
+class CCopyPrefetcher
+{
+protected:
+    COperations* Script;
+    TDirectArray<int> Files; // indexes of the operations which are read ahead (in the script order)
+
+    CRITICAL_SECTION CS;                                // protects the following data
+    CCopyPrefetchedFile Slots[COPY_PREFETCH_MAX_FILES]; // Files[i] uses Slots[i % COPY_PREFETCH_MAX_FILES]
+    int Consumed;                                       // Files[0..Consumed-1] were passed to the worker thread or skipped
+    int Assigned;                                       // Files[Consumed..Assigned-1] have their slots in use
+    DWORD BytesInFlight;                                // sum of CCopyPrefetchedFile::Reserved of used slots
+    BOOL Terminate;                                     // TRUE = reading threads should end
+
+    HANDLE WorkEvent; // manual-reset: signaled when there may be a file for a reading thread
+    HANDLE DoneEvent; // auto-reset: signaled when a reading thread finished a file
+    HANDLE Threads[COPY_PREFETCH_THREADS];
+    int ThreadsCount;
+
+public:
+    CCopyPrefetcher(COperations* script);
+    ~CCopyPrefetcher();
+
+    // returns TRUE if it makes sense to read ahead files of 'script'
+    static BOOL IsUseful(COperations* script);
+
+    // collects the files to read ahead and starts the reading threads; returns FALSE on error
+    BOOL Start();
+
+    // returns the file read ahead for operation 'index' of the script (NULL if the file
+    // was not read ahead or if it could not be read); files of operations before 'index'
+    // are released (they were skipped); if the file is just being read, waits for it;
+    // the returned file must be released by Release()
+    CCopyPrefetchedFile* Get(int index, CProgressDlgData& dlgData);
+
+    // releases the file returned by Get()
+    void Release(CCopyPrefetchedFile* file);
+
+    // body of a reading thread
+    void ReadFiles();
+
+protected:
+    // releases slot of Files[Consumed] and moves to the next file; must be called in CS
+    void ReleaseFirst();
+
+    // reads the source file of operation 'file->Index' into 'file'
+    void ReadAhead(CCopyPrefetchedFile* file);
+};
+
+static unsigned CopyPrefetchThreadEH(void* param)
+{
+#ifndef CALLSTK_DISABLE
+    __try
+    {
+#endif // CALLSTK_DISABLE
+        SetThreadNameInVCAndTrace("CopyPrefetch");
+        ((CCopyPrefetcher*)param)->ReadFiles();
+        return 0;
+#ifndef CALLSTK_DISABLE
+    }
+    __except (CCallStack::HandleException(GetExceptionInformation()))
+    {
+        TRACE_I("Thread CopyPrefetch: calling ExitProcess(1).");
+        //    ExitProcess(1);
+        TerminateProcess(GetCurrentProcess(), 1); // harsher exit (this one still invokes something)
+        return 1;
+    }
+#endif // CALLSTK_DISABLE
+}
+
+static DWORD WINAPI CopyPrefetchThread(void* param)
+{
+    CCallStack stack;
+    return CopyPrefetchThreadEH(param);
+}
+
+CCopyPrefetcher::CCopyPrefetcher(COperations* script) : Files(200, 1000)
+{
+    Script = script;
+    HANDLES(InitializeCriticalSection(&CS));
+    memset(Slots, 0, sizeof(Slots));
+    Consumed = 0;
+    Assigned = 0;
+    BytesInFlight = 0;
+    Terminate = FALSE;
+    WorkEvent = HANDLES(CreateEvent(NULL, TRUE, FALSE, NULL));
+    DoneEvent = HANDLES(CreateEvent(NULL, FALSE, FALSE, NULL));
+    ThreadsCount = 0;
+}
+
+CCopyPrefetcher::~CCopyPrefetcher()
+{
+    if (ThreadsCount > 0)
+    {
+        HANDLES(EnterCriticalSection(&CS));
+        Terminate = TRUE;
+        SetEvent(WorkEvent);
+        HANDLES(LeaveCriticalSection(&CS));
+        WaitForMultipleObjects(ThreadsCount, Threads, TRUE, INFINITE);
+        int i;
+        for (i = 0; i < ThreadsCount; i++)
+            HANDLES(CloseHandle(Threads[i]));
+    }
+    while (Consumed < Assigned)
+        ReleaseFirst();
+    if (WorkEvent != NULL)
+        HANDLES(CloseHandle(WorkEvent));
+    if (DoneEvent != NULL)
+        HANDLES(CloseHandle(DoneEvent));
+    HANDLES(DeleteCriticalSection(&CS));
+}
+
+BOOL CCopyPrefetcher::IsUseful(COperations* script)
+{
+    if (script->CopyAttrs || script->CopySecurity)
+        return FALSE; // such files are always copied the usual way
+    int smallFiles = 0;
+    int i;
+    for (i = 0; i < script->Count; i++)
+    {
+        COperation* op = &script->At(i);
+        switch (op->Opcode)
+        {
+        case ocCopyFile:
+        {
+            if (op->FileSize <= CQuadWord(COPY_PREFETCH_MAX_FILE_SIZE, 0))
+                smallFiles++;
+            break;
+        }
+
+        case ocCreateDir:
+        case ocCopyDirTime:
+        case ocLabelForSkipOfCreateDir:
+            break;
+
+        default:
+            return FALSE; // read ahead only in scripts of the Copy operation (sources are not modified by the script)
+        }
+    }
+    return smallFiles >= COPY_PREFETCH_MIN_FILES;
+}
+
+BOOL CCopyPrefetcher::Start()
+{
+    CALL_STACK_MESSAGE1("CCopyPrefetcher::Start()");
+    if (WorkEvent == NULL || DoneEvent == NULL)
+    {
+        TRACE_E("CCopyPrefetcher::Start(): unable to create events.");
+        return FALSE;
+    }
+    int i;
+    for (i = 0; i < Script->Count; i++)
+    {
+        COperation* op = &Script->At(i);
+        if (op->Opcode == ocCopyFile &&
+            op->FileSize <= CQuadWord(COPY_PREFETCH_MAX_FILE_SIZE, 0) &&
+            (op->OpFlags & (OPFL_COPY_ADS | OPFL_AS_ENCRYPTED)) == 0 &&
+            !FileNameIsInvalid(op->SourceName, TRUE))
+        {
+            Files.Add(i);
+        }
+    }
+    if (!Files.IsGood())
+    {
+        Files.ResetState();
+        return FALSE;
+    }
+    for (i = 0; i < COPY_PREFETCH_THREADS; i++)
+    {
+        DWORD threadID;
+        Threads[ThreadsCount] = HANDLES(CreateThread(NULL, 0, CopyPrefetchThread, this, 0, &threadID));
+        if (Threads[ThreadsCount] == NULL)
+        {
+            TRACE_E("CCopyPrefetcher::Start(): unable to start reading thread.");
+            break;
+        }
+        ThreadsCount++;
+    }
+    if (ThreadsCount == 0)
+        return FALSE;
+    HANDLES(EnterCriticalSection(&CS));
+    SetEvent(WorkEvent);
+    HANDLES(LeaveCriticalSection(&CS));
+    return TRUE;
+}
+
+void CCopyPrefetcher::ReleaseFirst()
+{
+    CCopyPrefetchedFile* file = &Slots[Consumed % COPY_PREFETCH_MAX_FILES];
+    if (file->Data != NULL)
+        free(file->Data);
+    BytesInFlight -= file->Reserved;
+    memset(file, 0, sizeof(CCopyPrefetchedFile));
+    Consumed++;
+    SetEvent(WorkEvent); // there is place for another file
+}
+
+void CCopyPrefetcher::ReadFiles()
+{
+    CALL_STACK_MESSAGE1("CCopyPrefetcher::ReadFiles()");
+    while (1)
+    {
+        HANDLES(EnterCriticalSection(&CS));
+        if (Terminate)
+        {
+            HANDLES(LeaveCriticalSection(&CS));
+            break;
+        }
+        CCopyPrefetchedFile* file = NULL;
+        if (Assigned < Files.Count && Assigned - Consumed < COPY_PREFETCH_MAX_FILES)
+        {
+            DWORD size = Script->At(Files[Assigned]).FileSize.LoDWord + 1;
+            if (BytesInFlight + size <= COPY_PREFETCH_MAX_BYTES)
+            {
+                file = &Slots[Assigned % COPY_PREFETCH_MAX_FILES];
+                file->State = cpsReading;
+                file->Index = Files[Assigned];
+                file->Reserved = size;
+                BytesInFlight += size;
+                Assigned++;
+            }
+        }
+        if (file == NULL) // nothing to do, wait for the worker thread
+        {
+            ResetEvent(WorkEvent);
+            HANDLES(LeaveCriticalSection(&CS));
+            WaitForSingleObject(WorkEvent, INFINITE);
+            continue;
+        }
+        HANDLES(LeaveCriticalSection(&CS));
+
+        ReadAhead(file); // the slot is not released while it is being read (see Get)
+
+        HANDLES(EnterCriticalSection(&CS));
+        file->State = cpsReady;
+        HANDLES(LeaveCriticalSection(&CS));
+        SetEvent(DoneEvent);
+    }
+}
+
+void CCopyPrefetcher::ReadAhead(CCopyPrefetchedFile* file)
+{
+    COperation* op = &Script->At(file->Index);
+    file->Ok = FALSE;
+    file->Size = 0;
+    file->Data = malloc(file->Reserved);
+    if (file->Data == NULL)
+    {
+        TRACE_E(LOW_MEMORY);
+        return;
+    }
+    HANDLE in = HANDLES_Q(CreateFileUtf8(op->SourceName, GENERIC_READ,
+                                         FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+    if (in != INVALID_HANDLE_VALUE)
+    {
+        BOOL ok = TRUE;
+        DWORD read;
+        while (file->Size < file->Reserved) // one byte more than the expected size detects growing files
+        {
+            if (!ReadFile(in, (char*)file->Data + file->Size, file->Reserved - file->Size, &read, NULL))
+            {
+                ok = FALSE;
+                break;
+            }
+            if (read == 0)
+                break; // EOF
+            file->Size += read;
+        }
+        file->Ok = ok && file->Size < file->Reserved &&
+                   GetFileTime(in, NULL, NULL, &file->LastWrite);
+        HANDLES(CloseHandle(in));
+    }
+    if (!file->Ok) // the worker thread copies the file the usual way
+    {
+        free(file->Data);
+        file->Data = NULL;
+    }
+}
+
+CCopyPrefetchedFile*
+CCopyPrefetcher::Get(int index, CProgressDlgData& dlgData)
+{
+    CCopyPrefetchedFile* file = NULL;
+    HANDLES(EnterCriticalSection(&CS));
+    while (Consumed < Files.Count && Files[Consumed] <= index) // files of skipped operations and then the file of 'index'
+    {
+        if (Consumed == Assigned) // no reading thread got to this file yet, the worker thread copies it itself
+        {
+            Consumed++;
+            Assigned++;
+            continue;
+        }
+        CCopyPrefetchedFile* f = &Slots[Consumed % COPY_PREFETCH_MAX_FILES];
+        while (f->State == cpsReading && !*dlgData.CancelWorker) // the file is just being read, wait for it
+        {
+            HANDLES(LeaveCriticalSection(&CS));
+            WaitForSingleObject(DoneEvent, 100);
+            HANDLES(EnterCriticalSection(&CS));
+        }
+        if (f->State == cpsReading)
+            break; // cancel, the slot will be released in the destructor
+        if (f->Index == index && f->Ok)
+        {
+            file = f;
+            break;
+        }
+        ReleaseFirst();
+    }
+    HANDLES(LeaveCriticalSection(&CS));
+    return file;
+}
+
+void CCopyPrefetcher::Release(CCopyPrefetchedFile* file)
+{
+    HANDLES(EnterCriticalSection(&CS));
+    if (Consumed < Assigned && file == &Slots[Consumed % COPY_PREFETCH_MAX_FILES])
+        ReleaseFirst();
+    else
+        TRACE_E("CCopyPrefetcher::Release(): unexpected file!");
+    HANDLES(LeaveCriticalSection(&CS));
+}
+
 BOOL GetDirTime(const char* dirName, FILETIME* ftModified);
 BOOL DoCopyDirTime(HWND hProgressDlg, const char* targetName, FILETIME* modified, CProgressDlgData& dlgData, BOOL quiet);
 
@@ -4613,12 +4975,80 @@ void DoCopyFileLoopAsync(CAsyncCopyParams* asyncPar, HANDLE& in, HANDLE& out, vo
     }
 }
 
+// copies the file read ahead by CCopyPrefetcher: creates the target file, writes the data,
+// sets the time of the last write, closes the file and sets its attributes; if anything
+// fails, the target file is deleted and FALSE is returned (the file is then copied the
+// usual way, including the error dialogs); '*cancel' is TRUE if the user cancelled the operation
+BOOL DoCopyPrefetchedFile(COperation* op, CCopyPrefetchedFile* file, HWND hProgressDlg,
+                          COperations* script, const CQuadWord& totalDone, CQuadWord& operationDone,
+                          int bufferSize, int& limitBufferSize, DWORD clearReadonlyMask,
+                          CProgressDlgData& dlgData, BOOL* cancel)
+{
+    *cancel = FALSE;
+    HANDLE out = SalCreateFileEx(op->TargetName, GENERIC_WRITE, 0, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    HANDLES_ADD_EX(__otQuiet, out != INVALID_HANDLE_VALUE, __htFile,
+                   __hoCreateFile, out, GetLastError(), TRUE);
+    if (out == INVALID_HANDLE_VALUE)
+        return FALSE; // e.g. the target file exists, the usual way asks the user what to do
+
+    script->SetFileStartParams();
+    BOOL ok = TRUE;
+    DWORD offset = 0;
+    while (offset < file->Size)
+    {
+        DWORD size = min(file->Size - offset, (DWORD)limitBufferSize);
+        DWORD written;
+        if (!WriteFile(out, (char*)file->Data + offset, size, &written, NULL) || written != size)
+        {
+            ok = FALSE;
+            break;
+        }
+        offset += size;
+        if (!script->ChangeSpeedLimit)                                 // when the speed limit can change, this is not a suitable wait point
+            WaitForSingleObject(dlgData.WorkerNotSuspended, INFINITE); // if we should be in suspend mode, wait ...
+        if (*dlgData.CancelWorker)
+        {
+            *cancel = TRUE;
+            ok = FALSE;
+            break;
+        }
+
+        script->AddBytesToSpeedMetersAndTFSandPS(size, FALSE, bufferSize, &limitBufferSize);
+
+        operationDone += CQuadWord(size, 0);
+        SetProgressWithoutSuspend(hProgressDlg, CaclProg(operationDone, op->Size),
+                                  CaclProg(totalDone + operationDone, script->TotalSize), dlgData);
+
+        if (script->ChangeSpeedLimit)                                  // speed limit may change; this is the right place to wait until the
+        {                                                              // worker resumes and fetches a fresh copy buffer size
+            WaitForSingleObject(dlgData.WorkerNotSuspended, INFINITE); // if we should be in suspend mode, wait ...
+            script->GetNewBufSize(&limitBufferSize, bufferSize);
+        }
+    }
+    if (ok && !SetFileTime(out, NULL /*&creation*/, NULL /*&lastAccess*/, &file->LastWrite))
+        ok = FALSE;
+    if (!HANDLES(CloseHandle(out)))
+        ok = FALSE;
+    if (!ok)
+    {
+        if (DeleteFileUtf8(op->TargetName) == 0)
+        {
+            DWORD err = GetLastError();
+            TRACE_E("DoCopyPrefetchedFile(): Unable to remove newly created file: " << op->TargetName << ", error: " << GetErrorText(err));
+        }
+        return FALSE;
+    }
+    SetFileAttributesUtf8(op->TargetName, (op->Attr & clearReadonlyMask) | FILE_ATTRIBUTE_ARCHIVE);
+    return TRUE;
+}
+
 BOOL DoCopyFile(COperation* op, HWND hProgressDlg, void* buffer,
                 COperations* script, CQuadWord& totalDone,
                 DWORD clearReadonlyMask, BOOL* skip, BOOL lantasticCheck,
                 int& mustDeleteFileBeforeOverwrite, int& allocWholeFileOnStart,
                 CProgressDlgData& dlgData, BOOL copyADS, BOOL copyAsEncrypted,
-                BOOL isMove, CAsyncCopyParams*& asyncPar)
+                BOOL isMove, CAsyncCopyParams*& asyncPar,
+                CCopyPrefetchedFile* prefetched = NULL)
 {
     if (script->CopyAttrs && copyAsEncrypted)
         TRACE_E("DoCopyFile(): unexpected parameter value: copyAsEncrypted is TRUE when script->CopyAttrs is TRUE!");
@@ -4743,6 +5173,30 @@ COPY_AGAIN:
     int limitBufferSize = bufferSize;
     script->SetTFSandProgressSize(lastTransferredFileSize, totalDone, &limitBufferSize, bufferSize);
 
+    if (prefetched != NULL) // the source file was read ahead, copy it without opening the source file
+    {
+        CCopyPrefetchedFile* file = prefetched;
+        prefetched = NULL; // try it only once (not after COPY_AGAIN)
+        if (!invalidTgtName && !copyADS && !copyAsEncrypted && !lantasticCheck &&
+            !script->CopyAttrs && !script->CopySecurity)
+        {
+            BOOL cancel;
+            if (DoCopyPrefetchedFile(op, file, hProgressDlg, script, totalDone, operationDone, bufferSize,
+                                     limitBufferSize, clearReadonlyMask, dlgData, &cancel))
+            {
+                if (operationDone < COPY_MIN_FILE_SIZE) // zero/small files take at least as long as files of size COPY_MIN_FILE_SIZE
+                    script->AddBytesToSpeedMetersAndTFSandPS((DWORD)(COPY_MIN_FILE_SIZE - operationDone).Value, TRUE, 0, NULL, MAX_OP_FILESIZE);
+                totalDone += op->Size;
+                script->SetProgressSize(totalDone);
+                return TRUE;
+            }
+            if (cancel)
+                return FALSE;
+            operationDone = CQuadWord(0, 0); // forget the progress of the failed attempt and copy the file the usual way
+            script->SetTFSandProgressSize(lastTransferredFileSize, totalDone, &limitBufferSize, bufferSize);
+        }
+    }
+
     while (1)
     {
         if (!invalidSrcName && !asyncPar->Failed())
@@ -7421,6 +7875,35 @@ BOOL DoDeleteDirLink(HWND hProgressDlg, char* name, const CQuadWord& size, COper
     }
 }
 
+// returns the number of characters at the beginning of 's' (length 'len') which are
+// neither '\r' nor '\n'
+static int GetLengthToEOL(const char* s, int len)
+{
+    int i = 0;
+    if (GetCpuFeatures() & CPU_FEATURE_SSE2)
+    {
+        __m128i cr = _mm_set1_epi8('\r');
+        __m128i lf = _mm_set1_epi8('\n');
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+            if (mask != 0)
+            {
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+                return i + (int)bit;
+            }
+        }
+    }
+    for (; i < len; i++)
+    {
+        if (s[i] == '\r' || s[i] == '\n')
+            break;
+    }
+    return i;
+}
+
 // a) create a temporary file in the same directory as file 'name'
 // b) transfer the contents of 'name' into the temporary file while applying the
 //    conversions specified by convertData.CodeType and convertData.EOFType
@@ -7439,6 +7922,7 @@ BOOL DoConvert(HWND hProgressDlg, char* name, char* sourceBuffer, char* targetBu
     // if the path ends with a space/dot it is invalid and we must not run the conversion,
     // CreateFile would trim the spaces/dots and convert a different file
     BOOL invalidName = FileNameIsInvalid(name, TRUE);
+    BOOL asciiPreserving = IsAsciiPreservingTable(convertData.CodeTable);
 
 CONVERT_AGAIN:
 
@@ -7555,6 +8039,18 @@ CONVERT_AGAIN:
                                 targetIterator = targetBuffer;
                                 while (sourceIterator - sourceBuffer < (int)read)
                                 {
+                                    // characters up to the next line end are converted at once (see ConvertByTable)
+                                    int run = (int)read - (int)(sourceIterator - sourceBuffer);
+                                    if (convertData.EOFType != 0)
+                                        run = GetLengthToEOL(sourceIterator, run);
+                                    if (run > 0)
+                                    {
+                                        ConvertByTable(convertData.CodeTable, asciiPreserving, sourceIterator, targetIterator, run);
+                                        sourceIterator += run;
+                                        targetIterator += run;
+                                        continue;
+                                    }
+
                                     // lastChar is TRUE when sourceIterator points to the final character in the buffer
                                     BOOL lastChar = (sourceIterator - sourceBuffer == (int)read - 1);
 
@@ -8192,6 +8688,17 @@ unsigned ThreadWorkerBody(void* parameter)
         char opChangAttrs[50];
         lstrcpyn(opChangAttrs, LoadStr(IDS_CHANGINGATTRS), 50);
 
+        CCopyPrefetcher* prefetcher = NULL; // reads small source files ahead (only for Copy)
+        if (CCopyPrefetcher::IsUseful(script))
+        {
+            prefetcher = new CCopyPrefetcher(script);
+            if (!prefetcher->Start())
+            {
+                delete prefetcher;
+                prefetcher = NULL;
+            }
+        }
+
         int i;
         for (i = 0; !*dlgData.CancelWorker && i < script->Count; i++)
         {
@@ -8213,12 +8720,15 @@ unsigned ThreadWorkerBody(void* parameter)
 
                 BOOL lantasticCheck = IsLantasticDrive(op->TargetName, lastLantasticCheckRoot, lastIsLantasticPath);
 
+                CCopyPrefetchedFile* prefetched = prefetcher != NULL ? prefetcher->Get(i, dlgData) : NULL;
                 Error = !DoCopyFile(op, hProgressDlg, buffer, script, totalDone,
                                     clearReadonlyMask, NULL, lantasticCheck, mustDeleteFileBeforeOverwrite,
                                     allocWholeFileOnStart, dlgData,
                                     (op->OpFlags & OPFL_COPY_ADS) != 0,
                                     (op->OpFlags & OPFL_AS_ENCRYPTED) != 0,
-                                    FALSE, asyncPar);
+                                    FALSE, asyncPar, prefetched);
+                if (prefetched != NULL)
+                    prefetcher->Release(prefetched);
                 ExecLogFileOperationResult(opName, op->SourceName, op->TargetName, !Error);
                 break;
             }
@@ -8493,6 +9003,8 @@ unsigned ThreadWorkerBody(void* parameter)
                 TRACE_E("ThreadWorkerBody(): operation done: progressSize != script->TotalSize (" << progressSize.Value << " != " << script->TotalSize.Value << ")");
             }
         }
+        if (prefetcher != NULL)
+            delete prefetcher;
     }
     if (asyncPar != NULL)
         delete asyncPar;
@@ -8776,3 +9288,181 @@ int COperationsQueue::GetNumOfOperations()
 
 
 
+
+#ifdef _DEBUG
+
+#define COPY_BENCH_DIRS 20   // number of directories in the synthetic tree
+#define COPY_BENCH_FILES 250 // number of files in each directory (sizes from 1 to 8 KB)
+
+// creates a synthetic tree of small files in 'root' (unless it already exists)
+static BOOL CopyBenchmarkCreateTree(const char* root)
+{
+    if (GetFileAttributes(root) != INVALID_FILE_ATTRIBUTES)
+        return TRUE; // created by a previous run
+    if (!CreateDirectory(root, NULL))
+        return FALSE;
+    char data[8192];
+    DWORD seed = 12345;
+    int i;
+    for (i = 0; i < (int)sizeof(data); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (char)(seed >> 16);
+    }
+    char path[MAX_PATH];
+    BOOL ok = TRUE;
+    int d;
+    for (d = 0; ok && d < COPY_BENCH_DIRS; d++)
+    {
+        sprintf(path, "%s\\d%03d", root, d);
+        if (!CreateDirectory(path, NULL))
+            break;
+        char* fileEnd = path + strlen(path);
+        int f;
+        for (f = 0; ok && f < COPY_BENCH_FILES; f++)
+        {
+            sprintf(fileEnd, "\\file%03d.dat", f);
+            HANDLE file = HANDLES_Q(CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL));
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                ok = FALSE;
+                break;
+            }
+            DWORD size = 1024 + (d * COPY_BENCH_FILES + f) * 997 % (sizeof(data) - 1024);
+            DWORD written;
+            if (!WriteFile(file, data, size, &written, NULL) || written != size)
+                ok = FALSE;
+            HANDLES(CloseHandle(file));
+        }
+    }
+    return ok && d == COPY_BENCH_DIRS;
+}
+
+void CopyBenchmark(const char* dir)
+{
+    CALL_STACK_MESSAGE2("CopyBenchmark(%s)", dir);
+    char srcRoot[MAX_PATH];
+    char tgtRoot[MAX_PATH];
+    lstrcpyn(srcRoot, dir, MAX_PATH);
+    lstrcpyn(tgtRoot, dir, MAX_PATH);
+    if (!SalPathAppend(srcRoot, "copybench", MAX_PATH) || !SalPathAppend(tgtRoot, "copybench.out", MAX_PATH) ||
+        !CopyBenchmarkCreateTree(srcRoot))
+    {
+        TRACE_E("CopyBenchmark(): unable to create synthetic tree in " << dir);
+        return;
+    }
+
+    // script with the files of the tree (target directories are created in advance)
+    COperations* script = new COperations(COPY_BENCH_DIRS * COPY_BENCH_FILES, 1000, NULL, NULL, NULL);
+    CreateDirectory(tgtRoot, NULL);
+    CQuadWord totalSize(0, 0);
+    int d;
+    for (d = 0; d < COPY_BENCH_DIRS; d++)
+    {
+        char path[MAX_PATH];
+        sprintf(path, "%s\\d%03d", tgtRoot, d);
+        CreateDirectory(path, NULL);
+        int f;
+        for (f = 0; f < COPY_BENCH_FILES; f++)
+        {
+            COperation op;
+            op.Opcode = ocCopyFile;
+            op.OpFlags = OPFL_SRCPATH_IS_FAST | OPFL_TGTPATH_IS_FAST;
+            op.Attr = FILE_ATTRIBUTE_ARCHIVE;
+            sprintf(path, "%s\\d%03d\\file%03d.dat", srcRoot, d, f);
+            op.SourceName = DupStr(path);
+            sprintf(path, "%s\\d%03d\\file%03d.dat", tgtRoot, d, f);
+            op.TargetName = DupStr(path);
+            WIN32_FILE_ATTRIBUTE_DATA attrData;
+            if (op.SourceName == NULL || op.TargetName == NULL ||
+                !GetFileAttributesEx(op.SourceName, GetFileExInfoStandard, &attrData))
+            {
+                TRACE_E("CopyBenchmark(): unable to prepare the script.");
+                FreeScript(script);
+                return;
+            }
+            op.FileSize = CQuadWord(attrData.nFileSizeLow, attrData.nFileSizeHigh);
+            op.Size = op.FileSize < COPY_MIN_FILE_SIZE ? COPY_MIN_FILE_SIZE : op.FileSize;
+            totalSize += op.Size;
+            script->Add(op);
+        }
+    }
+    script->TotalSize = totalSize;
+
+    void* buffer = malloc(FAST_LOCAL_COPY_BUFFER);
+    HANDLE workerNotSuspended = HANDLES(CreateEvent(NULL, TRUE, TRUE, NULL));
+    BOOL cancelWorker = FALSE;
+    int operationProgress = 0;
+    int summaryProgress = 0;
+    CProgressDlgData dlgData;
+    // all "Skip All"/"Overwrite All" flags and confirmations are off (FALSE/0), a dialog would cancel the benchmark
+    memset(&dlgData, 0, offsetof(CProgressDlgData, RecycleMasks));
+    dlgData.WorkerNotSuspended = workerNotSuspended;
+    dlgData.CancelWorker = &cancelWorker;
+    dlgData.OperationProgress = &operationProgress;
+    dlgData.SummaryProgress = &summaryProgress;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    CAsyncCopyParams* asyncPar = NULL;
+    int pass;
+    for (pass = 0; buffer != NULL && workerNotSuspended != NULL && pass < 2; pass++)
+    {
+        // first pass: one file after another, second pass: with reading ahead of the source files
+        CCopyPrefetcher* prefetcher = NULL;
+        if (pass == 1)
+        {
+            prefetcher = new CCopyPrefetcher(script);
+            if (!prefetcher->Start())
+            {
+                delete prefetcher;
+                break;
+            }
+        }
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        CQuadWord totalDone(0, 0);
+        int mustDeleteFileBeforeOverwrite = 0;
+        int allocWholeFileOnStart = 0;
+        int i;
+        for (i = 0; i < script->Count && !cancelWorker; i++)
+        {
+            CCopyPrefetchedFile* prefetched = prefetcher != NULL ? prefetcher->Get(i, dlgData) : NULL;
+            if (!DoCopyFile(&script->At(i), NULL, buffer, script, totalDone, 0xFFFFFFFF, NULL, FALSE,
+                            mustDeleteFileBeforeOverwrite, allocWholeFileOnStart, dlgData, FALSE, FALSE,
+                            FALSE, asyncPar, prefetched))
+            {
+                cancelWorker = TRUE;
+            }
+            if (prefetched != NULL)
+                prefetcher->Release(prefetched);
+        }
+        QueryPerformanceCounter(&end);
+        if (prefetcher != NULL)
+            delete prefetcher;
+        double seconds = (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+        TRACE_I("CopyBenchmark(): " << (pass == 0 ? "one by one" : "read ahead") << ": " << i << " files, " << (seconds > 0 ? (DWORD)(i / seconds) : 0) << " files/s" << (cancelWorker ? " (FAILED)" : ""));
+
+        for (i = 0; i < script->Count; i++) // delete the copies for the next pass
+            DeleteFileUtf8(script->At(i).TargetName);
+        if (cancelWorker)
+            break;
+    }
+    for (d = 0; d < COPY_BENCH_DIRS; d++)
+    {
+        char path[MAX_PATH];
+        sprintf(path, "%s\\d%03d", tgtRoot, d);
+        RemoveDirectory(path);
+    }
+    RemoveDirectory(tgtRoot);
+
+    if (asyncPar != NULL)
+        delete asyncPar;
+    if (workerNotSuspended != NULL)
+        HANDLES(CloseHandle(workerNotSuspended));
+    if (buffer != NULL)
+        free(buffer);
+    FreeScript(script);
+}
+
+#endif // _DEBUG
@@ -526,3 +526,9 @@ BOOL CheckFileOrDirADS(const char* fileName, BOOL isDir, CQuadWord* adsSize, wch
                        int* streamNamesCount, BOOL* lowMemory, DWORD* winError,
                        DWORD bytesPerCluster, CQuadWord* adsOccupiedSpace,
                        BOOL* onlyDiscardableStreams);
+
+#ifdef _DEBUG
+// measures copying of many small files (one by one and with reading ahead) on a synthetic
+// tree created in 'dir' (see bench.h)
+void CopyBenchmark(const char* dir);
+#endif // _DEBUG